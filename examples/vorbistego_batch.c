@@ -0,0 +1,902 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: batch embedding and extraction
+
+ Runs the jobs of a manifest, one per line:
+
+   embed   <cover.wav> <payload> <stego.ogg> <key> [options]
+   extract <stego.ogg> <output> <key> [options]
+
+ The options are those of vorbistego_cfg (--shm, --ssm, --sca, ...),
+ and are parsed once, when the manifest is read. Blank lines and lines
+ starting with '#' are skipped. One JSON object per job is printed as
+ soon as it ends, with its timing and the capacity used. The extract
+ jobs run with --sscan report instead the most likely candidate keys.
+
+ The stego layer keeps per process state, so each job runs in its own
+ process, and at most -j at once. The workers are forked from a parent
+ that has initialised libgcrypt and keeps an encoder setup (codebooks,
+ psychoacoustics, MDCT lookups) ready for each cover format: they start
+ encoding straight away, sharing the setups copy-on-write.
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <vorbis/codec.h>
+#include <vorbis/vorbisenc.h>
+
+#ifdef STEGO
+#include <gcrypt.h>
+#include "steganos_types.h"
+#include "steganos_stats.h"
+#include "steganos_scan.h"
+#include "miscellaneous.h"
+
+#define MAX_LINE        4096
+#define MAX_ARGS        64
+#define MAX_WORKERS     256
+#define MAX_SETUPS      8
+#define READ_FRAMES     1024
+#define READ_CHUNK      4096
+#define SCAN_TOP        8
+#define SCAN_KEY        48
+
+typedef struct {
+  int line ;
+  int embed ;               /* 1 embed, 0 extract */
+  char *input ;             /* Cover (embed) or stego stream (extract) */
+  char *output ;            /* Stego stream (embed), or NULL */
+  char *error ;             /* Why the job cannot run, or NULL */
+  fw_options_t fw ;
+  inv_options_t inv ;
+  int channels ;            /* Cover format (embed) */
+  long rate ;
+} batch_job ;
+
+typedef struct {
+  int ok ;
+  int complete ;            /* The transmission ended within the stream */
+  long frames ;             /* Vorbis blocks encoded or decoded */
+  double audio ;            /* Seconds of audio */
+  double elapsed ;          /* Wall seconds spent in the codec loop */
+  unsigned long bits ;      /* Payload bits hidden or read */
+  unsigned long hdr_bits ;
+  unsigned long capacity ;
+  int scanned ;             /* Steganalysis scan (--sscan) ranking below */
+  int candidates ;
+  unsigned long scan_frames ;
+  int ranked ;
+  struct {
+    char key [SCAN_KEY] ;   /* Truncated if longer */
+    unsigned long hits ;
+    unsigned long headers ;
+    unsigned long marks ;
+    double score ;
+  } ranking [SCAN_TOP] ;
+  char error [64] ;
+} job_result ;
+
+/* Encoder setup for a cover format, built once in the parent */
+typedef struct {
+  int channels ;
+  long rate ;
+  int ok ;
+  vorbis_info vi ;
+  vorbis_dsp_state vd ;
+} warm_setup ;
+
+typedef struct {
+  pid_t pid ;
+  int fd ;
+  int job ;
+  double start ;
+} worker ;
+
+static double
+now (void)
+{
+  struct timeval tv ;
+
+  gettimeofday (&tv, NULL) ;
+  return tv.tv_sec + tv.tv_usec / 1e6 ;
+}
+
+static unsigned int
+get_le (const unsigned char *p, int bytes)
+{
+  unsigned int v = 0 ;
+
+  while (bytes--)
+    v = (v << 8) | p [bytes] ;
+  return v ;
+}
+
+/* Opens a 16 bit PCM WAV file, positioned at the samples. */
+static FILE *
+wav_open (const char *path, int *channels, long *rate)
+{
+  unsigned char hdr [16] ;
+  unsigned int len, format = 0, bits = 0 ;
+  FILE *file ;
+
+  if ((file = fopen (path, "rb")) == NULL)
+    return NULL ;
+
+  if (fread (hdr, 1, 12, file) != 12 || memcmp (hdr, "RIFF", 4) ||
+      memcmp (hdr + 8, "WAVE", 4))
+    goto bad ;
+
+  while (fread (hdr, 1, 8, file) == 8) {
+    len = get_le (hdr + 4, 4) ;
+    if (!memcmp (hdr, "fmt ", 4)) {
+      if (len < 16 || fread (hdr, 1, 16, file) != 16)
+        goto bad ;
+      format = get_le (hdr, 2) ;
+      *channels = get_le (hdr + 2, 2) ;
+      *rate = get_le (hdr + 4, 4) ;
+      bits = get_le (hdr + 14, 2) ;
+      len -= 16 ;
+    }
+    else if (!memcmp (hdr, "data", 4)) {
+      /* 1 is PCM, 0xFFFE WAVE_FORMAT_EXTENSIBLE */
+      if ((format != 1 && format != 0xFFFE) || bits != 16 ||
+          *channels < 1 || *channels > 255 || *rate < 1)
+        goto bad ;
+      return file ;
+    }
+    if (fseek (file, len + (len & 1), SEEK_CUR))
+      goto bad ;
+  }
+
+ bad:
+  fclose (file) ;
+  errno = EINVAL ;
+  return NULL ;
+}
+
+/* Telemetry totals: from the live state, or from the last line of the
+ * JSON-lines dump if the state was freed at the end of the transmission. */
+static void
+job_totals (vorbis_block *vb, const char *stats_file, job_result *res)
+{
+  static steganos_stats_t stats ;
+  char line [1024] ;
+  FILE *file ;
+  unsigned long v [10] ;
+
+  if (vb->ss) {
+    if (steganos_get_stats (vb->ss, &stats) == I_STEGANOS_OK) {
+      res->bits = stats.totals.bits ;
+      res->hdr_bits = stats.totals.hdr_bits ;
+      res->capacity = stats.totals.capacity ;
+    }
+    return ;
+  }
+
+  if ((file = fopen (stats_file, "r")) == NULL)
+    return ;
+
+  while (fgets (line, sizeof (line), file)) {
+    if (sscanf (line, "{\"totals\":{\"frames\":%lu,\"hidden\":%lu,"
+                "\"desync\":%lu,\"ignored\":%lu,\"skipped\":%lu,"
+                "\"attempts\":%lu,\"retries\":%lu,\"capacity\":%lu,"
+                "\"bits\":%lu,\"hdr_bits\":%lu", &v [0], &v [1], &v [2],
+                &v [3], &v [4], &v [5], &v [6], &v [7], &v [8], &v [9]) == 10) {
+      res->capacity = v [7] ;
+      res->bits = v [8] ;
+      res->hdr_bits = v [9] ;
+      res->complete = 1 ;
+    }
+  }
+  fclose (file) ;
+}
+
+/* The SCAN_TOP most likely candidate keys of the steganalysis scan */
+static void
+job_ranking (steganos_scan_t *scan, job_result *res)
+{
+  steganos_scan_result_t ranking [SCAN_TOP] ;
+  int k, n ;
+
+  res->scanned = 1 ;
+  res->candidates = scan->n_candidates ;
+  res->scan_frames = scan->frames ;
+  if (steganos_scan_ranking (scan, ranking, SCAN_TOP, &n) != I_STEGANOS_OK)
+    return ;
+
+  for (k = 0 ; k < n ; k++) {
+    snprintf (res->ranking [k].key, SCAN_KEY, "%s", ranking [k].key) ;
+    res->ranking [k].hits = ranking [k].hits ;
+    res->ranking [k].headers = ranking [k].headers ;
+    res->ranking [k].marks = ranking [k].marks ;
+    res->ranking [k].score = ranking [k].score ;
+  }
+  res->ranked = n ;
+}
+
+static void
+embed_options (vorbis_block *vb, const fw_options_t *fw, char *stats_file)
+{
+  vb->delayfr = fw->delayfr ;
+  vb->da = fw->da ;
+  vb->sfile = fw->sfile ;
+  vb->hide_method = fw->hide_method ;
+  vb->sync_method = fw->sync_method ;
+  vb->sigma = fw->sigma ;
+  vb->skey = fw->skey ;
+  vb->sca = fw->sca ;
+  vb->scmda = fw->scmda ;
+  vb->schmac = fw->schmac ;
+  vb->sciv = fw->sciv ;
+  vb->scem = fw->scem ;
+  vb->scpkt = fw->scpkt ;
+  vb->scdds = fw->scdds ;
+  vb->sfv = fw->sfv ;
+  vb->scfmt = fw->scfmt ;
+  vb->scadapt = fw->scadapt ;
+  vb->scqueue = fw->scqueue ;
+  vb->slive = fw->slive ;
+  vb->slatency = fw->slatency ;
+  vb->fec_k = fw->fec_k ;
+  vb->fec_m = fw->fec_m ;
+  vb->sstats = stats_file ;
+  vb->srecord = fw->srecord ;
+  vb->sindex = fw->sindex ;
+  vb->quiet = 1 ;
+}
+
+static void
+extract_options (vorbis_block *vb, const inv_options_t *inv, char *stats_file)
+{
+  vb->sfile = inv->sfile ;
+  vb->hide_method = inv->hide_method ;
+  vb->sync_method = inv->sync_method ;
+  vb->sigma = inv->sigma ;
+  vb->skey = inv->skey ;
+  vb->sca = inv->sca ;
+  vb->scmda = inv->scmda ;
+  vb->schmac = inv->schmac ;
+  vb->scem = inv->scem ;
+  vb->scpkt = inv->scpkt ;
+  vb->scdds = inv->scdds ;
+  vb->scfmt = inv->scfmt ;
+  vb->fec_k = inv->fec_k ;
+  vb->fec_m = inv->fec_m ;
+  vb->sstats = stats_file ;
+  vb->srecord = inv->srecord ;
+  vb->sscan = inv->sscan ;
+  vb->sseek = inv->sseek ;
+  vb->quiet = 1 ;
+}
+
+/* The stats are needed for the report: a private file if the job did not
+ * ask for one. */
+static char *
+stats_file (char *requested, char *buf, size_t len)
+{
+  if (requested)
+    return requested ;
+  snprintf (buf, len, ".vorbistego-batch-%ld.jsonl", (long) getpid ()) ;
+  return buf ;
+}
+
+static void
+write_pages (ogg_stream_state *os, FILE *file, int flush)
+{
+  ogg_page og ;
+
+  while (flush ? ogg_stream_flush (os, &og) : ogg_stream_pageout (os, &og)) {
+    fwrite (og.header, 1, og.header_len, file) ;
+    fwrite (og.body, 1, og.body_len, file) ;
+  }
+}
+
+static int
+embed_job (const batch_job *job, warm_setup *setup, float quality,
+           job_result *res)
+{
+  static signed char readbuffer [READ_FRAMES * 2 * 255] ;
+  ogg_stream_state os ;
+  ogg_packet       op, header, header_comm, header_code ;
+  vorbis_comment   vc ;
+  vorbis_block     vb ;
+  warm_setup       own ;
+  FILE *in, *out ;
+  float **buffer ;
+  char stats_buf [64], *stats ;
+  long rate, samples, frames, i ;
+  int c, channels ;
+  double start ;
+
+  if ((in = wav_open (job->input, &channels, &rate)) == NULL) {
+    snprintf (res->error, sizeof (res->error), "cover: %s", strerror (errno)) ;
+    return 1 ;
+  }
+  /* Without a ready setup (too many formats), build our own */
+  if (setup == NULL) {
+    memset (&own, 0, sizeof (own)) ;
+    vorbis_info_init (&own.vi) ;
+    if (vorbis_encode_init_vbr (&own.vi, job->channels, job->rate, quality)) {
+      snprintf (res->error, sizeof (res->error), "unsupported cover format") ;
+      vorbis_info_clear (&own.vi) ;
+      fclose (in) ;
+      return 1 ;
+    }
+    vorbis_analysis_init (&own.vd, &own.vi) ;
+    setup = &own ;
+  }
+
+  if ((out = fopen (job->output, "wb")) == NULL) {
+    snprintf (res->error, sizeof (res->error), "output: %s", strerror (errno)) ;
+    if (setup == &own) {
+      vorbis_dsp_clear (&own.vd) ;
+      vorbis_info_clear (&own.vi) ;
+    }
+    fclose (in) ;
+    return 1 ;
+  }
+
+  stats = stats_file (job->fw.sstats, stats_buf, sizeof (stats_buf)) ;
+
+  vorbis_comment_init (&vc) ;
+  vorbis_comment_add_tag (&vc, "ENCODER", "vorbistego-batch") ;
+  memset (&vb, 0, sizeof (vb)) ;
+  vorbis_block_init (&setup->vd, &vb) ;
+  embed_options (&vb, &job->fw, stats) ;
+  ogg_stream_init (&os, (int) (time (NULL) ^ (getpid () << 16) ^ job->line)) ;
+
+  vorbis_analysis_headerout (&setup->vd, &vc, &header, &header_comm,
+                             &header_code) ;
+  ogg_stream_packetin (&os, &header) ;
+  ogg_stream_packetin (&os, &header_comm) ;
+  ogg_stream_packetin (&os, &header_code) ;
+  write_pages (&os, out, 1) ;
+
+  start = now () ;
+  samples = 0 ;
+  do {
+    frames = fread (readbuffer, 2 * channels, READ_FRAMES, in) ;
+    if (frames > 0) {
+      buffer = vorbis_analysis_buffer (&setup->vd, frames) ;
+      for (i = 0 ; i < frames ; i++)
+        for (c = 0 ; c < channels ; c++)
+          buffer [c][i] = ((readbuffer [(i * channels + c) * 2 + 1] << 8) |
+                           (0x00ff & (int) readbuffer [(i * channels + c) * 2]))
+                          / 32768.f ;
+      samples += frames ;
+    }
+    vorbis_analysis_wrote (&setup->vd, frames > 0 ? frames : 0) ;
+
+    while (vorbis_analysis_blockout (&setup->vd, &vb) == 1) {
+      vorbis_analysis (&vb, NULL) ;
+      vorbis_bitrate_addblock (&vb) ;
+      res->frames++ ;
+      while (vorbis_bitrate_flushpacket (&setup->vd, &op)) {
+        ogg_stream_packetin (&os, &op) ;
+        write_pages (&os, out, 0) ;
+      }
+    }
+  } while (frames > 0) ;
+  res->elapsed = now () - start ;
+  res->audio = (double) samples / rate ;
+  write_pages (&os, out, 1) ;
+
+  job_totals (&vb, stats, res) ;
+  res->ok = !ferror (in) && !ferror (out) ;
+  if (!res->ok)
+    snprintf (res->error, sizeof (res->error), "i/o error") ;
+
+  if (stats != job->fw.sstats)
+    remove (stats) ;
+  ogg_stream_clear (&os) ;
+  vorbis_block_clear (&vb) ;
+  vorbis_comment_clear (&vc) ;
+  if (setup == &own) {
+    vorbis_dsp_clear (&own.vd) ;
+    vorbis_info_clear (&own.vi) ;
+  }
+  fclose (in) ;
+  fclose (out) ;
+
+  return res->ok ? 0 : 1 ;
+}
+
+static int
+extract_job (const batch_job *job, job_result *res)
+{
+  ogg_sync_state   oy ;
+  ogg_stream_state os ;
+  ogg_page         og ;
+  ogg_packet       op ;
+  vorbis_info      vi ;
+  vorbis_comment   vc ;
+  vorbis_dsp_state vd ;
+  vorbis_block     vb ;
+  FILE *file ;
+  char *buffer, stats_buf [64], *stats ;
+  float **pcm ;
+  long samples ;
+  int bytes, headers, n, started ;
+  double start ;
+
+  if ((file = fopen (job->input, "rb")) == NULL) {
+    snprintf (res->error, sizeof (res->error), "input: %s", strerror (errno)) ;
+    return 1 ;
+  }
+
+  stats = stats_file (job->inv.sstats, stats_buf, sizeof (stats_buf)) ;
+
+  ogg_sync_init (&oy) ;
+  vorbis_info_init (&vi) ;
+  vorbis_comment_init (&vc) ;
+  headers = 0 ;
+  started = 0 ;
+  samples = 0 ;
+  start = now () ;
+
+  do {
+    buffer = ogg_sync_buffer (&oy, READ_CHUNK) ;
+    bytes = fread (buffer, 1, READ_CHUNK, file) ;
+    ogg_sync_wrote (&oy, bytes) ;
+
+    while (ogg_sync_pageout (&oy, &og) == 1) {
+      if (!started) {
+        ogg_stream_init (&os, ogg_page_serialno (&og)) ;
+        started = 1 ;
+      }
+      ogg_stream_pagein (&os, &og) ;
+
+      while (ogg_stream_packetout (&os, &op) == 1) {
+        if (headers < 3) {
+          if (vorbis_synthesis_headerin (&vi, &vc, &op) < 0) {
+            snprintf (res->error, sizeof (res->error), "not a Vorbis stream") ;
+            goto done ;
+          }
+          if (++headers == 3) {
+            vorbis_synthesis_init (&vd, &vi) ;
+            memset (&vb, 0, sizeof (vb)) ;
+            vorbis_block_init (&vd, &vb) ;
+            extract_options (&vb, &job->inv, stats) ;
+            start = now () ;
+          }
+          continue ;
+        }
+        if (vorbis_synthesis (&vb, &op) == 0)
+          vorbis_synthesis_blockin (&vd, &vb) ;
+        res->frames++ ;
+        while ((n = vorbis_synthesis_pcmout (&vd, &pcm)) > 0) {
+          vorbis_synthesis_read (&vd, n) ;
+          samples += n ;
+        }
+      }
+    }
+  } while (bytes > 0) ;
+
+  if (headers == 3) {
+    res->elapsed = now () - start ;
+    res->audio = (double) samples / vi.rate ;
+    job_totals (&vb, stats, res) ;
+    if (vb.scan) {
+      job_ranking (vb.scan, res) ;
+      steganos_scan_free (vb.scan) ;
+      free (vb.scan) ;
+      vb.scan = NULL ;
+    }
+    res->ok = 1 ;
+    vorbis_block_clear (&vb) ;
+    vorbis_dsp_clear (&vd) ;
+  }
+  else if (!res->error [0])
+    snprintf (res->error, sizeof (res->error), "truncated stream") ;
+
+ done:
+  if (stats != job->inv.sstats)
+    remove (stats) ;
+  if (started)
+    ogg_stream_clear (&os) ;
+  vorbis_comment_clear (&vc) ;
+  vorbis_info_clear (&vi) ;
+  ogg_sync_clear (&oy) ;
+  fclose (file) ;
+
+  return res->ok ? 0 : 1 ;
+}
+
+/* The encoder setup for the format of a cover, built the first time it is
+ * asked for. NULL if there are too many formats already. */
+static warm_setup *
+warm_get (warm_setup *setups, int *n_setups, int channels, long rate,
+          float quality)
+{
+  warm_setup *s ;
+  int k ;
+
+  for (k = 0 ; k < *n_setups ; k++)
+    if (setups [k].channels == channels && setups [k].rate == rate)
+      return setups [k].ok ? &setups [k] : NULL ;
+
+  if (*n_setups == MAX_SETUPS)
+    return NULL ;
+
+  s = &setups [(*n_setups)++] ;
+  memset (s, 0, sizeof (*s)) ;
+  s->channels = channels ;
+  s->rate = rate ;
+  vorbis_info_init (&s->vi) ;
+  if (vorbis_encode_init_vbr (&s->vi, channels, rate, quality) == 0) {
+    vorbis_analysis_init (&s->vd, &s->vi) ;
+    s->ok = 1 ;
+  }
+
+  return s->ok ? s : NULL ;
+}
+
+static void
+warm_free (warm_setup *setups, int n_setups)
+{
+  int k ;
+
+  for (k = 0 ; k < n_setups ; k++) {
+    if (setups [k].ok)
+      vorbis_dsp_clear (&setups [k].vd) ;
+    vorbis_info_clear (&setups [k].vi) ;
+  }
+}
+
+static void
+print_string (const char *s)
+{
+  putchar ('"') ;
+  for ( ; *s ; s++) {
+    if (*s == '"' || *s == '\\')
+      putchar ('\\') ;
+    if ((unsigned char) *s >= 0x20)
+      putchar (*s) ;
+  }
+  putchar ('"') ;
+}
+
+static void
+report (int n, const batch_job *job, const job_result *res, double wall,
+        long maxrss_kb)
+{
+  int k ;
+
+  printf ("{\"job\":%d,\"line\":%d,\"mode\":\"%s\",\"input\":", n, job->line,
+          job->embed ? "embed" : "extract") ;
+  print_string (job->input) ;
+  printf (",\"ok\":%d", res->ok) ;
+  if (!res->ok) {
+    printf (",\"error\":") ;
+    print_string (res->error [0] ? res->error : "worker failed") ;
+  }
+  else
+    printf (",\"complete\":%d,\"frames\":%ld,\"audio_s\":%.2f,"
+            "\"elapsed_s\":%.3f,\"wall_s\":%.3f,\"realtime\":%.1f,"
+            "\"bits\":%lu,\"hdr_bits\":%lu,\"capacity\":%lu,"
+            "\"utilisation\":%.4f,\"peak_rss_kb\":%ld",
+            res->complete, res->frames, res->audio, res->elapsed, wall,
+            res->elapsed > 0 ? res->audio / res->elapsed : 0.,
+            res->bits, res->hdr_bits, res->capacity,
+            res->capacity ? (double) (res->bits + res->hdr_bits) / res->capacity
+            : 0., maxrss_kb) ;
+  if (res->ok && res->scanned) {
+    printf (",\"scan\":{\"frames\":%lu,\"candidates\":%d,\"ranking\":[",
+            res->scan_frames, res->candidates) ;
+    for (k = 0 ; k < res->ranked ; k++) {
+      printf ("%s{\"key\":", k ? "," : "") ;
+      print_string (res->ranking [k].key) ;
+      printf (",\"hits\":%lu,\"headers\":%lu,\"marks\":%lu,\"score\":%.4f}",
+              res->ranking [k].hits, res->ranking [k].headers,
+              res->ranking [k].marks, res->ranking [k].score) ;
+    }
+    printf ("]}") ;
+  }
+  printf ("}\n") ;
+  fflush (stdout) ;
+}
+
+/* Reads the manifest. The jobs that cannot run keep the reason in
+ * job->error, and are reported as failed. */
+static int
+read_manifest (const char *path, batch_job **jobs)
+{
+  char line [MAX_LINE], *argv [MAX_ARGS + 6], *tok [MAX_ARGS + 1], *save ;
+  batch_job *job, *grown ;
+  FILE *file, *cover ;
+  int n = 0, size = 0, lineno = 0, ntok, argc, k ;
+
+  if ((file = strcmp (path, "-") ? fopen (path, "r") : stdin) == NULL) {
+    fprintf (stderr, "Error: %s: %s\n", path, strerror (errno)) ;
+    return -1 ;
+  }
+
+  *jobs = NULL ;
+  while (fgets (line, sizeof (line), file)) {
+    lineno++ ;
+    ntok = 0 ;
+    for (tok [0] = strtok_r (line, " \t\r\n", &save) ;
+         tok [ntok] && ntok < MAX_ARGS ;
+         tok [ntok] = strtok_r (NULL, " \t\r\n", &save))
+      ntok++ ;
+    if (!ntok || tok [0][0] == '#')
+      continue ;
+
+    if (n == size) {
+      size = size ? 2 * size : 64 ;
+      if ((grown = realloc (*jobs, sizeof (batch_job) * size)) == NULL) {
+        fprintf (stderr, "Error: %s\n", strerror (errno)) ;
+        break ;
+      }
+      *jobs = grown ;
+    }
+    job = &(*jobs) [n++] ;
+    memset (job, 0, sizeof (*job)) ;
+    job->line = lineno ;
+    job->embed = !strcmp (tok [0], "embed") ;
+
+    if ((!job->embed && strcmp (tok [0], "extract")) ||
+        ntok < (job->embed ? 5 : 4) || ntok == MAX_ARGS) {
+      job->input = strdup (ntok > 1 ? tok [1] : "") ;
+      job->error = "bad manifest line" ;
+      continue ;
+    }
+
+    /* The rest as a vorbistego_cfg command line */
+    job->input = strdup (tok [1]) ;
+    k = 2 ;
+    argc = 0 ;
+    argv [argc++] = DEFAULT_CONFIG_FILE ;
+    argv [argc++] = "--sfile" ;
+    argv [argc++] = tok [k++] ;
+    if (job->embed)
+      job->output = strdup (tok [k++]) ;
+    argv [argc++] = "--skey" ;
+    argv [argc++] = tok [k++] ;
+    while (k < ntok)
+      argv [argc++] = tok [k++] ;
+    argv [argc] = NULL ;
+
+    if (parse_options_argv (argc, argv, &job->fw, &job->inv, job->embed)
+        == I_MISC_ERR) {
+      job->error = "bad options" ;
+      continue ;
+    }
+
+    if (job->embed) {
+      if ((cover = wav_open (job->input, &job->channels, &job->rate)) == NULL)
+        job->error = "cover is not a 16 bit PCM WAV file" ;
+      else
+        fclose (cover) ;
+    }
+  }
+
+  if (file != stdin)
+    fclose (file) ;
+  return n ;
+}
+
+static int
+run_jobs (batch_job *jobs, int n_jobs, int n_workers, float quality)
+{
+  static warm_setup setups [MAX_SETUPS] ;
+  static worker workers [MAX_WORKERS] ;
+  struct rusage ru ;
+  job_result res ;
+  warm_setup *setup ;
+  batch_job *job ;
+  int next, running, failed, n_setups, k, fds [2], status ;
+  pid_t pid ;
+
+  next = running = failed = n_setups = 0 ;
+  for (k = 0 ; k < n_workers ; k++)
+    workers [k].pid = 0 ;
+
+  while (next < n_jobs || running) {
+
+    /* Fill the free workers */
+    for (k = 0 ; k < n_workers && next < n_jobs ; k++) {
+      if (workers [k].pid)
+        continue ;
+
+      job = &jobs [next] ;
+      memset (&res, 0, sizeof (res)) ;
+      if (job->error) {
+        snprintf (res.error, sizeof (res.error), "%s", job->error) ;
+        report (next++, job, &res, 0., 0) ;
+        failed++ ;
+        k-- ;
+        continue ;
+      }
+
+      setup = job->embed ?
+        warm_get (setups, &n_setups, job->channels, job->rate, quality) : NULL ;
+
+      if (pipe (fds)) {
+        snprintf (res.error, sizeof (res.error), "pipe: %s", strerror (errno)) ;
+        report (next++, job, &res, 0., 0) ;
+        failed++ ;
+        k-- ;
+        continue ;
+      }
+
+      fflush (stdout) ;
+      if ((pid = fork ()) < 0) {
+        snprintf (res.error, sizeof (res.error), "fork: %s", strerror (errno)) ;
+        report (next++, job, &res, 0., 0) ;
+        failed++ ;
+        close (fds [0]) ;
+        close (fds [1]) ;
+        k-- ;
+        continue ;
+      }
+
+      if (pid == 0) {
+        close (fds [0]) ;
+        if (job->embed)
+          embed_job (job, setup, quality, &res) ;
+        else
+          extract_job (job, &res) ;
+        if (write (fds [1], &res, sizeof (res)) != sizeof (res))
+          _exit (1) ;
+        _exit (0) ;
+      }
+
+      close (fds [1]) ;
+      workers [k].pid = pid ;
+      workers [k].fd = fds [0] ;
+      workers [k].job = next++ ;
+      workers [k].start = now () ;
+      running++ ;
+    }
+
+    if (!running)
+      break ;
+
+    /* Report the next job to end */
+    if ((pid = wait4 (-1, &status, 0, &ru)) < 0) {
+      if (errno == EINTR)
+        continue ;
+      fprintf (stderr, "Error: wait4: %s\n", strerror (errno)) ;
+      return -1 ;
+    }
+    for (k = 0 ; k < n_workers && workers [k].pid != pid ; k++)
+      ;
+    if (k == n_workers)
+      continue ;
+
+    memset (&res, 0, sizeof (res)) ;
+    if (read (workers [k].fd, &res, sizeof (res)) != sizeof (res) ||
+        !WIFEXITED (status))
+      res.ok = 0 ;
+    close (workers [k].fd) ;
+    report (workers [k].job, &jobs [workers [k].job], &res,
+            now () - workers [k].start, ru.ru_maxrss) ;
+    failed += !res.ok ;
+    workers [k].pid = 0 ;
+    running-- ;
+  }
+
+  warm_free (setups, n_setups) ;
+  return failed ;
+}
+
+static void
+job_free (batch_job *job)
+{
+  free (job->input) ;
+  free (job->output) ;
+  if (job->embed) {
+    free (job->fw.sfile) ;
+    free (job->fw.skey) ;
+    free (job->fw.sca) ;
+    free (job->fw.scmda) ;
+    free (job->fw.sciv) ;
+    free (job->fw.sstats) ;
+    free (job->fw.srecord) ;
+    free (job->fw.sindex) ;
+  }
+  else {
+    free (job->inv.sfile) ;
+    free (job->inv.skey) ;
+    free (job->inv.sca) ;
+    free (job->inv.scmda) ;
+    free (job->inv.sstats) ;
+    free (job->inv.srecord) ;
+    free (job->inv.sscan) ;
+  }
+}
+
+static void
+usage (void)
+{
+  printf ("Usage: vorbistego-batch [options] manifest\n"
+          "  -j workers    Jobs run at once [online CPUs]\n"
+          "  -q quality    VBR quality of the stego streams [0.4]\n"
+          "\n"
+          "Manifest lines ('-' reads it from stdin):\n"
+          "  embed   <cover.wav> <payload> <stego.ogg> <key> [options]\n"
+          "  extract <stego.ogg> <output> <key> [options]\n"
+          "with the options of vorbistego_cfg, e.g. --shm 0 --ssm 1. With\n"
+          "--sscan KEYFILE, an extract job ranks the candidate keys of\n"
+          "KEYFILE instead of extracting.\n") ;
+}
+
+int
+main (int argc, char **argv)
+{
+  batch_job *jobs ;
+  float quality = 0.4f ;
+  long n_workers ;
+  int n_jobs, failed, opt, k ;
+  double start ;
+
+  n_workers = sysconf (_SC_NPROCESSORS_ONLN) ;
+
+  while ((opt = getopt (argc, argv, "j:q:h")) != -1) {
+    switch (opt) {
+    case 'j': n_workers = atol (optarg) ; break ;
+    case 'q': quality = atof (optarg) ; break ;
+    default: usage () ; return opt == 'h' ? 0 : 1 ;
+    }
+  }
+
+  if (optind != argc - 1 || n_workers < 1) {
+    usage () ;
+    return 1 ;
+  }
+  if (n_workers > MAX_WORKERS)
+    n_workers = MAX_WORKERS ;
+
+  /* Once, before the workers are forked */
+  gcry_check_version (NULL) ;
+  gcry_control (GCRYCTL_INIT_SECMEM, 65536, 0) ;
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0) ;
+
+  start = now () ;
+  if ((n_jobs = read_manifest (argv [optind], &jobs)) < 0)
+    return 1 ;
+
+  failed = run_jobs (jobs, n_jobs, (int) n_workers, quality) ;
+
+  printf ("{\"jobs\":%d,\"failed\":%d,\"workers\":%ld,\"wall_s\":%.3f}\n",
+          n_jobs, failed, n_workers, now () - start) ;
+
+  for (k = 0 ; k < n_jobs ; k++)
+    job_free (&jobs [k]) ;
+  free (jobs) ;
+
+  return failed ? 1 : 0 ;
+}
+
+#else /* #ifndef STEGO */
+
+int
+main (void)
+{
+  printf ("vorbistego-batch: the library was built without STEGO\n") ;
+  return 1 ;
+}
+
+#endif /* #ifdef STEGO */
@@ -26,6 +26,7 @@ extern "C"
 /* #ifdef STEGO */
 #include "steganos/include/steganos_types.h"
 #include "steganos/include/cryptos_types.h"
+#include "steganos/include/fec_types.h"
 /* #endif */
 
 #include <ogg/ogg.h>
@@ -126,12 +127,16 @@ typedef struct vorbis_block{
   steganos_state_t *ss;
   cryptos_config_t *cc;
   cryptos_protocol_buffer_t *cb;
+  fec_state_t *fs;
+  steganos_scan_t *scan; /* Steganalysis scan (--sscan), kept across the
+			    stream for the caller to rank and free */
   int delayfr;          /* Number of frames to skip before hiding */
   int da;               /* Default desired aggressiveness */
   char *sfile;         /* Subliminal input/output file */
   int hide_method;      /* Default hiding method */
   int sync_method;      /* Default synchronization method */
   float sigma;          /* Default sigma */
+  int sfv;              /* Stego-frames format (1 or 2, encoder) */
   char *skey;          /* Key */
   char *sca;           /* Cipher algorithm */
   char *scmda;         /* Digest algorithm */
@@ -140,6 +145,20 @@ typedef struct vorbis_block{
   uint64_t scem;        /* Emission ID */
   uint64_t scpkt;       /* First packet ID */
   int scdds;            /* Default data size for crypto-packets */  
+  int scfmt;            /* Crypto-packets format (1 or 2) */
+  int scadapt;          /* Adaptive crypto-packets size flag */
+  int scqueue;          /* Crypto-packets produced ahead (0, no producer) */
+  int slive;            /* Live payload flag */
+  int slatency;         /* Live payload maximum latency, in ms */
+  int fec_k;            /* FEC group size (0, no FEC) */
+  int fec_m;            /* FEC parity packets per group */
+  char *sstats;         /* Telemetry JSON-lines output file */
+  char *srecord;        /* Frame recording output file */
+  char *sindex;         /* Embedding index output file (encoder) */
+  char *sscan;          /* Candidate keys file for the steganalysis scan (decoder) */
+  int sseek;            /* Seekable extraction flag (decoder) */
+  int sresync;          /* Set by the vorbisfile seeks, the next frame doesn't
+			   follow the previous one (decoder) */
   int quiet; /**< Quiet mode indicator */
 /* #endif */
   
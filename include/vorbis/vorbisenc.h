@@ -59,6 +59,17 @@ extern int vorbis_encode_setup_init(vorbis_info *vi);
 
 extern int vorbis_encode_ctl(vorbis_info *vi,int number,void *arg);
 
+/* Builds the codebooks, transforms and psychoacoustic tables of a VBR
+   encoder for the given settings and keeps them cached, so encoders
+   set up alike later start without that work. Kept until
+   vorbis_encode_warmup_clear. */
+extern int vorbis_encode_warmup(long channels,
+                                long rate,
+                                float base_quality /* quality level from 0. (lo) to 1. (hi) */
+                                );
+
+extern void vorbis_encode_warmup_clear(void);
+
   /* deprecated rate management supported only for compatability */
 #define OV_ECTL_RATEMANAGE_GET       0x10
 #define OV_ECTL_RATEMANAGE_SET       0x11
@@ -198,6 +198,11 @@ extern int ov_crosslap(OggVorbis_File *vf1,OggVorbis_File *vf2);
 extern int ov_halfrate(OggVorbis_File *vf,int flag);
 extern int ov_halfrate_p(OggVorbis_File *vf);
 
+#ifdef STEGO
+extern int ov_stego_extract_range(OggVorbis_File *vf,const char *index_file,
+                                  ogg_int64_t offset,ogg_int64_t length);
+#endif
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
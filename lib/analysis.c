@@ -39,6 +39,7 @@ int vorbis_analysis(vorbis_block *vb, ogg_packet *op){
   /* first things first.  Make sure encode is ready */
   for(i=0;i<PACKETBLOBS;i++)
     oggpack_reset(vbi->packetblob[i]);
+  vbi->blobpending=0;
 
   /* we only have one mapping type (0), and we let the mapping code
      itself figure out what soft mode to use.  This allows easier
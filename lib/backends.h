@@ -125,6 +125,7 @@ typedef struct{
   void (*free_info)    (vorbis_info_mapping *);
   int  (*forward)      (struct vorbis_block *vb);
   int  (*inverse)      (struct vorbis_block *vb,vorbis_info_mapping *);
+  int  (*blob)         (struct vorbis_block *vb,int);
 } vorbis_func_mapping;
 
 typedef struct vorbis_info_mapping0{
@@ -140,4 +141,9 @@ typedef struct vorbis_info_mapping0{
 
 } vorbis_info_mapping0;
 
+#ifdef STEGO
+/* stops the threads the steganographic layer of mapping0 started */
+extern void mapping0_stego_clear(void);
+#endif
+
 #endif
@@ -23,6 +23,7 @@
 #include "codec_internal.h"
 #include "os.h"
 #include "misc.h"
+#include "registry.h"
 #include "bitrate.h"
 
 /* compute bitrate tracking setup  */
@@ -61,6 +62,16 @@ void vorbis_bitrate_clear(bitrate_manager_state *bm){
   return;
 }
 
+/* bits in packet blob k; a managed encode leaves the blobs for the
+   mapping to encode only as they're looked at here */
+static long _blob_bits(vorbis_block *vb,int k){
+  vorbis_block_internal *vbi=vb->internal;
+
+  if(vbi->blobpending&(1<<k))
+    _mapping_P[0]->blob(vb,k);
+  return(oggpack_bytes(vbi->packetblob[k])*8);
+}
+
 int vorbis_bitrate_managed(vorbis_block *vb){
   vorbis_dsp_state      *vd=vb->vd;
   private_state         *b=vd->backend_state;
@@ -81,7 +92,7 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
   bitrate_manager_info  *bi=&ci->bi;
 
   int  choice=rint(bm->avgfloat);
-  long this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+  long this_bits=_blob_bits(vb,choice);
   long min_target_bits=(vb->W?bm->min_bitsper*bm->short_per_long:bm->min_bitsper);
   long max_target_bits=(vb->W?bm->max_bitsper*bm->short_per_long:bm->max_bitsper);
   int  samples=ci->blocksizes[vb->W]>>1;
@@ -119,13 +130,13 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
       while(choice>0 && this_bits>avg_target_bits &&
             bm->avg_reservoir+(this_bits-avg_target_bits)>desired_fill){
         choice--;
-        this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+        this_bits=_blob_bits(vb,choice);
       }
     }else if(bm->avg_reservoir+(this_bits-avg_target_bits)<desired_fill){
       while(choice+1<PACKETBLOBS && this_bits<avg_target_bits &&
             bm->avg_reservoir+(this_bits-avg_target_bits)<desired_fill){
         choice++;
-        this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+        this_bits=_blob_bits(vb,choice);
       }
     }
 
@@ -133,7 +144,7 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
     if(slew<-slewlimit)slew=-slewlimit;
     if(slew>slewlimit)slew=slewlimit;
     choice=rint(bm->avgfloat+= slew/vi->rate*samples);
-    this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+    this_bits=_blob_bits(vb,choice);
   }
 
 
@@ -145,7 +156,7 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
       while(bm->minmax_reservoir-(min_target_bits-this_bits)<0){
         choice++;
         if(choice>=PACKETBLOBS)break;
-        this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+        this_bits=_blob_bits(vb,choice);
       }
     }
   }
@@ -157,7 +168,7 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
       while(bm->minmax_reservoir+(this_bits-max_target_bits)>bi->reservoir_bits){
         choice--;
         if(choice<0)break;
-        this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+        this_bits=_blob_bits(vb,choice);
       }
     }
   }
@@ -171,10 +182,10 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
     long maxsize=(max_target_bits+(bi->reservoir_bits-bm->minmax_reservoir))/8;
     bm->choice=choice=0;
 
-    if(oggpack_bytes(vbi->packetblob[choice])>maxsize){
+    if(_blob_bits(vb,choice)>maxsize*8){
 
       oggpack_writetrunc(vbi->packetblob[choice],maxsize*8);
-      this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+      this_bits=_blob_bits(vb,choice);
     }
   }else{
     long minsize=(min_target_bits-bm->minmax_reservoir+7)/8;
@@ -184,9 +195,9 @@ int vorbis_bitrate_addblock(vorbis_block *vb){
     bm->choice=choice;
 
     /* prop up bitrate according to demand. pad this frame out with zeroes */
-    minsize-=oggpack_bytes(vbi->packetblob[choice]);
+    minsize-=_blob_bits(vb,choice)/8;
     while(minsize-->0)oggpack_write(vbi->packetblob[choice],0,8);
-    this_bits=oggpack_bytes(vbi->packetblob[choice])*8;
+    this_bits=_blob_bits(vb,choice);
 
   }
 
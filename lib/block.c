@@ -27,6 +27,7 @@
 
 #include "window.h"
 #include "mdct.h"
+#include "setupcache.h"
 #include "lpc.h"
 #include "registry.h"
 #include "misc.h"
@@ -35,6 +36,10 @@
 #include "steganos_types.h"
 #endif
 
+/* long blocks the analysis pcm window can slide forward before the
+   data is moved back to the start of its buffers */
+#define PCM_SLIDE_BLOCKS 4
+
 static int ilog2(unsigned int v){
   int ret=0;
   if(v)--v;
@@ -253,10 +258,8 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
 
   /* MDCT is tranform 0 */
 
-  b->transform[0][0]=_ogg_calloc(1,sizeof(mdct_lookup));
-  b->transform[1][0]=_ogg_calloc(1,sizeof(mdct_lookup));
-  mdct_init(b->transform[0][0],ci->blocksizes[0]>>hs);
-  mdct_init(b->transform[1][0],ci->blocksizes[1]>>hs);
+  b->transform[0][0]=_setup_cache_mdct(ci->blocksizes[0]>>hs);
+  b->transform[1][0]=_setup_cache_mdct(ci->blocksizes[1]>>hs);
 
   /* Vorbis I uses only window type 0 */
   b->window[0]=ilog2(ci->blocksizes[0])-6;
@@ -268,11 +271,19 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
     drft_init(&b->fft_look[0],ci->blocksizes[0]);
     drft_init(&b->fft_look[1],ci->blocksizes[1]);
 
-    /* finish the codebooks */
+    /* finish the codebooks; the ones vorbisenc took from the
+       templates are shared by every encoder using them */
     if(!ci->fullbooks){
-      ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
       for(i=0;i<ci->books;i++)
-        vorbis_book_init_encode(ci->fullbooks+i,ci->book_param[i]);
+        if(ci->book_param[i]->allocedp)break;
+      if(i==ci->books){
+        ci->fullbooks=_setup_cache_encode_books(ci->book_param,ci->books);
+        ci->fullbooks_shared=1;
+      }else{
+        ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
+        for(i=0;i<ci->books;i++)
+          vorbis_book_init_encode(ci->fullbooks+i,ci->book_param[i]);
+      }
     }
 
     b->psy=_ogg_calloc(ci->psys,sizeof(*b->psy));
@@ -286,7 +297,18 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
 
     v->analysisp=1;
   }else{
-    /* finish the codebooks */
+    /* finish the codebooks; streams with the same setup header share
+       them */
+    if(!ci->fullbooks && ci->setup_packet){
+      ci->fullbooks=_setup_cache_books(ci->setup_packet,ci->setup_bytes);
+      if(ci->fullbooks){
+        ci->fullbooks_shared=1;
+        for(i=0;i<ci->books;i++){
+          vorbis_staticbook_destroy(ci->book_param[i]);
+          ci->book_param[i]=NULL;
+        }
+      }
+    }
     if(!ci->fullbooks){
       ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
       for(i=0;i<ci->books;i++){
@@ -296,6 +318,15 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
         vorbis_staticbook_destroy(ci->book_param[i]);
         ci->book_param[i]=NULL;
       }
+      if(ci->setup_packet){
+        ci->fullbooks=_setup_cache_add_books(ci->setup_packet,ci->setup_bytes,
+                                             ci->fullbooks,ci->books);
+        ci->fullbooks_shared=1;
+      }
+    }
+    if(ci->setup_packet){
+      _ogg_free(ci->setup_packet);
+      ci->setup_packet=NULL;
     }
   }
 
@@ -304,10 +335,11 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
   v->pcm_storage=ci->blocksizes[1];
   v->pcm=_ogg_malloc(vi->channels*sizeof(*v->pcm));
   v->pcmret=_ogg_malloc(vi->channels*sizeof(*v->pcmret));
+  b->pcmbase=_ogg_malloc(vi->channels*sizeof(*b->pcmbase));
   {
     int i;
     for(i=0;i<vi->channels;i++)
-      v->pcm[i]=_ogg_calloc(v->pcm_storage,sizeof(*v->pcm[i]));
+      b->pcmbase[i]=v->pcm[i]=_ogg_calloc(v->pcm_storage,sizeof(*v->pcm[i]));
   }
 
   /* all 1 (large block) or 0 (small block) */
@@ -371,13 +403,11 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
       }
 
       if(b->transform[0]){
-        mdct_clear(b->transform[0][0]);
-        _ogg_free(b->transform[0][0]);
+        _setup_cache_release_mdct(b->transform[0][0]);
         _ogg_free(b->transform[0]);
       }
       if(b->transform[1]){
-        mdct_clear(b->transform[1][0]);
-        _ogg_free(b->transform[1][0]);
+        _setup_cache_release_mdct(b->transform[1][0]);
         _ogg_free(b->transform[1]);
       }
 
@@ -404,6 +434,11 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
 
       if(b->psy_g_look)_vp_global_free(b->psy_g_look);
       vorbis_bitrate_clear(&b->bms);
+#ifdef STEGO
+      /* an encode torn down before its payload is sent leaves the
+         crypto-packets producer running */
+      if(v->analysisp)mapping0_stego_clear();
+#endif
 
       drft_clear(&b->fft_look[0]);
       drft_clear(&b->fft_look[1]);
@@ -411,14 +446,16 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
     }
 
     if(v->pcm){
-      if(vi)
+      if(vi && b && b->pcmbase)
         for(i=0;i<vi->channels;i++)
-          if(v->pcm[i])_ogg_free(v->pcm[i]);
+          if(b->pcmbase[i])_ogg_free(b->pcmbase[i]);
       _ogg_free(v->pcm);
       if(v->pcmret)_ogg_free(v->pcmret);
     }
 
     if(b){
+      if(b->pcmbase)_ogg_free(b->pcmbase);
+
       /* free header, header1, header2 */
       if(b->header)_ogg_free(b->header);
       if(b->header1)_ogg_free(b->header1);
@@ -433,6 +470,7 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
 float **vorbis_analysis_buffer(vorbis_dsp_state *v, int vals){
   int i;
   vorbis_info *vi=v->vi;
+  codec_setup_info *ci=vi->codec_setup;
   private_state *b=v->backend_state;
 
   /* free header, header1, header2 */
@@ -441,13 +479,26 @@ float **vorbis_analysis_buffer(vorbis_dsp_state *v, int vals){
   if(b->header2)_ogg_free(b->header2);b->header2=NULL;
 
   /* Do we have enough storage space for the requested buffer? If not,
-     expand the PCM (and envelope) storage */
+     move the data back to the start of the buffers, and if that is not
+     enough either, expand the PCM (and envelope) storage, leaving room
+     for a few blocks to slide forward before the next move */
+
+  if(v->pcm_current+vals>=v->pcm_storage && b->pcmshift){
+    for(i=0;i<vi->channels;i++){
+      memmove(b->pcmbase[i],v->pcm[i],v->pcm_current*sizeof(*v->pcm[i]));
+      v->pcm[i]=b->pcmbase[i];
+    }
+    v->pcm_storage+=b->pcmshift;
+    b->pcmshift=0;
+  }
 
   if(v->pcm_current+vals>=v->pcm_storage){
-    v->pcm_storage=v->pcm_current+vals*2;
+    v->pcm_storage=v->pcm_current+vals*2+ci->blocksizes[1]*PCM_SLIDE_BLOCKS;
 
     for(i=0;i<vi->channels;i++){
-      v->pcm[i]=_ogg_realloc(v->pcm[i],v->pcm_storage*sizeof(*v->pcm[i]));
+      b->pcmbase[i]=_ogg_realloc(b->pcmbase[i],
+                                 v->pcm_storage*sizeof(*v->pcm[i]));
+      v->pcm[i]=b->pcmbase[i];
     }
   }
 
@@ -697,9 +748,12 @@ int vorbis_analysis_blockout(vorbis_dsp_state *v,vorbis_block *vb){
       _ve_envelope_shift(b->ve,movementW);
       v->pcm_current-=movementW;
 
+      /* slide the window rather than moving the data; the storage ahead
+         shrinks accordingly */
       for(i=0;i<vi->channels;i++)
-        memmove(v->pcm[i],v->pcm[i]+movementW,
-                v->pcm_current*sizeof(*v->pcm[i]));
+        v->pcm[i]+=movementW;
+      v->pcm_storage-=movementW;
+      b->pcmshift+=movementW;
 
 
       v->lW=v->W;
@@ -96,6 +96,16 @@ typedef struct encode_aux_pigeonhole{
   long *fitlength;
 } encode_aux_pigeonhole;
 
+/* Several short codewords decoded by a single lookup of dec_multitablen
+   bits; count==0 when the first codeword does not fit in the lookup */
+#define DEC_MULTI 4
+
+typedef struct dec_multientry{
+  ogg_uint16_t  entry[DEC_MULTI]; /* packed entry numbers, in stream order */
+  unsigned char count;
+  unsigned char bits;             /* total length of the count codewords */
+} dec_multientry;
+
 typedef struct codebook{
   long dim;           /* codebook dimensions (elements per vector) */
   long entries;       /* codebook entries */
@@ -114,6 +124,10 @@ typedef struct codebook{
   int           dec_firsttablen;
   int           dec_maxlength;
 
+  dec_multientry *dec_multitable; /* only for books with values and few
+                                     enough entries; see decode_packed_entries */
+  int             dec_multitablen;
+
 } codebook;
 
 extern void vorbis_staticbook_clear(static_codebook *b);
@@ -155,6 +169,16 @@ extern long vorbis_book_decodevv_add(codebook *book, float **a,
                                      long off,int ch,
                                     oggpack_buffer *b,int n);
 
+/* residue partition decoders specialised for the book dimension (and
+   for two interleaved channels); the generic ones above otherwise */
+typedef long (*vorbis_book_decodev_fn)(codebook *book, float *a,
+                                       oggpack_buffer *b,int n);
+
+extern vorbis_book_decodev_fn vorbis_book_decodev_add_kernel(codebook *book);
+extern long vorbis_book_decodevv_add_stereo(codebook *book, float **a,
+                                            long off,
+                                            oggpack_buffer *b,int n);
+
 
 
 #endif
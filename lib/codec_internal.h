@@ -37,6 +37,8 @@ typedef struct vorbis_block_internal{
                                               blob [PACKETBLOBS/2] points to
                                               the oggpack_buffer in the
                                               main vorbis_block */
+  int    blobpending; /* blobs the mapping has left to encode, by bit */
+  void  *blobstate;   /* what encoding them takes (block storage) */
 } vorbis_block_internal;
 
 typedef void vorbis_look_floor;
@@ -82,6 +84,12 @@ typedef struct private_state {
   bitrate_manager_state bms;
 
   ogg_int64_t sample_count;
+
+  /* the allocated pcm buffers; on the encoding side v->pcm[i] slides
+     forward along them (pcmshift) as blocks are consumed, and the data
+     is only moved back when the space ahead runs out */
+  float **pcmbase;
+  long    pcmshift;
 } private_state;
 
 /* codec_setup_info contains all the setup information specific to the
@@ -119,6 +127,10 @@ typedef struct codec_setup_info {
   vorbis_info_residue    *residue_param[64];
   static_codebook        *book_param[256];
   codebook               *fullbooks;
+  int                     fullbooks_shared; /* owned by the setup cache */
+  unsigned char          *setup_packet; /* decode only, until the books
+                                           are built */
+  long                    setup_bytes;
 
   vorbis_info_psy        *psy_param[4]; /* encode only */
   vorbis_info_psy_global psy_g_param;
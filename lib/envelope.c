@@ -29,6 +29,13 @@
 #include "mdct.h"
 #include "misc.h"
 
+/* SSE2 spectra and band sums on x86_64; the spectra are 32 bins, too
+   short for wider vectors to help */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define VE_SIMD
+#include <emmintrin.h>
+#endif
+
 void _ve_envelope_init(envelope_lookup *e,vorbis_info *vi){
   codec_setup_info *ci=vi->codec_setup;
   vorbis_info_psy_global *gi=&ci->psy_g_param;
@@ -69,6 +76,7 @@ void _ve_envelope_init(envelope_lookup *e,vorbis_info *vi){
   }
 
   e->filter=_ogg_calloc(VE_BANDS*ch,sizeof(*e->filter));
+  e->amp=_ogg_malloc(VE_BANDS*VE_BATCH*ch*sizeof(*e->amp));
   e->mark=_ogg_calloc(e->storage,sizeof(*e->mark));
 
 }
@@ -80,21 +88,27 @@ void _ve_envelope_clear(envelope_lookup *e){
     _ogg_free(e->band[i].window);
   _ogg_free(e->mdct_win);
   _ogg_free(e->filter);
+  _ogg_free(e->amp);
   _ogg_free(e->mark);
   memset(e,0,sizeof(*e));
 }
 
 /* fairly straight threshhold-by-band based until we find something
-   that works better and isn't patented. */
-
-static int _ve_amp(envelope_lookup *ve,
-                   vorbis_info_psy_global *gi,
-                   float *data,
-                   envelope_band *bands,
-                   envelope_filter_state *filters){
+   that works better and isn't patented.
+
+   The search runs in batches of up to VE_BATCH windows: the spectra
+   and band amplitudes of every channel in the batch first, then the
+   triggering, window by window.  Only the near-DC and trigger filters
+   carry state from window to window, so this decides exactly what
+   analysing one window of one channel at a time would. */
+
+/* the spread spectrum of one window, bin k at spec[k*VE_BATCH] */
+static void _ve_spectrum(envelope_lookup *ve,
+                         float *data,
+                         envelope_filter_state *filters,
+                         float *spec){
   long n=ve->winlength;
-  int ret=0;
-  long i,j;
+  long i;
   float decay;
 
   /* we want to have a 'minimum bar' for energy, else we're just
@@ -103,13 +117,7 @@ static int _ve_amp(envelope_lookup *ve,
 
   float minV=ve->minenergy;
   float *vec=alloca(n*sizeof(*vec));
-
-  /* stretch is used to gradually lengthen the number of windows
-     considered prevoius-to-potential-trigger */
-  int stretch=max(VE_MINSTRETCH,ve->stretch/2);
-  float penalty=gi->stretch_penalty-(ve->stretch/2-VE_MINSTRETCH);
-  if(penalty<0.f)penalty=0.f;
-  if(penalty>gi->stretch_penalty)penalty=gi->stretch_penalty;
+  float *spread=alloca(n/4*sizeof(*spread));
 
   /*_analysis_output_always("lpcm",seq2,data,n,0,0,
     totalshift+pos*ve->searchstep);*/
@@ -145,30 +153,110 @@ static int _ve_amp(envelope_lookup *ve,
     decay=todB(&decay)*.5-15.f;
   }
 
+  /* the spreading falls off 8dB a bin; taken down step by step as it
+     always was, so it rounds the same */
+  for(i=0;i<n/4;i++){
+    spread[i]=decay;
+    decay-=8.;
+  }
+
   /* perform spreading and limiting, also smooth the spectrum.  yes,
      the MDCT results in all real coefficients, but it still *behaves*
      like real/imaginary pairs */
-  for(i=0;i<n/2;i+=2){
+  i=0;
+#ifdef VE_SIMD
+  {
+    const __m128i abs=_mm_set1_epi32(0x7fffffff);
+    const __m128 scale=_mm_set1_ps(7.17711438e-7f);
+    const __m128 offset=_mm_set1_ps(764.6161886f);
+    const __m128 half=_mm_set1_ps(.5f);
+    const __m128 min=_mm_set1_ps(minV);
+    float out[4];
+
+    for(;i+8<=n/2;i+=8){
+      __m128 a=_mm_loadu_ps(vec+i);
+      __m128 b=_mm_loadu_ps(vec+i+4);
+      __m128 re=_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+      __m128 im=_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+      __m128 val=_mm_add_ps(_mm_mul_ps(re,re),_mm_mul_ps(im,im));
+
+      /* todB */
+      val=_mm_cvtepi32_ps(_mm_and_si128(_mm_castps_si128(val),abs));
+      val=_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(val,scale),offset),half);
+
+      val=_mm_max_ps(_mm_loadu_ps(spread+(i>>1)),val);
+      val=_mm_max_ps(min,val);
+      _mm_storeu_ps(out,val);
+      spec[(i>>1)*VE_BATCH]=out[0];
+      spec[((i>>1)+1)*VE_BATCH]=out[1];
+      spec[((i>>1)+2)*VE_BATCH]=out[2];
+      spec[((i>>1)+3)*VE_BATCH]=out[3];
+    }
+  }
+#endif
+  for(;i<n/2;i+=2){
     float val=vec[i]*vec[i]+vec[i+1]*vec[i+1];
     val=todB(&val)*.5f;
-    if(val<decay)val=decay;
+    if(val<spread[i>>1])val=spread[i>>1];
     if(val<minV)val=minV;
-    vec[i>>1]=val;
-    decay-=8.;
+    spec[(i>>1)*VE_BATCH]=val;
   }
 
   /*_analysis_output_always("spread",seq2++,vec,n/4,0,0,0);*/
+}
+
+/* the amplitude of every band in count windows of spread spectra,
+   band j of window w at amp[j*VE_BATCH+w] */
+static void _ve_bands(envelope_band *bands,
+                      const float *spec,
+                      int count,
+                      float *amp){
+  int i,j,w;
 
-  /* perform preecho/postecho triggering by band */
   for(j=0;j<VE_BANDS;j++){
-    float acc=0.;
-    float valmax,valmin;
+    const float *s=spec+bands[j].begin*VE_BATCH;
+    w=0;
 
     /* accumulate amplitude */
-    for(i=0;i<bands[j].end;i++)
-      acc+=vec[i+bands[j].begin]*bands[j].window[i];
+#ifdef VE_SIMD
+    for(;w+4<=count;w+=4){
+      __m128 acc=_mm_setzero_ps();
+      for(i=0;i<bands[j].end;i++)
+        acc=_mm_add_ps(acc,_mm_mul_ps(_mm_loadu_ps(s+i*VE_BATCH+w),
+                                      _mm_set1_ps(bands[j].window[i])));
+      _mm_storeu_ps(amp+j*VE_BATCH+w,
+                    _mm_mul_ps(acc,_mm_set1_ps(bands[j].total)));
+    }
+#endif
+    for(;w<count;w++){
+      float acc=0.;
+      for(i=0;i<bands[j].end;i++)
+        acc+=s[i*VE_BATCH+w]*bands[j].window[i];
+      amp[j*VE_BATCH+w]=acc*bands[j].total;
+    }
+  }
+}
+
+/* preecho/postecho triggering of one window of one channel, given
+   its band amplitudes (band j at amp[j*VE_BATCH]) */
+static int _ve_trigger(envelope_lookup *ve,
+                       vorbis_info_psy_global *gi,
+                       const float *amp,
+                       envelope_filter_state *filters){
+  int ret=0;
+  long i,j;
+
+  /* stretch is used to gradually lengthen the number of windows
+     considered prevoius-to-potential-trigger */
+  int stretch=max(VE_MINSTRETCH,ve->stretch/2);
+  float penalty=gi->stretch_penalty-(ve->stretch/2-VE_MINSTRETCH);
+  if(penalty<0.f)penalty=0.f;
+  if(penalty>gi->stretch_penalty)penalty=gi->stretch_penalty;
 
-    acc*=bands[j].total;
+  /* perform preecho/postecho triggering by band */
+  for(j=0;j<VE_BANDS;j++){
+    float acc=amp[j*VE_BATCH];
+    float valmax,valmin;
 
     /* convert amplitude to delta */
     {
@@ -218,6 +306,7 @@ long _ve_envelope_search(vorbis_dsp_state *v){
   codec_setup_info *ci=vi->codec_setup;
   vorbis_info_psy_global *gi=&ci->psy_g_param;
   envelope_lookup *ve=((private_state *)(v->backend_state))->ve;
+  float *spec=alloca(ve->winlength/4*VE_BATCH*sizeof(*spec));
   long i,j;
 
   int first=ve->current/ve->searchstep;
@@ -230,30 +319,44 @@ long _ve_envelope_search(vorbis_dsp_state *v){
     ve->mark=_ogg_realloc(ve->mark,ve->storage*sizeof(*ve->mark));
   }
 
-  for(j=first;j<last;j++){
-    int ret=0;
-
-    ve->stretch++;
-    if(ve->stretch>VE_MAXSTRETCH*2)
-      ve->stretch=VE_MAXSTRETCH*2;
+  for(j=first;j<last;j+=VE_BATCH){
+    int count=min(VE_BATCH,last-j);
+    int k;
 
+    /* spectra and band amplitudes of the batch, channel by channel */
     for(i=0;i<ve->ch;i++){
-      float *pcm=v->pcm[i]+ve->searchstep*(j);
-      ret|=_ve_amp(ve,gi,pcm,ve->band,ve->filter+i*VE_BANDS);
+      for(k=0;k<count;k++){
+        float *pcm=v->pcm[i]+ve->searchstep*(j+k);
+        _ve_spectrum(ve,pcm,ve->filter+i*VE_BANDS,spec+k);
+      }
+      _ve_bands(ve->band,spec,count,ve->amp+i*VE_BANDS*VE_BATCH);
     }
 
-    ve->mark[j+VE_POST]=0;
-    if(ret&1){
-      ve->mark[j]=1;
-      ve->mark[j+1]=1;
-    }
+    for(k=0;k<count;k++){
+      long w=j+k;
+      int ret=0;
 
-    if(ret&2){
-      ve->mark[j]=1;
-      if(j>0)ve->mark[j-1]=1;
-    }
+      ve->stretch++;
+      if(ve->stretch>VE_MAXSTRETCH*2)
+        ve->stretch=VE_MAXSTRETCH*2;
 
-    if(ret&4)ve->stretch=-1;
+      for(i=0;i<ve->ch;i++)
+        ret|=_ve_trigger(ve,gi,ve->amp+i*VE_BANDS*VE_BATCH+k,
+                         ve->filter+i*VE_BANDS);
+
+      ve->mark[w+VE_POST]=0;
+      if(ret&1){
+        ve->mark[w]=1;
+        ve->mark[w+1]=1;
+      }
+
+      if(ret&2){
+        ve->mark[w]=1;
+        if(w>0)ve->mark[w-1]=1;
+      }
+
+      if(ret&4)ve->stretch=-1;
+    }
   }
 
   ve->current=last*ve->searchstep;
@@ -28,6 +28,8 @@
 #define VE_BANDS  7
 #define VE_NEARDC 15
 
+#define VE_BATCH  16       /* search windows analysed together */
+
 #define VE_MINSTRETCH 2   /* a bit less than short block */
 #define VE_MAXSTRETCH 12  /* one-third full block */
 
@@ -60,6 +62,7 @@ typedef struct {
 
   envelope_band          band[VE_BANDS];
   envelope_filter_state *filter;
+  float                 *amp;    /* band amplitudes of a batch */
   int   stretch;
 
   int                   *mark;
@@ -37,9 +37,14 @@
 #include "global_types.h"
 #include "steganos_types.h"
 #include "cryptos_types.h"
+#include "fec_types.h"
 #include "protocols.h"
 #include "steganos_channel.h"
 #include "cryptos_channel.h"
+#include "fec_channel.h"
+#include "steganos_stats.h"
+#include "steganos_record.h"
+#include "steganos_scan.h"
 #include "numbers.h"
 #include "miscellaneous.h"
 #endif
@@ -1169,6 +1174,7 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 #ifdef STEGO
   int *floor=NULL;
   float *residue=NULL;
+  static FILE *stats_fp = NULL, *record_fp = NULL;
 
   if(!(floor = (int *) malloc(sizeof(int)*n))) {
     message_log("floor1_inverse2", strerror(errno));
@@ -1219,6 +1225,7 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
       int read, keylen, sca, scmda, rc;
       static inv_options_t inv;	
       static int eot=0, fd=-1, start = 0, print = 0;
+      uint32_t t0;
       char *tmp_name;
 
       if(!start) {
@@ -1226,6 +1233,8 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	vb->ss = NULL;
 	vb->cc = NULL;
 	vb->cb = NULL;
+	vb->fs = NULL;
+	vb->scan = NULL;
 	  
 	/* Try to read a config file. If it exists and has the --force-read-file flag,
 	   it will have precedence over command-line arguments. If not, the command line
@@ -1237,11 +1246,17 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	   and anything may happen. */
 	rc = parse_options(DEFAULT_CONFIG_FILE, NULL, &inv, 0);
 	if(rc == I_MISC_ERR || (rc = I_MISC_OK && !inv.force)) {
-	  if(vb->sfile || vb->skey) {
+	  if(vb->sfile || vb->skey || vb->sscan) {
 	    inv.sfile = vb->sfile; inv.hide_method = vb->hide_method; 
 	    inv.sync_method = vb->sync_method; inv.sigma = vb->sigma; 
 	    inv.skey = vb->skey; inv.sca = vb->sca; inv.scmda = vb->scmda; 
 	    inv.schmac = vb->schmac; inv.scem = vb->scem; inv.scpkt = vb->scpkt; 
+	    inv.scfmt = vb->scfmt; inv.fec_k = vb->fec_k; inv.fec_m = vb->fec_m;
+	    inv.sstats = vb->sstats;
+	    inv.srecord = vb->srecord;
+	    inv.sscan = vb->sscan;
+	    inv.scdds = vb->scdds;
+	    inv.sseek = vb->sseek;
 	    inv.quiet = vb->quiet;
 	  } 
 	}
@@ -1249,6 +1264,53 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	start = 1;
 
       }
+
+      /* Decoded frames sidecar: every frame, whatever happens next, so that
+	 the extraction can be replayed from it (see test/stegoreplay.c) */
+      if(inv.srecord && floor && residue) {
+	if(!record_fp &&
+	   steganos_record_open(inv.srecord, &record_fp) == I_STEGANOS_ERR) {
+	  inv.srecord = NULL;
+	} else if(steganos_vorbis_config_init(&vc, vb->vd->vi->rate, 
+					      vb->pcmend, look->vi->mult,
+					      look->vi->postlist,
+					      look->forward_index, look->posts)
+		  == I_STEGANOS_OK) {
+	  /* There is no end of stream down here: keep it flushed */
+	  steganos_record_frame(record_fp, &vc, fit_value, floor, residue);
+	  fflush(record_fp);
+	}
+      }
+
+      /* Steganalysis scan: the frame is checked against all the candidate
+	 keys, and nothing is recovered */
+      if(inv.sscan && !eot) {
+
+	if(!vb->scan) {
+	  if(!(vb->scan = (steganos_scan_t *) malloc(sizeof(steganos_scan_t)))) {
+	    message_log("floor1_inverse2", strerror(errno));
+	    eot = 1;
+	    goto no_stego;
+	  }
+
+	  if(steganos_scan_init(vb->scan, inv.sscan, inv.hide_method, 
+				inv.sync_method, inv.sigma) == I_STEGANOS_ERR) {
+	    free(vb->scan); vb->scan = NULL;
+	    eot = 1;
+	    goto no_stego;
+	  }
+	}
+
+	if(floor && residue &&
+	   steganos_vorbis_config_init(&vc, vb->vd->vi->rate, vb->pcmend, 
+				       look->vi->mult, look->vi->postlist,
+				       look->forward_index, look->posts)
+	   == I_STEGANOS_OK) {
+	  steganos_scan_frame(vb->scan, &vc, fit_value, floor, residue);
+	}
+
+	goto no_stego;
+      }
       
       /* While !eot */
       if(!eot) {
@@ -1270,6 +1332,13 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	    goto no_stego;
 	  }
 
+	  /* Telemetry output, not fatal if unavailable */
+	  if(inv.sstats && !stats_fp) {
+	    if(!(stats_fp = fopen(inv.sstats, "w"))) {
+	      message_log("floor1_inverse2", strerror(errno));
+	    }
+	  }
+
 	}
 
 	if((rc = steganos_vorbis_config_init(&vc, vb->vd->vi->rate, vb->pcmend, 
@@ -1294,7 +1363,9 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	  memset(tmp_name, 0, strlen(inv.sfile)+4);
 	  sprintf(tmp_name, ".%s.z", inv.sfile);
 
-	  if((fd = open(tmp_name, O_WRONLY | O_CREAT | O_APPEND, 
+	  /* Seekable extraction writes each packet at its payload offset */
+	  if((fd = open(tmp_name, O_WRONLY | O_CREAT | 
+			(inv.sseek ? 0 : O_APPEND), 
 			S_IRWXU | S_IRGRP | S_IROTH)) < 0 ) {
 	    message_log("floor1_inverse2", strerror(errno));
 	    rc = I_STEGANOS_ERR;
@@ -1319,12 +1390,47 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	  cryptos_md_algo_code(inv.scmda, &scmda);
 
 	  if(cryptos_config_init(vb->cc, sca, (byte *) inv.skey, keylen, scmda,
-				 inv.schmac, NULL, 0, inv.scem, inv.scpkt, 0)
-	     == I_CRYPTOS_ERR) {
+				 inv.schmac, NULL, 0, inv.scem, inv.scpkt, 
+				 inv.scdds) == I_CRYPTOS_ERR) {
+	    rc = I_STEGANOS_ERR;
+	    goto no_stego;
+	  }
+
+	  if(cryptos_config_set_format(vb->cc, inv.scfmt ? inv.scfmt : 
+				       CRYPTOS_FORMAT_V1, 0) == I_CRYPTOS_ERR) {
+	    rc = I_STEGANOS_ERR;
+	    goto no_stego;
+	  }
+
+	  /* Seekable extraction: start with whichever packet comes first. The
+	     FEC frames can't be realigned, so not with FEC. */
+	  if(inv.sseek && !inv.fec_k &&
+	     cryptos_config_set_seekable(vb->cc, inv.scdds) == I_CRYPTOS_ERR) {
 	    rc = I_STEGANOS_ERR;
 	    goto no_stego;
 	  }
 
+	  /* FEC layer, if requested. Sized as in mapping0_forward. Its buffer
+	     must hold a whole FEC frame plus a stego-frame worth of data. */
+	  if(inv.fec_k) {
+	    uint64_t max_packet;
+
+	    cryptos_packet_len(vb->cc, vb->cc->max_data, &max_packet);
+	    max_packet += CRYPTOS_VARINT_MAX_LEN;
+	    if(!(vb->fs = (fec_state_t *) malloc(sizeof(fec_state_t)))) {
+	      message_log("floor1_inverse2", strerror(errno));
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	    if(fec_state_init(vb->fs, inv.fec_k, inv.fec_m, max_packet,
+			      2*FEC_FRAME_LEN(max_packet+2)+MAX_SUBLIMINAL_BYTES)
+	       == I_FEC_ERR) {
+	      free(vb->fs); vb->fs = NULL;
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	  }
+
 	  if(fd != -1) {
 	    if(!(vb->cb = (cryptos_protocol_buffer_t *)
 		 malloc(sizeof(cryptos_protocol_buffer_t)))) {
@@ -1332,8 +1438,8 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
-	    if(cryptos_buffer_init(vb->cb, fd, vb->cc->default_data_size*2)
-	       == I_CRYPTOS_ERR) {
+	    if(cryptos_buffer_init(vb->cb, fd, vb->cc->default_data_size*2+
+				   MAX_SUBLIMINAL_BYTES) == I_CRYPTOS_ERR) {
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
@@ -1341,9 +1447,23 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	}
 
 	vb->ss->iters++;     
+	steganos_stats_begin(vb->ss, -1);
 
 	ss = vb->ss;
 	cc = vb->cc;
+
+	/* After a seek, the bits received so far don't continue with the next
+	   ones: drop them and look for the next packet again */
+	if(vb->sresync) {
+	  vb->sresync = 0;
+	  if(cc->seek_data_size && cc->packet) {
+	    cc->resync = 1;
+	    ss->carry = 0;
+	    ss->carry_len = 0;
+	    memset(vb->cb->buffer, 0, vb->cb->buffer_size);
+	    vb->cb->buffer_used = 0;
+	  }
+	}
       
 	/* A expected packet_id of 0 means the last packet (with id 0) has been 
 	   received. So we'll try to unhide data while it is received and no 
@@ -1352,6 +1472,21 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 
 	  /* Look for hidden data */
 	  if(floor && residue) {
+
+	    byte *sbuffer;
+	    size_t sbuffer_size, *sbuffer_used;
+
+	    /* With FEC, the unhidden bytes are FEC frames, which go to the FEC
+	       layer buffer instead of the cryptographic one */
+	    if(vb->fs) {
+	      sbuffer = vb->fs->buffer;
+	      sbuffer_size = vb->fs->buffer_size;
+	      sbuffer_used = &vb->fs->buffer_used;
+	    } else {
+	      sbuffer = vb->cb->buffer;
+	      sbuffer_size = vb->cb->buffer_size;
+	      sbuffer_used = &vb->cb->buffer_used;
+	    }
 	      
 	    /* Unhide the data */
 
@@ -1360,49 +1495,86 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 	       long time of desynchronization, a buffer overrun may happen. If
 	       so, reset the whole buffer.
 	    */
-	    if(vb->cb->buffer_size - vb->cb->buffer_used < MAX_SUBLIMINAL_SIZE) {
+	    if(sbuffer_size - *sbuffer_used < MAX_SUBLIMINAL_BYTES) {
 	      message_log("floor1_inverse2", "Buffer overrun, reset buffer");
-	      memset(vb->cb->buffer, 0, vb->cb->buffer_size);
-	      vb->cb->buffer_used = 0;	      
+	      memset(sbuffer, 0, sbuffer_size);
+	      *sbuffer_used = 0;	      
 	    }
 
 	    read = 0;
+	    t0 = steganos_stats_clock();
 	    if(steganos_inverse(ss, &vc, fit_value, floor, 
 				residue, inv.sigma,
-				&vb->cb->buffer[vb->cb->buffer_used], 
-				vb->cb->buffer_size - vb->cb->buffer_used,
+				&sbuffer[*sbuffer_used], 
+				sbuffer_size - *sbuffer_used,
 				&read) == I_STEGANOS_ERR) {
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
+	    ss->frame_stats.t_hide = steganos_stats_clock() - t0;
+	    ss->frame_stats.status = read ? 
+	      FRAME_STATUS_HIDDEN : FRAME_STATUS_IGNORED;
 
 
 	    if(read) {
 
 	      /* Increment the buffer bytes used */
-	      vb->cb->buffer_used += read;
-
-	      /* Decipher it */
-	      if(cryptos_inverse(cc, vb->cb) == I_CRYPTOS_ERR) {
+	      *sbuffer_used += read;
+
+	      /* Decipher it (rebuilding the lost packets first, with FEC) */
+	      t0 = steganos_stats_clock();
+	      if(vb->fs) {
+		rc = fec_inverse(vb->fs, cc, vb->cb);
+	      } else if(cc->resync) {
+		rc = cryptos_inverse_resync(ss, cc, vb->cb);
+		if(!cc->resync && !inv.quiet) {
+		  if(cc->offset == CRYPTOS_OFFSET_UNKNOWN) {
+		    fprintf(stderr, "Subliminal channel found at the last packet\n");
+		  } else {
+		    fprintf(stderr, "Subliminal channel found at packet %lu, "
+			    "payload offset %lu\n", cc->packet ? cc->packet-1 : 0,
+			    cc->offset);
+		  }
+		}
+	      } else {
+		rc = cryptos_inverse(cc, vb->cb);
+	      }
+	      ss->frame_stats.t_crypto = steganos_stats_clock() - t0;
+	      if(rc == I_CRYPTOS_ERR) {
 		rc = I_STEGANOS_ERR;
 		goto no_stego;
 	      }
+	      rc = I_STEGANOS_OK;
 	    
 	      /* If cc->packet has been changed to 0, means we received the End Of
 		 Transmission signal, so we can free all the structures. Otherwise,
 		 we increment the expected packet id */
 	      if(!cc->packet) {
 		FILE *fd_z, *fd_nz;
+		int keep;
 
 		if(!inv.quiet && !print) {
 		  fprintf(stderr, "%ld bits of subliminal data successfully recovered\n",
 			  vb->ss->read);
+		  if(vb->fs) {
+		    fprintf(stderr, "FEC: %lu packets rebuilt, %lu packets lost\n",
+			    vb->fs->recovered, vb->fs->lost);
+		  }
 		  print = 1;
 		}
 
+		if(vb->fs) {
+		  fec_state_free(vb->fs); free(vb->fs); vb->fs = NULL;
+		}
+
 		close(vb->cb->fd);
 		cryptos_buffer_free(vb->cb); free(vb->cb); vb->cb = NULL;
 		cryptos_config_free(vb->cc); free(vb->cc); vb->cc = NULL;
+		if(stats_fp) {
+		  steganos_stats_commit(vb->ss);
+		  steganos_stats_dump(vb->ss, stats_fp, 1);
+		  fclose(stats_fp); stats_fp = NULL;
+		}
 		steganos_state_free(vb->ss); free(vb->ss); vb->ss = NULL;
 		eot = 1;
 
@@ -1424,13 +1596,22 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
 		  message_log("floor1_inverse2", strerror(errno));
 		}
 
+		keep = 0;
 		if(fd_z && fd_nz) {
 		  if(zlib_inf(fd_z, fd_nz) != Z_OK) {
 		    message_log("floor1_inverse2", "Zlib error while decompressing");
+		    keep = inv.sseek;
 		  }
 		}
 
-		if(unlink(tmp_name)) {
+		/* A seekable extraction that started after the beginning of the
+		   payload can't be decompressed: keep what was recovered, at its
+		   offsets in the compressed stream */
+		if(keep) {
+		  if(!inv.quiet) {
+		    fprintf(stderr, "Partial payload kept in %s\n", tmp_name);
+		  }
+		} else if(unlink(tmp_name)) {
 		  message_log("floor1_inverse2", strerror(errno));
 		}
 
@@ -1462,6 +1643,7 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
     if(floor) free(floor);
     if(residue) free(residue);
     if(vb->ss) steganos_state_reset_iter(vb->ss);    
+    if(vb->ss && stats_fp) steganos_stats_dump(vb->ss, stats_fp, 0);
     floor = NULL;
     residue = NULL;
 
@@ -30,6 +30,7 @@
 #include "psy.h"
 #include "misc.h"
 #include "os.h"
+#include "setupcache.h"
 
 #define GENERAL_VENDOR_STRING "Xiph.Org libVorbis 1.2.3"
 #define ENCODE_VENDOR_STRING "Xiph.Org libVorbis I 20090709"
@@ -189,11 +190,17 @@ void vorbis_info_clear(vorbis_info *vi){
         /* knows if the book was not alloced */
         vorbis_staticbook_destroy(ci->book_param[i]);
       }
-      if(ci->fullbooks)
+      if(ci->fullbooks && !ci->fullbooks_shared)
         vorbis_book_clear(ci->fullbooks+i);
     }
-    if(ci->fullbooks)
+    if(ci->fullbooks){
+      if(ci->fullbooks_shared)
+        _setup_cache_release_books(ci->fullbooks);
+      else
         _ogg_free(ci->fullbooks);
+    }
+    if(ci->setup_packet)
+        _ogg_free(ci->setup_packet);
 
     for(i=0;i<ci->psys;i++)
       _vi_psy_free(ci->psy_param[i]);
@@ -420,7 +427,18 @@ int vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,ogg_packet *op)
           return(OV_EBADHEADER);
         }
 
-        return(_vorbis_unpack_books(vi,&opb));
+        {
+          int ret=_vorbis_unpack_books(vi,&opb);
+          codec_setup_info *ci=vi->codec_setup;
+
+          /* kept to find the decode books in the setup cache */
+          if(!ret){
+            ci->setup_packet=_ogg_malloc(op->bytes);
+            memcpy(ci->setup_packet,op->packet,op->bytes);
+            ci->setup_bytes=op->bytes;
+          }
+          return(ret);
+        }
 
       default:
         /* Not a valid vorbis header type */
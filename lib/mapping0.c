@@ -38,12 +38,27 @@
 #include "steganos/include/global_types.h"
 #include "steganos/include/steganos_types.h"
 #include "steganos/include/cryptos_types.h"
+#include "steganos/include/fec_types.h"
 #include "steganos/include/numbers.h"
 #include "steganos/lib/protocols.h"
 #include "steganos/lib/steganos_channel.h"
 #include "steganos/lib/cryptos_channel.h"
+#include "steganos/lib/cryptos_producer.h"
+#include "steganos/lib/fec_channel.h"
+#include "steganos/lib/steganos_stats.h"
+#include "steganos/lib/steganos_record.h"
+#include "steganos/lib/steganos_index.h"
+#include "steganos/lib/steganos_live.h"
 #include "steganos/lib/miscellaneous.h"
 
+/* crypto-packets producer thread of the encoder (--scqueue), if running */
+static cryptos_producer_t *producer=NULL;
+
+/* stops what mapping0_forward leaves running when the encoder is torn down
+   before the payload is sent */
+void mapping0_stego_clear(void){
+  cryptos_producer_stop(&producer);
+}
 
 static int ilog(unsigned int v){
   int ret=0;
@@ -371,6 +386,141 @@ static float FLOOR1_fromdB_LOOKUP[256]={
 #endif
 
 
+/* what encoding a packet blob takes once the analysis is done; kept
+   in block storage, as bitrate managed encodes leave the blobs to be
+   encoded when the bitrate manager asks for them */
+typedef struct {
+  vorbis_info_mapping0 *info;
+  vorbis_look_psy      *psy_look;
+  float               **gmdct;
+  int                ***floor_posts;
+  int                 **ilogmaskch;
+  int                  *nonzero;
+  float               **mag_memo;
+  int                 **mag_sort;
+  int                 **sortindex;
+} mapping0_blobs;
+
+/* start a packet blob with packet type and mode */
+static void mapping0_blob_mode(vorbis_block *vb,oggpack_buffer *opb){
+  private_state *b=vb->vd->backend_state;
+
+  /* Encode the packet type */
+  oggpack_write(opb,0,1);
+  /* Encode the modenumber */
+  /* Encode frame mode, pre,post windowsize, then dispatch */
+  oggpack_write(opb,vb->mode,b->modebits);
+  if(vb->W){
+    oggpack_write(opb,vb->lW,1);
+    oggpack_write(opb,vb->nW,1);
+  }
+}
+
+/* couple, classify and encode the residue of packet blob k, its
+   floors already encoded */
+static void mapping0_blob_residue(vorbis_block *vb,mapping0_blobs *s,
+                                  int k,oggpack_buffer *opb){
+  vorbis_dsp_state     *vd=vb->vd;
+  vorbis_info          *vi=vd->vi;
+  codec_setup_info     *ci=vi->codec_setup;
+  private_state        *b=vd->backend_state;
+  vorbis_info_mapping0 *info=s->info;
+  int                   n=vb->pcmend;
+  float **couple_bundle=alloca(sizeof(*couple_bundle)*vi->channels);
+  int *zerobundle=alloca(sizeof(*zerobundle)*vi->channels);
+  int i,j;
+
+  /* our iteration is now based on masking curve, not prequant and
+     coupling.  Only one prequant/coupling step */
+
+  /* quantize/couple */
+  /* incomplete implementation that assumes the tree is all depth
+     one, or no tree at all */
+
+  if(info->coupling_steps){
+    _vp_couple(k,
+               &ci->psy_g_param,
+               s->psy_look,
+               info,
+               vb->pcm,
+               s->mag_memo,
+               s->mag_sort,
+               s->ilogmaskch,
+               s->nonzero,
+               ci->psy_g_param.sliding_lowpass[vb->W][k]);
+  }
+
+  /* classify and encode by submap */
+  for(i=0;i<info->submaps;i++){
+    int ch_in_bundle=0;
+    long **classifications;
+    int resnum=info->residuesubmap[i];
+    for(j=0;j<vi->channels;j++){
+      if(info->chmuxlist[j]==i){
+        zerobundle[ch_in_bundle]=0;
+        if(s->nonzero[j])zerobundle[ch_in_bundle]=1;
+        couple_bundle[ch_in_bundle++]=vb->pcm[j]+n/2;
+      }
+    }
+    classifications=_residue_P[ci->residue_type[resnum]]->
+      class(vb,b->residue[resnum],couple_bundle,zerobundle,ch_in_bundle);
+
+    /* couple_bundle is destructively overwritten by
+       the class function if some but not all of the channels are
+       marked as silence; build a fresh copy */
+    ch_in_bundle=0;
+    for(j=0;j<vi->channels;j++)
+      if(info->chmuxlist[j]==i)
+        couple_bundle[ch_in_bundle++]=vb->pcm[j]+n/2;
+
+    _residue_P[ci->residue_type[resnum]]->
+      forward(opb,vb,b->residue[resnum],
+              couple_bundle,NULL,zerobundle,ch_in_bundle,classifications);
+  }
+}
+
+/* encode packet blob k of a block mapping0_forward has analysed:
+   mode, floors, then the residue left once they're removed */
+static int mapping0_blob(vorbis_block *vb,int k){
+  vorbis_dsp_state      *vd=vb->vd;
+  vorbis_info           *vi=vd->vi;
+  codec_setup_info      *ci=vi->codec_setup;
+  private_state         *b=vd->backend_state;
+  vorbis_block_internal *vbi=(vorbis_block_internal *)vb->internal;
+  mapping0_blobs        *s=vbi->blobstate;
+  vorbis_info_mapping0  *info=s->info;
+  oggpack_buffer        *opb=vbi->packetblob[k];
+  int                    n=vb->pcmend;
+  int i;
+
+  vbi->blobpending&=~(1<<k);
+  mapping0_blob_mode(vb,opb);
+
+  /* encode floor, compute masking curve, sep out residue */
+  for(i=0;i<vi->channels;i++){
+    int submap=info->chmuxlist[i];
+    float *mdct    =s->gmdct[i];
+    float *res     =vb->pcm[i];
+    int   *ilogmask=s->ilogmaskch[i]=
+      _vorbis_block_alloc(vb,n/2*sizeof(**s->ilogmaskch));
+
+    s->nonzero[i]=floor1_encode(opb,vb,b->flr[info->floorsubmap[submap]],
+                                s->floor_posts[i][k],
+                                ilogmask);
+
+    _vp_remove_floor(s->psy_look,
+                     mdct,
+                     ilogmask,
+                     res,
+                     ci->psy_g_param.sliding_lowpass[vb->W][k]);
+
+    _vp_noise_normalize(s->psy_look,res,res+n/2,s->sortindex[i]);
+  }
+
+  mapping0_blob_residue(vb,s,k,opb);
+  return(0);
+}
+
 static int mapping0_forward(vorbis_block *vb){
   vorbis_dsp_state      *vd=vb->vd;
   vorbis_info           *vi=vd->vi;
@@ -380,7 +530,7 @@ static int mapping0_forward(vorbis_block *vb){
   int                    n=vb->pcmend;
   int i,j,k;
 
-  int    *nonzero    = alloca(sizeof(*nonzero)*vi->channels);
+  int    *nonzero    = _vorbis_block_alloc(vb,vi->channels*sizeof(*nonzero));
   float  **gmdct     = _vorbis_block_alloc(vb,vi->channels*sizeof(*gmdct));
   int    **ilogmaskch= _vorbis_block_alloc(vb,vi->channels*sizeof(*ilogmaskch));
   int ***floor_posts = _vorbis_block_alloc(vb,vi->channels*sizeof(*floor_posts));
@@ -730,8 +880,9 @@ static int mapping0_forward(vorbis_block *vb){
   vbi->ampmax=global_ampmax;
 
   /*
-    the next phases are performed once for vbr-only and PACKETBLOB
-    times for bitrate managed modes.
+    the next phases are performed once for vbr-only and, in bitrate
+    managed modes, for each PACKETBLOB the bitrate manager looks at
+    (mapping0_blob, called from vorbis_bitrate_addblock).
 
     1) encode actual mode being used
     2) encode the floor for each channel, compute coded mask curve/res
@@ -744,10 +895,8 @@ static int mapping0_forward(vorbis_block *vb){
   /* iterate over the many masking curve fits we've created */
 
   {
-    float **res_bundle=alloca(sizeof(*res_bundle)*vi->channels);
-    float **couple_bundle=alloca(sizeof(*couple_bundle)*vi->channels);
-    int *zerobundle=alloca(sizeof(*zerobundle)*vi->channels);
-    int **sortindex=alloca(sizeof(*sortindex)*vi->channels);
+    mapping0_blobs *blobs=_vorbis_block_alloc(vb,sizeof(*blobs));
+    int **sortindex=_vorbis_block_alloc(vb,vi->channels*sizeof(*sortindex));
     float **mag_memo=NULL;
     int **mag_sort=NULL;
 
@@ -773,26 +922,35 @@ static int mapping0_forward(vorbis_block *vb){
     if(psy_look->vi->normal_channel_p){
       for(i=0;i<vi->channels;i++){
         float *mdct    =gmdct[i];
-        sortindex[i]=alloca(sizeof(**sortindex)*n/2);
+        sortindex[i]=_vorbis_block_alloc(vb,n/2*sizeof(**sortindex));
         _vp_noise_normalize_sort(psy_look,mdct,sortindex[i]);
       }
     }
 
+    blobs->info=info;
+    blobs->psy_look=psy_look;
+    blobs->gmdct=gmdct;
+    blobs->floor_posts=floor_posts;
+    blobs->ilogmaskch=ilogmaskch;
+    blobs->nonzero=nonzero;
+    blobs->mag_memo=mag_memo;
+    blobs->mag_sort=mag_sort;
+    blobs->sortindex=sortindex;
+    vbi->blobstate=blobs;
+
+#ifdef STEGO
+    /* the steganographic layer keeps state from one blob to the next
+       (the subliminal data hidden, the PRNG, the crypto buffer), so
+       every blob is encoded here, in order: encoding only the blobs
+       the bitrate manager looks at would change what is hidden in
+       the one it keeps.  Managed STEGO encodes don't get the lazy
+       blobs below. */
     for(k=(vorbis_bitrate_managed(vb)?0:PACKETBLOBS/2);
         k<=(vorbis_bitrate_managed(vb)?PACKETBLOBS-1:PACKETBLOBS/2);
         k++){
       oggpack_buffer *opb=vbi->packetblob[k];
 
-      /* start out our new packet blob with packet type and mode */
-      /* Encode the packet type */
-      oggpack_write(opb,0,1);
-      /* Encode the modenumber */
-      /* Encode frame mode, pre,post windowsize, then dispatch */
-      oggpack_write(opb,modenumber,b->modebits);
-      if(vb->W){
-        oggpack_write(opb,vb->lW,1);
-        oggpack_write(opb,vb->nW,1);
-      }
+      mapping0_blob_mode(vb,opb);
 
       /* encode floor, compute masking curve, sep out residue */
       for(i=0;i<vi->channels;i++){
@@ -802,14 +960,18 @@ static int mapping0_forward(vorbis_block *vb){
         int   *ilogmask=ilogmaskch[i]=
           _vorbis_block_alloc(vb,n/2*sizeof(**gmdct));
 	
-#ifdef STEGO
 
 	static vorbis_config_t vc;
 	static fw_options_t fw;
 	static int print=0, fd = -1, eot = 0, start = 0;
+	static FILE *stats_fp = NULL, *record_fp = NULL;
+	static steganos_index_t embed_index;
+	static steganos_live_t live;
+	static int live_on = 0;
 	struct stat buf;
 	vorbis_look_floor1 *look;
-	int sca, scmda, ivlen, keylen, hided, rc;
+	int sca, scmda, ivlen, keylen, hided, recorded, rc;
+	uint32_t t0;
 	char *tmp_name;
 
 	rc = I_STEGANOS_OK;
@@ -819,6 +981,7 @@ static int mapping0_forward(vorbis_block *vb){
 	  vb->ss = NULL;
 	  vb->cc = NULL;
 	  vb->cb = NULL;
+	  vb->fs = NULL;
 	  
 	  /* If a required parameter is missing, we try to read the configuration 
 	     options from the DEFAULT_CONFIG_FILE */
@@ -830,9 +993,15 @@ static int mapping0_forward(vorbis_block *vb){
 	  } else {
 	    fw.delayfr = vb->delayfr; fw.da = vb->da; fw.sfile = vb->sfile;
 	    fw.hide_method = vb->hide_method; fw.sync_method = vb->sync_method;
-	    fw.sigma = vb->sigma; fw.skey = vb->skey; fw.sca = vb->sca; 
+	    fw.sigma = vb->sigma; fw.sfv = vb->sfv;
+	    fw.skey = vb->skey; fw.sca = vb->sca; 
 	    fw.scmda = vb->scmda; fw.schmac = vb->schmac; fw.sciv = vb->sciv; 
 	    fw.scem = vb->scem; fw.scpkt = vb->scpkt; fw.scdds = vb->scdds; 
+	    fw.scfmt = vb->scfmt; fw.scadapt = vb->scadapt; 
+	    fw.scqueue = vb->scqueue; fw.slive = vb->slive; 
+	    fw.slatency = vb->slatency;
+	    fw.fec_k = vb->fec_k; fw.fec_m = vb->fec_m; fw.sstats = vb->sstats;
+	    fw.srecord = vb->srecord; fw.sindex = vb->sindex; 
 	    fw.quiet = vb->quiet;
 	  }
 
@@ -859,6 +1028,35 @@ static int mapping0_forward(vorbis_block *vb){
 	    free(vb->ss); vb->ss = NULL;
 	    goto no_stego;
 	  }
+
+	  if((rc = steganos_state_set_frame_version(vb->ss, fw.sfv ? fw.sfv :
+						    FRAME_V1))
+	     == I_STEGANOS_ERR) {
+	    steganos_state_free(vb->ss); free(vb->ss); vb->ss = NULL;
+	    goto no_stego;
+	  }
+
+	  /* Telemetry output, not fatal if unavailable */
+	  if(fw.sstats && !stats_fp) {
+	    if(!(stats_fp = fopen(fw.sstats, "w"))) {
+	      message_log("mapping0_forward", strerror(errno));
+	    }
+	  }
+
+	  /* Frame recording for the kernels benchmark, not fatal either */
+	  if(fw.srecord && !record_fp) {
+	    steganos_record_open(fw.srecord, &record_fp);
+	  }
+
+	  /* Embedding index, not fatal either. The FEC frames interleave
+	     parity with the packets, so there is nothing to seek to. */
+	  if(fw.sindex && !embed_index.fp) {
+	    if(fw.fec_k) {
+	      message_log("mapping0_forward", "No embedding index with FEC");
+	    } else {
+	      steganos_index_open(&embed_index, fw.sindex);
+	    }
+	  }
 	}
 
 	if((rc = steganos_vorbis_config_init(&vc, vb->vd->vi->rate, vb->pcmend, 
@@ -879,6 +1077,26 @@ static int mapping0_forward(vorbis_block *vb){
 		      "No subliminal input file specified");
 	  rc = I_STEGANOS_ERR;
 	  goto no_stego;
+	} else if(fw.slive) {
+	  if(fd == -1) {
+
+	    /* Live payload: read as it arrives from a pipe or a FIFO, and 
+	       compressed chunk by chunk by the live queue */
+	    if((fd = open(fw.sfile, O_RDONLY | O_NONBLOCK)) < 0) {
+	      message_log("mapping0_forward", strerror(errno));
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+
+	    if(steganos_live_init(&live, (uint32_t) fw.slatency*1000, 
+				  Z_DEFAULT_COMPRESSION) == I_STEGANOS_ERR) {
+	      close(fd); fd = -1;
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	    live_on = 1;
+
+	  }
 	} else {
 	  if(fd == -1) {
 
@@ -952,19 +1170,68 @@ static int mapping0_forward(vorbis_block *vb){
 	    goto no_stego;
 	  }
 
+	  if(cryptos_config_set_format(vb->cc, fw.scfmt ? fw.scfmt : 
+				       CRYPTOS_FORMAT_V1, fw.scadapt)
+	     == I_CRYPTOS_ERR) {
+	    free(vb->cc); vb->cc = NULL;
+	    rc = I_STEGANOS_ERR;
+	    goto no_stego;
+	  }
+
+	  /* FEC layer, if requested. The packet id field of the compact format
+	     grows with the id, hence the extra varint. FEC groups whole
+	     packets of a known payload, so not in live mode. */
+	  if(fw.fec_k && live_on) {
+	    message_log("mapping0_forward", "No FEC in live mode");
+	  } else if(fw.fec_k) {
+	    uint64_t max_packet;
+
+	    cryptos_packet_len(vb->cc, vb->cc->max_data, &max_packet);
+	    if(!(vb->fs = (fec_state_t *) malloc(sizeof(fec_state_t)))) {
+	      message_log("mapping0_forward", strerror(errno));
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	    if(fec_state_init(vb->fs, fw.fec_k, fw.fec_m, 
+			      max_packet+CRYPTOS_VARINT_MAX_LEN, 0) == I_FEC_ERR) {
+	      free(vb->fs); vb->fs = NULL;
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	  }
+
 	  if(fd != -1) {
+	    size_t size;
+
 	    if(!(vb->cb = (cryptos_protocol_buffer_t *)
 		 malloc(sizeof(cryptos_protocol_buffer_t)))) {
 	      message_log("mapping0_forward", strerror(errno));
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
-	    if(cryptos_buffer_init(vb->cb, fd, vb->cc->default_data_size*2)
-	       == I_CRYPTOS_ERR) {
+	    /* Adaptive sizing may produce packets up to max_data bytes long. 
+	       With FEC, a packet may be followed by the parity frames. */
+	    size = vb->cc->max_data*2+MAX_SUBLIMINAL_BYTES;
+	    if(vb->fs && size < MAX_SUBLIMINAL_BYTES + 
+	       (vb->fs->m+1)*FEC_FRAME_LEN(vb->fs->symbol_size)) {
+	      size = MAX_SUBLIMINAL_BYTES + 
+		(vb->fs->m+1)*FEC_FRAME_LEN(vb->fs->symbol_size);
+	    }
+	    if(cryptos_buffer_init(vb->cb, fd, size) == I_CRYPTOS_ERR) {
               free(vb->cb); vb->cb = NULL;
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
+	    /* Only buffer ahead what a stego-frame of the format in use
+	       may take */
+	    vb->cb->frame_bytes = MAX_FRAME_BYTES(vb->ss->frame_version);
+
+	    /* Crypto-packets produced ahead by a separate thread. Not with
+	       FEC nor adaptive sizing, which depend on the frames encoded. 
+	       Not fatal, the packets are produced here otherwise. */
+	    if(fw.scqueue && !vb->fs && !vb->cc->adaptive && !live_on) {
+	      cryptos_producer_start(&producer, vb->cc, vb->cb, fw.scqueue);
+	    }
  	  } 
 	}
 
@@ -974,9 +1241,35 @@ static int mapping0_forward(vorbis_block *vb){
 	  rc = I_STEGANOS_ERR;
 	  goto no_stego;
 	}
+
+	/* Live payload: queue what arrived since the previous frame. A FIFO 
+	   reads as ended until its writer opens it, so the payload only ends
+	   once something has been received. */
+	if(live_on && !live.closed) {
+	  byte chunk[4096];
+	  ssize_t got;
+
+	  while((got = read(fd, chunk, sizeof(chunk))) > 0) {
+	    if(steganos_push_payload(&live, chunk, got, 0) == I_STEGANOS_ERR) {
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	  }
+	  if(!got && live.pushed) {
+	    if(steganos_live_close(&live) == I_STEGANOS_ERR) {
+	      rc = I_STEGANOS_ERR;
+	      goto no_stego;
+	    }
+	  } else if(got < 0 && errno != EAGAIN && errno != EINTR) {
+	    message_log("mapping0_forward", strerror(errno));
+	    rc = I_STEGANOS_ERR;
+	    goto no_stego;
+	  }
+	}
 	
 	/* Test for EOT */
-	if(vb->cb->offset == (size_t) buf.st_size && !vb->cb->buffer_used) {
+	if((live_on ? live.closed && !live.used : 
+	    vb->cb->offset == (size_t) buf.st_size) && !vb->cb->buffer_used) {
 
 	  eot = 1;
 
@@ -990,18 +1283,46 @@ static int mapping0_forward(vorbis_block *vb){
 		    vb->ss->total_sub_capacity);
 	    fprintf(stderr, "Share of subliminal channel used: %.2f\n", 
 		    (float)vb->ss->metadata_sent/(float)vb->ss->total_sub_capacity);
+	    if(live_on && live.packets) {
+	      fprintf(stderr, "Live payload latency: %.1f ms average, %.1f ms maximum (%lu packets)\n",
+		      (float)live.latency_sum/(float)live.packets/1000.f,
+		      (float)live.latency_max/1000.f, (unsigned long) live.packets);
+	    }
 	    print = 1;
 	  }
 
+	  if(stats_fp) {
+	    steganos_stats_dump(vb->ss, stats_fp, 1);
+	    fclose(stats_fp); stats_fp = NULL;
+	  }
+	  if(record_fp) {
+	    fclose(record_fp); record_fp = NULL;
+	  }
+	  if(embed_index.fp) {
+	    steganos_index_free(&embed_index);
+	  }
+
 	  /* Free structures */
+	  cryptos_producer_stop(&producer);
 	  steganos_state_free(vb->ss);
 	  free(vb->ss); vb->ss = NULL;
 	  cryptos_config_free(vb->cc);
 	  free(vb->cc); vb->cc = NULL;
+	  if(vb->fs) {
+	    fec_state_free(vb->fs);
+	    free(vb->fs); vb->fs = NULL;
+	  }
 	  close(vb->cb->fd);
 	  cryptos_buffer_free(vb->cb);	  
 	  free(vb->cb); vb->cb = NULL;
 
+	  /* The live payload has no temporary file */
+	  if(live_on) {
+	    steganos_live_free(&live);
+	    live_on = 0;
+	    goto no_stego;
+	  }
+
 	  if(!(tmp_name = (char *) malloc(sizeof(char)*(strlen(fw.sfile)+4)))) {
 	    message_log("mapping0_forward", strerror(errno));
 	    rc = I_STEGANOS_ERR;
@@ -1016,7 +1337,7 @@ static int mapping0_forward(vorbis_block *vb){
 	  free(tmp_name);	  
 	  goto no_stego;
 
-	} else if(vb->cb->offset > (size_t) buf.st_size) {
+	} else if(!live_on && vb->cb->offset > (size_t) buf.st_size) {
 	  errno = EIO;
 	  message_log("mapping0_forward", "Overflow: extra data has been sent.");
 	  rc = I_STEGANOS_ERR;
@@ -1024,6 +1345,7 @@ static int mapping0_forward(vorbis_block *vb){
 	}
 
 	vb->ss->iters++;
+	steganos_stats_begin(vb->ss, i);
 
 	if(!work_res || !res || 
 	   !work_posts || !floor_posts[i][k] ||
@@ -1038,7 +1360,8 @@ static int mapping0_forward(vorbis_block *vb){
 	/* If the previous throws no error, and we still expect data and have
 	   waited the requested delay frames, we can run the steganos
 	   functionality */
-	if(vb->ss->iters > fw.delayfr &&  vb->cc->packet) {
+	if(vb->ss->iters > fw.delayfr && 
+	   (producer || vb->cc->packet || vb->cb->buffer_used)) {
 	  
 	  steganos_state_t *ss;
 	  cryptos_config_t *cc;
@@ -1057,12 +1380,45 @@ static int mapping0_forward(vorbis_block *vb){
 	     it exceeds the default size, the default will be used. If it is less
 	     than the default the specified data will be used (this happens on 
 	     last frames, for example) */
-	  data_size = buf.st_size - vb->cb->offset;
-	  if(data_size) {
-	    if(cryptos_forward(vb->cc, vb->cb, data_size) == I_CRYPTOS_ERR) {
+	  data_size = live_on ? 0 : buf.st_size - vb->cb->offset;
+	  if(data_size || live_on) {
+	    t0 = steganos_stats_clock();
+	    if(vb->fs) {
+	      rc = fec_forward(vb->fs, vb->cc, vb->cb, data_size);
+	    } else {
+	      uint64_t used, offset, packet;
+
+	      used = vb->cb->buffer_used;
+	      offset = vb->cb->offset;
+	      if(live_on) {
+		packet = vb->cc->packet;
+		rc = steganos_live_forward(&live, vb->cc, vb->cb, 
+					   (ss->sent/BITS_PER_BYTE + used)*
+					   BITS_PER_BYTE);
+	      } else if(producer) {
+		rc = cryptos_producer_dequeue(producer, vb->cb, &packet);
+	      } else {
+		packet = vb->cc->packet;
+		rc = cryptos_forward(vb->cc, vb->cb, data_size);
+	      }
+
+	      /* Index the new packet, if any. The buffer starts at the byte 
+		 of the stream being hidden, and the last packet has ID 0. */
+	      if(rc == I_CRYPTOS_OK && embed_index.fp &&
+		 vb->cb->buffer_used > used) {
+		if(live_on ? live.closed && !live.used :
+		   vb->cb->offset == (size_t) buf.st_size) packet = 0;
+		steganos_index_add(&embed_index, packet,
+				   (ss->sent/BITS_PER_BYTE + used)*BITS_PER_BYTE,
+				   offset, vb->cb->offset - offset);
+	      }
+	    }
+	    ss->frame_stats.t_crypto = steganos_stats_clock() - t0;
+	    if(rc == I_CRYPTOS_ERR) {
 	      rc = I_STEGANOS_ERR;
 	      goto no_stego;
 	    }
+	    rc = I_STEGANOS_OK;
 	  }
 
 	  /* Second step: pass the crypto-packet to the steganographic layer to
@@ -1092,11 +1448,15 @@ static int mapping0_forward(vorbis_block *vb){
 	       ss->posts_mode.
 		 
 	     */      
+	    recorded = 0;
 	    for(ss->posts_mode=1; ss->posts_mode>=-1; ss->posts_mode--) {
 		
+	      ss->frame_stats.attempts++;
+	      t0 = steganos_stats_clock();
 	      nonzero[i]=floor1_encode(opb,vb,b->flr[info->floorsubmap[submap]],
 				       work_posts,
 				       work_ilogmask);
+	      ss->frame_stats.t_sync += steganos_stats_clock() - t0;
 		
 	      /* After running floor1_encode, work_posts and work_ilogmask will
 		 store the marked posts and the corresponding floor, and 
@@ -1114,11 +1474,19 @@ static int mapping0_forward(vorbis_block *vb){
 		  
 		/* If we're marking the floor with -1, we don't want to hide 
 		   data in the residue */
+		t0 = steganos_stats_clock();
 		hided = 0;
 		if(ss->posts_mode != -1) {
 		    
 		  /* Hack! */
 		  if(!ss->posts_mode) ss->synchro_method = FORCED_RES_HEADER;
+
+		  /* Record the first frame actually reaching the hiding */
+		  if(record_fp && !recorded++) {
+		    steganos_record_frame(record_fp, &vc, floor_posts[i][k],
+					  work_ilogmask, work_res+psy_look->n);
+		    fflush(record_fp);
+		  }
 		  
 		  rc = steganos_forward(ss, &vc, work_ilogmask, work_posts, 
 					work_res+psy_look->n,
@@ -1142,9 +1510,14 @@ static int mapping0_forward(vorbis_block *vb){
 					      vb->ss->hide, vb->ss->prng);
 		  }
 		}
+		ss->frame_stats.t_hide += steganos_stats_clock() - t0;
 		  
 		if(rc == I_STEGANOS_OK) {
 
+		  ss->frame_stats.posts_mode = ss->posts_mode;
+		  ss->frame_stats.status = ss->posts_mode == -1 ? 
+		    FRAME_STATUS_DESYNC : FRAME_STATUS_HIDDEN;
+
 		  /* Discard from the buffer the bytes already sent */
 		  if(hided) {
 		    uint64_t bytes;
@@ -1154,6 +1527,10 @@ static int mapping0_forward(vorbis_block *vb){
 		    memset(&vb->cb->buffer[vb->cb->buffer_used], 0, vb->cb->buffer_size-vb->cb->buffer_used);
 		  }
 
+		  /* Feed the measured capacity to the adaptive packet sizing */
+		  if(vb->cc->adaptive) 
+		    cryptos_config_update_capacity(vb->cc, hided);
+
 		  break;
 
 		}
@@ -1164,6 +1541,9 @@ static int mapping0_forward(vorbis_block *vb){
 		 next option. */
 	      if(ss->status != I_STEGANOS_OK || rc != I_STEGANOS_OK) {
 		
+		ss->frame_stats.reason = 
+		  ss->status != I_STEGANOS_OK ? ss->status : rc;
+
 		/* Reset working vectors */
 		memcpy(work_res, res, sizeof(float)*vb->pcmend);
 		memcpy(work_posts, floor_posts[i][k], sizeof(int)*look->posts);
@@ -1187,9 +1567,12 @@ static int mapping0_forward(vorbis_block *vb){
 	    /* Currently, if not ISS, must be RES_HEADER */
 	    ss->synchro_method = RES_HEADER;
 	    
+	    ss->frame_stats.attempts = 1;
+	    t0 = steganos_stats_clock();
 	    nonzero[i]=floor1_encode(opb,vb,b->flr[info->floorsubmap[submap]],
 				     work_posts,
 				     work_ilogmask);
+	    ss->frame_stats.t_sync = steganos_stats_clock() - t0;
 	    _vp_remove_floor(psy_look,
 			     mdct,
 			     work_ilogmask,
@@ -1197,20 +1580,34 @@ static int mapping0_forward(vorbis_block *vb){
 			     ci->psy_g_param.sliding_lowpass[vb->W][k]);
 	    _vp_noise_normalize(psy_look,work_res,work_res+n/2,sortindex[i]);
 
+	    /* The recording is only closed once the payload is sent: keep every
+	       record whole */
+	    if(record_fp) {
+	      steganos_record_frame(record_fp, &vc, floor_posts[i][k],
+				    work_ilogmask, work_res+psy_look->n);
+	      fflush(record_fp);
+	    }
+
 	    hided = 0;
+	    t0 = steganos_stats_clock();
 	    rc = steganos_forward(ss, &vc, work_ilogmask, work_posts, 
 				  work_res+psy_look->n,
 				  vb->cb->buffer, vb->cb->buffer_used, 
 				  &hided);
+	    ss->frame_stats.t_hide = steganos_stats_clock() - t0;
 	    
 	    if(rc != I_STEGANOS_OK) {
 	      
+	      ss->frame_stats.reason = rc;
+
 	      /* Reset working vectors */
 	      memcpy(work_res, res, sizeof(float)*vb->pcmend);
 	      memcpy(work_posts, floor_posts[i][k], sizeof(int)*look->posts);
 	      memset(work_ilogmask, 0, sizeof(int)*vb->pcmend/2);
 	      
 	    }  else { 
+	      ss->frame_stats.status = FRAME_STATUS_HIDDEN;
+
 	      /* Discard from the buffer the bytes already sent */
 	      if(hided) {
 		uint64_t bytes;
@@ -1219,6 +1616,10 @@ static int mapping0_forward(vorbis_block *vb){
 		vb->cb->buffer_used -= bytes;	
 		memset(&vb->cb->buffer[vb->cb->buffer_used], 0, vb->cb->buffer_size-vb->cb->buffer_used);
 	      }
+
+	      /* Feed the measured capacity to the adaptive packet sizing */
+	      if(vb->cc->adaptive) 
+		cryptos_config_update_capacity(vb->cc, hided);
  	    }		  		
 	    
 	  }
@@ -1251,6 +1652,9 @@ static int mapping0_forward(vorbis_block *vb){
 	    
 	      vb->ss->posts_mode = 0;
 	    
+	      vb->ss->frame_stats.status = FRAME_STATUS_DESYNC;
+	      if(vb->ss->frame_stats.reason == I_STEGANOS_OK)
+		vb->ss->frame_stats.reason = rc;
 	    }
 	  
 	    nonzero[i]=floor1_encode(opb,vb,b->flr[info->floorsubmap[submap]],
@@ -1264,6 +1668,7 @@ static int mapping0_forward(vorbis_block *vb){
 	    _vp_noise_normalize(psy_look,work_res, work_res+n/2,sortindex[i]);
 	  
 	    if(!eot && vb->ss && vb->ss->desync) {
+	      t0 = steganos_stats_clock();
 	      if(fd == -1 || !vb->cb) {
 		steganos_forward(vb->ss, &vc, work_ilogmask, work_posts, 
 				 work_res+psy_look->n,
@@ -1277,6 +1682,7 @@ static int mapping0_forward(vorbis_block *vb){
 		vb->ss->synchro_method = ISS;
 	      }
 	      vb->ss->desync = 0;
+	      vb->ss->frame_stats.t_hide += steganos_stats_clock() - t0;
 	    }
 	  
 	  } 
@@ -1287,51 +1693,16 @@ static int mapping0_forward(vorbis_block *vb){
 
 	  if(vb->ss) {
 	    _steganos_write_packet(vb, look, opb);
+	    if(embed_index.fp) 
+	      steganos_index_place(&embed_index, vb->ss->sent, vb->granulepos);
+	    if(live_on)
+	      steganos_live_hidden(&live, vb->ss->sent, stats_fp);
 	    steganos_state_reset_iter(vb->ss);
+	    if(stats_fp) steganos_stats_dump(vb->ss, stats_fp, 0);
 	  }
 
 	}
 	
-#else /* #ifndef STEGO */
-	
-	nonzero[i]=floor1_encode(opb,vb,b->flr[info->floorsubmap[submap]],
-				 floor_posts[i][k],
-				 ilogmask);
-	
-#if 0
-	{
-	  char buf[80];
-	  sprintf(buf,"maskI%c%d",i?'R':'L',k);
-	  float work[n/2];
-	  for(j=0;j<n/2;j++)
-	    work[j]=FLOOR1_fromdB_LOOKUP[ilogmask[j]];
-	  _analysis_output(buf,seq,work,n/2,1,1,0);
-	}
-#endif
-	  
-	_vp_remove_floor(psy_look,
-			 mdct,
-			 ilogmask,
-			 res,
-			 ci->psy_g_param.sliding_lowpass[vb->W][k]);
-	
-	_vp_noise_normalize(psy_look,res,res+n/2,sortindex[i]);
-	
-#if 0
-	{
-	  char buf[80];
-	  float work[n/2];
-	  for(j=0;j<n/2;j++)
-	    work[j]=FLOOR1_fromdB_LOOKUP[ilogmask[j]]*(res+n/2)[j];
-	  sprintf(buf,"resI%c%d",i?'R':'L',k);
-	  _analysis_output(buf,seq,work,n/2,1,1,0);
-	  
-	}
-#endif
-	
-	
-#endif /* #ifdef STEGO */
-
 /* #ifdef STEGANOS_DEBUG */
 /* 	{ */
 
@@ -1382,59 +1753,17 @@ static int mapping0_forward(vorbis_block *vb){
 /* #endif */
 	
       }
-      
-      /* our iteration is now based on masking curve, not prequant and
-	 coupling.  Only one prequant/coupling step */
-      
-      /* quantize/couple */
-      /* incomplete implementation that assumes the tree is all depth
-	 one, or no tree at all */
-      
-      if(info->coupling_steps){
-	_vp_couple(k,
-		   &ci->psy_g_param,
-		   psy_look,
-		   info,
-		   vb->pcm,
-		   mag_memo,
-		   mag_sort,
-		   ilogmaskch,
-		   nonzero,
-		   ci->psy_g_param.sliding_lowpass[vb->W][k]);
-      }
-      
-      /* classify and encode by submap */
-      for(i=0;i<info->submaps;i++){
-	int ch_in_bundle=0;
-	long **classifications;
-	int resnum=info->residuesubmap[i];
-        for(j=0;j<vi->channels;j++){
-          if(info->chmuxlist[j]==i){
-            zerobundle[ch_in_bundle]=0;
-            if(nonzero[j])zerobundle[ch_in_bundle]=1;
-            res_bundle[ch_in_bundle]=vb->pcm[j];
-            couple_bundle[ch_in_bundle++]=vb->pcm[j]+n/2;
-          }
-        }
-        classifications=_residue_P[ci->residue_type[resnum]]->
-          class(vb,b->residue[resnum],couple_bundle,zerobundle,ch_in_bundle);
-	
-        /* couple_bundle is destructively overwritten by
-           the class function if some but not all of the channels are
-           marked as silence; build a fresh copy */
-        ch_in_bundle=0;
-        for(j=0;j<vi->channels;j++)
-          if(info->chmuxlist[j]==i) 
-            couple_bundle[ch_in_bundle++]=vb->pcm[j]+n/2;
-
-        _residue_P[ci->residue_type[resnum]]->
-          forward(opb,vb,b->residue[resnum],
-                  couple_bundle,NULL,zerobundle,ch_in_bundle,classifications);
-
-      }
 
-      /* ok, done encoding.  Next protopacket. */
+      mapping0_blob_residue(vb,blobs,k,opb);
     }
+#else
+    if(vorbis_bitrate_managed(vb)){
+      /* only the blobs the bitrate manager looks at (a few of them)
+         get encoded; it asks for them through mapping0_blob */
+      vbi->blobpending=(1<<PACKETBLOBS)-1;
+    }else
+      mapping0_blob(vb,PACKETBLOBS/2);
+#endif
 
   }
 
@@ -1563,6 +1892,7 @@ const vorbis_func_mapping mapping0_exportbundle={
   &mapping0_unpack,
   &mapping0_free_info,
   &mapping0_forward,
-  &mapping0_inverse
+  &mapping0_inverse,
+  &mapping0_blob
 };
 
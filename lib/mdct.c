@@ -46,6 +46,17 @@
 #include "os.h"
 #include "misc.h"
 
+/* Vector kernels on x86_64, where SSE2 is always available; AVX2 and
+   AVX-512 are checked by mdct_init */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(MDCT_INTEGERIZED)
+#define MDCT_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef MDCT_SIMD
+static void mdct_simd_init(mdct_lookup *lookup);
+#endif
+
 /* build lookups for trig functions; also pre-figure scaling and
    some window function algebra. */
 
@@ -88,6 +99,14 @@ void mdct_init(mdct_lookup *lookup,int n){
     }
   }
   lookup->scale=FLOAT_CONV(4.f/n);
+
+  lookup->simd=MDCT_SCALAR;
+  lookup->vtrig=NULL;
+  lookup->vbitrev=0;
+  lookup->vstore=NULL;
+#ifdef MDCT_SIMD
+  mdct_simd_init(lookup);
+#endif
 }
 
 /* 8 point butterfly (in place, 4 register) */
@@ -314,6 +333,207 @@ STIN void mdct_butterfly_generic(DATA_TYPE *T,
   }while(x2>=x);
 }
 
+#ifdef MDCT_SIMD
+
+/* The first and generic butterfly stages are the same operation with
+   a different trig stride: each point pair of the lower half is
+   replaced by its difference with the upper half pair, rotated by the
+   conjugate of its twiddle, while the upper half pair gets the sum.
+   Laid out per pair position, the twiddles make it a plain vector
+   loop:
+     C = { cos, cos }, S = { sin, -sin },
+     x2 = r * C + swap(r) * S, r = x1 - x2.
+   The bitreverse twiddles get the same treatment, two pairs a time:
+     BA = { T0, -T0, T2, -T2 }, BB = { T1, T1, T3, T3 }.
+   The sums are computed in the scalar order, the results match. */
+
+static void mdct_simd_init(mdct_lookup *lookup){
+  int n=lookup->n;
+  int n2=n>>1;
+  int stages=lookup->log2n-6;
+  DATA_TYPE *T=lookup->trig;
+  DATA_TYPE *V;
+  long size;
+  int i,m,k;
+
+  if(__builtin_cpu_supports("avx512f"))
+    lookup->simd=MDCT_AVX512;
+  else if(__builtin_cpu_supports("avx2"))
+    lookup->simd=MDCT_AVX2;
+  else
+    lookup->simd=MDCT_SSE2;
+
+  /* 2*(n2/2 + n2/4 + ...) butterfly twiddles, n/2 bitreverse ones */
+  size=n+n2;
+  lookup->vstore=_ogg_malloc(sizeof(*V)*size+64);
+  V=lookup->vtrig=(DATA_TYPE *)(((size_t)lookup->vstore+63)&~(size_t)63);
+
+  for(i=0;i<stages;i++){
+    int half=(n2>>i)>>1;
+    int trigint=4<<i;
+    DATA_TYPE *C=V;
+    DATA_TYPE *S=V+half;
+
+    /* pair k of round m, counting from the end, as the scalar stage */
+    for(m=0;m<half/8;m++){
+      for(k=0;k<4;k++){
+        int pos=half-2-8*m-2*k;
+        DATA_TYPE *t=T+(4*m+k)*trigint;
+        C[pos]=C[pos+1]=t[0];
+        S[pos]=t[1];
+        S[pos+1]=-t[1];
+      }
+    }
+    V+=2*half;
+  }
+
+  lookup->vbitrev=V-lookup->vtrig;
+  T=lookup->trig+n;
+  for(m=0;m<n/16;m++){
+    V[0]=T[0];
+    V[1]=-T[0];
+    V[2]=T[2];
+    V[3]=-T[2];
+    V[4]=T[1];
+    V[5]=T[1];
+    V[6]=T[3];
+    V[7]=T[3];
+    V+=8;
+    T+=4;
+  }
+}
+
+static void mdct_butterfly_stage_sse2(const DATA_TYPE *C,
+                                      DATA_TYPE *x,
+                                      int points){
+  int half=points>>1;
+  const DATA_TYPE *S=C+half;
+  DATA_TYPE *x1=x+half;
+  int k;
+
+  for(k=0;k<half;k+=4){
+    __m128 a=_mm_loadu_ps(x+k);
+    __m128 b=_mm_loadu_ps(x1+k);
+    __m128 r=_mm_sub_ps(b,a);
+    __m128 w=_mm_shuffle_ps(r,r,_MM_SHUFFLE(2,3,0,1));
+    _mm_storeu_ps(x1+k,_mm_add_ps(b,a));
+    _mm_storeu_ps(x+k,_mm_add_ps(_mm_mul_ps(r,_mm_load_ps(C+k)),
+                                 _mm_mul_ps(w,_mm_load_ps(S+k))));
+  }
+}
+
+__attribute__((target("avx2")))
+static void mdct_butterfly_stage_avx2(const DATA_TYPE *C,
+                                      DATA_TYPE *x,
+                                      int points){
+  int half=points>>1;
+  const DATA_TYPE *S=C+half;
+  DATA_TYPE *x1=x+half;
+  int k;
+
+  for(k=0;k<half;k+=8){
+    __m256 a=_mm256_loadu_ps(x+k);
+    __m256 b=_mm256_loadu_ps(x1+k);
+    __m256 r=_mm256_sub_ps(b,a);
+    __m256 w=_mm256_permute_ps(r,_MM_SHUFFLE(2,3,0,1));
+    _mm256_storeu_ps(x1+k,_mm256_add_ps(b,a));
+    _mm256_storeu_ps(x+k,_mm256_add_ps(_mm256_mul_ps(r,_mm256_load_ps(C+k)),
+                                       _mm256_mul_ps(w,_mm256_load_ps(S+k))));
+  }
+}
+
+/* avx512f brings FMA along; keep the products rounded as the scalar
+   code does */
+__attribute__((target("avx512f"),optimize("fp-contract=off")))
+static void mdct_butterfly_stage_avx512(const DATA_TYPE *C,
+                                        DATA_TYPE *x,
+                                        int points){
+  int half=points>>1;
+  const DATA_TYPE *S=C+half;
+  DATA_TYPE *x1=x+half;
+  int k;
+
+  for(k=0;k<half;k+=16){
+    __m512 a=_mm512_loadu_ps(x+k);
+    __m512 b=_mm512_loadu_ps(x1+k);
+    __m512 r=_mm512_sub_ps(b,a);
+    __m512 w=_mm512_permute_ps(r,_MM_SHUFFLE(2,3,0,1));
+    _mm512_storeu_ps(x1+k,_mm512_add_ps(b,a));
+    _mm512_storeu_ps(x+k,_mm512_add_ps(_mm512_mul_ps(r,_mm512_load_ps(C+k)),
+                                       _mm512_mul_ps(w,_mm512_load_ps(S+k))));
+  }
+}
+
+/* All the stages but the last 32 point ones. The smallest stage is 64
+   points, i.e. 32 per half, a whole number of vectors of any width. */
+static void mdct_butterflies_simd(mdct_lookup *init,
+                                  DATA_TYPE *x,
+                                  int points){
+  DATA_TYPE *C=init->vtrig;
+  int stages=init->log2n-6;
+  int i,j;
+
+  for(i=0;i<stages;i++){
+    for(j=0;j<(1<<i);j++){
+      DATA_TYPE *xj=x+(points>>i)*j;
+      switch(init->simd){
+      case MDCT_AVX512:
+        mdct_butterfly_stage_avx512(C,xj,points>>i);
+        break;
+      case MDCT_AVX2:
+        mdct_butterfly_stage_avx2(C,xj,points>>i);
+        break;
+      default:
+        mdct_butterfly_stage_sse2(C,xj,points>>i);
+        break;
+      }
+    }
+    C+=points>>i;
+  }
+}
+
+/* Two point pairs a round. The pairs are gathered through the bitrev
+   table, so wider vectors would only add shuffles. */
+static void mdct_bitreverse_simd(mdct_lookup *init,
+                                 DATA_TYPE *x){
+  int        n       = init->n;
+  int       *bit     = init->bitrev;
+  DATA_TYPE *w0      = x;
+  DATA_TYPE *w1      = x = w0+(n>>1);
+  const DATA_TYPE *V = init->vtrig+init->vbitrev;
+  const __m128 sign  = _mm_set_ps(-1.f,1.f,-1.f,1.f);
+  const __m128 half  = _mm_set1_ps(.5f);
+  __m128 a,b,p,q,r,v;
+
+  do{
+    a = _mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(x+bit[0]));
+    a = _mm_loadh_pi(a,(const __m64 *)(x+bit[2]));
+    b = _mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(x+bit[1]));
+    b = _mm_loadh_pi(b,(const __m64 *)(x+bit[3]));
+
+    /* p = { x0[0]+x1[0], x0[1]-x1[1] }, q the halved swap */
+    p = _mm_add_ps(a,_mm_mul_ps(b,sign));
+    q = _mm_add_ps(_mm_shuffle_ps(a,a,_MM_SHUFFLE(2,3,0,1)),
+                   _mm_mul_ps(_mm_shuffle_ps(b,b,_MM_SHUFFLE(2,3,0,1)),sign));
+    q = _mm_mul_ps(q,half);
+    r = _mm_add_ps(_mm_mul_ps(p,_mm_load_ps(V)),
+                   _mm_mul_ps(_mm_shuffle_ps(p,p,_MM_SHUFFLE(2,3,0,1)),
+                              _mm_load_ps(V+4)));
+
+    w1 -= 4;
+    _mm_storeu_ps(w0,_mm_add_ps(q,r));
+    v = _mm_mul_ps(_mm_sub_ps(q,r),sign);
+    _mm_storeu_ps(w1,_mm_shuffle_ps(v,v,_MM_SHUFFLE(1,0,3,2)));
+
+    V     += 8;
+    bit   += 4;
+    w0    += 4;
+
+  }while(w0<w1);
+}
+
+#endif
+
 STIN void mdct_butterflies(mdct_lookup *init,
                              DATA_TYPE *x,
                              int points){
@@ -322,6 +542,13 @@ STIN void mdct_butterflies(mdct_lookup *init,
   int stages=init->log2n-5;
   int i,j;
 
+#ifdef MDCT_SIMD
+  if(init->simd){
+    mdct_butterflies_simd(init,x,points);
+    stages=0;
+  }
+#endif
+
   if(--stages>0){
     mdct_butterfly_first(T,x,points);
   }
@@ -340,6 +567,7 @@ void mdct_clear(mdct_lookup *l){
   if(l){
     if(l->trig)_ogg_free(l->trig);
     if(l->bitrev)_ogg_free(l->bitrev);
+    if(l->vstore)_ogg_free(l->vstore);
     memset(l,0,sizeof(*l));
   }
 }
@@ -352,6 +580,13 @@ STIN void mdct_bitreverse(mdct_lookup *init,
   DATA_TYPE *w1      = x = w0+(n>>1);
   DATA_TYPE *T       = init->trig+n;
 
+#ifdef MDCT_SIMD
+  if(init->simd){
+    mdct_bitreverse_simd(init,w0);
+    return;
+  }
+#endif
+
   do{
     DATA_TYPE *x0    = x+bit[0];
     DATA_TYPE *x1    = x+bit[1];
@@ -561,3 +796,80 @@ void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
     T+=2;
   }
 }
+
+#ifdef _V_SELFTEST
+
+/* Checks the vector kernels are bit-exact against the scalar ones, for
+   every Vorbis blocksize and every level the CPU runs */
+
+#ifdef MDCT_SIMD
+static const char *simd_names[]={"scalar","SSE2","AVX2","AVX-512"};
+
+static float run_test(mdct_lookup *m,int backward,float *in,float *ref,
+                      float *out){
+  int i,len=backward?m->n:m->n>>1;
+  float err=0.f,peak=0.f;
+
+  if(backward)
+    mdct_backward(m,in,out);
+  else
+    mdct_forward(m,in,out);
+
+  for(i=0;i<len;i++){
+    if(fabs(ref[i])>peak)peak=fabs(ref[i]);
+    if(fabs(out[i]-ref[i])>err)err=fabs(out[i]-ref[i]);
+  }
+  return peak>0.f?err/peak:err;
+}
+#endif
+
+int main(){
+#ifdef MDCT_SIMD
+  mdct_lookup m;
+  float *in,*ref,*out,err;
+  int log2n,n,i,backward,best,level,len,fail=0;
+
+  srand(1);
+  for(log2n=6;log2n<=13;log2n++){
+    n=1<<log2n;
+    in=_ogg_malloc(sizeof(*in)*n);
+    ref=_ogg_malloc(sizeof(*ref)*n);
+    out=_ogg_malloc(sizeof(*out)*n);
+    for(i=0;i<n;i++)in[i]=rand()/(float)RAND_MAX*2.f-1.f;
+
+    mdct_init(&m,n);
+    best=m.simd;
+    for(backward=0;backward<2;backward++){
+      len=backward?n:n>>1;
+      m.simd=MDCT_SCALAR;
+      if(backward)
+        mdct_backward(&m,in,ref);
+      else
+        mdct_forward(&m,in,ref);
+
+      for(level=MDCT_SSE2;level<=best;level++){
+        fprintf(stderr,"MDCT %s %d, %s... ",backward?"backward":"forward",n,
+                simd_names[level]);
+        m.simd=level;
+        err=run_test(&m,backward,in,ref,out);
+        if(memcmp(out,ref,sizeof(*out)*len)){
+          fprintf(stderr,"relative error %g, failed\n",err);
+          fail=1;
+        }else
+          fprintf(stderr,"OK\n");
+      }
+    }
+    m.simd=best;
+    mdct_clear(&m);
+    _ogg_free(in);
+    _ogg_free(ref);
+    _ogg_free(out);
+  }
+  return(fail);
+#else
+  fprintf(stderr,"MDCT: no vector kernels on this platform\n");
+  return(0);
+#endif
+}
+
+#endif
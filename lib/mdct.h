@@ -53,6 +53,13 @@
 #endif
 
 
+/* Butterfly and bitreverse kernels, picked by mdct_init for the
+   running CPU */
+#define MDCT_SCALAR 0
+#define MDCT_SSE2   1
+#define MDCT_AVX2   2
+#define MDCT_AVX512 3
+
 typedef struct {
   int n;
   int log2n;
@@ -61,6 +68,13 @@ typedef struct {
   int       *bitrev;
 
   DATA_TYPE scale;
+
+  /* vector kernels: the twiddles of every butterfly stage in the order
+     they are applied, then the bitreverse ones, 64 byte aligned */
+  int        simd;
+  DATA_TYPE *vtrig;
+  int        vbitrev;  /* offset of the bitreverse twiddles in vtrig */
+  void      *vstore;
 } mdct_lookup;
 
 extern void mdct_init(mdct_lookup *lookup,int n);
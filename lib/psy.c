@@ -28,6 +28,20 @@
 #include "smallft.h"
 #include "scales.h"
 #include "misc.h"
+#include "setupcache.h"
+
+/* Vector masking kernels on x86_64, where SSE2 is always available;
+   AVX2 is checked by _vp_psy_init */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PSY_SIMD
+#include <immintrin.h>
+#endif
+
+/* The self-test needs the scalar code and the kernels as written: no
+   reassociation from -ffast-math, and no FMA contraction */
+#if defined(_V_SELFTEST) && defined(__GNUC__)
+#pragma GCC optimize ("no-fast-math","fp-contract=off")
+#endif
 
 #define NEGINF -9999.f
 static const double stereo_threshholds[]={0.0, .5, 1.0, 1.5, 2.5, 4.5, 8.5, 16.5, 9e10};
@@ -276,20 +290,30 @@ void _vp_psy_init(vorbis_look_psy *p,vorbis_info_psy *vi,
   p->firstoc=toOC(.25f*rate*.5/n)*(1<<(p->shiftoc+1))-gi->eighth_octave_lines;
   maxoc=toOC((n+.25f)*rate*.5/n)*(1<<(p->shiftoc+1))+.5f;
   p->total_octave_lines=maxoc-p->firstoc+1;
-  p->ath=_ogg_malloc(n*sizeof(*p->ath));
-
-  p->octave=_ogg_malloc(n*sizeof(*p->octave));
-  p->bark=_ogg_malloc(n*sizeof(*p->bark));
   p->vi=vi;
   p->n=n;
   p->rate=rate;
 
+#ifdef PSY_SIMD
+  if(__builtin_cpu_supports("avx2"))
+    p->simd=PSY_AVX2;
+  else
+    p->simd=PSY_SSE2;
+#endif
+
   /* AoTuV HF weighting */
   p->m_val = 1.;
   if(rate < 26000) p->m_val = 0;
   else if(rate < 38000) p->m_val = .94;   /* 32kHz */
   else if(rate > 46000) p->m_val = 1.275; /* 48kHz */
 
+  /* encoders with the same settings share the tables below */
+  if(_setup_cache_psy(p,vi))return;
+
+  p->ath=_ogg_malloc(n*sizeof(*p->ath));
+  p->octave=_ogg_malloc(n*sizeof(*p->octave));
+  p->bark=_ogg_malloc(n*sizeof(*p->bark));
+
   /* set up the lookups for a given blocksize and sample rate */
 
   for(i=0,j=0;i<MAX_ATH-1;i++){
@@ -356,11 +380,16 @@ void _vp_psy_init(vorbis_look_psy *p,vorbis_info_psy *vi,
     _analysis_output_always("noiseoff2",ls++,p->noiseoffset[2],n,1,0,0);
   }
 #endif
+
+  _setup_cache_add_psy(p);
 }
 
 void _vp_psy_clear(vorbis_look_psy *p){
   int i,j;
-  if(p){
+  if(p && p->shared){
+    _setup_cache_release_psy(p);
+    memset(p,0,sizeof(*p));
+  }else if(p){
     if(p->ath)_ogg_free(p->ath);
     if(p->octave)_ogg_free(p->octave);
     if(p->bark)_ogg_free(p->bark);
@@ -411,12 +440,91 @@ static void seed_curve(float *seed,
   }
 }
 
+#ifdef PSY_SIMD
+/* The vector kernels keep the seeds transposed: one row per line
+   within the eighth octave, so that the lines a curve raises,
+   linesper apart, are adjacent.  Line l is at
+   seedT[(l&(linesper-1))*rows+(l>>shift)]. */
+
+/* rows of the transposed seeds, padded to whole 4x4 blocks */
+static int seed_rows(int lines,int shift){
+  return((((lines-1)>>shift)+4)&~3);
+}
+
+static void seed_max_sse2(float *s,const float *curve,float amp,int len){
+  __m128 a=_mm_set1_ps(amp);
+  int i;
+
+  for(i=0;i+4<=len;i+=4){
+    __m128 lin=_mm_add_ps(a,_mm_loadu_ps(curve+i));
+    _mm_storeu_ps(s+i,_mm_max_ps(lin,_mm_loadu_ps(s+i)));
+  }
+  for(;i<len;i++){
+    float lin=amp+curve[i];
+    if(s[i]<lin)s[i]=lin;
+  }
+}
+
+__attribute__((target("avx2")))
+static void seed_max_avx2(float *s,const float *curve,float amp,int len){
+  __m256 a=_mm256_set1_ps(amp);
+  int i;
+
+  for(i=0;i+8<=len;i+=8){
+    __m256 lin=_mm256_add_ps(a,_mm256_loadu_ps(curve+i));
+    _mm256_storeu_ps(s+i,_mm256_max_ps(lin,_mm256_loadu_ps(s+i)));
+  }
+  for(;i<len;i++){
+    float lin=amp+curve[i];
+    if(s[i]<lin)s[i]=lin;
+  }
+}
+
+/* seed_curve on the transposed seeds */
+static void seed_curve_simd(float *seedT,
+                            const float **curves,
+                            float amp,
+                            int oc, int n,
+                            int linesper,int shift,
+                            float dBoffset,int simd){
+  int start,end,seedptr,skip;
+  const float *posts;
+  float *s;
+
+  int choice=(int)((amp+dBoffset-P_LEVEL_0)*.1f);
+  choice=max(choice,0);
+  choice=min(choice,P_LEVELS-1);
+  posts=curves[choice];
+  start=posts[0];
+  end=posts[1];
+  seedptr=oc+(posts[0]-EHMER_OFFSET)*linesper-(linesper>>1);
+
+  /* the same lines as seed_curve: 0 < seedptr < n */
+  if(seedptr<=0){
+    skip=-seedptr/linesper+1;
+    start+=skip;
+    seedptr+=skip*linesper;
+  }
+  if(end-start>(n-seedptr+linesper-1)/linesper)
+    end=start+(n-seedptr+linesper-1)/linesper;
+  if(end<=start)return;
+
+  s=seedT+(seedptr&(linesper-1))*seed_rows(n,shift)+(seedptr>>shift);
+  if(simd==PSY_AVX2)
+    seed_max_avx2(s,posts+2+start,amp,end-start);
+  else
+    seed_max_sse2(s,posts+2+start,amp,end-start);
+}
+#endif
+
+/* seed is transposed (see seed_curve_simd) when shift is not negative */
 static void seed_loop(vorbis_look_psy *p,
                       const float ***curves,
                       const float *f,
                       const float *flr,
                       float *seed,
-                      float specmax){
+                      float specmax,
+                      int shift){
   vorbis_info_psy *vi=p->vi;
   long n=p->n,i;
   float dBoffset=vi->max_curve_dB-specmax;
@@ -437,6 +545,19 @@ static void seed_loop(vorbis_look_psy *p,
       if(oc>=P_BANDS)oc=P_BANDS-1;
       if(oc<0)oc=0;
 
+#ifdef PSY_SIMD
+      if(shift>=0)
+        seed_curve_simd(seed,
+                        curves[oc],
+                        max,
+                        p->octave[i]-p->firstoc,
+                        p->total_octave_lines,
+                        p->eighth_octave_lines,
+                        shift,
+                        dBoffset,
+                        p->simd);
+      else
+#endif
       seed_curve(seed,
                  curves[oc],
                  max,
@@ -541,11 +662,152 @@ static void max_seeds(vorbis_look_psy *p,
 
 }
 
+#ifdef PSY_SIMD
+/* The windowed regressions of bark_noise_hybridmp for consecutive bins
+   a vector at a time, from bin i on while the windows are inside the
+   spectrum (the scalar middle loops): the sums over windows given by b
+   (fixed<=0) or fixed wide ones.  The operations are those of the
+   scalar loops, in the same order.  Returns the next bin to do, and the
+   regression of the last bin done in ABD. */
+
+#define GATHER4(v,k) _mm_setr_ps(v[k[0]],v[k[1]],v[k[2]],v[k[3]])
+
+static int bark_noise_sse2(int i,int n,const long *b,int fixed,
+                           const float *N,const float *X,
+                           const float *XX,const float *Y,
+                           const float *XY,float *noise,
+                           float offset,float *ABD){
+  const __m128 step=_mm_setr_ps(0.f,1.f,2.f,3.f);
+  const __m128 zero=_mm_setzero_ps();
+  const __m128 off=_mm_set1_ps(offset);
+  __m128 tN,tX,tXX,tY,tXY,A,B,D,R,x;
+  int start=i,k;
+
+  A=B=D=zero;
+  for(;i+4<=n;i+=4){
+    if(fixed>0){
+      int hi=i+fixed/2;
+      int lo=hi-fixed;
+      if(hi+3>=n)break;
+      tN=_mm_sub_ps(_mm_loadu_ps(N+hi),_mm_loadu_ps(N+lo));
+      tX=_mm_sub_ps(_mm_loadu_ps(X+hi),_mm_loadu_ps(X+lo));
+      tXX=_mm_sub_ps(_mm_loadu_ps(XX+hi),_mm_loadu_ps(XX+lo));
+      tY=_mm_sub_ps(_mm_loadu_ps(Y+hi),_mm_loadu_ps(Y+lo));
+      tXY=_mm_sub_ps(_mm_loadu_ps(XY+hi),_mm_loadu_ps(XY+lo));
+    }else{
+      int lo[4],hi[4];
+      if((b[i+3]&0xffff)>=n)break;
+      for(k=0;k<4;k++){
+        lo[k]=b[i+k]>>16;
+        hi[k]=b[i+k]&0xffff;
+      }
+      tN=_mm_sub_ps(GATHER4(N,hi),GATHER4(N,lo));
+      tX=_mm_sub_ps(GATHER4(X,hi),GATHER4(X,lo));
+      tXX=_mm_sub_ps(GATHER4(XX,hi),GATHER4(XX,lo));
+      tY=_mm_sub_ps(GATHER4(Y,hi),GATHER4(Y,lo));
+      tXY=_mm_sub_ps(GATHER4(XY,hi),GATHER4(XY,lo));
+    }
+
+    A=_mm_sub_ps(_mm_mul_ps(tY,tXX),_mm_mul_ps(tX,tXY));
+    B=_mm_sub_ps(_mm_mul_ps(tN,tXY),_mm_mul_ps(tX,tY));
+    D=_mm_sub_ps(_mm_mul_ps(tN,tXX),_mm_mul_ps(tX,tX));
+    x=_mm_add_ps(_mm_set1_ps(i),step);
+    R=_mm_div_ps(_mm_add_ps(A,_mm_mul_ps(x,B)),D);
+
+    if(fixed>0)
+      _mm_storeu_ps(noise+i,_mm_min_ps(_mm_sub_ps(R,off),
+                                       _mm_loadu_ps(noise+i)));
+    else
+      _mm_storeu_ps(noise+i,_mm_sub_ps(_mm_max_ps(zero,R),off));
+  }
+
+  if(i>start){
+    float t[4];
+    _mm_storeu_ps(t,A);
+    ABD[0]=t[3];
+    _mm_storeu_ps(t,B);
+    ABD[1]=t[3];
+    _mm_storeu_ps(t,D);
+    ABD[2]=t[3];
+  }
+  return(i);
+}
+
+__attribute__((target("avx2")))
+static int bark_noise_avx2(int i,int n,const long *b,int fixed,
+                           const float *N,const float *X,
+                           const float *XX,const float *Y,
+                           const float *XY,float *noise,
+                           float offset,float *ABD){
+  const __m256 step=_mm256_setr_ps(0.f,1.f,2.f,3.f,4.f,5.f,6.f,7.f);
+  const __m256 zero=_mm256_setzero_ps();
+  const __m256 off=_mm256_set1_ps(offset);
+  const __m256i mask=_mm256_set1_epi32(0xffff);
+  __m256 tN,tX,tXX,tY,tXY,A,B,D,R,x;
+  int start=i;
+
+  A=B=D=zero;
+  for(;i+8<=n;i+=8){
+    if(fixed>0){
+      int hi=i+fixed/2;
+      int lo=hi-fixed;
+      if(hi+7>=n)break;
+      tN=_mm256_sub_ps(_mm256_loadu_ps(N+hi),_mm256_loadu_ps(N+lo));
+      tX=_mm256_sub_ps(_mm256_loadu_ps(X+hi),_mm256_loadu_ps(X+lo));
+      tXX=_mm256_sub_ps(_mm256_loadu_ps(XX+hi),_mm256_loadu_ps(XX+lo));
+      tY=_mm256_sub_ps(_mm256_loadu_ps(Y+hi),_mm256_loadu_ps(Y+lo));
+      tXY=_mm256_sub_ps(_mm256_loadu_ps(XY+hi),_mm256_loadu_ps(XY+lo));
+    }else{
+      __m256i w,lo,hi;
+      if((b[i+7]&0xffff)>=n)break;
+      w=_mm256_setr_epi32(b[i],b[i+1],b[i+2],b[i+3],
+                          b[i+4],b[i+5],b[i+6],b[i+7]);
+      lo=_mm256_srai_epi32(w,16);
+      hi=_mm256_and_si256(w,mask);
+      tN=_mm256_sub_ps(_mm256_i32gather_ps(N,hi,4),
+                       _mm256_i32gather_ps(N,lo,4));
+      tX=_mm256_sub_ps(_mm256_i32gather_ps(X,hi,4),
+                       _mm256_i32gather_ps(X,lo,4));
+      tXX=_mm256_sub_ps(_mm256_i32gather_ps(XX,hi,4),
+                        _mm256_i32gather_ps(XX,lo,4));
+      tY=_mm256_sub_ps(_mm256_i32gather_ps(Y,hi,4),
+                       _mm256_i32gather_ps(Y,lo,4));
+      tXY=_mm256_sub_ps(_mm256_i32gather_ps(XY,hi,4),
+                        _mm256_i32gather_ps(XY,lo,4));
+    }
+
+    A=_mm256_sub_ps(_mm256_mul_ps(tY,tXX),_mm256_mul_ps(tX,tXY));
+    B=_mm256_sub_ps(_mm256_mul_ps(tN,tXY),_mm256_mul_ps(tX,tY));
+    D=_mm256_sub_ps(_mm256_mul_ps(tN,tXX),_mm256_mul_ps(tX,tX));
+    x=_mm256_add_ps(_mm256_set1_ps(i),step);
+    R=_mm256_div_ps(_mm256_add_ps(A,_mm256_mul_ps(x,B)),D);
+
+    if(fixed>0)
+      _mm256_storeu_ps(noise+i,_mm256_min_ps(_mm256_sub_ps(R,off),
+                                             _mm256_loadu_ps(noise+i)));
+    else
+      _mm256_storeu_ps(noise+i,_mm256_sub_ps(_mm256_max_ps(zero,R),off));
+  }
+
+  if(i>start){
+    float t[8];
+    _mm256_storeu_ps(t,A);
+    ABD[0]=t[7];
+    _mm256_storeu_ps(t,B);
+    ABD[1]=t[7];
+    _mm256_storeu_ps(t,D);
+    ABD[2]=t[7];
+  }
+  return(i);
+}
+#endif
+
 static void bark_noise_hybridmp(int n,const long *b,
                                 const float *f,
                                 float *noise,
                                 const float offset,
-                                const int fixed){
+                                const int fixed,
+                                const int simd){
 
   float *N=alloca(n*sizeof(*N));
   float *X=alloca(n*sizeof(*N));
@@ -622,6 +884,21 @@ static void bark_noise_hybridmp(int n,const long *b,
     noise[i] = R - offset;
   }
 
+#ifdef PSY_SIMD
+  if (simd) {
+    float ABD[3];
+    ABD[0] = A;
+    ABD[1] = B;
+    ABD[2] = D;
+    i = (simd == PSY_AVX2 ? bark_noise_avx2 : bark_noise_sse2)
+      (i, n, b, 0, N, X, XX, Y, XY, noise, offset, ABD);
+    A = ABD[0];
+    B = ABD[1];
+    D = ABD[2];
+    x = i;
+  }
+#endif
+
   for ( ;; i++, x += 1.f) {
 
     lo = b[i] >> 16;
@@ -671,6 +948,22 @@ static void bark_noise_hybridmp(int n,const long *b,
 
     if (R - offset < noise[i]) noise[i] = R - offset;
   }
+
+#ifdef PSY_SIMD
+  if (simd) {
+    float ABD[3];
+    ABD[0] = A;
+    ABD[1] = B;
+    ABD[2] = D;
+    i = (simd == PSY_AVX2 ? bark_noise_avx2 : bark_noise_sse2)
+      (i, n, b, fixed, N, X, XX, Y, XY, noise, offset, ABD);
+    A = ABD[0];
+    B = ABD[1];
+    D = ABD[2];
+    x = i;
+  }
+#endif
+
   for ( ;; i++, x += 1.f) {
 
     hi = i + fixed / 2;
@@ -782,6 +1075,51 @@ void _vp_remove_floor(vorbis_look_psy *p,
     residue[i]=0.;
 }
 
+#ifdef PSY_SIMD
+/* The noise compander lookup of _vp_noisemask.  The level is rounded
+   as (int)(logmask+.5) is, in double, by rounding the clamped level's
+   fraction separately.  Returns the number of bins done. */
+static int noise_compand_sse2(int n,float *logmask,const float *work,
+                              const float *compand){
+  const __m128 top=_mm_set1_ps(NOISE_COMPAND_LEVELS-1);
+  const __m128 half=_mm_set1_ps(.5f);
+  int i,dB[4];
+
+  for(i=0;i+4<=n;i+=4){
+    __m128 v=_mm_min_ps(_mm_max_ps(_mm_loadu_ps(logmask+i),
+                                   _mm_setzero_ps()),top);
+    __m128i d=_mm_cvttps_epi32(v);
+    __m128 frac=_mm_sub_ps(v,_mm_cvtepi32_ps(d));
+    d=_mm_sub_epi32(d,_mm_castps_si128(_mm_cmpge_ps(frac,half)));
+    _mm_storeu_si128((__m128i *)dB,d);
+    _mm_storeu_ps(logmask+i,_mm_add_ps(_mm_loadu_ps(work+i),
+                                       GATHER4(compand,dB)));
+  }
+  return(i);
+}
+
+__attribute__((target("avx2")))
+static int noise_compand_avx2(int n,float *logmask,const float *work,
+                              const float *compand){
+  const __m256 top=_mm256_set1_ps(NOISE_COMPAND_LEVELS-1);
+  const __m256 half=_mm256_set1_ps(.5f);
+  int i;
+
+  for(i=0;i+8<=n;i+=8){
+    __m256 v=_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(logmask+i),
+                                         _mm256_setzero_ps()),top);
+    __m256i d=_mm256_cvttps_epi32(v);
+    __m256 frac=_mm256_sub_ps(v,_mm256_cvtepi32_ps(d));
+    d=_mm256_sub_epi32(d,_mm256_castps_si256(_mm256_cmp_ps(frac,half,
+                                                           _CMP_GE_OQ)));
+    _mm256_storeu_ps(logmask+i,
+                     _mm256_add_ps(_mm256_loadu_ps(work+i),
+                                   _mm256_i32gather_ps(compand,d,4)));
+  }
+  return(i);
+}
+#endif
+
 void _vp_noisemask(vorbis_look_psy *p,
                    float *logmdct,
                    float *logmask){
@@ -790,12 +1128,12 @@ void _vp_noisemask(vorbis_look_psy *p,
   float *work=alloca(n*sizeof(*work));
 
   bark_noise_hybridmp(n,p->bark,logmdct,logmask,
-                      140.,-1);
+                      140.,-1,p->simd);
 
   for(i=0;i<n;i++)work[i]=logmdct[i]-logmask[i];
 
   bark_noise_hybridmp(n,p->bark,work,logmask,0.,
-                      p->vi->noisewindowfixed);
+                      p->vi->noisewindowfixed,p->simd);
 
   for(i=0;i<n;i++)work[i]=logmdct[i]-work[i];
 
@@ -821,7 +1159,14 @@ void _vp_noisemask(vorbis_look_psy *p,
   }
 #endif
 
-  for(i=0;i<n;i++){
+  i=0;
+#ifdef PSY_SIMD
+  if(p->simd==PSY_AVX2)
+    i=noise_compand_avx2(n,logmask,work,p->vi->noisecompand);
+  else if(p->simd)
+    i=noise_compand_sse2(n,logmask,work,p->vi->noisecompand);
+#endif
+  for(;i<n;i++){
     int dB=logmask[i]+.5;
     if(dB>=NOISE_COMPAND_LEVELS)dB=NOISE_COMPAND_LEVELS-1;
     if(dB<0)dB=0;
@@ -838,9 +1183,8 @@ void _vp_tonemask(vorbis_look_psy *p,
 
   int i,n=p->n;
 
-  float *seed=alloca(sizeof(*seed)*p->total_octave_lines);
+  float *seed;
   float att=local_specmax+p->vi->ath_adjatt;
-  for(i=0;i<p->total_octave_lines;i++)seed[i]=NEGINF;
 
   /* set the ATH (floating below localmax, not global max by a
      specified att) */
@@ -850,11 +1194,142 @@ void _vp_tonemask(vorbis_look_psy *p,
     logmask[i]=p->ath[i]+att;
 
   /* tone masking */
-  seed_loop(p,(const float ***)p->tonecurves,logfft,logmask,seed,global_specmax);
+#ifdef PSY_SIMD
+  if(p->simd && p->eighth_octave_lines>=4 &&
+     !(p->eighth_octave_lines&(p->eighth_octave_lines-1))){
+    int linesper=p->eighth_octave_lines;
+    int shift,rows,r,c;
+    float *seedT;
+
+    for(shift=0;(1<<shift)<linesper;shift++);
+    rows=seed_rows(p->total_octave_lines,shift);
+    seedT=alloca(sizeof(*seedT)*rows*linesper);
+    seed=alloca(sizeof(*seed)*rows*linesper);
+    for(i=0;i<rows*linesper;i++)seedT[i]=NEGINF;
+
+    seed_loop(p,(const float ***)p->tonecurves,logfft,logmask,seedT,
+              global_specmax,shift);
+
+    /* transposed back in 4x4 blocks */
+    for(c=0;c<linesper;c+=4)
+      for(r=0;r<rows;r+=4){
+        __m128 r0=_mm_loadu_ps(seedT+c*rows+r);
+        __m128 r1=_mm_loadu_ps(seedT+(c+1)*rows+r);
+        __m128 r2=_mm_loadu_ps(seedT+(c+2)*rows+r);
+        __m128 r3=_mm_loadu_ps(seedT+(c+3)*rows+r);
+        _MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+        _mm_storeu_ps(seed+r*linesper+c,r0);
+        _mm_storeu_ps(seed+(r+1)*linesper+c,r1);
+        _mm_storeu_ps(seed+(r+2)*linesper+c,r2);
+        _mm_storeu_ps(seed+(r+3)*linesper+c,r3);
+      }
+  }else
+#endif
+  {
+    seed=alloca(sizeof(*seed)*p->total_octave_lines);
+    for(i=0;i<p->total_octave_lines;i++)seed[i]=NEGINF;
+    seed_loop(p,(const float ***)p->tonecurves,logfft,logmask,seed,
+              global_specmax,-1);
+  }
   max_seeds(p,seed,logmask);
 
 }
 
+#ifdef PSY_SIMD
+/* _vp_offset_and_mix a vector at a time; the AoTuV attenuation is
+   computed in double, as the scalar code does.  Returns the number of
+   bins done. */
+static int offset_and_mix_sse2(int n,const float *noise,const float *tone,
+                               const float *noiseoffset,float toneatt,
+                               float noisemaxsupp,int aotuv,float cx,
+                               float *logmask,float *mdct,
+                               const float *logmdct){
+  const __m128 att=_mm_set1_ps(toneatt);
+  const __m128 supp=_mm_set1_ps(noisemaxsupp);
+  const __m128 coeffi=_mm_set1_ps(-17.2f);
+  const __m128 minde=_mm_set1_ps(0.0001f);
+  const __m128d one=_mm_set1_pd(1.0);
+  const __m128d lo=_mm_set1_pd(0.0003);
+  const __m128d hi=_mm_set1_pd(0.005);
+  const __m128d c=_mm_set1_pd(cx);
+  int i;
+
+  for(i=0;i+4<=n;i+=4){
+    __m128 val=_mm_add_ps(_mm_loadu_ps(noise+i),_mm_loadu_ps(noiseoffset+i));
+    val=_mm_min_ps(supp,val);
+    _mm_storeu_ps(logmask+i,_mm_max_ps(_mm_add_ps(_mm_loadu_ps(tone+i),att),
+                                       val));
+
+    if(aotuv){
+      __m128 rel=_mm_sub_ps(val,_mm_loadu_ps(logmdct+i));
+      __m128 d=_mm_sub_ps(rel,coeffi);
+      __m128d d0=_mm_cvtps_pd(d);
+      __m128d d1=_mm_cvtps_pd(_mm_movehl_ps(d,d));
+      __m128 deh=_mm_movelh_ps(
+        _mm_cvtpd_ps(_mm_sub_pd(one,_mm_mul_pd(_mm_mul_pd(d0,hi),c))),
+        _mm_cvtpd_ps(_mm_sub_pd(one,_mm_mul_pd(_mm_mul_pd(d1,hi),c))));
+      __m128 del=_mm_movelh_ps(
+        _mm_cvtpd_ps(_mm_sub_pd(one,_mm_mul_pd(_mm_mul_pd(d0,lo),c))),
+        _mm_cvtpd_ps(_mm_sub_pd(one,_mm_mul_pd(_mm_mul_pd(d1,lo),c))));
+      __m128 neg=_mm_cmplt_ps(deh,_mm_setzero_ps());
+      __m128 above=_mm_cmpgt_ps(rel,coeffi);
+      __m128 de;
+
+      deh=_mm_or_ps(_mm_and_ps(neg,minde),_mm_andnot_ps(neg,deh));
+      de=_mm_or_ps(_mm_and_ps(above,deh),_mm_andnot_ps(above,del));
+      _mm_storeu_ps(mdct+i,_mm_mul_ps(_mm_loadu_ps(mdct+i),de));
+    }
+  }
+  return(i);
+}
+
+__attribute__((target("avx2")))
+static int offset_and_mix_avx2(int n,const float *noise,const float *tone,
+                               const float *noiseoffset,float toneatt,
+                               float noisemaxsupp,int aotuv,float cx,
+                               float *logmask,float *mdct,
+                               const float *logmdct){
+  const __m256 att=_mm256_set1_ps(toneatt);
+  const __m256 supp=_mm256_set1_ps(noisemaxsupp);
+  const __m256 coeffi=_mm256_set1_ps(-17.2f);
+  const __m256 minde=_mm256_set1_ps(0.0001f);
+  const __m256d one=_mm256_set1_pd(1.0);
+  const __m256d lo=_mm256_set1_pd(0.0003);
+  const __m256d hi=_mm256_set1_pd(0.005);
+  const __m256d c=_mm256_set1_pd(cx);
+  int i;
+
+  for(i=0;i+8<=n;i+=8){
+    __m256 val=_mm256_add_ps(_mm256_loadu_ps(noise+i),
+                             _mm256_loadu_ps(noiseoffset+i));
+    val=_mm256_min_ps(supp,val);
+    _mm256_storeu_ps(logmask+i,
+                     _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(tone+i),att),
+                                   val));
+
+    if(aotuv){
+      __m256 rel=_mm256_sub_ps(val,_mm256_loadu_ps(logmdct+i));
+      __m256 d=_mm256_sub_ps(rel,coeffi);
+      __m256d d0=_mm256_cvtps_pd(_mm256_castps256_ps128(d));
+      __m256d d1=_mm256_cvtps_pd(_mm256_extractf128_ps(d,1));
+      __m256 deh=_mm256_set_m128(
+        _mm256_cvtpd_ps(_mm256_sub_pd(one,_mm256_mul_pd(_mm256_mul_pd(d1,hi),c))),
+        _mm256_cvtpd_ps(_mm256_sub_pd(one,_mm256_mul_pd(_mm256_mul_pd(d0,hi),c))));
+      __m256 del=_mm256_set_m128(
+        _mm256_cvtpd_ps(_mm256_sub_pd(one,_mm256_mul_pd(_mm256_mul_pd(d1,lo),c))),
+        _mm256_cvtpd_ps(_mm256_sub_pd(one,_mm256_mul_pd(_mm256_mul_pd(d0,lo),c))));
+      __m256 neg=_mm256_cmp_ps(deh,_mm256_setzero_ps(),_CMP_LT_OQ);
+      __m256 above=_mm256_cmp_ps(rel,coeffi,_CMP_GT_OQ);
+
+      deh=_mm256_blendv_ps(deh,minde,neg);
+      _mm256_storeu_ps(mdct+i,_mm256_mul_ps(_mm256_loadu_ps(mdct+i),
+                                            _mm256_blendv_ps(del,deh,above)));
+    }
+  }
+  return(i);
+}
+#endif
+
 void _vp_offset_and_mix(vorbis_look_psy *p,
                         float *noise,
                         float *tone,
@@ -868,7 +1343,18 @@ void _vp_offset_and_mix(vorbis_look_psy *p,
 
   cx = p->m_val;
 
-  for(i=0;i<n;i++){
+  i=0;
+#ifdef PSY_SIMD
+  if(p->simd==PSY_AVX2)
+    i=offset_and_mix_avx2(n,noise,tone,p->noiseoffset[offset_select],
+                          toneatt,p->vi->noisemaxsupp,offset_select==1,cx,
+                          logmask,mdct,logmdct);
+  else if(p->simd)
+    i=offset_and_mix_sse2(n,noise,tone,p->noiseoffset[offset_select],
+                          toneatt,p->vi->noisemaxsupp,offset_select==1,cx,
+                          logmask,mdct,logmdct);
+#endif
+  for(;i<n;i++){
     float val= noise[i]+p->noiseoffset[offset_select][i];
     if(val>p->vi->noisemaxsupp)val=p->vi->noisemaxsupp;
     logmask[i]=max(val,tone[i]+toneatt);
@@ -1021,11 +1507,33 @@ float **_vp_quantize_couple_memo(vorbis_block *vb,
   return(ret);
 }
 
-/* this is for per-channel noise normalization */
-static int apsort(const void *a, const void *b){
-  float f1=fabs(**(float**)a);
-  float f2=fabs(**(float**)b);
-  return (f1<f2)-(f1>f2);
+/* this is for per-channel noise normalization: the n magnitudes at
+   mags by falling size, equal ones in order of position, as qsort
+   (a merge sort in glibc) has always left them.  With the sign
+   cleared the IEEE bit pattern of a float orders as its magnitude
+   does, so pattern and position pack into one integer key and the
+   order is that of the keys; the partitions are short enough (8 and
+   32 lines) that an insertion sort of those beats a radix pass. */
+static void _vp_magnitude_sort(const float *mags,int n,
+                               ogg_int64_t *work,int *out,int offset){
+  union {
+    float f;
+    ogg_uint32_t i;
+  } m;
+  int i,j;
+
+  for(i=0;i<n;i++){
+    ogg_int64_t key;
+    m.f=mags[i];
+    key=((ogg_int64_t)(m.i&0x7fffffffUL)<<32)|(ogg_uint32_t)~i;
+
+    for(j=i;j>0 && work[j-1]<key;j--)
+      work[j]=work[j-1];
+    work[j]=key;
+  }
+
+  for(i=0;i<n;i++)
+    out[i]=offset+(int)~(ogg_uint32_t)work[i];
 }
 
 int **_vp_quantize_couple_sort(vorbis_block *vb,
@@ -1035,19 +1543,16 @@ int **_vp_quantize_couple_sort(vorbis_block *vb,
 
 
   if(p->vi->normal_point_p){
-    int i,j,k,n=p->n;
+    int i,j,n=p->n;
     int **ret=_vorbis_block_alloc(vb,vi->coupling_steps*sizeof(*ret));
     int partition=p->vi->normal_partition;
-    float **work=alloca(sizeof(*work)*partition);
+    ogg_int64_t *work=alloca(sizeof(*work)*partition);
 
     for(i=0;i<vi->coupling_steps;i++){
       ret[i]=_vorbis_block_alloc(vb,n*sizeof(**ret));
 
-      for(j=0;j<n;j+=partition){
-        for(k=0;k<partition;k++)work[k]=mags[i]+k+j;
-        qsort(work,partition,sizeof(*work),apsort);
-        for(k=0;k<partition;k++)ret[i][k+j]=work[k]-mags[i];
-      }
+      for(j=0;j<n;j+=partition)
+        _vp_magnitude_sort(mags[i]+j,partition,work,ret[i]+j,j);
     }
     return(ret);
   }
@@ -1056,19 +1561,16 @@ int **_vp_quantize_couple_sort(vorbis_block *vb,
 
 void _vp_noise_normalize_sort(vorbis_look_psy *p,
                               float *magnitudes,int *sortedindex){
-  int i,j,n=p->n;
+  int j,n=p->n;
   vorbis_info_psy *vi=p->vi;
   int partition=vi->normal_partition;
-  float **work=alloca(sizeof(*work)*partition);
+  ogg_int64_t *work=alloca(sizeof(*work)*partition);
   int start=vi->normal_start;
 
   for(j=start;j<n;j+=partition){
     if(j+partition>n)partition=n-j;
-    for(i=0;i<partition;i++)work[i]=magnitudes+i+j;
-    qsort(work,partition,sizeof(*work),apsort);
-    for(i=0;i<partition;i++){
-      sortedindex[i+j-start]=work[i]-magnitudes;
-    }
+    _vp_magnitude_sort(magnitudes+j,partition,work,
+                       sortedindex+j-start,j);
   }
 }
 
@@ -1225,3 +1727,146 @@ void hf_reduction(vorbis_info_psy_global *g,
       mdct[i][j] *= (1.0 - de*((float)(j-limit) / (float)(n-limit)));
   }
 }
+
+#ifdef _V_SELFTEST
+
+/* Checks the vector masking kernels against the scalar ones, for a
+   short and a long block and every level the CPU runs.  The kernels do
+   the scalar operations in the scalar order, so with psy.c compiled as
+   written (no -ffast-math, no FMA contraction; see the pragma at the
+   top) every output must be identical.  The noise compander is the 44.1kHz mode A
+   one of modes/psych_44.h, whose steps are whole dBs: a level rounded
+   to another entry shows up as an error of a dB or more. */
+
+#include <stdio.h>
+
+/* _psy_compand_44, mode A short and long */
+static const float psy_compand[2][NOISE_COMPAND_LEVELS]={
+  {
+    0, 1, 2, 3, 4, 5, 5,  5,
+    6, 6, 6, 5, 4, 4, 4,  4,
+    4, 4, 5, 5, 5, 6, 6,  6,
+    7, 7, 7, 8, 8, 8, 9, 10,
+    11,12,13,14,15,16,17, 18,
+  },
+  {
+    0, 1, 2, 3, 4, 5, 6,  7,
+    8, 8, 7, 6, 5, 4, 4,  4,
+    4, 4, 5, 5, 5, 6, 6,  6,
+    7, 7, 7, 8, 8, 8, 9, 10,
+    11,12,13,14,15,16,17, 18,
+  }
+};
+
+#ifdef PSY_SIMD
+static const char *simd_names[]={"scalar","SSE2","AVX2"};
+
+/* number of outputs differing, and the largest difference in err */
+static int mismatches(const float *a,const float *b,int n,float *err){
+  int i,count=0;
+  *err=0.f;
+  for(i=0;i<n;i++)
+    if(a[i]!=b[i]){
+      count++;
+      if(fabs(a[i]-b[i])>*err)*err=fabs(a[i]-b[i]);
+    }
+  return count;
+}
+
+/* all outputs of the three kernels, in out[0..6*n) */
+static void run_masks(vorbis_look_psy *p,const float *logmdct,
+                      const float *logfft,const float *mdct,float specmax,
+                      float *out){
+  int n=p->n,i;
+  float *noise=out,*tone=out+n;
+
+  _vp_noisemask(p,(float *)logmdct,noise);
+  _vp_tonemask(p,(float *)logfft,tone,specmax,specmax-6.f);
+  for(i=0;i<P_NOISECURVES;i++){
+    memcpy(out+(2+i*2)*n,mdct,sizeof(*mdct)*n);
+    _vp_offset_and_mix(p,noise,tone,i,out+(3+i*2)*n,out+(2+i*2)*n,
+                       (float *)logmdct);
+  }
+}
+#endif
+
+int main(){
+#ifdef PSY_SIMD
+  vorbis_info_psy vi;
+  vorbis_info_psy_global gi;
+  vorbis_look_psy p;
+  float *logmdct,*logfft,*mdct,*ref,*out,specmax,err;
+  int blocksizes[2]={256,2048};
+  int b,i,j,n,best,level,count,fail=0;
+
+  memset(&vi,0,sizeof(vi));
+  memset(&gi,0,sizeof(gi));
+  vi.ath_adjatt=-100.f;
+  vi.ath_maxatt=-140.f;
+  vi.tone_abs_limit=-40.f;
+  vi.tone_decay=-.5f;
+  vi.noisemaxsupp=-6.f;
+  vi.noisewindowlo=.5f;
+  vi.noisewindowhi=.5f;
+  vi.noisewindowlomin=10;
+  vi.noisewindowhimin=10;
+  vi.noisewindowfixed=100;
+  vi.max_curve_dB=105.f;
+  for(i=0;i<P_BANDS;i++){
+    vi.toneatt[i]=-35.f;
+    for(j=0;j<P_NOISECURVES;j++)
+      vi.noiseoff[j][i]=-10.f+4.f*j-.5f*i;
+  }
+  gi.eighth_octave_lines=8;
+
+  srand(1);
+  for(b=0;b<2;b++){
+    n=blocksizes[b]/2;
+    memcpy(vi.noisecompand,psy_compand[b],sizeof(vi.noisecompand));
+    logmdct=_ogg_malloc(sizeof(*logmdct)*n);
+    logfft=_ogg_malloc(sizeof(*logfft)*n);
+    mdct=_ogg_malloc(sizeof(*mdct)*n);
+    ref=_ogg_malloc(sizeof(*ref)*n*8);
+    out=_ogg_malloc(sizeof(*out)*n*8);
+
+    specmax=-9999.f;
+    for(i=0;i<n;i++){
+      logmdct[i]=-20.f-60.f*i/n+(rand()/(float)RAND_MAX-.5f)*30.f;
+      if(i%37==0)logmdct[i]+=40.f;
+      logfft[i]=logmdct[i]+3.f;
+      if(logfft[i]>specmax)specmax=logfft[i];
+      mdct[i]=rand()/(float)RAND_MAX*2.f-1.f;
+    }
+
+    _vp_psy_init(&p,&vi,&gi,n,44100);
+    best=p.simd;
+    p.simd=PSY_SCALAR;
+    run_masks(&p,logmdct,logfft,mdct,specmax,ref);
+
+    for(level=PSY_SSE2;level<=best;level++){
+      fprintf(stderr,"masking %d, %s... ",n,simd_names[level]);
+      p.simd=level;
+      run_masks(&p,logmdct,logfft,mdct,specmax,out);
+      count=mismatches(ref,out,n*8,&err);
+      if(count){
+        fprintf(stderr,"%d outputs differ (up to %g), failed\n",count,err);
+        fail=1;
+      }else
+        fprintf(stderr,"OK\n");
+    }
+    p.simd=best;
+    _vp_psy_clear(&p);
+    _ogg_free(logmdct);
+    _ogg_free(logfft);
+    _ogg_free(mdct);
+    _ogg_free(ref);
+    _ogg_free(out);
+  }
+  return(fail);
+#else
+  fprintf(stderr,"masking: no vector kernels on this platform\n");
+  return(0);
+#endif
+}
+
+#endif
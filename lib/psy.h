@@ -93,6 +93,11 @@ typedef struct {
 } vorbis_look_psy_global;
 
 
+/* Masking kernels, picked by _vp_psy_init for the running CPU */
+#define PSY_SCALAR 0
+#define PSY_SSE2   1
+#define PSY_AVX2   2
+
 typedef struct {
   int n;
   struct vorbis_info_psy *vi;
@@ -112,6 +117,9 @@ typedef struct {
 
   float m_val; /* Masking compensation value */
 
+  int   shared; /* the tables belong to the setup cache */
+  int   simd;
+
 } vorbis_look_psy;
 
 extern void   _vp_psy_init(vorbis_look_psy *p,vorbis_info_psy *vi,
@@ -45,6 +45,9 @@ typedef struct {
   codebook   *phrasebook;
   codebook ***partbooks;
 
+  /* residue 1 decoders for each partbook, picked for its dimension */
+  vorbis_book_decodev_fn  **partdecode;
+
   int         partvals;
   int       **decodemap;
 
@@ -137,9 +140,12 @@ void res0_free_look(vorbis_look_residue *i){
     }
     fprintf(stderr,"\n");*/
 
-    for(j=0;j<look->parts;j++)
+    for(j=0;j<look->parts;j++){
       if(look->partbooks[j])_ogg_free(look->partbooks[j]);
+      if(look->partdecode[j])_ogg_free(look->partdecode[j]);
+    }
     _ogg_free(look->partbooks);
+    _ogg_free(look->partdecode);
     for(j=0;j<look->partvals;j++)
       _ogg_free(look->decodemap[j]);
     _ogg_free(look->decodemap);
@@ -273,15 +279,19 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,
   dim=look->phrasebook->dim;
 
   look->partbooks=_ogg_calloc(look->parts,sizeof(*look->partbooks));
+  look->partdecode=_ogg_calloc(look->parts,sizeof(*look->partdecode));
 
   for(j=0;j<look->parts;j++){
     int stages=ilog(info->secondstages[j]);
     if(stages){
       if(stages>maxstage)maxstage=stages;
       look->partbooks[j]=_ogg_calloc(stages,sizeof(*look->partbooks[j]));
+      look->partdecode[j]=_ogg_calloc(stages,sizeof(*look->partdecode[j]));
       for(k=0;k<stages;k++)
         if(info->secondstages[j]&(1<<k)){
           look->partbooks[j][k]=ci->fullbooks+info->booklist[acc++];
+          look->partdecode[j][k]=
+            vorbis_book_decodev_add_kernel(look->partbooks[j][k]);
 #ifdef TRAIN_RES
           look->training_data[k][j]=_ogg_calloc(look->partbooks[j][k]->entries,
                                            sizeof(***look->training_data));
@@ -633,11 +643,11 @@ static int _01forward(oggpack_buffer *opb,
   return(0);
 }
 
-/* a truncated packet here just means 'stop working'; it's not an error */
+/* a truncated packet here just means 'stop working'; it's not an error.
+   decodepart NULL uses the decoders res0_look picked for each book */
 static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
                       float **in,int ch,
-                      long (*decodepart)(codebook *, float *,
-                                         oggpack_buffer *,int)){
+                      vorbis_book_decodev_fn decodepart){
 
   long i,j,k,l,s;
   vorbis_look_residue0 *look=(vorbis_look_residue0 *)vl;
@@ -681,8 +691,10 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
             if(info->secondstages[partword[j][l][k]]&(1<<s)){
               codebook *stagebook=look->partbooks[partword[j][l][k]][s];
               if(stagebook){
-                if(decodepart(stagebook,in[j]+offset,&vb->opb,
-                              samples_per_partition)==-1)goto eopbreak;
+                vorbis_book_decodev_fn decode=decodepart?decodepart:
+                  look->partdecode[partword[j][l][k]][s];
+                if(decode(stagebook,in[j]+offset,&vb->opb,
+                          samples_per_partition)==-1)goto eopbreak;
               }
             }
           }
@@ -802,7 +814,7 @@ int res1_inverse(vorbis_block *vb,vorbis_look_residue *vl,
     if(nonzero[i])
       in[used++]=in[i];
   if(used)
-    return(_01inverse(vb,vl,in,used,vorbis_book_decodev_add));
+    return(_01inverse(vb,vl,in,used,NULL));
   else
     return(0);
 }
@@ -879,29 +891,58 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
     for(i=0;i<ch;i++)if(nonzero[i])break;
     if(i==ch)return(0); /* no nonzero vectors */
 
-    for(s=0;s<look->stages;s++){
-      for(i=0,l=0;i<partvals;l++){
+    /* two channels take the stereo kernels; the loops are the same */
+    if(ch==2){
+      for(s=0;s<look->stages;s++){
+        for(i=0,l=0;i<partvals;l++){
 
-        if(s==0){
-          /* fetch the partition word */
-          int temp=vorbis_book_decode(look->phrasebook,&vb->opb);
-          if(temp==-1)goto eopbreak;
-          partword[l]=look->decodemap[temp];
-          if(partword[l]==NULL)goto errout;
-        }
+          if(s==0){
+            /* fetch the partition word */
+            int temp=vorbis_book_decode(look->phrasebook,&vb->opb);
+            if(temp==-1)goto eopbreak;
+            partword[l]=look->decodemap[temp];
+            if(partword[l]==NULL)goto errout;
+          }
 
-        /* now we decode residual values for the partitions */
-        for(k=0;k<partitions_per_word && i<partvals;k++,i++)
-          if(info->secondstages[partword[l][k]]&(1<<s)){
-            codebook *stagebook=look->partbooks[partword[l][k]][s];
-
-            if(stagebook){
-              if(vorbis_book_decodevv_add(stagebook,in,
-                                          i*samples_per_partition+info->begin,ch,
-                                          &vb->opb,samples_per_partition)==-1)
-                goto eopbreak;
+          /* now we decode residual values for the partitions */
+          for(k=0;k<partitions_per_word && i<partvals;k++,i++)
+            if(info->secondstages[partword[l][k]]&(1<<s)){
+              codebook *stagebook=look->partbooks[partword[l][k]][s];
+
+              if(stagebook){
+                if(vorbis_book_decodevv_add_stereo(stagebook,in,
+                                   i*samples_per_partition+info->begin,
+                                   &vb->opb,samples_per_partition)==-1)
+                  goto eopbreak;
+              }
             }
+        }
+      }
+    }else{
+      for(s=0;s<look->stages;s++){
+        for(i=0,l=0;i<partvals;l++){
+
+          if(s==0){
+            /* fetch the partition word */
+            int temp=vorbis_book_decode(look->phrasebook,&vb->opb);
+            if(temp==-1)goto eopbreak;
+            partword[l]=look->decodemap[temp];
+            if(partword[l]==NULL)goto errout;
           }
+
+          /* now we decode residual values for the partitions */
+          for(k=0;k<partitions_per_word && i<partvals;k++,i++)
+            if(info->secondstages[partword[l][k]]&(1<<s)){
+              codebook *stagebook=look->partbooks[partword[l][k]][s];
+
+              if(stagebook){
+                if(vorbis_book_decodevv_add(stagebook,in,
+                                   i*samples_per_partition+info->begin,ch,
+                                   &vb->opb,samples_per_partition)==-1)
+                  goto eopbreak;
+              }
+            }
+        }
       }
     }
   }
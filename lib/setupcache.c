@@ -0,0 +1,320 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+  function: process wide cache of codebooks, MDCT lookups and psy tables
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ogg/ogg.h>
+#include "vorbis/codec.h"
+#include "codec_internal.h"
+#include "os.h"
+#include "misc.h"
+#include "setupcache.h"
+
+/* one cached setup (books), transform (mdct) or psy look (psy) */
+typedef struct setup_entry{
+  struct setup_entry *next;
+  int                 refs;
+  long                lastuse;
+
+  ogg_uint32_t        hash;
+  unsigned char      *packet; /* setup header, or the static books list */
+  long                bytes;
+  int                 encode;
+  codebook           *books;
+  int                 n;
+
+  mdct_lookup        *mdct;
+
+  vorbis_look_psy    *psy;
+  vorbis_info_psy     psyinfo;
+} setup_entry;
+
+static pthread_mutex_t cache_lock=PTHREAD_MUTEX_INITIALIZER;
+static setup_entry *cache=NULL;
+static long cache_clock=0;
+
+/* FNV-1a */
+static ogg_uint32_t _setup_hash(const unsigned char *p,long bytes){
+  ogg_uint32_t h=2166136261UL;
+  long i;
+  for(i=0;i<bytes;i++){
+    h^=p[i];
+    h*=16777619UL;
+  }
+  return(h);
+}
+
+static void _entry_free(setup_entry *e){
+  int i;
+  if(e->books){
+    for(i=0;i<e->n;i++)
+      vorbis_book_clear(e->books+i);
+    _ogg_free(e->books);
+  }
+  if(e->mdct){
+    mdct_clear(e->mdct);
+    _ogg_free(e->mdct);
+  }
+  if(e->psy){
+    _vp_psy_clear(e->psy);
+    _ogg_free(e->psy);
+  }
+  if(e->packet)_ogg_free(e->packet);
+  _ogg_free(e);
+}
+
+/* drops the least recently used idle entries over SETUP_CACHE_IDLE;
+   called locked */
+static void _cache_trim(void){
+  for(;;){
+    setup_entry **p,**oldest=NULL;
+    int idle=0;
+
+    for(p=&cache;*p;p=&(*p)->next)
+      if((*p)->refs==0){
+        idle++;
+        if(!oldest || (*p)->lastuse<(*oldest)->lastuse)oldest=p;
+      }
+    if(idle<=SETUP_CACHE_IDLE)return;
+
+    {
+      setup_entry *e=*oldest;
+      *oldest=e->next;
+      _entry_free(e);
+    }
+  }
+}
+
+static setup_entry *_cache_find_books(ogg_uint32_t hash,int encode,
+                                      const unsigned char *packet,long bytes){
+  setup_entry *e;
+  for(e=cache;e;e=e->next)
+    if(e->books && e->encode==encode && e->hash==hash && e->bytes==bytes &&
+       !memcmp(e->packet,packet,bytes))
+      return(e);
+  return(NULL);
+}
+
+codebook *_setup_cache_books(const unsigned char *packet,long bytes){
+  ogg_uint32_t hash=_setup_hash(packet,bytes);
+  codebook *ret=NULL;
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  e=_cache_find_books(hash,0,packet,bytes);
+  if(e){
+    e->refs++;
+    e->lastuse=cache_clock++;
+    ret=e->books;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return(ret);
+}
+
+codebook *_setup_cache_add_books(const unsigned char *packet,long bytes,
+                                 codebook *books,int n){
+  ogg_uint32_t hash=_setup_hash(packet,bytes);
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  e=_cache_find_books(hash,0,packet,bytes);
+  if(e){
+    /* built meanwhile by another stream */
+    int i;
+    e->refs++;
+    e->lastuse=cache_clock++;
+    pthread_mutex_unlock(&cache_lock);
+    for(i=0;i<n;i++)
+      vorbis_book_clear(books+i);
+    _ogg_free(books);
+    return(e->books);
+  }
+
+  e=_ogg_calloc(1,sizeof(*e));
+  e->packet=_ogg_malloc(bytes);
+  memcpy(e->packet,packet,bytes);
+  e->bytes=bytes;
+  e->hash=hash;
+  e->books=books;
+  e->n=n;
+  e->refs=1;
+  e->lastuse=cache_clock++;
+  e->next=cache;
+  cache=e;
+  pthread_mutex_unlock(&cache_lock);
+  return(books);
+}
+
+codebook *_setup_cache_encode_books(static_codebook **sbooks,int n){
+  const unsigned char *key=(const unsigned char *)sbooks;
+  long bytes=n*sizeof(*sbooks);
+  ogg_uint32_t hash=_setup_hash(key,bytes);
+  codebook *books;
+  setup_entry *e;
+  int i;
+
+  pthread_mutex_lock(&cache_lock);
+  e=_cache_find_books(hash,1,key,bytes);
+  if(e){
+    e->refs++;
+    e->lastuse=cache_clock++;
+    pthread_mutex_unlock(&cache_lock);
+    return(e->books);
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  /* built unlocked; two encoders starting together may both build */
+  books=_ogg_calloc(n,sizeof(*books));
+  for(i=0;i<n;i++)
+    vorbis_book_init_encode(books+i,sbooks[i]);
+
+  pthread_mutex_lock(&cache_lock);
+  e=_ogg_calloc(1,sizeof(*e));
+  e->packet=_ogg_malloc(bytes);
+  memcpy(e->packet,key,bytes);
+  e->bytes=bytes;
+  e->hash=hash;
+  e->encode=1;
+  e->books=books;
+  e->n=n;
+  e->refs=1;
+  e->lastuse=cache_clock++;
+  e->next=cache;
+  cache=e;
+  pthread_mutex_unlock(&cache_lock);
+  return(books);
+}
+
+void _setup_cache_release_books(codebook *books){
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  for(e=cache;e;e=e->next)
+    if(e->books==books){
+      if(--e->refs==0)_cache_trim();
+      break;
+    }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+mdct_lookup *_setup_cache_mdct(int n){
+  mdct_lookup *ret;
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  for(e=cache;e;e=e->next)
+    if(e->mdct && e->mdct->n==n){
+      e->refs++;
+      e->lastuse=cache_clock++;
+      ret=e->mdct;
+      pthread_mutex_unlock(&cache_lock);
+      return(ret);
+    }
+  pthread_mutex_unlock(&cache_lock);
+
+  /* mdct_init runs unlocked; a lookup built twice is merely redundant */
+  ret=_ogg_calloc(1,sizeof(*ret));
+  mdct_init(ret,n);
+
+  pthread_mutex_lock(&cache_lock);
+  e=_ogg_calloc(1,sizeof(*e));
+  e->mdct=ret;
+  e->refs=1;
+  e->lastuse=cache_clock++;
+  e->next=cache;
+  cache=e;
+  pthread_mutex_unlock(&cache_lock);
+  return(ret);
+}
+
+void _setup_cache_release_mdct(mdct_lookup *m){
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  for(e=cache;e;e=e->next)
+    if(e->mdct==m){
+      if(--e->refs==0)_cache_trim();
+      break;
+    }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/* the settings the psy tables are derived from */
+static int _psy_match(setup_entry *e,vorbis_look_psy *p,vorbis_info_psy *vi){
+  vorbis_info_psy *k=&e->psyinfo;
+
+  return(e->psy->n==p->n && e->psy->rate==p->rate &&
+         e->psy->eighth_octave_lines==p->eighth_octave_lines &&
+         k->tone_centerboost==vi->tone_centerboost &&
+         k->tone_decay==vi->tone_decay &&
+         k->noisewindowlo==vi->noisewindowlo &&
+         k->noisewindowhi==vi->noisewindowhi &&
+         k->noisewindowlomin==vi->noisewindowlomin &&
+         k->noisewindowhimin==vi->noisewindowhimin &&
+         !memcmp(k->toneatt,vi->toneatt,sizeof(k->toneatt)) &&
+         !memcmp(k->noiseoff,vi->noiseoff,sizeof(k->noiseoff)));
+}
+
+int _setup_cache_psy(vorbis_look_psy *p,vorbis_info_psy *vi){
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  for(e=cache;e;e=e->next)
+    if(e->psy && _psy_match(e,p,vi)){
+      e->refs++;
+      e->lastuse=cache_clock++;
+      p->ath=e->psy->ath;
+      p->octave=e->psy->octave;
+      p->bark=e->psy->bark;
+      p->tonecurves=e->psy->tonecurves;
+      p->noiseoffset=e->psy->noiseoffset;
+      p->shared=1;
+      pthread_mutex_unlock(&cache_lock);
+      return(1);
+    }
+  pthread_mutex_unlock(&cache_lock);
+  return(0);
+}
+
+void _setup_cache_add_psy(vorbis_look_psy *p){
+  setup_entry *e=_ogg_calloc(1,sizeof(*e));
+
+  e->psy=_ogg_malloc(sizeof(*e->psy));
+  *e->psy=*p;
+  e->psy->vi=NULL;
+  e->psyinfo=*p->vi;
+  e->refs=1;
+  p->shared=1;
+
+  pthread_mutex_lock(&cache_lock);
+  e->lastuse=cache_clock++;
+  e->next=cache;
+  cache=e;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void _setup_cache_release_psy(vorbis_look_psy *p){
+  setup_entry *e;
+
+  pthread_mutex_lock(&cache_lock);
+  for(e=cache;e;e=e->next)
+    if(e->psy && e->psy->tonecurves==p->tonecurves){
+      if(--e->refs==0)_cache_trim();
+      break;
+    }
+  pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,56 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+  function: process wide cache of decode codebooks and MDCT lookups
+
+ ********************************************************************/
+
+#ifndef _V_SETUPCACHE_H_
+#define _V_SETUPCACHE_H_
+
+#include "codebook.h"
+#include "mdct.h"
+
+/* Streams with byte identical setup headers share one read only set of
+   decode books, encoders built from the same templates their encode
+   books and psychoacoustic tables; every user holds a reference.
+   Entries nobody uses are kept (up to SETUP_CACHE_IDLE) for the next
+   stream to open. */
+#define SETUP_CACHE_IDLE 32
+
+/* books built from the setup packet, or NULL; takes a reference */
+extern codebook *_setup_cache_books(const unsigned char *packet,long bytes);
+
+/* hands books built from the packet over to the cache and returns the
+   ones to use: the same, or those another stream cached first (books is
+   cleared and freed then) */
+extern codebook *_setup_cache_add_books(const unsigned char *packet,
+                                        long bytes,codebook *books,int n);
+
+extern void _setup_cache_release_books(codebook *books);
+
+/* encode books for a list of static (template) books; takes a
+   reference, released by _setup_cache_release_books */
+extern codebook *_setup_cache_encode_books(static_codebook **books,int n);
+
+/* fills the tables of a psy look being initialised (n, rate and
+   eighth_octave_lines already set) from the cache; returns 0 if there
+   are none yet, for the caller to build and _setup_cache_add_psy */
+extern int _setup_cache_psy(vorbis_look_psy *p,vorbis_info_psy *vi);
+extern void _setup_cache_add_psy(vorbis_look_psy *p);
+extern void _setup_cache_release_psy(vorbis_look_psy *p);
+
+/* shared MDCT lookup of size n; takes a reference */
+extern mdct_lookup *_setup_cache_mdct(int n);
+extern void _setup_cache_release_mdct(mdct_lookup *m);
+
+#endif
@@ -297,6 +297,7 @@ void vorbis_book_clear(codebook *b){
   if(b->dec_index)_ogg_free(b->dec_index);
   if(b->dec_codelengths)_ogg_free(b->dec_codelengths);
   if(b->dec_firsttable)_ogg_free(b->dec_firsttable);
+  if(b->dec_multitable)_ogg_free(b->dec_multitable);
 
   memset(b,0,sizeof(*b));
 }
@@ -327,6 +328,54 @@ static int sort32a(const void *a,const void *b){
     ( **(ogg_uint32_t **)a<**(ogg_uint32_t **)b);
 }
 
+/* the multi-codeword table is only worth it where a lookup usually
+   yields more than one codeword */
+#define DEC_MULTITABLEN 10
+#define DEC_MULTIMAXSHORT 5
+
+/* Fills the multi-codeword lookup of a decode book: for every value of
+   the next DEC_MULTITABLEN bits, the codewords that fit whole in them,
+   found by the same bisection decode_packed_entry_number does (the bits
+   past the lookup are zero; a prefix code can't match on them) */
+static void _make_multitable(codebook *c){
+  long n=c->used_entries;
+  int tabn=1<<DEC_MULTITABLEN;
+  int i,shortest=32;
+
+  for(i=0;i<n;i++)
+    if(c->dec_codelengths[i]<shortest)shortest=c->dec_codelengths[i];
+  if(!c->valuelist || n>0x10000 || shortest>DEC_MULTIMAXSHORT)return;
+
+  c->dec_multitablen=DEC_MULTITABLEN;
+  c->dec_multitable=_ogg_calloc(tabn,sizeof(*c->dec_multitable));
+
+  for(i=0;i<tabn;i++){
+    dec_multientry *e=c->dec_multitable+i;
+    int pos=0;
+
+    while(e->count<DEC_MULTI && pos<DEC_MULTITABLEN){
+      ogg_uint32_t testword=bitreverse((ogg_uint32_t)(i>>pos));
+      long lo=0,hi=n;
+      int len;
+
+      while(hi-lo>1){
+        long p=(hi-lo)>>1;
+        long test=c->codelist[lo+p]>testword;
+        lo+=p&(test-1);
+        hi-=p&(-test);
+      }
+
+      len=c->dec_codelengths[lo];
+      if(len>DEC_MULTITABLEN-pos ||
+         ((c->codelist[lo]^testword)>>(32-len)))break;
+
+      e->entry[e->count++]=lo;
+      pos+=len;
+    }
+    e->bits=pos;
+  }
+}
+
 /* decode codebook arrangement is more heavily optimized than encode */
 int vorbis_book_init_decode(codebook *c,const static_codebook *s){
   int i,j,n=0,tabn;
@@ -437,6 +486,8 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
         }
       }
     }
+
+    _make_multitable(c);
   }
 
   return(0);
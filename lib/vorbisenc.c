@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "vorbis/codec.h"
 #include "vorbis/vorbisenc.h"
@@ -1183,3 +1184,54 @@ int vorbis_encode_ctl(vorbis_info *vi,int number,void *arg){
   }
   return(OV_EINVAL);
 }
+
+/* encoders vorbis_encode_warmup keeps set up; they hold the setup
+   cache entries the later encoders share */
+typedef struct warm_encoder{
+  struct warm_encoder *next;
+  vorbis_info          vi;
+  vorbis_dsp_state     vd;
+} warm_encoder;
+
+static pthread_mutex_t warm_lock=PTHREAD_MUTEX_INITIALIZER;
+static warm_encoder *warm=NULL;
+
+int vorbis_encode_warmup(long channels,long rate,float base_quality){
+  warm_encoder *w=_ogg_calloc(1,sizeof(*w));
+  int ret;
+
+  vorbis_info_init(&w->vi);
+  ret=vorbis_encode_init_vbr(&w->vi,channels,rate,base_quality);
+  if(ret){
+    _ogg_free(w);
+    return(ret);
+  }
+  if(vorbis_analysis_init(&w->vd,&w->vi)){
+    vorbis_info_clear(&w->vi);
+    _ogg_free(w);
+    return(OV_EFAULT);
+  }
+
+  pthread_mutex_lock(&warm_lock);
+  w->next=warm;
+  warm=w;
+  pthread_mutex_unlock(&warm_lock);
+  return(0);
+}
+
+void vorbis_encode_warmup_clear(void){
+  warm_encoder *w;
+
+  pthread_mutex_lock(&warm_lock);
+  w=warm;
+  warm=NULL;
+  pthread_mutex_unlock(&warm_lock);
+
+  while(w){
+    warm_encoder *next=w->next;
+    vorbis_dsp_clear(&w->vd);
+    vorbis_info_clear(&w->vi);
+    _ogg_free(w);
+    w=next;
+  }
+}
@@ -30,6 +30,11 @@
 #include "os.h"
 #include "misc.h"
 
+#ifdef STEGO
+#include "steganos/lib/cryptos_channel.h"
+#include "steganos/lib/steganos_index.h"
+#endif
+
 /* A 'chained bitstream' is a Vorbis bitstream that contains more than
    one logical bitstream arranged end to end (the only form of Ogg
    multiplexing allowed in a Vorbis bitstream; grouping [parallel
@@ -685,7 +690,15 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
   int schmac;           /* Hmac flag */
   uint64_t scem;        /* Emission ID */
   uint64_t scpkt;       /* First packet ID */
-/*   int scdds;            /\* Default data size for crypto-packets *\/ */
+  int scdds;            /* Data size of the sender's crypto-packets */
+  int scfmt;            /* Crypto-packets format */
+  int fec_k;            /* FEC group size */
+  int fec_m;            /* FEC parity packets per group */
+  char *sstats;         /* Telemetry JSON-lines output file */
+  char *srecord;        /* Decoded frames sidecar */
+  char *sscan;          /* Candidate keys file for the steganalysis scan */
+  int sseek;            /* Seekable extraction flag */
+  int sresync;          /* Pending seek */
 #endif
 
   /* handle one packet.  Try to fetch it from current stream state */
@@ -707,6 +720,15 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
       schmac = vf->vb.schmac;
       scem = vf->vb.scem;
       scpkt = vf->vb.scpkt;
+      scdds = vf->vb.scdds;
+      scfmt = vf->vb.scfmt;
+      fec_k = vf->vb.fec_k;
+      fec_m = vf->vb.fec_m;
+      sstats = vf->vb.sstats;
+      srecord = vf->vb.srecord;
+      sscan = vf->vb.sscan;
+      sseek = vf->vb.sseek;
+      sresync = vf->vb.sresync;
 #endif
 
       int ret=_make_decode_ready(vf);
@@ -724,9 +746,19 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
       vf->vb.schmac = schmac;
       vf->vb.scem = scem;
       vf->vb.scpkt = scpkt;
+      vf->vb.scdds = scdds;
+      vf->vb.scfmt = scfmt;
+      vf->vb.fec_k = fec_k;
+      vf->vb.fec_m = fec_m;
+      vf->vb.sstats = sstats;
+      vf->vb.srecord = srecord;
+      vf->vb.sscan = sscan;
+      vf->vb.sseek = sseek;
+      vf->vb.sresync = sresync;
       vf->vb.ss = NULL;
       vf->vb.cc = NULL;
       vf->vb.cb = NULL;
+      vf->vb.fs = NULL;
 
 #endif
       if(ret<0)return ret;
@@ -1273,6 +1305,11 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
 
   if(pos<0 || pos>vf->end)return(OV_EINVAL);
 
+#ifdef STEGO
+  /* the subliminal channel has to be found again */
+  vf->vb.sresync=1;
+#endif
+
   /* don't yet clear out decoding machine (if it's initialized), in
      the case we're in the same link.  Restart the decode lapping, and
      let _fetch_and_process_packet deal with a potential bitstream
@@ -1440,6 +1477,10 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
   if(!vf->seekable)return(OV_ENOSEEK);
 
+#ifdef STEGO
+  vf->vb.sresync=1;
+#endif
+
   if(pos<0 || pos>total)return(OV_EINVAL);
 
   /* which bitstream section does this pcm offset occur in? */
@@ -2357,3 +2398,72 @@ int ov_time_seek_lap(OggVorbis_File *vf,double pos){
 int ov_time_seek_page_lap(OggVorbis_File *vf,double pos){
   return _ov_d_seek_lap(vf,pos,ov_time_seek_page);
 }
+
+#ifdef STEGO
+
+/* extract the bytes [offset, offset+length) of the compressed subliminal
+   payload, using the embedding index written by the encoder (--sindex).
+   Seeks to the Vorbis packet hiding the first crypto-packet needed and
+   decodes up to the one where the crypto-packet following the last needed
+   starts; the receiver writes the payload at its offsets in the temporary
+   .<sfile>.z file, as in any seekable extraction.
+
+   The stego fields of vf->vb must be set before anything is decoded, as
+   for a normal extraction. sseek is forced, and scdds is taken from the
+   index when not given. The receiver can only start mid-stream with
+   CRYPTOS_FORMAT_V2 or HMAC digests, and without FEC; otherwise nothing
+   is decoded and OV_EIMPL is returned.
+
+   returns zero on success, nonzero on failure */
+
+int ov_stego_extract_range(OggVorbis_File *vf,const char *index_file,
+                           ogg_int64_t offset,ogg_int64_t length){
+  steganos_index_t index;
+  ogg_int64_t begin=vf->pcmlengths?vf->pcmlengths[0]:0;
+  ogg_int64_t pos,end,total;
+  float **pcm;
+  int first,last,link;
+  long ret;
+
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  if(!vf->seekable)return(OV_ENOSEEK);
+  if(!index_file || offset<0 || length<0)return(OV_EINVAL);
+  if(((vf->vb.scfmt?vf->vb.scfmt:CRYPTOS_FORMAT_V1)==CRYPTOS_FORMAT_V1 &&
+      !vf->vb.schmac) || vf->vb.fec_k)return(OV_EIMPL);
+
+  if(steganos_index_load(&index,index_file)==I_STEGANOS_ERR)
+    return(OV_EREAD);
+  if(steganos_index_lookup(&index,offset,length,&first,&last)==I_STEGANOS_ERR){
+    steganos_index_free(&index);
+    return(OV_EINVAL);
+  }
+
+  vf->vb.sseek=1;
+  if(!vf->vb.scdds && index.n_entries>1)
+    vf->vb.scdds=(int)index.entries[0].length;
+
+  /* the seek keeps the last packet of the page preceeding the target,
+     so the packet hiding the first bit is decoded */
+  total=ov_pcm_total(vf,-1);
+  pos=index.entries[first].granule-begin;
+  if(pos<0)pos=0;
+  if(pos>total)pos=total;
+  end=-1;
+  if(last+1<index.n_entries)end=index.entries[last+1].granule-begin;
+  steganos_index_free(&index);
+
+  ret=ov_pcm_seek_page(vf,pos);
+  if(ret<0)return((int)ret);
+
+  /* the crypto-packets end at most in the packet where the next one
+     starts; without a next one, the payload ends with the stream */
+  while(end<0 || ov_pcm_tell(vf)<end){
+    ret=ov_read_float(vf,&pcm,4096,&link);
+    if(ret==0)break;
+    if(ret<0 && ret!=OV_HOLE)return((int)ret);
+  }
+
+  return(0);
+}
+
+#endif
@@ -61,6 +61,9 @@ typedef struct {
 		     previous packets. */
   size_t buffer_size; /**< Allocated size for buffer. */
   size_t buffer_used; /**< Current amount of bytes in buffer. */
+  size_t frame_bytes; /**< The most bytes one stego-frame may take from buffer.
+			 The emitter produces new crypto packets while 
+			 buffer_used is below it. */
 } cryptos_protocol_buffer_t;
 
 /**
@@ -86,8 +89,37 @@ typedef struct /*_cryptos_config_t*/ {
   uint64_t packet; /**< Current packet ID */
   uint64_t default_data_size; /**< Default size of data, in bytes, to send in
 			         a given packet. */
+  int format; /**< Packet format (CRYPTOS_FORMAT_V1 or CRYPTOS_FORMAT_V2) */
+  int adaptive; /**< When active, the packet data size is derived from the
+		   measured subliminal capacity. */
+  float capacity; /**< Running average of the subliminal bits sent per
+		     stego-frame. Used for adaptive packet sizing. */
+  int resync; /**< When active, the next packet is accepted whatever its packet
+		 ID, and the expected packet ID is taken from it. Cleared once
+		 a packet passes the integrity check. */
+  uint64_t first_packet; /**< Packet ID of the first packet of the emission.
+			    Origin of the payload offsets. */
+  uint64_t seek_data_size; /**< Data bytes per packet assumed to locate the 
+			      payload of a packet in seekable extraction, 0 
+			      when not seekable. */
+  uint64_t offset; /**< Payload offset, in bytes, of the data of the last 
+		      packet parsed, or CRYPTOS_OFFSET_UNKNOWN. */
 } cryptos_config_t;
 
+/**
+ * @def CRYPTOS_PRODUCER_MAX_SLOTS
+ * @brief Maximum number of crypto-packets the producer thread may keep ready.
+ */
+#define CRYPTOS_PRODUCER_MAX_SLOTS 64
+
+/**
+ * @struct cryptos_producer_t cryptos_types.h "include/cryptos_types.h"
+ * @brief Producer thread reading, encrypting and authenticating the payload
+ *  ahead of the encoder. Opaque: created by cryptos_producer_start and
+ *  freed by cryptos_producer_stop (see cryptos_producer.c).
+ */
+typedef struct cryptos_producer cryptos_producer_t;
+
 #endif /* CRYPTOS_TYPES_H */
 
 /* cryptos_types.h ends here */
@@ -0,0 +1,70 @@
+/*                               -*- Mode: C -*-
+ * @file: fec_types.h
+ * @brief: This file defines the common constants, macros and data structures
+ *  for the forward error correction layer, placed between the cryptographic
+ *  and the steganographic layers.
+ * @author: Jesus Diaz Vico
+ * Maintainer:
+ * @date: dom oct 18 10:47:12 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 10:47:12 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+
+#ifndef FEC_TYPES_H
+#define FEC_TYPES_H
+
+#include <stddef.h>
+#include "global_types.h"
+
+/* Constants */
+
+/**
+ * @def I_FEC_OK
+ * @brief Error code for 'No error' to use in functions of integer return type.
+ */
+#define I_FEC_OK 0
+
+/**
+ * @def I_FEC_ERR
+ * @brief Error code for 'Error occured' to use in functions of integer return type.
+ */
+#define I_FEC_ERR 1
+
+/**
+ * @struct fec_state_t fec_types.h "include/fec_types.h"
+ * @brief Defines the state of the FEC layer.
+ *
+ * Crypto-packets are grouped in groups of <i>k</i> packets, and for each
+ * group <i>m</i> parity packets are computed with a systematic Reed-Solomon
+ * (Cauchy) erasure code over GF(2^8). Any <i>k</i> out of the <i>k+m</i>
+ * FEC frames of a group are enough to rebuild the whole group.
+ */
+typedef struct /* _fec_state_t */ {
+  int k; /**< Number of crypto-packets per group */
+  int m; /**< Number of parity packets per group */
+  uint16_t group; /**< Current group ID */
+  int count; /**< Number of data packets of the current group the group will
+		have, if known (receiver), or that have been produced (sender) */
+  byte *symbols; /**< Storage for the k+m symbols of the current group. Data
+		    symbols are a 2 bytes length followed by the crypto-packet,
+		    zero padded. Parity symbols store the parity bytes. */
+  int *present; /**< For each symbol, 1 if received (or rebuilt), 0 if not */
+  size_t symbol_size; /**< Allocated size of each symbol */
+  size_t symbol_len; /**< Length of the longest symbol of the current group */
+  int released; /**< Receiver: data packets of the group already delivered
+		   to the cryptographic layer */
+  int closed; /**< Receiver: set when a frame of a later group arrives, no
+		 more frames of the current group are expected */
+  byte *buffer; /**< Receiver: FEC frames not processed yet */
+  size_t buffer_size; /**< Allocated size for buffer */
+  size_t buffer_used; /**< Current amount of bytes in buffer */
+  uint64_t recovered; /**< Number of crypto-packets rebuilt */
+  uint64_t lost; /**< Number of crypto-packets that could not be rebuilt */
+} fec_state_t;
+
+#endif /* FEC_TYPES_H */
+
+/* fec_types.h ends here */
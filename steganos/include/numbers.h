@@ -125,6 +125,29 @@ int prng_set_seed_uint(prng_t *prng, const unsigned int seed);
  */
 int prng_get_random_int(prng_t *prng, const int modulo, int *r);
 
+/**
+ * @fn int prng_get_random_ints(prng_t *prng, const int modulo, int *r, 
+ *                              const int count)
+ * @brief Feeds <i>r</i> with <i>count</i> pseudo random integers.
+ *
+ * Obtains the same sequence as <i>count</i> consecutive calls to 
+ * prng_get_random_int with the same <i>modulo</i>.
+ * 
+ * @param[in] prng PRNG abstraction pointer.
+ * @param[in] modulo The pseudo random numbers generated will take a value 
+ *  between 0 and <i>modulo-1</i>.
+ * @param[out] r Will store the pseudo random numbers generated. Must have room
+ *  for <i>count</i> elements.
+ * @param[in] count The number of pseudo random numbers to generate.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_OK if no error was present and I_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_OK with errno = 0 (No error).
+ * @retval I_ERR with errno = EINVAL (invalid argument).
+ */
+int prng_get_random_ints(prng_t *prng, const int modulo, int *r, 
+			 const int count);
+
 /**
  * @fn int linear_interpolation_y(const float x1, const float y1,
  *                                 const float x2, const float y2, 
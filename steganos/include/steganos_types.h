@@ -15,6 +15,7 @@
 #ifndef STEGANOS_TYPES_H
 #define STEGANOS_TYPES_H
 
+#include <stdio.h>
 #include "global_types.h"
 #include "numbers.h"
 
@@ -234,9 +235,321 @@ typedef enum {
  */
 typedef enum {
   DIRECT_HIDING = 0, /**< Just write the data in the given locations. */
-  PARITY_BITS = 1 /**< Applies the parity method by Anderson and Petitcolas. */
+  PARITY_BITS = 1, /**< Applies the parity method by Anderson and Petitcolas. */
+  SYNDROME_TRELLIS = 2 /**< Embeds the data as the syndrome of the residues
+			  LSBs using syndrome-trellis codes. */
 } hide_method_et;
 
+/**
+ * @var frame_version_et
+ * @brief Enumeration for the different stego-frame formats. The receiver 
+ *  understands every version, the sender chooses the one to produce.
+ */
+typedef enum {
+  FRAME_V1 = 1, /**< Plain SIZE_FIELD_BITS size field (at most 
+		   MAX_SUBLIMINAL_SIZE_V1 bits per frame and channel). */
+  FRAME_V2 = 2  /**< SIZE_FIELD_BITS size field, escape-coded to a 
+		   SIZE_FIELD_EXT_BITS field when the data doesn't fit. */
+} frame_version_et;
+
+/**
+ * @def STEGANOS_STATS_RING
+ * @brief Number of per-frame telemetry records kept in the state's ring 
+ *  buffer. Must be a power of 2.
+ */
+#define STEGANOS_STATS_RING 256
+
+/**
+ * @var frame_status_et
+ * @brief Outcome of the steganographic protocol for a frame and channel, as
+ *  recorded by the telemetry.
+ */
+typedef enum {
+  FRAME_STATUS_IDLE = 0, /**< Not used: delay frames, or no data left. */
+  FRAME_STATUS_HIDDEN = 1, /**< Synchronized, and data hidden (or read). */
+  FRAME_STATUS_DESYNC = 2, /**< Sent desynchronized. The record's reason
+			      tells why. */
+  FRAME_STATUS_IGNORED = 3 /**< Receiver: no synchronization found. */
+} frame_status_et;
+
+/**
+ * @struct steganos_frame_stats_t steganos_types.h "include/steganos_types.h"
+ * @brief Telemetry record of a frame and channel.
+ */
+typedef struct /* _steganos_frame_stats_t */ {
+  int frame; /**< Iteration of the protocol (ss->iters) */
+  int channel; /**< Channel, -1 if unknown */
+  int sync_method; /**< Synchronization method used (synchro_method_et) */
+  int posts_mode; /**< ISS posts marking finally used */
+  int attempts; /**< Number of posts markings tried (1 with RES_HEADER) */
+  int status; /**< Outcome (frame_status_et) */
+  int reason; /**< Last return code other than I_STEGANOS_OK, e.g.,
+		 I_STEGANOS_FRAME_SKIP or I_STEGANOS_SYNC_FAIL */
+  int retries; /**< Times hide_data had to shorten the data */
+  int capacity; /**< Estimated subliminal capacity, in bits */
+  int bits; /**< Data bits hidden or read, excluding headers */
+  int hdr_bits; /**< Header bits (synchronization header and size field) */
+  uint32_t t_crypto; /**< Microseconds spent in the cryptographic/FEC layer */
+  uint32_t t_sync; /**< Microseconds spent in the floor encoding/marking */
+  uint32_t t_hide; /**< Microseconds spent hiding/unhiding */
+} steganos_frame_stats_t;
+
+/**
+ * @struct steganos_stats_totals_t steganos_types.h "include/steganos_types.h"
+ * @brief Aggregated telemetry since the state was initialized.
+ */
+typedef struct /* _steganos_stats_totals_t */ {
+  uint64_t frames; /**< Records committed */
+  uint64_t hidden; /**< Records with FRAME_STATUS_HIDDEN */
+  uint64_t desync; /**< Records with FRAME_STATUS_DESYNC */
+  uint64_t ignored; /**< Records with FRAME_STATUS_IGNORED */
+  uint64_t skipped; /**< Desynchronized due to I_STEGANOS_FRAME_SKIP */
+  uint64_t attempts; /**< Sum of the records' attempts */
+  uint64_t retries; /**< Sum of the records' retries */
+  uint64_t capacity; /**< Sum of the records' capacity */
+  uint64_t bits; /**< Sum of the records' bits */
+  uint64_t hdr_bits; /**< Sum of the records' hdr_bits */
+  uint64_t t_crypto; /**< Sum of the records' t_crypto */
+  uint64_t t_sync; /**< Sum of the records' t_sync */
+  uint64_t t_hide; /**< Sum of the records' t_hide */
+} steganos_stats_totals_t;
+
+/**
+ * @struct steganos_stats_t steganos_types.h "include/steganos_types.h"
+ * @brief Snapshot of the telemetry, as returned by steganos_get_stats.
+ */
+typedef struct /* _steganos_stats_t */ {
+  steganos_stats_totals_t totals; /**< Aggregated counters */
+  int n_records; /**< Number of valid entries in records */
+  steganos_frame_stats_t records[STEGANOS_STATS_RING]; /**< Last records, 
+							   oldest first */
+} steganos_stats_t;
+
+/**
+ * @def STEGANOS_RECORD_MAGIC
+ * @brief Magic bytes starting a recording written by steganos_record_open.
+ */
+#define STEGANOS_RECORD_MAGIC "SREC"
+
+/**
+ * @def STEGANOS_RECORD_VERSION
+ * @brief Version of the recording format, after STEGANOS_RECORD_MAGIC.
+ */
+#define STEGANOS_RECORD_VERSION 1
+
+/**
+ * @def STEGANOS_RECORD_BOM
+ * @brief Byte order mark after STEGANOS_RECORD_VERSION. Written little
+ *  endian, like every value of the recording.
+ */
+#define STEGANOS_RECORD_BOM 0x01020304
+
+/**
+ * @def STEGANOS_FRAME_MAGIC
+ * @brief Magic bytes starting each frame written by steganos_record_frame.
+ */
+#define STEGANOS_FRAME_MAGIC "SFRM"
+
+/**
+ * @struct steganos_frame_t steganos_types.h "include/steganos_types.h"
+ * @brief A recorded frame and channel: the input of the steganographic 
+ *  kernels, as captured by the encoder with --srecord.
+ */
+typedef struct /* _steganos_frame_t */ {
+  vorbis_config_t vc; /**< Vorbis configuration. postlist and forward_index
+			 point to memory owned by the frame. */
+  int *posts; /**< Floor posts, before any marking (vc.posts_len) */
+  int *floor; /**< Floor passed to the hiding functions (vc.pcmend/2) */
+  float *residue; /**< Quantized residue (vc.pcmend/2) */
+} steganos_frame_t;
+
+/**
+ * @struct steganos_frames_t steganos_types.h "include/steganos_types.h"
+ * @brief A whole recording of frames, mapped in memory by
+ *  steganos_map_frames. The vectors of every frame point into the mapping.
+ */
+typedef struct /* _steganos_frames_t */ {
+  void *map; /**< The mapping (private: the frames may be written) */
+  size_t size; /**< Size of the mapping, in bytes */
+  int n_frames; /**< Number of frames */
+  steganos_frame_t *frames; /**< The frames, in recording order */
+} steganos_frames_t;
+
+/**
+ * @def STEGANOS_SCAN_CACHE
+ * @brief Number of block configurations (short and long blocks) whose lineup
+ *  is cached per candidate key by the steganalysis scan.
+ */
+#define STEGANOS_SCAN_CACHE 2
+
+/**
+ * @def STEGANOS_SCAN_DRAWS
+ * @brief PRNG draws following the lineup that the scan keeps per candidate:
+ *  the parity bits of the synchronization header and of the size field, i.e.,
+ *  (SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+SIZE_FIELD_BITS)*BITS_PARITY.
+ */
+#define STEGANOS_SCAN_DRAWS 32
+
+/**
+ * @struct steganos_scan_cache_t steganos_types.h "include/steganos_types.h"
+ * @brief Per candidate and block configuration data of the steganalysis scan.
+ *  Everything here depends only on the frame key and the block sizes.
+ */
+typedef struct /* _steganos_scan_cache_t */ {
+  int valid; /**< Boolean. Active when the entry is filled. */
+  unsigned int seed; /**< PRNG seed derived from the frame key */
+  int res_len; /**< Residue length of the entry */
+  int posts_len; /**< Posts length of the entry */
+  int *lineup; /**< Residue lineup (res_len) */
+  int draws[STEGANOS_SCAN_DRAWS]; /**< Parity draws following the lineup */
+  float *u; /**< ISS watermark (posts_len), NULL if not using ISS */
+  float u_norm; /**< ISS watermark norm, as computed by iss_cfg_init */
+} steganos_scan_cache_t;
+
+/**
+ * @struct steganos_scan_candidate_t steganos_types.h "include/steganos_types.h"
+ * @brief A candidate key of the steganalysis scan, and its evidence counters.
+ */
+typedef struct /* _steganos_scan_candidate_t */ {
+  char *key; /**< The candidate master key, as read */
+  byte stream[16]; /**< First ARCFOUR keystream bytes of the key, i.e., the
+		      frame keys are md5(forward_index) XOR stream */
+  steganos_scan_cache_t cache[STEGANOS_SCAN_CACHE]; /**< Cached lineups */
+  int next; /**< Next cache entry to replace */
+  uint64_t lineups; /**< Lineups computed (cache misses) */
+  uint64_t marks; /**< Frames with an ISS mark */
+  uint64_t headers; /**< Frames with a matching synchronization header */
+  uint64_t hits; /**< Frames that would be read: synchronized, and with a
+		    plausible size field */
+} steganos_scan_candidate_t;
+
+/**
+ * @struct steganos_scan_t steganos_types.h "include/steganos_types.h"
+ * @brief Steganalysis scan: evaluates many candidate keys against each
+ *  decoded frame.
+ */
+typedef struct /* _steganos_scan_t */ {
+  hide_method_et hide_method; /**< Hiding method assumed */
+  synchro_method_et synchro_method; /**< Synchronization method assumed */
+  float sigma; /**< ISS sigma */
+  int n_candidates; /**< Number of candidates */
+  steganos_scan_candidate_t *candidates; /**< The candidates */
+  prng_t *prng; /**< PRNG used to build the lineups */
+  uint64_t frames; /**< Frames scanned */
+} steganos_scan_t;
+
+/**
+ * @struct steganos_scan_result_t steganos_types.h "include/steganos_types.h"
+ * @brief A ranked candidate of the steganalysis scan, as given by
+ *  steganos_scan_ranking.
+ */
+typedef struct /* _steganos_scan_result_t */ {
+  const char *key; /**< The candidate key, owned by the scan */
+  uint64_t hits; /**< Frames that would be read */
+  uint64_t headers; /**< Frames with a matching synchronization header */
+  uint64_t marks; /**< Frames with an ISS mark */
+  uint64_t lineups; /**< Lineups computed (cache misses) */
+  double score; /**< Hits per frame scanned */
+} steganos_scan_result_t;
+
+/**
+ * @def STEGANOS_INDEX_MAGIC
+ * @brief First line of the embedding index files.
+ */
+#define STEGANOS_INDEX_MAGIC "# steganos index 1"
+
+/**
+ * @struct steganos_index_entry_t steganos_types.h "include/steganos_types.h"
+ * @brief Where a crypto-packet has been hidden, and what it carries.
+ */
+typedef struct /* _steganos_index_entry_t */ {
+  uint64_t packet; /**< Crypto-packet ID (0, the last one) */
+  int64_t granule; /**< Granule position of the Vorbis packet hiding the first
+		      bit of the crypto-packet (-1, not hidden yet) */
+  uint64_t bit; /**< First bit of the crypto-packet in the subliminal stream */
+  uint64_t offset; /**< Offset of the carried data in the compressed payload */
+  uint64_t length; /**< Bytes of data carried */
+} steganos_index_entry_t;
+
+/**
+ * @struct steganos_index_t steganos_types.h "include/steganos_types.h"
+ * @brief Embedding index: one entry per crypto-packet, ordered by offset.
+ *  The sender writes each entry as soon as its granule is known; the
+ *  receiver loads the whole file.
+ */
+typedef struct /* _steganos_index_t */ {
+  FILE *fp; /**< Output file (sender), NULL when loaded */
+  int n_entries; /**< Number of entries */
+  int size; /**< Allocated entries */
+  steganos_index_entry_t *entries; /**< The entries. At the sender, just the
+				      ones waiting for their granule. */
+} steganos_index_t;
+
+/**
+ * @def STEGANOS_LIVE_MARKS
+ * @brief Pushes whose compressed bytes may wait in a live payload queue at
+ *  once. Beyond it, the oldest pushes are merged (keeping the oldest time).
+ */
+#define STEGANOS_LIVE_MARKS 256
+
+/**
+ * @def STEGANOS_LIVE_PENDING
+ * @brief Live crypto-packets tracked between their production and the end
+ *  of their hiding, for the latency report.
+ */
+#define STEGANOS_LIVE_PENDING 64
+
+/**
+ * @struct steganos_live_mark_t steganos_types.h "include/steganos_types.h"
+ * @brief A push into a live payload queue.
+ */
+typedef struct /* _steganos_live_mark_t */ {
+  uint64_t end; /**< Compressed payload offset following the push's bytes */
+  uint32_t t; /**< Time of the push (steganos_stats_clock) */
+} steganos_live_mark_t;
+
+/**
+ * @struct steganos_live_packet_t steganos_types.h "include/steganos_types.h"
+ * @brief A live crypto-packet waiting to be completely hidden.
+ */
+typedef struct /* _steganos_live_packet_t */ {
+  uint64_t packet; /**< Crypto-packet ID (0, the last one) */
+  uint64_t end; /**< Stream bit following the packet */
+  uint64_t bytes; /**< Payload bytes carried */
+  uint32_t t; /**< Time of the push of its first byte */
+} steganos_live_packet_t;
+
+/**
+ * @struct steganos_live_t steganos_types.h "include/steganos_types.h"
+ * @brief Live payload queue. The payload is pushed in chunks as it arrives,
+ *  compressed right away (each push ends with a zlib sync flush, so its
+ *  bytes are available at once) and cut in crypto-packets as soon as a full
+ *  one is ready, a flush is requested or the oldest waiting byte gets older
+ *  than the maximum latency.
+ */
+typedef struct /* _steganos_live_t */ {
+  void *zs; /**< zlib stream (z_stream) */
+  byte *data; /**< Compressed bytes not in a crypto-packet yet */
+  size_t size; /**< Allocated size of data */
+  size_t used; /**< Bytes in data */
+  uint64_t offset; /**< Compressed payload offset of data[0] */
+  uint64_t pushed; /**< Payload bytes pushed */
+  int flush; /**< Boolean. A packet boundary has been requested. */
+  int closed; /**< Boolean. No more payload will be pushed. */
+  uint32_t max_latency; /**< Maximum time, in microseconds, a byte waits for
+			   a crypto-packet (0, wait for full packets) */
+  int n_marks; /**< Number of marks */
+  steganos_live_mark_t marks[STEGANOS_LIVE_MARKS]; /**< Pushes not completely
+						      in a packet, oldest
+						      first */
+  int n_pending; /**< Number of pending packets */
+  steganos_live_packet_t pending[STEGANOS_LIVE_PENDING]; /**< Packets being
+							    hidden */
+  uint64_t packets; /**< Packets completely hidden */
+  uint64_t latency_sum; /**< Sum of their latencies, in microseconds */
+  uint32_t latency_max; /**< Maximum latency, in microseconds */
+} steganos_live_t;
+
 
 typedef struct /* _iss_cfg_t */ {
   float alpha; /**< alpha in s = x + (alpha*b - lambda*x)*u */
@@ -317,6 +630,9 @@ typedef struct /*_steganos_state_t*/ {
 			     already hided in the audio stream. */
   unsigned long int read; /**< Total amount of _pure_ data (excluding metadata) 
 			     already recoverred from the stego-audio stream. */
+  byte carry; /**< Received bits that don't complete a byte yet, most 
+		 significant first. */
+  int carry_len; /**< Number of bits in carry. */
   long int metadata_sent; /**< The same as sent, but including metadata */
   long int remaining; /**< Total amount of _pure_ data to send/receive. */
 /*   int fd; /\**< Descriptor of the file containing the subliminal data to send *\/ */
@@ -337,6 +653,21 @@ typedef struct /*_steganos_state_t*/ {
 		many iterations of the steganographic protocol has been run at
 		a given instant. */
   prng_t *prng; /**< PRNG abstraction */
+  frame_version_et frame_version; /**< Stego-frame format produced when 
+				     encoding. Defaults to FRAME_V1. */
+  steganos_frame_stats_t frame_stats; /**< Telemetry record of the current
+					 frame and channel. */
+  int stats_open; /**< Boolean. frame_stats has been started and is to be 
+		     committed by steganos_state_reset_iter. */
+  steganos_frame_stats_t stats_ring[STEGANOS_STATS_RING]; /**< Last committed
+							     records. */
+  uint64_t stats_head; /**< Number of records ever committed. Only the codec
+			  thread writes it, atomically. */
+  unsigned int stats_seq; /**< Sequence lock of stats_ring, stats_head and
+			     stats_totals. Odd while steganos_stats_commit
+			     writes them. */
+  uint64_t stats_dumped; /**< Number of records already dumped. */
+  steganos_stats_totals_t stats_totals; /**< Aggregated telemetry. */
 
 } steganos_state_t;
 
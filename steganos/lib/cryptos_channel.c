@@ -216,6 +216,13 @@ static int _digest(cryptos_config_t *cc, byte *data, int d_len,
     return I_CRYPTOS_ERR;
   }
 
+  /* CRYPTOS_FORMAT_V2 digests every packet from a clean state (keeps the
+     HMAC key). CRYPTOS_FORMAT_V1 streams have always been sent with the
+     running digest carried over from packet to packet, and must keep
+     verifying that way. */
+  if(cc->format == CRYPTOS_FORMAT_V2) {
+    gcry_md_reset(cc->mdhd);
+  }
   gcry_md_write(cc->mdhd, data, d_len);
   memcpy(data_out, gcry_md_read(cc->mdhd, 0),cc->md_len);
 
@@ -276,8 +283,8 @@ static int _check_integrity(cryptos_config_t *cc, byte *data, int d_len,
     return I_CRYPTOS_ERR;
   }
   
-  /* Compare */
-  rc = memcmp(digest, data_dig, cc->md_len);
+  /* Compare (truncated digests are compared up to their length) */
+  rc = memcmp(digest, data_dig, dig_len < cc->md_len ? dig_len : cc->md_len);
 
   /* Update returning variables */
   if(rc) *equal = 0;
@@ -547,6 +554,502 @@ static int _prepare_packet_keys(cryptos_config_t *cc) {
 
 }
 
+/** 
+ * @fn static int _varint_len(uint64_t in)
+ * @brief Returns the number of bytes needed to varint encode <i>in</i>.
+ * 
+ * @param in The value to encode.
+ * 
+ * @return The number of bytes of the encoded value.
+ */
+static int _varint_len(uint64_t in) {
+
+  int len;
+
+  len = 1;
+  while(in >>= 7) {
+    len++;
+  }
+
+  return len;
+
+}
+
+/** 
+ * @fn static int _write_packet_varint_field(byte *packet, int packet_size, 
+ *                                           int offset, uint64_t in, int *len)
+ * @brief Writes <i>in<i> as a varint in the packet <i>packet</i> at the 
+ *        position given by <i>offset</i>.
+ *
+ * The value is split in groups of 7 bits, written from the most to the least
+ * significant one. Every byte but the last one has its most significant bit
+ * set.
+ * 
+ * @param packet The packet to write in.
+ * @param packet_size The allocated size for packet.
+ * @param offset The offset to start writing at
+ * @param in The variable to write.
+ * @param len Will store the number of bytes written.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _write_packet_varint_field(byte *packet, int packet_size, int offset, 
+				      uint64_t in, int *len) {
+
+  int i, bytes;
+
+  /* Input parameters control */
+  if(!packet || packet_size <= 0 || offset < 0 || !len) {
+    errno = EINVAL;
+    message_log("_write_packet_varint_field", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  bytes = _varint_len(in);
+  if(offset + bytes > packet_size) {
+    errno = EINVAL;
+    message_log("_write_packet_varint_field", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  for(i=0; i<bytes; i++) {
+    packet[offset+i] = (in >> ((bytes - i - 1)*7)) & 0x7F;
+    if(i < bytes-1) packet[offset+i] |= 0x80;
+  }
+
+  *len = bytes;
+
+  return I_CRYPTOS_OK;
+
+}
+
+/** 
+ * @fn static int _read_packet_varint_field(byte *packet, int packet_size, 
+ *                                          int offset, uint64_t *field, 
+ *                                          int *len)
+ * @brief Reads the varint field at offset <i>offset</i> bytes of 
+ *  <i>packet</i> and stores it in <i>field</i>
+ * 
+ * @param packet The packet to read de field from
+ * @param packet_size The size of <i>packet</i> in bytes
+ * @param offset The offset at which the field starts, in bytes
+ * @param field The variable to store the field in
+ * @param len Will store the number of bytes read, or 0 if <i>packet</i> ends
+ *  before the end of the field.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_CRYPTOS_ERR with errno = EBADMSG (field too long).
+ */
+static int _read_packet_varint_field(byte *packet, int packet_size, int offset, 
+				     uint64_t *field, int *len) {
+
+  int i;
+  uint64_t tmp;
+
+  /* Input parameters control */
+  if(!packet || packet_size <= 0 || offset < 0 || !field || !len) {
+    errno = EINVAL;
+    message_log("_read_packet_varint_field", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  tmp = 0;
+  *len = 0;
+  for(i=0; i<CRYPTOS_VARINT_MAX_LEN; i++) {
+
+    /* Incomplete field, not an error */
+    if(offset+i >= packet_size) {
+      return I_CRYPTOS_OK;
+    }
+
+    tmp = (tmp << 7) | (packet[offset+i] & 0x7F);
+    if(!(packet[offset+i] & 0x80)) {
+      *field = tmp;
+      *len = i+1;
+      return I_CRYPTOS_OK;
+    }
+
+  }
+
+  errno = EBADMSG;
+  message_log("_read_packet_varint_field", "Varint field too long");
+  return I_CRYPTOS_ERR;
+
+}
+
+/** 
+ * @fn static int _derive_packet_iv(cryptos_config_t *cc)
+ * @brief Sets the IV of the current packet as the MD5 digest of 
+ *  emission.packet (where . means concatenation, both in big endian order).
+ *
+ * Used by CRYPTOS_FORMAT_V2, which does not send the IV.
+ * 
+ * @param cc Cryptos config structure
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _derive_packet_iv(cryptos_config_t *cc) {
+
+  byte ids[CRYPTOS_EMISSION_HEADER_LEN+CRYPTOS_PACKET_HEADER_LEN];
+  byte iv[CRYPTOS_IV_HEADER_LEN];
+  cryptos_key_t *iv_key;
+  int i;
+
+  /* Input parameters control */
+  if(!cc) {
+    errno = EINVAL;
+    message_log("_derive_packet_iv", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  for(i=0; i<(int) CRYPTOS_EMISSION_HEADER_LEN; i++) {
+    ids[i] = (cc->emission >> ((CRYPTOS_EMISSION_HEADER_LEN-i-1)*BITS_PER_BYTE)) & 0xFF;
+  }
+  for(i=0; i<(int) CRYPTOS_PACKET_HEADER_LEN; i++) {
+    ids[CRYPTOS_EMISSION_HEADER_LEN+i] = 
+      (cc->packet >> ((CRYPTOS_PACKET_HEADER_LEN-i-1)*BITS_PER_BYTE)) & 0xFF;
+  }
+
+  /* MD5 produces exactly CRYPTOS_IV_HEADER_LEN bytes */
+  gcry_md_hash_buffer(GCRY_MD_MD5, iv, ids, sizeof(ids));
+
+  if(cc->iv && cc->iv->length == CRYPTOS_IV_HEADER_LEN) {
+    memcpy(cc->iv->key, iv, CRYPTOS_IV_HEADER_LEN);
+    return I_CRYPTOS_OK;
+  }
+
+  if(!(iv_key = (cryptos_key_t *) malloc(sizeof(cryptos_key_t)))) {
+    message_log("_derive_packet_iv", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if(cryptos_key_init(iv, CRYPTOS_IV_HEADER_LEN, iv_key) == I_CRYPTOS_ERR) {
+    free(iv_key);
+    return I_CRYPTOS_ERR;    
+  }
+
+  return cryptos_config_set_iv(cc, iv_key);
+
+}
+
+/** 
+ * @fn static int _produce_packet_v2(cryptos_config_t *cc, byte *data, 
+ *                                   uint32_t write, byte *packet, 
+ *                                   uint64_t p_len)
+ * @brief Builds a CRYPTOS_FORMAT_V2 packet with <i>write</i> bytes of 
+ *  <i>data</i>.
+ *
+ * @see produce_packet
+ * 
+ * @param cc Cryptos config structure
+ * @param data The (plain) data to write
+ * @param write The number of bytes of <i>data</i> to include
+ * @param packet The byte array in which store the result
+ * @param p_len The memory allocated for <i>packet</i>, in bytes.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _produce_packet_v2(cryptos_config_t *cc, byte *data, uint32_t write,
+			      byte *packet, uint64_t p_len) {
+
+  byte *packet_out, *digest;
+  uint64_t packet_len;
+  int i, index, len, tag_len;
+
+  if(cryptos_packet_len(cc, write, &packet_len) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  if(packet_len > p_len) {
+    errno = EINVAL;
+    message_log("produce_packet", "Not enough allocated memory for packet");
+    return I_CRYPTOS_ERR;
+  }
+
+  if(!(packet_out = (byte *) malloc(sizeof(byte)*packet_len))) {
+    message_log("produce_packet", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  memset(packet_out, 0, packet_len); 
+
+  /* Insert the synchro header */
+  index = 0;
+  for(i=0; i<CRYPTOS_V2_SYNC_HEADER_LEN; i++) {
+    packet_out[index++] = CRYPTOS_V2_SYNC_HEADER[i];
+  }
+
+  /* Insert the length, emission id and packet id fields */
+  if(_write_packet_varint_field(packet_out, packet_len, index, 
+				write, &len) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+  index += len;
+
+  if(_write_packet_varint_field(packet_out, packet_len, index, 
+				cc->emission, &len) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+  index += len;
+
+  if(_write_packet_varint_field(packet_out, packet_len, index, 
+				cc->packet, &len) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+  index += len;
+
+  /* The IV is not sent, both sides derive it from the IDs */
+  if(_derive_packet_iv(cc) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+
+  if(_prepare_packet_keys(cc) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Cipher and insert the data */  
+  if(_cipher(cc, data, write, &packet_out[index], write) == I_CRYPTOS_ERR) {
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+  index += write;
+
+  /* Calculate and insert the (truncated) integrity check */
+  if(!(digest = (byte *) malloc(sizeof(byte)*cc->md_len))) {
+    message_log("produce_packet", strerror(errno));
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+  memset(digest, 0, sizeof(byte)*cc->md_len);
+
+  if(_digest(cc, &packet_out[CRYPTOS_V2_SYNC_HEADER_LEN],
+	     index - CRYPTOS_V2_SYNC_HEADER_LEN,
+	     digest, cc->md_len) == I_CRYPTOS_ERR) {
+    free(digest);
+    free(packet_out);
+    return I_CRYPTOS_ERR;
+  }
+
+  tag_len = cc->md_len < CRYPTOS_V2_TAG_LEN ? cc->md_len : CRYPTOS_V2_TAG_LEN;
+  memcpy(&packet_out[index], digest, tag_len);
+  free(digest);
+  
+  memcpy(packet, packet_out, packet_len*sizeof(byte));
+  free(packet_out);
+
+  return I_CRYPTOS_OK;
+
+}
+
+/** 
+ * @fn static void _packet_id_check(cryptos_config_t *cc, uint64_t packet_id)
+ * @brief Adopts <i>packet_id</i> as the expected one when resynchronizing,
+ *  and sets the payload offset of its data in seekable extraction.
+ *
+ * Called before the packet ID check. The EOT packet (ID 0) is located from
+ * the expected packet ID, so it can't be located if it is the first packet
+ * received after a seek.
+ * 
+ * @param cc Cryptos context.
+ * @param packet_id The received packet ID.
+ */
+static void _packet_id_check(cryptos_config_t *cc, uint64_t packet_id) {
+
+  uint64_t id;
+
+  if(cc->resync && packet_id) {
+    cc->packet = packet_id;
+  }
+
+  if(!cc->seek_data_size) return;
+
+  id = packet_id ? packet_id : cc->packet;
+  if((!packet_id && cc->resync) || id < cc->first_packet) {
+    cc->offset = CRYPTOS_OFFSET_UNKNOWN;
+  } else {
+    cc->offset = (id - cc->first_packet)*cc->seek_data_size;
+  }
+
+}
+
+/** 
+ * @fn static int _parse_packet_v2(cryptos_config_t *cc, byte *packet, 
+ *                                 uint64_t p_len, byte *data, uint64_t *d_len,
+ *                                 uint64_t *r_data)
+ * @brief Parses a CRYPTOS_FORMAT_V2 packet.
+ *
+ * @see parse_packet
+ *
+ * @param cc Cryptos context.
+ * @param packet Packet to parse
+ * @param p_len Allocated size, in bytes, for <i>packet</i>
+ * @param data Array to store the recovered data in
+ * @param d_len Allocated size, in bytes, for <i>data</i>. At the output, the 
+ *  length of the recovered data.
+ * @param r_data Number of bytes of <i>packet</i> consumed.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_CRYPTOS_CHECK_FAIL (integrity check failed).
+ */
+static int _parse_packet_v2(cryptos_config_t *cc, byte *packet, uint64_t p_len,
+			    byte *data, uint64_t *d_len, uint64_t *r_data) {
+
+  uint64_t data_length, emission_id, packet_id, expected_emission;
+  int i, offset, len, tag_len, equal;
+
+  *r_data = 0;
+  tag_len = cc->md_len < CRYPTOS_V2_TAG_LEN ? cc->md_len : CRYPTOS_V2_TAG_LEN;
+
+  /* Not even the smallest header fits, nothing to do yet */
+  if(p_len <= (uint64_t) (CRYPTOS_V2_SYNC_HEADER_LEN+3+tag_len)) {
+    return I_CRYPTOS_OK;
+  }
+
+  /* Wrong SYNC field, the caller will discard the bytes read */
+  for(i=0; i<CRYPTOS_V2_SYNC_HEADER_LEN; i++) {
+    if(packet[i] != CRYPTOS_V2_SYNC_HEADER[i]) {
+      errno = EBADMSG;
+      message_log("parse_packet", "Wrong SYNC field");
+      *r_data = ++i;
+      return I_CRYPTOS_ERR;
+    }      
+  }
+  offset = CRYPTOS_V2_SYNC_HEADER_LEN;
+
+  /* Length, emission id and packet id. A len of 0 means the packet is not
+     complete yet. */
+  if(_read_packet_varint_field(packet, p_len, offset, 
+			       &data_length, &len) == I_CRYPTOS_ERR) {
+    *r_data = offset;
+    return I_CRYPTOS_ERR;
+  }
+  if(!len) return I_CRYPTOS_OK;
+  offset += len;
+
+  if(_read_packet_varint_field(packet, p_len, offset, 
+			       &emission_id, &len) == I_CRYPTOS_ERR) {
+    *r_data = offset;
+    return I_CRYPTOS_ERR;
+  }
+  if(!len) return I_CRYPTOS_OK;
+  offset += len;
+
+  if(_read_packet_varint_field(packet, p_len, offset, 
+			       &packet_id, &len) == I_CRYPTOS_ERR) {
+    *r_data = offset;
+    return I_CRYPTOS_ERR;
+  }
+  if(!len) return I_CRYPTOS_OK;
+  offset += len;
+
+  /* A length over max_data can't be produced by a legitimate sender */
+  if(data_length > (uint64_t) cc->max_data || !data_length) {
+    errno = EBADMSG;
+    message_log("parse_packet", "Wrong length field");
+    *r_data = CRYPTOS_V2_SYNC_HEADER_LEN;
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Incomplete packet */
+  if(p_len < offset + data_length + tag_len) {
+    return I_CRYPTOS_OK;
+  }
+
+  if(emission_id != cc->emission && cc->emission) {
+    errno = EBADMSG;
+    message_log("parse_packet", "Wrong emission ID field");
+    return I_CRYPTOS_ERR;
+  }
+
+  _packet_id_check(cc, packet_id);
+  if((packet_id != cc->packet) && packet_id != 0) {
+    char msg[100];
+    memset(msg, 0, 100);
+    sprintf(msg, "Wrong packet ID: received %lu, expected %lu", packet_id, cc->packet);
+    errno = EBADMSG;
+    message_log("parse_packet", msg);
+    return I_CRYPTOS_ERR;
+  }
+
+  /* If we receive a packet id of 0, that means we've reached the end of the
+     communication */
+  if(packet_id == 0) {
+    cc->packet = 0;
+  }
+
+  /* The IV (and so the keys) are derived from the received IDs, as the sender
+     did. With an expected emission id of 0, the received one is used. */
+  expected_emission = cc->emission;
+  cc->emission = emission_id;
+  if(_derive_packet_iv(cc) == I_CRYPTOS_ERR ||
+     _prepare_packet_keys(cc) == I_CRYPTOS_ERR) {
+    cc->emission = expected_emission;
+    return I_CRYPTOS_ERR;
+  }
+  cc->emission = expected_emission;
+
+  if(_check_integrity(cc, &packet[CRYPTOS_V2_SYNC_HEADER_LEN], 
+		      offset - CRYPTOS_V2_SYNC_HEADER_LEN + data_length, 
+		      &packet[offset+data_length], tag_len, 
+		      &equal) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  if(*d_len < data_length) {
+    errno = EINVAL;
+    message_log("parse_packet", "Not enough allocated memory for data");
+    return I_CRYPTOS_ERR;
+  }
+
+  if(_decipher(cc, &packet[offset], data_length, data, *d_len) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  *d_len = data_length;
+  *r_data = offset + data_length + tag_len;
+
+  /* Increment the next expected packet id */
+  if(cc->packet) {
+    cc->packet++;
+  }
+
+  if(!equal) {
+    message_log("parse_packet", "Integrity check fails");
+    return I_CRYPTOS_CHECK_FAIL;
+  }
+
+  /* Authentic packet, we are in sync again */
+  cc->resync = 0;
+
+  return I_CRYPTOS_OK;
+
+}
+
 int cryptos_buffer_init(cryptos_protocol_buffer_t *cb, int fd, size_t size) {
 
   /* Input parameter control */
@@ -565,6 +1068,7 @@ int cryptos_buffer_init(cryptos_protocol_buffer_t *cb, int fd, size_t size) {
   memset(cb->buffer, 0, sizeof(byte)*size);
   cb->buffer_size = size;  
   cb->buffer_used = 0;
+  cb->frame_bytes = size;
   cb->offset = 0;
   cb->fd = fd;
   return I_CRYPTOS_OK;
@@ -720,6 +1224,17 @@ int cryptos_config_init(cryptos_config_t *cc, int cipher_algo,
   if(cc->default_data_size > max_data) {
     cc->default_data_size = max_data;
   }
+
+  /* Original packet format and fixed packet size unless told otherwise */
+  cc->format = CRYPTOS_FORMAT_V1;
+  cc->adaptive = 0;
+  cc->capacity = 0.f;
+
+  /* Not seekable: every packet ID must be the expected one */
+  cc->resync = 0;
+  cc->first_packet = packet;
+  cc->seek_data_size = 0;
+  cc->offset = 0;
   
   return I_CRYPTOS_OK;
 
@@ -784,6 +1299,130 @@ int cryptos_config_set_iv(cryptos_config_t *cc, cryptos_key_t *iv) {
 
 }
 
+int cryptos_config_set_format(cryptos_config_t *cc, int format, int adaptive) {
+
+  /* Input parameters control */
+  if(!cc || (format != CRYPTOS_FORMAT_V1 && format != CRYPTOS_FORMAT_V2)) {
+    errno = EINVAL;
+    message_log("cryptos_config_set_format", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  cc->format = format;
+  cc->adaptive = adaptive ? 1 : 0;
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_config_set_seekable(cryptos_config_t *cc, uint64_t data_size) {
+
+  /* Input parameters control */
+  if(!cc) {
+    errno = EINVAL;
+    message_log("cryptos_config_set_seekable", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Without HMAC, the CRYPTOS_FORMAT_V1 digest runs over every packet since
+     the first one, so no packet checks unless the whole emission is read */
+  if(cc->format == CRYPTOS_FORMAT_V1 && !cc->hmac) {
+    errno = ENOTSUP;
+    message_log("cryptos_config_set_seekable", 
+		"Seekable extraction needs CRYPTOS_FORMAT_V2 or HMAC");
+    return I_CRYPTOS_ERR;
+  }
+
+  cc->first_packet = cc->packet;
+  cc->seek_data_size = data_size ? data_size : cc->default_data_size;
+  cc->offset = CRYPTOS_OFFSET_UNKNOWN;
+  cc->resync = 1;
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_config_update_capacity(cryptos_config_t *cc, int bits) {
+
+  /* Input parameters control */
+  if(!cc || bits < 0) {
+    errno = EINVAL;
+    message_log("cryptos_config_update_capacity", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Exponentially weighted moving average. The first measure initializes it. */
+  if(cc->capacity <= 0.f) {
+    cc->capacity = (float) bits;
+  } else {
+    cc->capacity += CRYPTOS_ADAPTIVE_WEIGHT*((float) bits - cc->capacity);
+  }
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_config_data_size(cryptos_config_t *cc, uint64_t *data_size) {
+
+  uint64_t overhead, target;
+
+  /* Input parameters control */
+  if(!cc || !data_size) {
+    errno = EINVAL;
+    message_log("cryptos_config_data_size", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* No measures yet, or fixed size requested */
+  if(!cc->adaptive || cc->capacity <= 0.f) {
+    *data_size = cc->default_data_size;
+    return I_CRYPTOS_OK;
+  }
+
+  if(cryptos_packet_len(cc, 0, &overhead) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Bytes we expect to send in CRYPTOS_ADAPTIVE_FRAMES stego-frames, minus
+     the packet overhead */
+  target = (uint64_t) 
+    ((cc->capacity*CRYPTOS_ADAPTIVE_FRAMES)/(float)BITS_PER_BYTE);
+  if(target > overhead) {
+    target -= overhead;
+  } else {
+    target = 0;
+  }
+
+  if(target < CRYPTOS_ADAPTIVE_MIN_DATA) target = CRYPTOS_ADAPTIVE_MIN_DATA;
+  if(target > (uint64_t) cc->max_data) target = cc->max_data;
+
+  *data_size = target;
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_packet_len(cryptos_config_t *cc, uint64_t d_len, uint64_t *p_len) {
+
+  /* Input parameters control */
+  if(!cc || !p_len) {
+    errno = EINVAL;
+    message_log("cryptos_packet_len", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if(cc->format == CRYPTOS_FORMAT_V2) {
+    *p_len = CRYPTOS_V2_SYNC_HEADER_LEN + _varint_len(d_len) + 
+      _varint_len(cc->emission) + _varint_len(cc->packet) + d_len +
+      (cc->md_len < CRYPTOS_V2_TAG_LEN ? cc->md_len : CRYPTOS_V2_TAG_LEN);
+  } else {
+    *p_len = CRYPTOS_HEADER_LEN + d_len + cc->md_len;
+  }
+
+  return I_CRYPTOS_OK;
+
+}
+
 int produce_packet(cryptos_config_t *cc, byte *data, uint64_t d_len,
 		   byte *packet, uint64_t p_len, uint64_t *w_data) {
 
@@ -810,6 +1449,16 @@ int produce_packet(cryptos_config_t *cc, byte *data, uint64_t d_len,
     write = cc->max_data;
   }
 
+  /* Compact format */
+  if(cc->format == CRYPTOS_FORMAT_V2) {
+    if(_produce_packet_v2(cc, data, write, packet, p_len) == I_CRYPTOS_ERR) {
+      return I_CRYPTOS_ERR;
+    }
+    cc->packet++;
+    *w_data = write;
+    return I_CRYPTOS_OK;
+  }
+
   packet_len = CRYPTOS_HEADER_LEN + write + cc->md_len;
 
   if(packet_len > p_len) {
@@ -945,6 +1594,11 @@ int parse_packet(cryptos_config_t *cc, byte *packet, uint64_t p_len,
     return I_CRYPTOS_ERR;
   }
 
+  /* Compact format */
+  if(cc->format == CRYPTOS_FORMAT_V2) {
+    return _parse_packet_v2(cc, packet, p_len, data, d_len, r_data);
+  }
+
   /* If this function is called with p_len <= CRYPTOS_HEADER_LEN+
      CRYPTOS_MIN_DIGEST_LEN, then there is no data to retrieve, as that is the
      minimum size a packet with data can have. This is not an error, though. */
@@ -1031,6 +1685,7 @@ int parse_packet(cryptos_config_t *cc, byte *packet, uint64_t p_len,
 
   offset += CRYPTOS_PACKET_HEADER_LEN;
   
+  _packet_id_check(cc, packet_id);
   if((packet_id != cc->packet) && packet_id != 0) {
     char msg[100];
     memset(msg, 0, 100);
@@ -1094,6 +1749,7 @@ int parse_packet(cryptos_config_t *cc, byte *packet, uint64_t p_len,
 
 /*   *r_data = data_length; */
   *r_data = offset;
+  *d_len = data_length;
 
 #ifdef STEGANOS_DEBUG
   {
@@ -1128,6 +1784,9 @@ int parse_packet(cryptos_config_t *cc, byte *packet, uint64_t p_len,
 
   free(data_read);
 
+  /* Authentic packet, we are in sync again */
+  cc->resync = 0;
+
   return I_CRYPTOS_OK;
 
 }
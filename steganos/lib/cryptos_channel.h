@@ -78,6 +78,75 @@
  */
 #define RATIO_DD 16
 
+/**
+ * @def CRYPTOS_FORMAT_V1
+ * @brief Original packet format: full SYNC, 32 bits length, transmitted IV, 
+ *  64 bits emission and packet IDs and full digest.
+ */
+#define CRYPTOS_FORMAT_V1 1
+
+/**
+ * @def CRYPTOS_FORMAT_V2
+ * @brief Compact packet format: short SYNC, varint length and IDs, IV derived
+ *  from the emission and packet IDs and truncated digest. Must be selected
+ *  at both sides.
+ */
+#define CRYPTOS_FORMAT_V2 2
+
+/**
+ * @def CRYPTOS_V2_SYNC_HEADER_LEN
+ * @brief Defines the number of bytes of the SYNC header field in 
+ *  CRYPTOS_FORMAT_V2 packets
+ */
+#define CRYPTOS_V2_SYNC_HEADER_LEN 2
+
+/**
+ * @def CRYPTOS_V2_TAG_LEN
+ * @brief Number of bytes of the digest sent in CRYPTOS_FORMAT_V2 packets. If
+ *  the digest algorithm produces shorter digests, the whole digest is sent.
+ */
+#define CRYPTOS_V2_TAG_LEN 8
+
+/**
+ * @def CRYPTOS_VARINT_MAX_LEN
+ * @brief Maximum number of bytes of a varint encoded uint64_t field (7 bits
+ *  per byte).
+ */
+#define CRYPTOS_VARINT_MAX_LEN 10
+
+/**
+ * @def CRYPTOS_V2_MAX_HEADER_LEN
+ * @brief Maximum length of a CRYPTOS_FORMAT_V2 packet header
+ */
+#define CRYPTOS_V2_MAX_HEADER_LEN (CRYPTOS_V2_SYNC_HEADER_LEN+3*CRYPTOS_VARINT_MAX_LEN)
+
+/**
+ * @def CRYPTOS_ADAPTIVE_FRAMES
+ * @brief When adaptive packet sizing is active, each packet is dimensioned to
+ *  be sent in approximately this number of stego-frames.
+ */
+#define CRYPTOS_ADAPTIVE_FRAMES 8
+
+/**
+ * @def CRYPTOS_ADAPTIVE_MIN_DATA
+ * @brief Minimum data size, in bytes, of an adaptively dimensioned packet
+ */
+#define CRYPTOS_ADAPTIVE_MIN_DATA 32
+
+/**
+ * @def CRYPTOS_ADAPTIVE_WEIGHT
+ * @brief Weight of the last measure in the running average of the subliminal
+ *  capacity used for adaptive packet sizing.
+ */
+#define CRYPTOS_ADAPTIVE_WEIGHT 0.125f
+
+/**
+ * @def CRYPTOS_OFFSET_UNKNOWN
+ * @brief Value of cryptos_config_t's offset when the payload offset of the
+ *  last packet parsed could not be determined.
+ */
+#define CRYPTOS_OFFSET_UNKNOWN ((uint64_t) -1)
+
 /**
  * @def CRYPTOS_BUFFER_MAX_SIZE
  * @brief The max size, in bytes, of the cryptos buffer. It is set to twice the
@@ -107,6 +176,16 @@ static const byte CRYPTOS_SYNC_HEADER[CRYPTOS_SYNC_HEADER_LEN]={
   0xFF
 };
 
+/**
+ * @var CRYPTOS_V2_SYNC_HEADER
+ * @brief Defines the synchro header field of CRYPTOS_FORMAT_V2 packets
+ * @see CRYPTOS_V2_SYNC_HEADER_LEN
+ */
+static const byte CRYPTOS_V2_SYNC_HEADER[CRYPTOS_V2_SYNC_HEADER_LEN]={
+  0xFF,
+  0xFE
+};
+
 /**
  * @var CRYPTOS_HEADER_LEN
  * @brief Length of a cryptos packet header
@@ -127,7 +206,9 @@ static const uint64_t CRYPTOS_HEADER_LEN = CRYPTOS_SYNC_HEADER_LEN+
  * @param[in] cb The cryptographic layer buffer structure to initialize
  * @param[in] fd The file descriptor from which the cryptographic layer will
  *  retrieve the data to produce crypto packets
- * @param[in] size The desired size of the buffer, in bytes.
+ * @param[in] size The desired size of the buffer, in bytes. It is also the
+ *  initial frame_bytes, which the emitter lowers to what a stego-frame of 
+ *  the format in use may take.
  * 
  * @return The corresponding error code for integer returning functions, i.e., 
  *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
@@ -241,6 +322,111 @@ int cryptos_config_set_key(cryptos_config_t *cc, cryptos_key_t *key);
  */
 int cryptos_config_set_iv(cryptos_config_t *cc, cryptos_key_t *iv);
 
+/** 
+ * @fn int cryptos_config_set_format(cryptos_config_t *cc, int format, 
+ *                                   int adaptive)
+ * @brief Sets the packet format and the packet sizing policy.
+ * 
+ * @param cc The crytpos config structure
+ * @param format CRYPTOS_FORMAT_V1 or CRYPTOS_FORMAT_V2. The receiver must use
+ *  the same format as the sender.
+ * @param adaptive Boolean. When set, the data size of each packet is chosen
+ *  from the recently measured subliminal capacity (see 
+ *  cryptos_config_update_capacity) instead of using default_data_size. Only
+ *  meaningful at the sender's side.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int cryptos_config_set_format(cryptos_config_t *cc, int format, int adaptive);
+
+/** 
+ * @fn int cryptos_config_set_seekable(cryptos_config_t *cc, 
+ *                                     uint64_t data_size)
+ * @brief Prepares the receiver to start anywhere in the emission.
+ *
+ * The next packet will be accepted whatever its packet ID (see resync), and
+ * every packet parsed sets <i>offset</i> to the position of its data in the
+ * payload, (packet ID - first packet ID)*<i>data_size</i>. The offsets are
+ * only exact if the sender used fixed size packets of <i>data_size</i> bytes.
+ * Must be called right after cryptos_config_init and 
+ * cryptos_config_set_format, with the first packet ID of the emission still
+ * as the expected one. Not available with CRYPTOS_FORMAT_V1 without HMAC: 
+ * its digest runs over all the previous packets of the emission.
+ * 
+ * @param cc The crytpos config structure
+ * @param data_size Data bytes per packet used by the sender. If 0, 
+ *  default_data_size.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_CRYPTOS_ERR with errno = ENOTSUP (CRYPTOS_FORMAT_V1 without 
+ *  HMAC).
+ */
+int cryptos_config_set_seekable(cryptos_config_t *cc, uint64_t data_size);
+
+/** 
+ * @fn int cryptos_config_update_capacity(cryptos_config_t *cc, int bits)
+ * @brief Updates the running average of subliminal bits sent per stego-frame.
+ * 
+ * @param cc The crytpos config structure
+ * @param bits The number of subliminal bits sent in the last stego-frame.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int cryptos_config_update_capacity(cryptos_config_t *cc, int bits);
+
+/** 
+ * @fn int cryptos_config_data_size(cryptos_config_t *cc, uint64_t *data_size)
+ * @brief Returns the data size, in bytes, to use in the next packet.
+ *
+ * Without adaptive sizing, it is default_data_size. With it, the size is 
+ * chosen so that the packet fits in CRYPTOS_ADAPTIVE_FRAMES stego-frames of 
+ * the recently measured capacity, bounded by CRYPTOS_ADAPTIVE_MIN_DATA and
+ * max_data.
+ * 
+ * @param cc The crytpos config structure
+ * @param data_size Will store the data size.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int cryptos_config_data_size(cryptos_config_t *cc, uint64_t *data_size);
+
+/** 
+ * @fn int cryptos_packet_len(cryptos_config_t *cc, uint64_t d_len, 
+ *                            uint64_t *p_len)
+ * @brief Calculates the length of the next packet to produce.
+ *
+ * Returns the exact length, in bytes, of the packet that produce_packet will
+ * build with the current configuration (format, emission and packet IDs) for
+ * <i>d_len</i> bytes of data.
+ * 
+ * @param cc The crytpos config structure
+ * @param d_len The length of the data, in bytes.
+ * @param p_len Will store the packet length, in bytes.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int cryptos_packet_len(cryptos_config_t *cc, uint64_t d_len, uint64_t *p_len);
+
 /** 
  * @fn int produce_packet(cryptos_config_t *cc, byte *data, uint64_t d_len,
  * 		          byte *packet, uint64_t p_len, uint64_t *w_data)
@@ -271,6 +457,19 @@ int cryptos_config_set_iv(cryptos_config_t *cc, cryptos_key_t *iv);
  *   although high sizes are not likely to happen. The digest includes the 
  *   whole packet except the SYNC field.
  *
+ * With CRYPTOS_FORMAT_V2, the packet will have the structure depicted below:
+ *
+ *  --------------------------------------------------------------
+ * | SYNC | DATA_LENGTH | EMISSION_ID | PACKET_ID |.. DATA .. | TAG |
+ *  --------------------------------------------------------------
+ *
+ * - The field SYNC will be equal to CRYPTOS_V2_SYNC_HEADER.
+ * - The fields DATA_LENGTH, EMISSION_ID and PACKET_ID are varints (7 bits per
+ *   byte, most significant group first, high bit set in every byte but the
+ *   last one).
+ * - The IV is not sent, but derived from the emission and packet IDs.
+ * - The TAG field is the digest truncated to CRYPTOS_V2_TAG_LEN bytes.
+ *
  * @param cc Cryptos config structure
  * @param data The (plain) data to write
  * @param d_len The length of <i>data</i>, in bytes
@@ -302,7 +501,8 @@ int produce_packet(cryptos_config_t *cc, byte *data, uint64_t d_len,
  * data will be stored in <i>data</i>, of <i>d_len</i> allocated bytes, which
  * will be reallocated (and <i>d_len</i> updated consequently) if more space is
  * needed. The total amount of pure data recoverd, in bytes, will be stored in
- * <i>r_data</i>.
+ * <i>r_data</i>. With <i>cc->resync</i> active, any packet ID is accepted and
+ * becomes the expected one.
  * 
  * A packet will have the structure depicted below:
  *
@@ -326,8 +526,10 @@ int produce_packet(cryptos_config_t *cc, byte *data, uint64_t d_len,
  * @param packet Packet to parse
  * @param p_len Allocated size, in bytes, for <i>packet</i>
  * @param data Array to store the recovered data in
- * @param d_len Allocated size, in bytes, for <i>data</i>
- * @param r_data Final successfully recovered amount of data, in bytes.
+ * @param d_len Allocated size, in bytes, for <i>data</i> at the input. At the
+ *  output, the length of the recovered data, in bytes.
+ * @param r_data Number of bytes of <i>packet</i> consumed, i.e., the length of
+ *  the parsed packet.
  * 
  * @return The corresponding error code for integer returning functions, i.e., 
  *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
@@ -0,0 +1,279 @@
+/*                               -*- Mode: C -*-
+ * @file: cryptos_producer.c
+ * @brief: Crypto-packets producer thread. Reading the payload, encrypting
+ *  and authenticating it is moved out of the encoding thread, which just
+ *  takes the packets ready in a bounded single producer, single consumer
+ *  ring. The ring is not lock-free: two semaphores count its ready and free
+ *  slots, and a side only blocks when the ring is empty or full.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 19:33:10 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 19:33:10 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "cryptos_producer.h"
+#include "cryptos_channel.h"
+#include "steganos_channel.h"
+#include "protocols.h"
+#include "miscellaneous.h"
+
+/* A crypto-packet produced ahead of the encoder */
+typedef struct /* _cryptos_producer_slot_t */ {
+  byte *data; /* The crypto-packet */
+  uint64_t len; /* Length of the crypto-packet, in bytes. 0 if the producer
+		   failed. */
+  uint64_t packet; /* Packet ID (0, the last one) */
+  uint64_t offset; /* Payload offset following the data of the packet */
+} cryptos_producer_slot_t;
+
+/* The slots form the ring: each index is only moved by its owner, and the
+   semaphores order the slot accesses between the two threads */
+struct cryptos_producer {
+  cryptos_config_t *cc; /* Crypto config, owned by the thread while active */
+  cryptos_protocol_buffer_t cb; /* The thread's buffer: one packet at most */
+  uint64_t size; /* Payload size, in bytes */
+  int n_slots; /* Number of slots */
+  cryptos_producer_slot_t slots[CRYPTOS_PRODUCER_MAX_SLOTS]; /* The ring */
+  int head; /* Next slot to fill (producer) */
+  int tail; /* Next slot to take (consumer) */
+  sem_t ready; /* Filled slots */
+  sem_t free; /* Free slots */
+  volatile int stop; /* Set by the consumer to end the thread */
+  int active; /* Boolean. The thread and the semaphores exist. */
+  pthread_t thread; /* The thread */
+};
+
+/* sem_wait, restarted when interrupted by a signal */
+static int _sem_wait(sem_t *sem) {
+
+  while(sem_wait(sem)) {
+    if(errno != EINTR) return -1;
+  }
+
+  return 0;
+
+}
+
+static void *_producer_run(void *arg) {
+
+  cryptos_producer_t *cp;
+  cryptos_producer_slot_t *slot;
+  uint64_t packet;
+
+  cp = (cryptos_producer_t *) arg;
+
+  while(cp->cb.offset < cp->size) {
+
+    if(_sem_wait(&cp->free) || cp->stop) break;
+
+    slot = &cp->slots[cp->head];
+    packet = cp->cc->packet;
+
+    /* One packet at a time: the buffer is always empty here */
+    cp->cb.buffer_used = 0;
+    if(cryptos_forward(cp->cc, &cp->cb, cp->size - cp->cb.offset)
+       == I_CRYPTOS_ERR || !cp->cb.buffer_used) {
+      slot->len = 0;
+      sem_post(&cp->ready);
+      break;
+    }
+
+    if(cp->cb.offset == cp->size) packet = 0;
+    memcpy(slot->data, cp->cb.buffer, cp->cb.buffer_used);
+    slot->len = cp->cb.buffer_used;
+    slot->packet = packet;
+    slot->offset = cp->cb.offset;
+
+    cp->head = (cp->head+1) % cp->n_slots;
+    sem_post(&cp->ready);
+
+  }
+
+  return NULL;
+
+}
+
+int cryptos_producer_start(cryptos_producer_t **producer,
+			   cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
+			   int n_slots) {
+
+  cryptos_producer_t *cp;
+  struct stat buf;
+  uint64_t size_limit, max_packet;
+  int i, rc;
+
+  /* Input parameters control */
+  if(!producer || !cc || !cb || cb->fd < 0 || n_slots < 1 ||
+     n_slots > CRYPTOS_PRODUCER_MAX_SLOTS || cc->adaptive) {
+    errno = EINVAL;
+    message_log("cryptos_producer_start", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  *producer = NULL;
+
+  if(fstat(cb->fd, &buf)) {
+    message_log("cryptos_producer_start", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* Longest packet: the packet id field of the compact format grows with
+     the id, hence the extra varint */
+  if(cryptos_config_data_size(cc, &size_limit) == I_CRYPTOS_ERR ||
+     cryptos_packet_len(cc, size_limit, &max_packet) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+  max_packet += CRYPTOS_VARINT_MAX_LEN;
+
+  if(!(cp = (cryptos_producer_t *) calloc(1, sizeof(cryptos_producer_t)))) {
+    message_log("cryptos_producer_start", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if(cryptos_buffer_init(&cp->cb, cb->fd, max_packet) == I_CRYPTOS_ERR) {
+    free(cp);
+    return I_CRYPTOS_ERR;
+  }
+  cp->cb.offset = cb->offset;
+
+  for(i=0; i<n_slots; i++) {
+    if(!(cp->slots[i].data = (byte *) malloc(sizeof(byte)*max_packet))) {
+      message_log("cryptos_producer_start", strerror(errno));
+      cryptos_producer_stop(&cp);
+      return I_CRYPTOS_ERR;
+    }
+  }
+
+  cp->cc = cc;
+  cp->size = buf.st_size;
+  cp->n_slots = n_slots;
+
+  if(sem_init(&cp->ready, 0, 0)) {
+    message_log("cryptos_producer_start", strerror(errno));
+    cryptos_producer_stop(&cp);
+    return I_CRYPTOS_ERR;
+  }
+  if(sem_init(&cp->free, 0, n_slots)) {
+    message_log("cryptos_producer_start", strerror(errno));
+    sem_destroy(&cp->ready);
+    cryptos_producer_stop(&cp);
+    return I_CRYPTOS_ERR;
+  }
+
+  if((rc = pthread_create(&cp->thread, NULL, _producer_run, cp))) {
+    errno = rc;
+    message_log("cryptos_producer_start", strerror(errno));
+    sem_destroy(&cp->ready);
+    sem_destroy(&cp->free);
+    cryptos_producer_stop(&cp);
+    return I_CRYPTOS_ERR;
+  }
+
+  cp->active = 1;
+  *producer = cp;
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_producer_dequeue(cryptos_producer_t *cp,
+			     cryptos_protocol_buffer_t *cb, uint64_t *packet) {
+
+  cryptos_producer_slot_t *slot;
+
+  /* Input parameters control */
+  if(!cp || !cb || !packet) {
+    errno = EINVAL;
+    message_log("cryptos_producer_dequeue", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* As in cryptos_forward, nothing to do while the buffer covers a whole
+     stego-frame */
+  if(cb->buffer_used >= cb->frame_bytes) {
+    return I_CRYPTOS_OK;
+  }
+
+  if(_sem_wait(&cp->ready)) {
+    message_log("cryptos_producer_dequeue", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  slot = &cp->slots[cp->tail];
+
+  /* The failed slot stays ready, for the next calls to fail too */
+  if(!slot->len) {
+    sem_post(&cp->ready);
+    errno = EIO;
+    message_log("cryptos_producer_dequeue", "The producer thread failed");
+    return I_CRYPTOS_ERR;
+  }
+
+  if(cb->buffer_used + slot->len > cb->buffer_size) {
+    sem_post(&cp->ready);
+    errno = ENOBUFS;
+    message_log("cryptos_producer_dequeue", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  memcpy(&cb->buffer[cb->buffer_used], slot->data, slot->len);
+  cb->buffer_used += slot->len;
+  cb->offset = slot->offset;
+  *packet = slot->packet;
+
+  cp->tail = (cp->tail+1) % cp->n_slots;
+  sem_post(&cp->free);
+
+  return I_CRYPTOS_OK;
+
+}
+
+int cryptos_producer_stop(cryptos_producer_t **producer) {
+
+  cryptos_producer_t *cp;
+  int i;
+
+  if(!producer || !*producer) {
+    return I_CRYPTOS_OK;
+  }
+  cp = *producer;
+
+  if(cp->active) {
+    cp->stop = 1;
+    sem_post(&cp->free);
+    pthread_join(cp->thread, NULL);
+    sem_destroy(&cp->ready);
+    sem_destroy(&cp->free);
+    cp->active = 0;
+  }
+
+  for(i=0; i<CRYPTOS_PRODUCER_MAX_SLOTS; i++) {
+    if(cp->slots[i].data) {
+      free(cp->slots[i].data); cp->slots[i].data = NULL;
+    }
+  }
+
+  cryptos_buffer_free(&cp->cb);
+  free(cp);
+  *producer = NULL;
+
+  return I_CRYPTOS_OK;
+
+}
+
+/* cryptos_producer.c ends here */
+#endif
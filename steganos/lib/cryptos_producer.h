@@ -0,0 +1,95 @@
+/*                               -*- Mode: C -*-
+ * @file: cryptos_producer.h
+ * @brief: Headers for the crypto-packets producer thread.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 19:31:47 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 19:31:47 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef CRYPTOS_PRODUCER_H
+#define CRYPTOS_PRODUCER_H
+
+#include "cryptos_types.h"
+
+/**
+ * @fn int cryptos_producer_start(cryptos_producer_t **producer,
+ *                               cryptos_config_t *cc,
+ *                               cryptos_protocol_buffer_t *cb, int n_slots)
+ * @brief Starts a thread producing the crypto-packets of the payload in
+ *  <i>cb</i>'s file, from <i>cb</i>->offset on, up to <i>n_slots</i> packets
+ *  ahead of the consumer.
+ *
+ * Until cryptos_producer_stop, <i>cc</i> belongs to the thread and the
+ * consumer must get its packets with cryptos_producer_dequeue instead of
+ * cryptos_forward. Adaptive sizing is not supported, as the packet sizes
+ * would depend on frames not encoded yet.
+ *
+ * @param producer Will store the producer, NULL on error.
+ * @param cc The crypto config, already initialized.
+ * @param cb The consumer's buffer: payload file and current offset.
+ * @param n_slots Number of packets kept ready, up to
+ *  CRYPTOS_PRODUCER_MAX_SLOTS.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument, or adaptive
+ *  sizing active).
+ * @retval I_CRYPTOS_ERR with errno != 0 && errno != EINVAL (I/O error, or
+ *  unable to create the thread).
+ */
+int cryptos_producer_start(cryptos_producer_t **producer,
+			   cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
+			   int n_slots);
+
+/**
+ * @fn int cryptos_producer_dequeue(cryptos_producer_t *cp, 
+ *                                 cryptos_protocol_buffer_t *cb,
+ *                                 uint64_t *packet)
+ * @brief Consumer's side counterpart of cryptos_forward: appends the next
+ *  ready crypto-packet to <i>cb</i>, unless it already holds a whole
+ *  stego-frame, and updates <i>cb</i>->offset.
+ *
+ * Waits for the producer only when no packet is ready.
+ *
+ * @param cp The producer.
+ * @param cb The consumer's buffer.
+ * @param packet Will store the ID of the packet appended, if any (0, the
+ *  last one).
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_CRYPTOS_ERR with errno = EIO (the producer failed).
+ * @retval I_CRYPTOS_ERR with errno = ENOBUFS (no room in <i>cb</i>).
+ */
+int cryptos_producer_dequeue(cryptos_producer_t *cp,
+			     cryptos_protocol_buffer_t *cb, uint64_t *packet);
+
+/**
+ * @fn int cryptos_producer_stop(cryptos_producer_t **producer)
+ * @brief Stops and joins the thread, and frees the producer. The packets not
+ *  dequeued are lost, and the crypto config goes back to the caller.
+ *
+ * Does nothing if <i>*producer</i> is NULL, so it may be called again from
+ * any teardown path.
+ *
+ * @param producer The producer. Set to NULL.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ */
+int cryptos_producer_stop(cryptos_producer_t **producer);
+
+#endif /* CRYPTOS_PRODUCER_H */
+
+/* cryptos_producer.h ends here */
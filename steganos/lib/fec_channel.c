@@ -0,0 +1,657 @@
+/*                               -*- Mode: C -*-
+ * @file: fec_channel.c
+ * @brief: Forward error correction layer. Systematic Reed-Solomon erasure
+ *  code (Cauchy matrix over GF(2^8)) applied over groups of crypto-packets.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 11:05:51 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 11:05:51 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "zlib.h"
+#include "fec_channel.h"
+#include "miscellaneous.h"
+
+/* GF(2^8) arithmetic, primitive polynomial x^8+x^4+x^3+x^2+1 */
+static byte _gf_exp[2*256];
+static int _gf_log[256];
+static int _gf_ready = 0;
+
+/**
+ * @fn static void _gf_init(void)
+ * @brief Fills the exponential and logarithm tables of GF(2^8).
+ */
+static void _gf_init(void) {
+
+  int i, x;
+
+  if(_gf_ready) return;
+
+  x = 1;
+  for(i=0; i<255; i++) {
+    _gf_exp[i] = (byte) x;
+    _gf_log[x] = i;
+    x <<= 1;
+    if(x & 0x100) x ^= 0x11D;
+  }
+
+  /* Duplicated, so the sum of two logarithms needs no modulo */
+  for(i=255; i<2*256; i++) {
+    _gf_exp[i] = _gf_exp[i-255];
+  }
+
+  _gf_ready = 1;
+
+}
+
+/**
+ * @fn static byte _gf_mul(byte a, byte b)
+ * @brief Product of <i>a</i> and <i>b</i> in GF(2^8).
+ */
+static byte _gf_mul(byte a, byte b) {
+  if(!a || !b) return 0;
+  return _gf_exp[_gf_log[a] + _gf_log[b]];
+}
+
+/**
+ * @fn static byte _gf_inv(byte a)
+ * @brief Multiplicative inverse of <i>a</i> (which can't be 0) in GF(2^8).
+ */
+static byte _gf_inv(byte a) {
+  return _gf_exp[255 - _gf_log[a]];
+}
+
+/**
+ * @fn static void _gf_mul_add(byte *dst, byte *src, byte c, size_t len)
+ * @brief dst += c*src, for vectors of <i>len</i> elements of GF(2^8).
+ */
+static void _gf_mul_add(byte *dst, byte *src, byte c, size_t len) {
+
+  size_t i;
+  int lc;
+
+  if(!c) return;
+
+  if(c == 1) {
+    for(i=0; i<len; i++) dst[i] ^= src[i];
+    return;
+  }
+
+  lc = _gf_log[c];
+  for(i=0; i<len; i++) {
+    if(src[i]) dst[i] ^= _gf_exp[_gf_log[src[i]] + lc];
+  }
+
+}
+
+/**
+ * @fn static byte _cauchy(int i, int j)
+ * @brief Element (i,j) of the Cauchy encoding matrix, i.e., the coefficient
+ *  of the data symbol j in the parity symbol i.
+ *
+ * Uses x_i = 255-i and y_j = j, which are all distinct while
+ * k+m <= FEC_MAX_SYMBOLS, so every square submatrix is invertible.
+ */
+static byte _cauchy(int i, int j) {
+  return _gf_inv((byte) ((FEC_MAX_SYMBOLS - i) ^ j));
+}
+
+/**
+ * @fn static int _gf_invert(byte *a, byte *inv, int n)
+ * @brief Inverts the <i>n</i>x<i>n</i> matrix <i>a</i> (destroyed in the
+ *  process) by Gauss-Jordan elimination, storing the result in <i>inv</i>.
+ *
+ * @return I_FEC_OK if the matrix was invertible, I_FEC_ERR otherwise.
+ */
+static int _gf_invert(byte *a, byte *inv, int n) {
+
+  int r, c, p, i;
+  byte f, t;
+
+  memset(inv, 0, n*n);
+  for(i=0; i<n; i++) inv[i*n+i] = 1;
+
+  for(c=0; c<n; c++) {
+
+    /* Pivot */
+    for(p=c; p<n && !a[p*n+c]; p++);
+    if(p == n) return I_FEC_ERR;
+
+    if(p != c) {
+      for(i=0; i<n; i++) {
+	t = a[p*n+i]; a[p*n+i] = a[c*n+i]; a[c*n+i] = t;
+	t = inv[p*n+i]; inv[p*n+i] = inv[c*n+i]; inv[c*n+i] = t;
+      }
+    }
+
+    f = _gf_inv(a[c*n+c]);
+    for(i=0; i<n; i++) {
+      a[c*n+i] = _gf_mul(a[c*n+i], f);
+      inv[c*n+i] = _gf_mul(inv[c*n+i], f);
+    }
+
+    for(r=0; r<n; r++) {
+      if(r == c || !(t = a[r*n+c])) continue;
+      for(i=0; i<n; i++) {
+	a[r*n+i] ^= _gf_mul(t, a[c*n+i]);
+	inv[r*n+i] ^= _gf_mul(t, inv[c*n+i]);
+      }
+    }
+
+  }
+
+  return I_FEC_OK;
+
+}
+
+/**
+ * @fn static byte *_symbol(fec_state_t *fs, int i)
+ * @brief Returns the i-th symbol of the current group.
+ */
+static byte *_symbol(fec_state_t *fs, int i) {
+  return &fs->symbols[(size_t) i*fs->symbol_size];
+}
+
+/**
+ * @fn static void _next_group(fec_state_t *fs)
+ * @brief Discards the current group and starts the next one.
+ */
+static void _next_group(fec_state_t *fs) {
+
+  fs->group++;
+  fs->count = 0;
+  fs->symbol_len = 0;
+  fs->released = 0;
+  fs->closed = 0;
+  memset(fs->present, 0, sizeof(int)*(fs->k+fs->m));
+  memset(fs->symbols, 0, fs->symbol_size*(fs->k+fs->m));
+
+}
+
+/**
+ * @fn static int _write_frame(fec_state_t *fs, int index, int count,
+ *                             byte *payload, size_t len, byte *frame,
+ *                             size_t f_len, size_t *written)
+ * @brief Writes a FEC frame of the current group into <i>frame</i>.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ */
+static int _write_frame(fec_state_t *fs, int index, int count, byte *payload,
+			size_t len, byte *frame, size_t f_len, size_t *written) {
+
+  uLong crc;
+
+  if(len > 0xFFFF || f_len < FEC_FRAME_LEN(len)) {
+    errno = EINVAL;
+    message_log("_write_frame", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  memcpy(frame, FEC_SYNC_HEADER, FEC_SYNC_HEADER_LEN);
+  frame[2] = (fs->group >> 8) & 0xFF;
+  frame[3] = fs->group & 0xFF;
+  frame[4] = (byte) index;
+  frame[5] = (byte) count;
+  frame[6] = (len >> 8) & 0xFF;
+  frame[7] = len & 0xFF;
+  memcpy(&frame[FEC_HEADER_LEN], payload, len);
+
+  /* The CRC covers everything but the SYNC field */
+  crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, &frame[FEC_SYNC_HEADER_LEN],
+	      FEC_HEADER_LEN-FEC_SYNC_HEADER_LEN+len);
+  frame[FEC_HEADER_LEN+len] = (crc >> 24) & 0xFF;
+  frame[FEC_HEADER_LEN+len+1] = (crc >> 16) & 0xFF;
+  frame[FEC_HEADER_LEN+len+2] = (crc >> 8) & 0xFF;
+  frame[FEC_HEADER_LEN+len+3] = crc & 0xFF;
+
+  *written = FEC_FRAME_LEN(len);
+
+  return I_FEC_OK;
+
+}
+
+/**
+ * @fn static int _rebuild(fec_state_t *fs)
+ * @brief Rebuilds the missing data symbols of the current group, if enough
+ *  parity symbols have been received.
+ *
+ * With e missing data symbols and e parity ones, solves the e x e system
+ * given by the corresponding submatrix of the Cauchy matrix.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present (even if nothing could be rebuilt) and
+ *  I_FEC_ERR if an error occured with errno updated.
+ */
+static int _rebuild(fec_state_t *fs) {
+
+  byte *a, *inv, *rhs;
+  int *missing, *rows, e, p, i, j, r, c;
+  size_t len;
+
+  /* Without any parity frame we don't even know the size of the group */
+  if(!fs->count) return I_FEC_OK;
+
+  if(!(missing = (int *) malloc(sizeof(int)*(fs->k+fs->m)))) {
+    message_log("_rebuild", strerror(errno));
+    return I_FEC_ERR;
+  }
+  rows = &missing[fs->k];
+
+  e = 0;
+  for(j=0; j<fs->count; j++) {
+    if(!fs->present[j]) missing[e++] = j;
+  }
+
+  p = 0;
+  for(i=0; i<fs->m && p<e; i++) {
+    if(fs->present[fs->k+i]) rows[p++] = i;
+  }
+
+  if(!e || p < e) {
+    free(missing);
+    return I_FEC_OK;
+  }
+
+  len = fs->symbol_len;
+  a = (byte *) malloc(sizeof(byte)*(2*e*e + e*len));
+  if(!a) {
+    message_log("_rebuild", strerror(errno));
+    free(missing);
+    return I_FEC_ERR;
+  }
+  inv = &a[e*e];
+  rhs = &a[2*e*e];
+
+  for(r=0; r<e; r++) {
+    for(c=0; c<e; c++) {
+      a[r*e+c] = _cauchy(rows[r], missing[c]);
+    }
+  }
+
+  if(_gf_invert(a, inv, e) == I_FEC_ERR) {
+    errno = EDOM;
+    message_log("_rebuild", "Singular decoding matrix");
+    free(a); free(missing);
+    return I_FEC_ERR;
+  }
+
+  /* Remove the contribution of the received data symbols from the parity */
+  for(r=0; r<e; r++) {
+    memcpy(&rhs[r*len], _symbol(fs, fs->k+rows[r]), len);
+    for(j=0; j<fs->count; j++) {
+      if(fs->present[j]) {
+	_gf_mul_add(&rhs[r*len], _symbol(fs, j), _cauchy(rows[r], j), len);
+      }
+    }
+  }
+
+  for(c=0; c<e; c++) {
+    byte *sym = _symbol(fs, missing[c]);
+    memset(sym, 0, fs->symbol_size);
+    for(r=0; r<e; r++) {
+      _gf_mul_add(sym, &rhs[r*len], inv[c*e+r], len);
+    }
+    fs->present[missing[c]] = 1;
+    fs->recovered++;
+  }
+
+  free(a);
+  free(missing);
+
+  return I_FEC_OK;
+
+}
+
+int fec_state_init(fec_state_t *fs, int k, int m, size_t max_packet,
+		   size_t buffer_size) {
+
+  /* Input parameters control */
+  if(!fs || k < 1 || m < 1 || k+m > FEC_MAX_SYMBOLS || !max_packet ||
+     max_packet+2 > 0xFFFF) {
+    errno = EINVAL;
+    message_log("fec_state_init", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  _gf_init();
+
+  memset(fs, 0, sizeof(fec_state_t));
+  fs->k = k;
+  fs->m = m;
+  fs->symbol_size = max_packet+2;
+
+  if(!(fs->symbols = (byte *) malloc(sizeof(byte)*fs->symbol_size*(k+m)))) {
+    message_log("fec_state_init", strerror(errno));
+    return I_FEC_ERR;
+  }
+  memset(fs->symbols, 0, sizeof(byte)*fs->symbol_size*(k+m));
+
+  if(!(fs->present = (int *) malloc(sizeof(int)*(k+m)))) {
+    message_log("fec_state_init", strerror(errno));
+    free(fs->symbols); fs->symbols = NULL;
+    return I_FEC_ERR;
+  }
+  memset(fs->present, 0, sizeof(int)*(k+m));
+
+  if(buffer_size) {
+    if(!(fs->buffer = (byte *) malloc(sizeof(byte)*buffer_size))) {
+      message_log("fec_state_init", strerror(errno));
+      free(fs->symbols); fs->symbols = NULL;
+      free(fs->present); fs->present = NULL;
+      return I_FEC_ERR;
+    }
+    memset(fs->buffer, 0, sizeof(byte)*buffer_size);
+    fs->buffer_size = buffer_size;
+  }
+
+  return I_FEC_OK;
+
+}
+
+int fec_state_free(fec_state_t *fs) {
+
+  if(!fs) {
+    return I_FEC_OK;
+  }
+
+  if(fs->symbols) {
+    free(fs->symbols); fs->symbols = NULL;
+  }
+
+  if(fs->present) {
+    free(fs->present); fs->present = NULL;
+  }
+
+  if(fs->buffer) {
+    free(fs->buffer); fs->buffer = NULL;
+  }
+
+  return I_FEC_OK;
+
+}
+
+int fec_encode_packet(fec_state_t *fs, byte *packet, size_t p_len,
+		      byte *frame, size_t f_len, size_t *written) {
+
+  byte *sym;
+
+  /* Input parameters control */
+  if(!fs || !packet || !p_len || p_len+2 > fs->symbol_size || !frame ||
+     !written) {
+    errno = EINVAL;
+    message_log("fec_encode_packet", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  if(fs->count >= fs->k) {
+    errno = EINVAL;
+    message_log("fec_encode_packet", "Group full, parity frames expected");
+    return I_FEC_ERR;
+  }
+
+  /* Store the symbol for the parity computation */
+  sym = _symbol(fs, fs->count);
+  memset(sym, 0, fs->symbol_size);
+  sym[0] = (p_len >> 8) & 0xFF;
+  sym[1] = p_len & 0xFF;
+  memcpy(&sym[2], packet, p_len);
+  if(p_len+2 > fs->symbol_len) fs->symbol_len = p_len+2;
+
+  if(_write_frame(fs, fs->count, 0, packet, p_len, frame, f_len, written)
+     == I_FEC_ERR) {
+    return I_FEC_ERR;
+  }
+
+  fs->count++;
+
+  return I_FEC_OK;
+
+}
+
+int fec_encode_parity(fec_state_t *fs, byte *frames, size_t f_len,
+		      size_t *written) {
+
+  byte *parity;
+  size_t w;
+  int i, j;
+
+  /* Input parameters control */
+  if(!fs || !frames || !written) {
+    errno = EINVAL;
+    message_log("fec_encode_parity", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  *written = 0;
+
+  if(!fs->count) {
+    return I_FEC_OK;
+  }
+
+  if(f_len < fs->m*FEC_FRAME_LEN(fs->symbol_len)) {
+    errno = EINVAL;
+    message_log("fec_encode_parity", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  for(i=0; i<fs->m; i++) {
+
+    parity = _symbol(fs, fs->k+i);
+    memset(parity, 0, fs->symbol_size);
+    for(j=0; j<fs->count; j++) {
+      _gf_mul_add(parity, _symbol(fs, j), _cauchy(i, j), fs->symbol_len);
+    }
+
+    if(_write_frame(fs, fs->k+i, fs->count, parity, fs->symbol_len,
+		    &frames[*written], f_len-*written, &w) == I_FEC_ERR) {
+      return I_FEC_ERR;
+    }
+    *written += w;
+
+  }
+
+  _next_group(fs);
+
+  return I_FEC_OK;
+
+}
+
+int fec_parse_frame(fec_state_t *fs, byte *frame, size_t f_len,
+		    size_t *r_data) {
+
+  byte *sym;
+  size_t i, len;
+  int index, count;
+  int16_t diff;
+  uint16_t group;
+  uLong crc;
+
+  /* Input parameters control */
+  if(!fs || !frame || !r_data) {
+    errno = EINVAL;
+    message_log("fec_parse_frame", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  *r_data = 0;
+
+  if(f_len < FEC_SYNC_HEADER_LEN) {
+    return I_FEC_OK;
+  }
+
+  /* Not synchronized: skip up to the next candidate SYNC field */
+  if(memcmp(frame, FEC_SYNC_HEADER, FEC_SYNC_HEADER_LEN)) {
+    for(i=1; i<f_len; i++) {
+      if(frame[i] == FEC_SYNC_HEADER[0] &&
+	 (i+1 == f_len || frame[i+1] == FEC_SYNC_HEADER[1])) {
+	break;
+      }
+    }
+    *r_data = i;
+    return I_FEC_OK;
+  }
+
+  if(f_len < FEC_HEADER_LEN) {
+    return I_FEC_OK;
+  }
+
+  group = (frame[2] << 8) | frame[3];
+  index = frame[4];
+  count = frame[5];
+  len = (frame[6] << 8) | frame[7];
+
+  /* Implausible header, skip the SYNC field and look for the next one */
+  if(index >= fs->k+fs->m ||
+     (index < fs->k && (!len || len+2 > fs->symbol_size)) ||
+     (index >= fs->k && (!count || count > fs->k || len > fs->symbol_size))) {
+    *r_data = FEC_SYNC_HEADER_LEN;
+    return I_FEC_OK;
+  }
+
+  /* Incomplete frame */
+  if(f_len < FEC_FRAME_LEN(len)) {
+    return I_FEC_OK;
+  }
+
+  crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, &frame[FEC_SYNC_HEADER_LEN],
+	      FEC_HEADER_LEN-FEC_SYNC_HEADER_LEN+len);
+  if(frame[FEC_HEADER_LEN+len] != ((crc >> 24) & 0xFF) ||
+     frame[FEC_HEADER_LEN+len+1] != ((crc >> 16) & 0xFF) ||
+     frame[FEC_HEADER_LEN+len+2] != ((crc >> 8) & 0xFF) ||
+     frame[FEC_HEADER_LEN+len+3] != (crc & 0xFF)) {
+    message_log("fec_parse_frame", "CRC check fails, frame dropped");
+    *r_data = FEC_SYNC_HEADER_LEN;
+    return I_FEC_OK;
+  }
+
+  diff = (int16_t) (uint16_t) (group - fs->group);
+
+  /* Late frame of an already delivered group */
+  if(diff < 0) {
+    *r_data = FEC_FRAME_LEN(len);
+    return I_FEC_OK;
+  }
+
+  /* First frame of a later group: the current one won't receive more */
+  if(diff > 0) {
+    fs->closed = 1;
+    return I_FEC_OK;
+  }
+
+  if(!fs->present[index]) {
+    sym = _symbol(fs, index);
+    memset(sym, 0, fs->symbol_size);
+    if(index < fs->k) {
+      sym[0] = (len >> 8) & 0xFF;
+      sym[1] = len & 0xFF;
+      memcpy(&sym[2], &frame[FEC_HEADER_LEN], len);
+      if(len+2 > fs->symbol_len) fs->symbol_len = len+2;
+    } else {
+      memcpy(sym, &frame[FEC_HEADER_LEN], len);
+      fs->count = count;
+      fs->symbol_len = len;
+    }
+    fs->present[index] = 1;
+  }
+
+  *r_data = FEC_FRAME_LEN(len);
+
+  return I_FEC_OK;
+
+}
+
+int fec_next_packet(fec_state_t *fs, byte *packet, size_t p_len,
+		    size_t *d_len, int *lost) {
+
+  byte *sym;
+  size_t len;
+  int total, j;
+
+  /* Input parameters control */
+  if(!fs || !packet || !d_len || !lost) {
+    errno = EINVAL;
+    message_log("fec_next_packet", strerror(errno));
+    return I_FEC_ERR;
+  }
+
+  *d_len = 0;
+  *lost = 0;
+
+  /* Until a parity frame arrives, assume a full group */
+  total = fs->count ? fs->count : fs->k;
+
+  while(fs->released < total) {
+
+    j = fs->released;
+
+    if(!fs->present[j]) {
+      if(_rebuild(fs) == I_FEC_ERR) {
+	return I_FEC_ERR;
+      }
+    }
+
+    if(!fs->present[j]) {
+
+      /* Wait for more frames, unless none will come */
+      if(!fs->closed) {
+	return I_FEC_OK;
+      }
+
+      message_log("fec_next_packet", "Packet lost");
+      fs->released++;
+      fs->lost++;
+      (*lost)++;
+      continue;
+
+    }
+
+    sym = _symbol(fs, j);
+    len = (sym[0] << 8) | sym[1];
+
+    /* Only possible with a wrongly rebuilt symbol */
+    if(!len || len+2 > fs->symbol_size) {
+      message_log("fec_next_packet", "Packet lost");
+      fs->released++;
+      fs->lost++;
+      (*lost)++;
+      continue;
+    }
+
+    if(len > p_len) {
+      errno = EINVAL;
+      message_log("fec_next_packet", "Not enough allocated memory for packet");
+      return I_FEC_ERR;
+    }
+
+    memcpy(packet, &sym[2], len);
+    *d_len = len;
+    fs->released++;
+    break;
+
+  }
+
+  if(fs->released >= total) {
+    _next_group(fs);
+  }
+
+  return I_FEC_OK;
+
+}
+
+/* fec_channel.c ends here */
+#endif
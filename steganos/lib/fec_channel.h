@@ -0,0 +1,201 @@
+/*                               -*- Mode: C -*-
+ * @file: fec_channel.h
+ * @brief: Headers for the forward error correction (erasure coding) layer.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 11:02:37 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 11:02:37 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef FEC_CHANNEL_H
+#define FEC_CHANNEL_H
+
+#include <stddef.h>
+#include "fec_types.h"
+
+/**
+ * @def FEC_SYNC_HEADER_LEN
+ * @brief Defines the number of bytes of the SYNC header field of FEC frames
+ */
+#define FEC_SYNC_HEADER_LEN 2
+
+/**
+ * @def FEC_HEADER_LEN
+ * @brief Defines the number of bytes of the FEC frame header: SYNC (2),
+ *  GROUP (2), INDEX (1), COUNT (1) and LENGTH (2)
+ */
+#define FEC_HEADER_LEN 8
+
+/**
+ * @def FEC_CRC_LEN
+ * @brief Defines the number of bytes of the CRC32 trailer of FEC frames
+ */
+#define FEC_CRC_LEN 4
+
+/**
+ * @def FEC_FRAME_LEN
+ * @brief Length of a FEC frame carrying <i>payload</i> bytes
+ */
+#define FEC_FRAME_LEN(payload) ((payload)+FEC_HEADER_LEN+FEC_CRC_LEN)
+
+/**
+ * @def FEC_MAX_SYMBOLS
+ * @brief Maximum value of k+m. The INDEX field is one byte long and the
+ *  Cauchy matrix needs k+m distinct elements of GF(2^8).
+ */
+#define FEC_MAX_SYMBOLS 255
+
+/**
+ * @def FEC_SYNC_HEADER
+ * @brief The value of the SYNC header of FEC frames. Differs from the crypto
+ *  packets ones, so both layers can not be mistaken.
+ */
+static const byte FEC_SYNC_HEADER[FEC_SYNC_HEADER_LEN] = {0xFF, 0xFA};
+
+/**
+ * @fn int fec_state_init(fec_state_t *fs, int k, int m, size_t max_packet,
+ *                        size_t buffer_size)
+ * @brief Initializes the FEC layer state.
+ *
+ * @param fs The FEC state to initialize.
+ * @param k Number of crypto-packets per group.
+ * @param m Number of parity packets per group. k+m must not exceed
+ *  FEC_MAX_SYMBOLS.
+ * @param max_packet Maximum length, in bytes, of the crypto-packets.
+ * @param buffer_size Size of the buffer for the received FEC frames. Only
+ *  needed at the receiver's side, use 0 at the emitter's side.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ * @retval I_FEC_ERR with errno != 0 && errno != EINVAL (see corresponding
+ *         error code)
+ */
+int fec_state_init(fec_state_t *fs, int k, int m, size_t max_packet,
+		   size_t buffer_size);
+
+/**
+ * @fn int fec_state_free(fec_state_t *fs)
+ * @brief Frees the memory allocated for the FEC state.
+ *
+ * @param fs The FEC state to free.
+ *
+ * @return I_FEC_OK.
+ */
+int fec_state_free(fec_state_t *fs);
+
+/**
+ * @fn int fec_encode_packet(fec_state_t *fs, byte *packet, size_t p_len,
+ *                           byte *frame, size_t f_len, size_t *written)
+ * @brief Produces the FEC frame carrying the given crypto-packet.
+ *
+ * The packet is also stored as a symbol of the current group, for the
+ * parity computation done by fec_encode_parity.
+ * The FEC frame has the following structure:
+ *
+ * SYNC | GROUP | INDEX | COUNT | LENGTH | PAYLOAD | CRC32
+ *
+ * For data frames, COUNT is 0 and PAYLOAD is the crypto-packet. For parity
+ * frames, INDEX >= k, COUNT is the number of data packets of the group, and
+ * PAYLOAD are the parity bytes.
+ *
+ * @param fs The FEC state.
+ * @param packet The crypto-packet.
+ * @param p_len The length of the crypto-packet.
+ * @param frame Output buffer.
+ * @param f_len Allocated size of <i>frame</i>.
+ * @param written Will store the number of bytes written into <i>frame</i>.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_encode_packet(fec_state_t *fs, byte *packet, size_t p_len,
+		      byte *frame, size_t f_len, size_t *written);
+
+/**
+ * @fn int fec_encode_parity(fec_state_t *fs, byte *frames, size_t f_len,
+ *                           size_t *written)
+ * @brief Produces the m parity frames of the current group and starts a new
+ *  group.
+ *
+ * Must be called every k packets, and after the last packet of the
+ * transmission (closing a possibly shorter group). Does nothing if the
+ * current group is empty.
+ *
+ * @param fs The FEC state.
+ * @param frames Output buffer.
+ * @param f_len Allocated size of <i>frames</i>.
+ * @param written Will store the number of bytes written into <i>frames</i>.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_encode_parity(fec_state_t *fs, byte *frames, size_t f_len,
+		      size_t *written);
+
+/**
+ * @fn int fec_parse_frame(fec_state_t *fs, byte *frame, size_t f_len,
+ *                         size_t *r_data)
+ * @brief Parses the FEC frame at the beginning of <i>frame</i>.
+ *
+ * Valid frames of the current group are stored as symbols. Corrupted frames
+ * (wrong CRC) are dropped, which is what turns a damaged stego-frame into
+ * an erasure. If the frame belongs to a later group, the current group is
+ * closed and the frame is not consumed: fec_next_packet must be called to
+ * deliver (or give up) the pending packets first.
+ *
+ * @param fs The FEC state.
+ * @param frame The received bytes.
+ * @param f_len The number of received bytes.
+ * @param r_data Will store the number of bytes consumed. 0 means that the
+ *  frame is not complete yet (or that the current group has to be closed).
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_parse_frame(fec_state_t *fs, byte *frame, size_t f_len,
+		    size_t *r_data);
+
+/**
+ * @fn int fec_next_packet(fec_state_t *fs, byte *packet, size_t p_len,
+ *                         size_t *d_len, int *lost)
+ * @brief Returns the next crypto-packet of the current group, in order.
+ *
+ * Missing packets are rebuilt from the parity ones when enough frames of the
+ * group have been received. If the group has been closed and a packet can
+ * not be rebuilt, it is given up and counted in <i>lost</i>.
+ *
+ * @param fs The FEC state.
+ * @param packet Output buffer.
+ * @param p_len Allocated size of <i>packet</i>.
+ * @param d_len Will store the length of the packet written into
+ *  <i>packet</i>, or 0 if no packet is available yet.
+ * @param lost Will store the number of packets given up before the
+ *  returned one.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_FEC_OK if no error was present and I_FEC_ERR if an error occured
+ *  with errno updated.
+ * @retval I_FEC_OK with errno = 0 (No error).
+ * @retval I_FEC_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_next_packet(fec_state_t *fs, byte *packet, size_t p_len,
+		    size_t *d_len, int *lost);
+
+#endif /* FEC_CHANNEL_H */
+
+/* fec_channel.h ends here */
@@ -40,6 +40,7 @@
 #endif
 
 #include "miscellaneous.h"
+#include "cryptos_types.h"
 
 /** 
  * @fn int parse_validate_steganos_xml(const char *filename, 
@@ -548,6 +549,7 @@ struct option long_options_enc[] = {
   {"shm", required_argument, 0, 0},
   {"ssm", required_argument, 0, 0},
   {"ssigma", required_argument, 0, 0},
+  {"sfv", required_argument, 0, 0},
   {"skey", required_argument, 0, 0},
   {"sca", required_argument, 0, 0},
   {"scmda", required_argument, 0, 0},
@@ -556,6 +558,15 @@ struct option long_options_enc[] = {
   {"scem", required_argument, 0, 0},
   {"scpkt", required_argument, 0, 0},
   {"scdds", required_argument, 0, 0},
+  {"scfmt", required_argument, 0, 0},
+  {"scadapt", no_argument, 0, 0},
+  {"scqueue", required_argument, 0, 0},
+  {"slive", no_argument, 0, 0},
+  {"slatency", required_argument, 0, 0},
+  {"sfec", required_argument, 0, 0},
+  {"sstats", required_argument, 0, 0},
+  {"srecord", required_argument, 0, 0},
+  {"sindex", required_argument, 0, 0},
   {"quiet", no_argument, 0, 0},
   {"force-read-file", no_argument, 0, 0},
   {NULL,0,0,0}
@@ -572,18 +583,23 @@ struct option long_options_dec[] = {
   {"schmac", no_argument, 0, 0},
   {"scem", required_argument, 0, 0},
   {"scpkt", required_argument, 0, 0},
+  {"scdds", required_argument, 0, 0},
+  {"scfmt", required_argument, 0, 0},
+  {"sfec", required_argument, 0, 0},
+  {"sstats", required_argument, 0, 0},
+  {"srecord", required_argument, 0, 0},
+  {"sscan", required_argument, 0, 0},
+  {"sseek", no_argument, 0, 0},
   {"quiet", no_argument, 0, 0},
   {"force-read-file", no_argument, 0, 0},
   {NULL,0,0,0}
 };
 
 
-int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int sender) {
+int parse_options_argv(int argc, char **argv, fw_options_t *fw,
+		       inv_options_t *inv, int sender) {
 
-  FILE *fd;
-  char **_argv, _st_argv[31][100];
-  int option_index, rc, ret, _argc, i, optind_aux;
-  char c, str[100];
+  int option_index, rc, ret, optind_aux;
 
   /* Declare an set the params to their default values */
   int delayfr=0;          /* Number of frames to skip before hiding */
@@ -592,6 +608,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
   int hide_method=-1;     /* Hiding method, if at the end is still -1, error */
   int sync_method=-1;     /* Default synchronization method, if at the end is still -1, error */
   float sigma=1.f;        /* Default sigma */
+  int sfv=1;              /* Stego-frames format */
   char *skey=NULL;        /* Key */
   char *sca=NULL;         /* Cipher algorithm */
   char *scmda=NULL;       /* Digest algorithm */
@@ -600,92 +617,44 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
   uint64_t scem=0;        /* Emission ID */
   uint64_t scpkt=1;       /* First packet ID */
   int scdds=0;            /* Default data size for crypto-packets */  
+  int scfmt=1;            /* Crypto-packets format */
+  int scadapt=0;          /* Adaptive crypto-packets size flag */
+  int scqueue=0;          /* Crypto-packets produced ahead (0, no producer) */
+  int slive=0;            /* Live payload flag */
+  int slatency=0;         /* Live payload maximum latency, in ms (0, none) */
+  int fec_k=0;            /* FEC group size (0, no FEC) */
+  int fec_m=0;            /* FEC parity packets per group */
+  char *sstats=NULL;      /* Telemetry JSON-lines output file */
+  char *srecord=NULL;     /* Frame recording output file */
+  char *sindex=NULL;      /* Embedding index output file */
+  char *sscan=NULL;       /* Candidate keys file for the steganalysis scan */
+  int sseek=0;            /* Seekable extraction flag */
   int quiet=0;            /* Quiet mode indicator */
   int force=0;            /* Force to read config from file */
 
-  if(!cfg_file ||
+  if(argc < 1 || !argv ||
      (sender && !fw) ||
      (!sender && !inv)) {
     errno = EINVAL;
-    message_log("parse_options", strerror(errno));
-    return I_MISC_ERR;
-  }
-
-  if(!(fd = fopen(cfg_file, "r"))) {
-    message_log("parse_options", strerror(errno));
-    return I_MISC_ERR;
-  }
-
-  for(i=0; i<14; i++) 
-    memset(_st_argv[i], 0, 100);  
-
-  i=0; c = 0; _argc = 0;
-  memset(str, 0, 100);
-  while(c != '\n') {
-    c = fgetc(fd);
-    if(c == EOF) {
-      fprintf(stderr, "Unexpected End Of File\n");
-      fclose(fd);
-      errno = EBADF;
-      return I_MISC_ERR;
-    } else if(isspace(c)) {
-      if(_argc > 31) {
-	fprintf(stderr, "Unexpected param: %s\n", str);
-	fclose(fd);
-	errno = EINVAL;
-	return I_MISC_ERR;
-      }
-      strcpy(_st_argv[_argc], str);
-      _argc++;
-      memset(str, 0,100);
-      i = 0;
-    } else {
-      str[i] = c;
-      i++;
-    }
-  }
-
-  if(strcmp(_st_argv[0], cfg_file)) {
-    fprintf(stderr, "Bad configuration file\n");
-    errno = EBADF;
-    fclose(fd);
+    message_log("parse_options_argv", strerror(errno));
     return I_MISC_ERR;
   }
 
-  /* Allocate dynamic _argv */
-  _argv = (char **) malloc(sizeof(char*)*_argc);
-  if(!_argv) {
-    fprintf(stderr, "%s", strerror(errno));
-    fclose(fd);
-    return I_MISC_ERR;
-  }
-
-  for(i=0; i<_argc; i++) {
-    if(!(_argv[i] = (char *) malloc(sizeof(char)*(strlen(_st_argv[i])+1)))) {
-      fprintf(stderr, "%s", strerror(errno));
-      free(_argv);
-      fclose(fd);
-      return I_MISC_ERR;
-    }
-    memset(_argv[i], 0, strlen(_st_argv[i])+1);
-    strcpy(_argv[i], _st_argv[i]);
-  }
-
   rc = I_MISC_OK; ret = 0;
   option_index = 0;
   optind_aux = optind;
   optind = 1;
   while(ret != -1) {
     if(sender) {
-      ret = getopt_long(_argc, _argv, "", long_options_enc, &option_index);
+      ret = getopt_long(argc, argv, "", long_options_enc, &option_index);
     } else {
-      ret = getopt_long(_argc, _argv, "", long_options_dec, &option_index);
+      ret = getopt_long(argc, argv, "", long_options_dec, &option_index);
     }
 
     if(ret == -1) break;
     if(ret == '?') {
       rc = I_MISC_ERR;;
-      goto free;
+      goto end;
     }
 
     if(sender) {
@@ -694,7 +663,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: delay frames \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}                 
       }
       else if(!strcmp(long_options_enc[option_index].name, "sda")) {
@@ -702,12 +671,12 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: desired aggressiveness \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;
-	  goto free;
+	  goto end;
 	}
 	if(da < 1 || da > 10) {
 	  fprintf(stderr, "Error: wrong aggressiveness \"%s\" (Must be in [1,10])\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "sfile")) {
@@ -718,7 +687,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: hiding method \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "ssm")) {
@@ -726,7 +695,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: synchronization method \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "ssigma")) {
@@ -734,7 +703,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: sigma \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "skey")) {
@@ -757,7 +726,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: Emission ID \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "scpkt")) {
@@ -765,7 +734,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: Packet ID \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_enc[option_index].name, "scdds")) {
@@ -773,9 +742,63 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: Default data size \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
+	}
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "sfv")) {
+	if(sscanf(optarg, "%d", &sfv) != 1 ||
+	   (sfv != FRAME_V1 && sfv != FRAME_V2)) {
+	  fprintf(stderr, "Error: Stego-frames format \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
+	}
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "scfmt")) {
+	if(sscanf(optarg, "%d", &scfmt) != 1 ||
+	   (scfmt != 1 && scfmt != 2)) {
+	  fprintf(stderr, "Error: Crypto-packets format \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
+	}
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "scadapt")) {
+	scadapt = 1;
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "slive")) {
+	slive = 1;
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "slatency")) {
+	if(sscanf(optarg, "%d", &slatency) != 1 || slatency < 0) {
+	  fprintf(stderr, "Error: Maximum latency \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;
+	  goto end;
+	}
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "scqueue")) {
+	if(sscanf(optarg, "%d", &scqueue) != 1 ||
+	   scqueue < 0 || scqueue > CRYPTOS_PRODUCER_MAX_SLOTS) {
+	  fprintf(stderr, "Error: Crypto-packets queue \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;
+	  goto end;
+	}
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "sfec")) {
+	if(sscanf(optarg, "%d,%d", &fec_k, &fec_m) != 2 ||
+	   fec_k < 1 || fec_m < 1) {
+	  fprintf(stderr, "Error: FEC parameters \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
 	}
       } 
+      else if(!strcmp(long_options_enc[option_index].name, "sstats")) {
+	sstats = strdup(optarg);
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "srecord")) {
+	srecord = strdup(optarg);
+      } 
+      else if(!strcmp(long_options_enc[option_index].name, "sindex")) {
+	sindex = strdup(optarg);
+      } 
       else if(!strcmp(long_options_enc[option_index].name, "quiet")) {
 	quiet = 1;
       } 
@@ -784,7 +807,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
       } else {
 	fprintf(stderr, "Error: Unrecognised parameter\n");
 	rc = I_MISC_ERR;;
-	goto free;
+	goto end;
       }
     } else {      
       if(!strcmp(long_options_dec[option_index].name, "sfile")) {
@@ -795,7 +818,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: hiding method \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_dec[option_index].name, "ssm")) {
@@ -803,7 +826,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: synchronization method \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_dec[option_index].name, "ssigma")) {
@@ -811,7 +834,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: sigma \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_dec[option_index].name, "skey")) {
@@ -831,7 +854,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: Emission ID \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
 	}
       }
       else if(!strcmp(long_options_dec[option_index].name, "scpkt")) {
@@ -839,9 +862,44 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
 	   != 1) {
 	  fprintf(stderr, "Error: Packet ID \"%s\" not recognised\n", optarg);
 	  rc = I_MISC_ERR;;
-	  goto free;
+	  goto end;
+	}
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "scdds")) {
+	if(sscanf(optarg, "%d", &scdds) != 1 || scdds < 0) {
+	  fprintf(stderr, "Error: Default data size \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
+	}
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "scfmt")) {
+	if(sscanf(optarg, "%d", &scfmt) != 1 ||
+	   (scfmt != 1 && scfmt != 2)) {
+	  fprintf(stderr, "Error: Crypto-packets format \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
 	}
       }
+      else if(!strcmp(long_options_dec[option_index].name, "sfec")) {
+	if(sscanf(optarg, "%d,%d", &fec_k, &fec_m) != 2 ||
+	   fec_k < 1 || fec_m < 1) {
+	  fprintf(stderr, "Error: FEC parameters \"%s\" not recognised\n", optarg);
+	  rc = I_MISC_ERR;;
+	  goto end;
+	}
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "sstats")) {
+	sstats = strdup(optarg);
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "srecord")) {
+	srecord = strdup(optarg);
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "sscan")) {
+	sscan = strdup(optarg);
+      }
+      else if(!strcmp(long_options_dec[option_index].name, "sseek")) {
+	sseek = 1;
+      }
       else if(!strcmp(long_options_dec[option_index].name, "quiet")) {
 	quiet = 1;
       }
@@ -850,33 +908,42 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
       } else {
 	fprintf(stderr, "Error: Unrecognised parameter\n");
 	rc = I_MISC_ERR;;
-	goto free;
+	goto end;
       }
 
     }
    
   }
 
-  /* Check required params */
-  if(!skey) {
+  /* Check required params. The steganalysis scan needs no key nor output
+     file, it tries the candidate ones */
+  if(!skey && !sscan) {
     fprintf(stderr, "Error: missing key\n");
     rc = I_MISC_ERR;;
-    goto free;   
+    goto end;   
   }
-  if(!sfile) {
+  if(!sfile && !sscan) {
     fprintf(stderr, "Error: missing input/output file\n");
     rc = I_MISC_ERR;;
-    goto free;
+    goto end;
   }
   if(hide_method == -1) {
     fprintf(stderr, "Error: missing hiding method\n");
     rc = I_MISC_ERR;;
-    goto free;
+    goto end;
   }
   if(sync_method == -1) {
     fprintf(stderr, "Error: missing synchronization method\n");
     rc = I_MISC_ERR;;
-    goto free;
+    goto end;
+  }
+  /* The CRYPTOS_FORMAT_V1 digest runs over every packet since the first
+     one, unless it is an HMAC; it can't be checked starting mid-stream */
+  if(!sender && sseek && !fec_k &&
+     scfmt == 1 && !schmac) {
+    fprintf(stderr, "Error: seekable extraction needs --scfmt 2 or --schmac\n");
+    rc = I_MISC_ERR;;
+    goto end;
   }
 
   /* Update parameters */
@@ -887,6 +954,7 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
     fw->hide_method = hide_method;
     fw->sync_method = sync_method;
     fw->sigma = sigma;
+    fw->sfv = sfv;
     fw->skey = skey;
     fw->sca = sca;
     fw->scmda = scmda;
@@ -895,6 +963,16 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
     fw->scem = scem;
     fw->scpkt = scpkt;
     fw->scdds = scdds;
+    fw->scfmt = scfmt;
+    fw->scadapt = scadapt;
+    fw->scqueue = scqueue;
+    fw->slive = slive;
+    fw->slatency = slatency;
+    fw->fec_k = fec_k;
+    fw->fec_m = fec_m;
+    fw->sstats = sstats;
+    fw->srecord = srecord;
+    fw->sindex = sindex;
     fw->quiet = quiet;
     fw->force = force;
   } else {
@@ -908,12 +986,105 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
     inv->schmac = schmac;
     inv->scem = scem;
     inv->scpkt = scpkt;
+    inv->scdds = scdds;
+    inv->scfmt = scfmt;
+    inv->fec_k = fec_k;
+    inv->fec_m = fec_m;
+    inv->sstats = sstats;
+    inv->srecord = srecord;
+    inv->sscan = sscan;
+    inv->sseek = sseek;
     inv->quiet = quiet;
     inv->force = force;
   }
 
- free:
-  
+
+ end:
+
+  /* Restore the previous optind */
+  optind = optind_aux;
+
+  return rc;
+
+}
+
+int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int sender) {
+
+  FILE *fd;
+  char **_argv, _st_argv[31][100];
+  int rc, _argc, i;
+  char c, str[100];
+  if(!cfg_file ||
+     (sender && !fw) ||
+     (!sender && !inv)) {
+    errno = EINVAL;
+    message_log("parse_options", strerror(errno));
+    return I_MISC_ERR;
+  }
+
+  if(!(fd = fopen(cfg_file, "r"))) {
+    message_log("parse_options", strerror(errno));
+    return I_MISC_ERR;
+  }
+
+  for(i=0; i<14; i++) 
+    memset(_st_argv[i], 0, 100);  
+
+  i=0; c = 0; _argc = 0;
+  memset(str, 0, 100);
+  while(c != '\n') {
+    c = fgetc(fd);
+    if(c == EOF) {
+      fprintf(stderr, "Unexpected End Of File\n");
+      fclose(fd);
+      errno = EBADF;
+      return I_MISC_ERR;
+    } else if(isspace(c)) {
+      if(_argc > 31) {
+	fprintf(stderr, "Unexpected param: %s\n", str);
+	fclose(fd);
+	errno = EINVAL;
+	return I_MISC_ERR;
+      }
+      strcpy(_st_argv[_argc], str);
+      _argc++;
+      memset(str, 0,100);
+      i = 0;
+    } else {
+      str[i] = c;
+      i++;
+    }
+  }
+
+  if(strcmp(_st_argv[0], cfg_file)) {
+    fprintf(stderr, "Bad configuration file\n");
+    errno = EBADF;
+    fclose(fd);
+    return I_MISC_ERR;
+  }
+
+  /* Allocate dynamic _argv */
+  _argv = (char **) malloc(sizeof(char*)*_argc);
+  if(!_argv) {
+    fprintf(stderr, "%s", strerror(errno));
+    fclose(fd);
+    return I_MISC_ERR;
+  }
+
+  for(i=0; i<_argc; i++) {
+    if(!(_argv[i] = (char *) malloc(sizeof(char)*(strlen(_st_argv[i])+1)))) {
+      fprintf(stderr, "%s", strerror(errno));
+      free(_argv);
+      fclose(fd);
+      return I_MISC_ERR;
+    }
+    memset(_argv[i], 0, strlen(_st_argv[i])+1);
+    strcpy(_argv[i], _st_argv[i]);
+  }
+
+
+  rc = parse_options_argv(_argc, _argv, fw, inv, sender);
+
   fclose(fd);
   for(i=0; i<_argc; i++) {
     free(_argv[i]); 
@@ -922,9 +1093,6 @@ int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int send
   free(_argv); 
   _argv = NULL;
 
-  /* Restore the previous optind */
-  optind = optind_aux;
-
   return rc;
 
 }
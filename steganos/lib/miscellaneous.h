@@ -59,6 +59,7 @@ typedef struct {
   int hide_method;      /**< Hiding method, if at the end is still -1, error */
   int sync_method;      /**< Default synchronization method, if at the end is still -1, error */
   float sigma;          /**< Default sigma */
+  int sfv;              /**< Stego-frames format (1 or 2) */
   char *skey;           /**< Key */
   char *sca;            /**< Cipher algorithm */
   char *scmda;          /**< Digest algorithm */
@@ -67,6 +68,19 @@ typedef struct {
   uint64_t scem;        /**< Emission ID */
   uint64_t scpkt;       /**< First packet ID */
   int scdds;            /**< Default data size for crypto-packets */  
+  int scfmt;            /**< Crypto-packets format (1 or 2) */
+  int scadapt;          /**< Adaptive crypto-packets size flag */
+  int scqueue;          /**< Crypto-packets produced ahead by a separate thread
+			   (0, produced by the encoding thread) */
+  int slive;            /**< Live payload flag: sfile is a pipe or a FIFO read
+			   as the payload arrives */
+  int slatency;         /**< Live payload maximum latency, in milliseconds
+			   (0, full crypto-packets only) */
+  int fec_k;            /**< FEC group size (0, no FEC) */
+  int fec_m;            /**< FEC parity packets per group */
+  char *sstats;         /**< Telemetry JSON-lines output file (NULL, none) */
+  char *srecord;        /**< Frame recording output file (NULL, none) */
+  char *sindex;         /**< Embedding index output file (NULL, none) */
   int quiet;            /**< Quiet mode indicator */
   int force;            /**< Indicates obligation to use the config from file */
 } fw_options_t;
@@ -87,6 +101,17 @@ typedef struct {
   int schmac;           /**< Hmac flag */
   uint64_t scem;        /**< Emission ID */
   uint64_t scpkt;       /**< First packet ID */
+  int scdds;            /**< Data size of the sender's crypto-packets, to 
+			   locate the payload in seekable extraction */
+  int scfmt;            /**< Crypto-packets format (1 or 2) */
+  int fec_k;            /**< FEC group size (0, no FEC) */
+  int fec_m;            /**< FEC parity packets per group */
+  char *sstats;         /**< Telemetry JSON-lines output file (NULL, none) */
+  char *srecord;        /**< Decoded frames sidecar, for replays (NULL, none) */
+  char *sscan;          /**< Candidate keys file for the steganalysis scan
+			   (NULL, normal extraction) */
+  int sseek;            /**< Seekable extraction flag: the extraction may start
+			   anywhere in the emission */
   int quiet;            /**< Quiet mode indicator */
   int force;            /**< Indicates obligation to use the config from file */
 } inv_options_t;
@@ -218,6 +243,32 @@ int message_log(const char *caller, const char *message);
  */
 int parse_options(char *cfg_file, fw_options_t *fw, inv_options_t *inv, int sender);
 
+/**
+ * @fn int parse_options_argv(int argc, char **argv, fw_options_t *fw,
+ *                            inv_options_t *inv, int sender);
+ * @brief Parses the configuration options from an argument vector, as
+ *  parse_options does with the contents of the configuration file. Lets
+ *  a program driving several encodings or decodings (e.g. vorbistego-batch)
+ *  parse the options of each one just once.
+ *
+ * @param[in] argc Number of arguments in <i>argv</i>.
+ * @param[in] argv The arguments. argv[0] is the program name and is ignored.
+ *  Note that getopt_long may permute the rest.
+ * @param[out] fw The forward options to fill when sender is set to 1
+ * @param[out] inv The inverse options to fill when sender is set to 0
+ * @param[in] sender When set to 1, indicates we must fill the forward config.
+ *  When set to 0, indicates we must fill the inverse config.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_MISC_OK if no error was present and I_MISC_ERR if an error occured with
+ *  errno updated.
+ * @retval I_MISC_OK with errno = 0 (No error).
+ * @retval I_MISC_ERR with errno = EINVAL (invalid argument), or if an
+ *  option is not recognised or a required one is missing.
+ */
+int parse_options_argv(int argc, char **argv, fw_options_t *fw,
+		       inv_options_t *inv, int sender);
+
 /* The following functions are extracted from the zlib's zpipe.c example program
    and are exactly the same except the names. */
 
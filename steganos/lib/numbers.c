@@ -152,6 +152,31 @@ int prng_get_random_int(prng_t *prng, const int modulo, int *r) {
   return I_OK;
 }
 
+int prng_get_random_ints(prng_t *prng, const int modulo, int *r, 
+			 const int count) {
+
+  int i, rnd;
+  long int lrnd;
+
+  /* Input parameters control */
+  if(!prng || modulo <= 0 || !r || count < 0) {
+    errno = EINVAL;
+    message_log("prng_get_random_ints", strerror(errno));
+    return I_ERR;
+  }
+
+  /* Same mapping as prng_get_random_int, so both can be mixed */
+  for(i=0; i<count; i++) {
+    lrnd = random();
+    if(lrnd > INT_MAX) rnd = INT_MAX;
+    else rnd = lrnd;
+    r[i] = (int) (((float)modulo*rnd)/(RAND_MAX+1.0));
+  }
+
+  prng->iters += count;
+  return I_OK;
+}
+
 int linear_interpolation_y(const float x1, const float y1,
 			    const float x2, const float y2, 
 			    const float x, float *y) {
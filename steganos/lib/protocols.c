@@ -36,15 +36,62 @@
 #include "protocols.h"
 #include "steganos_channel.h"
 #include "cryptos_channel.h"
+#include "fec_channel.h"
 #include "miscellaneous.h"
 #include "numbers.h"
 
+/* Byte i of the stream that starts phase bits into buffer followed by the
+   carry bits (zeros after them) */
+static byte _shifted_byte(const byte *buffer, size_t used, byte carry, 
+			  int phase, size_t i) {
+
+  byte hi, lo;
+
+  hi = i < used ? buffer[i] : (i == used ? carry : 0);
+  if(!phase) return hi;
+  lo = i+1 < used ? buffer[i+1] : (i+1 == used ? carry : 0);
+
+  return (byte) ((hi << phase) | (lo >> (BITS_PER_BYTE - phase)));
+
+}
+
+/* Writes the data of the last packet parsed. In seekable extraction, at its
+   payload offset, or after the data already written if it is unknown. */
+static int _write_payload(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
+			  byte *data, uint64_t d_len) {
+
+  ssize_t rc;
+
+  if(!cc->seek_data_size) {
+    rc = write(cb->fd, data, d_len);
+  } else if(cc->offset != CRYPTOS_OFFSET_UNKNOWN) {
+    rc = pwrite(cb->fd, data, d_len, cc->offset);
+  } else if(lseek(cb->fd, 0, SEEK_END) == -1) {
+    rc = -1;
+  } else {
+    rc = write(cb->fd, data, d_len);
+  }
+
+  if(rc == -1) {
+    message_log("cryptos_inverse", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if((uint64_t) rc != d_len) {
+    message_log("cryptos_inverse", "Unknown error");
+    return I_CRYPTOS_ERR;
+  }
+
+  return I_CRYPTOS_OK;
+
+}
+
 int cryptos_forward(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb, 
  		    uint64_t data_size) {
 
   struct stat buf;
   byte *tmp, *packet;
-  uint64_t written, effective_data_size, packet_size;
+  uint64_t written, effective_data_size, packet_size, size_limit;
   ssize_t rc;
 
   /* Input parameters control */
@@ -56,19 +103,27 @@ int cryptos_forward(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
 
   /* If the remaining data in the buffer is at least big enough to cover
      a whole stego-frame, we don't have work to do yet. */
-  if(cb->buffer_used >= MAX_SUBLIMINAL_SIZE) {
+  if(cb->buffer_used >= cb->frame_bytes) {
     return I_CRYPTOS_OK;
   }
 
   /* If the received data_size is 0 or we receive a data_size > than the
-     default packet size, the size is changed to the default. */
-  if(!data_size || data_size > cc->default_data_size) {
-    effective_data_size = cc->default_data_size;
+     packet size (the default one, or the one derived from the measured
+     capacity if adaptive sizing is active), the size is changed to it. */
+  if(cryptos_config_data_size(cc, &size_limit) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  if(!data_size || data_size > size_limit) {
+    effective_data_size = size_limit;
   } else {
     effective_data_size = data_size;
   }
 
-  packet_size = effective_data_size + CRYPTOS_HEADER_LEN + cc->md_len;
+  /* Upper bound, the exact size is known once the data has been read */
+  if(cryptos_packet_len(cc, effective_data_size, &packet_size) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
 
   if(!(packet = (byte *) malloc(sizeof(byte)*packet_size))) {
     message_log("cryptos_forward", strerror(errno));
@@ -115,6 +170,14 @@ int cryptos_forward(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
     cc->packet = 0;
   }
 
+  /* Actual length of the packet (the last one may carry less data, and the
+     varint fields of the compact format depend on the packet id) */
+  if(cryptos_packet_len(cc, rc, &packet_size) == I_CRYPTOS_ERR) {
+    free(packet);
+    free(tmp);
+    return I_CRYPTOS_ERR;
+  }
+
   written = 0;
   if(produce_packet(cc, tmp, rc, packet, packet_size,
 		    &written) == I_CRYPTOS_ERR) {
@@ -171,18 +234,18 @@ int cryptos_inverse(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb) {
     return I_CRYPTOS_ERR;
   }
 
-  if(!(tmp = (byte *) malloc(sizeof(byte)*cc->default_data_size))) {
+  if(!(tmp = (byte *) malloc(sizeof(byte)*cc->max_data))) {
     errno = EINVAL;
     message_log("cryptos_inverse", strerror(errno));
     return I_CRYPTOS_ERR;
   }
 
-  memset(tmp, 0, cc->default_data_size);
+  memset(tmp, 0, cc->max_data);
   read = 0;
 
   /* If we get an error parsing the packet, it was malformed or had an
      unexpected EMISSION or PACKET ids */
-  data = cc->default_data_size;
+  data = cc->max_data;
   if((rc = parse_packet(cc, cb->buffer, cb->buffer_used, tmp, 
 			&data, &read)) == I_CRYPTOS_ERR) {
     
@@ -224,19 +287,248 @@ int cryptos_inverse(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb) {
   cb->buffer_used -= read;
   memset(&cb->buffer[cb->buffer_used], 0, cb->buffer_size - cb->buffer_used);
 
-  if((rc = write(cb->fd, tmp, read-CRYPTOS_HEADER_LEN-cc->md_len)) == -1) {
-    message_log("cryptos_inverse", strerror(errno));
-    free(tmp);
+  /* parse_packet leaves in data the number of data bytes recovered */
+  rc = _write_payload(cc, cb, tmp, data);
+  free(tmp);
+
+  return rc;
+
+}
+
+int cryptos_inverse_resync(steganos_state_t *ss, cryptos_config_t *cc, 
+			   cryptos_protocol_buffer_t *cb) {
+
+  const byte *sync;
+  byte *stream, *tmp;
+  uint64_t bits, n, o, data, read, expected, max_packet;
+  int phase, sync_len, rest, rc;
+
+  /* Input parameters control */
+  if(!ss || !cc || !cb) {
+    errno = EINVAL;
+    message_log("cryptos_inverse_resync", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if(!cc->resync) {
+    return cryptos_inverse(cc, cb);
+  }
+
+  if(cc->format == CRYPTOS_FORMAT_V2) {
+    sync = CRYPTOS_V2_SYNC_HEADER;
+    sync_len = CRYPTOS_V2_SYNC_HEADER_LEN;
+  } else {
+    sync = CRYPTOS_SYNC_HEADER;
+    sync_len = CRYPTOS_SYNC_HEADER_LEN;
+  }
+
+  if(cb->buffer_used <= (size_t) sync_len) {
+    return I_CRYPTOS_OK;
+  }
+  bits = cb->buffer_used*BITS_PER_BYTE + ss->carry_len;
+
+  if(!(stream = (byte *) malloc(sizeof(byte)*cb->buffer_used))) {
+    message_log("cryptos_inverse_resync", strerror(errno));
     return I_CRYPTOS_ERR;
   }
 
+  /* Large enough for the data of any complete packet in the buffer, so
+     parse_packet never has to reallocate it */
+  if(!(tmp = (byte *) malloc(sizeof(byte)*cb->buffer_size))) {
+    message_log("cryptos_inverse_resync", strerror(errno));
+    free(stream);
+    return I_CRYPTOS_ERR;
+  }
+
+  /* The bit where the sender's bytes start is unknown: try every alignment
+     of the received bits, and every byte offset within it, until a packet
+     passes the integrity check */
+  rc = I_CRYPTOS_OK;
+  for(phase=0; phase<BITS_PER_BYTE && cc->resync; phase++) {
+
+    n = (bits - phase)/BITS_PER_BYTE;
+    for(o=0; o<n; o++) {
+      stream[o] = _shifted_byte(cb->buffer, cb->buffer_used, ss->carry, 
+				phase, o);
+    }
+
+    for(o=0; o+sync_len<n; o++) {
+
+      if(memcmp(&stream[o], sync, sync_len)) continue;
+
+      /* False positives must not change the expected packet id */
+      expected = cc->packet;
+      data = cb->buffer_size; read = 0;
+      if(parse_packet(cc, &stream[o], n-o, tmp, &data, &read) != I_CRYPTOS_OK ||
+	 !read || cc->resync) {
+	cc->packet = expected;
+	continue;
+      }
+
+      /* In sync. What follows the packet, in the sender's alignment, replaces
+	 the buffer, and the bits that don't fill a byte become the carry */
+      rest = (bits - phase) % BITS_PER_BYTE;
+      ss->carry = rest ? 
+	_shifted_byte(cb->buffer, cb->buffer_used, ss->carry, phase, n) &
+	(0xFF << (BITS_PER_BYTE - rest)) : 0;
+      ss->carry_len = rest;
+      cb->buffer_used = n - o - read;
+      memcpy(cb->buffer, &stream[o+read], cb->buffer_used);
+      memset(&cb->buffer[cb->buffer_used], 0, cb->buffer_size - cb->buffer_used);
+
+      rc = _write_payload(cc, cb, tmp, data);
+      break;
+
+    }
+
+  }
+
+  free(stream);
   free(tmp);
 
-  if((uint64_t) rc != read-CRYPTOS_HEADER_LEN-cc->md_len) {
-    message_log("cryptos_inverse", "Unknown error");
+  /* Still searching. A packet starting before the last max_packet bytes 
+     would have been complete, so only those are kept. Dropping whole bytes 
+     doesn't change the alignments to try. */
+  if(cc->resync) {
+    if(cryptos_packet_len(cc, cc->max_data, &max_packet) == I_CRYPTOS_ERR) {
+      return I_CRYPTOS_ERR;
+    }
+    if(cb->buffer_used > max_packet) {
+      o = cb->buffer_used - max_packet;
+      memmove(cb->buffer, &cb->buffer[o], max_packet);
+      cb->buffer_used = max_packet;
+      memset(&cb->buffer[cb->buffer_used], 0, cb->buffer_size - cb->buffer_used);
+    }
+  }
+
+  return rc;
+
+}
+
+int fec_forward(fec_state_t *fs, cryptos_config_t *cc, 
+		cryptos_protocol_buffer_t *cb, uint64_t data_size) {
+
+  byte *packet;
+  size_t used, p_len, written;
+
+  /* Input parameters control */
+  if(!fs || !cc || !cb) {
+    errno = EINVAL;
+    message_log("fec_forward", strerror(errno));
     return I_CRYPTOS_ERR;
   }
-  
+
+  /* Same condition as in cryptos_forward */
+  if(cb->buffer_used >= cb->frame_bytes) {
+    return I_CRYPTOS_OK;
+  }
+
+  /* Let the cryptographic layer append the packet, and then replace it by
+     its FEC frame */
+  used = cb->buffer_used;
+  if(cryptos_forward(cc, cb, data_size) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  p_len = cb->buffer_used - used;
+  if(!p_len) {
+    return I_CRYPTOS_OK;
+  }
+
+  if(!(packet = (byte *) malloc(sizeof(byte)*p_len))) {
+    message_log("fec_forward", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  memcpy(packet, &cb->buffer[used], p_len);
+  cb->buffer_used = used;
+
+  if(fec_encode_packet(fs, packet, p_len, &cb->buffer[cb->buffer_used],
+		       cb->buffer_size - cb->buffer_used, &written) == I_FEC_ERR) {
+    free(packet);
+    return I_CRYPTOS_ERR;
+  }
+  cb->buffer_used += written;
+  free(packet);
+
+  /* Close the group when full, or when this was the last packet */
+  if(fs->count == fs->k || !cc->packet) {
+    if(fec_encode_parity(fs, &cb->buffer[cb->buffer_used], 
+			 cb->buffer_size - cb->buffer_used, &written) 
+       == I_FEC_ERR) {
+      return I_CRYPTOS_ERR;
+    }
+    cb->buffer_used += written;
+  }
+
+  return I_CRYPTOS_OK;
+
+}
+
+int fec_inverse(fec_state_t *fs, cryptos_config_t *cc, 
+		cryptos_protocol_buffer_t *cb) {
+
+  size_t read, d_len;
+  uint16_t group;
+  int lost, progress;
+
+  /* Input parameters control */
+  if(!fs || !cc || !cb) {
+    errno = EINVAL;
+    message_log("fec_inverse", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  while(cc->packet) {
+
+    progress = 0;
+
+    /* Consume all the complete FEC frames received */
+    do {
+      if(fec_parse_frame(fs, fs->buffer, fs->buffer_used, &read) == I_FEC_ERR) {
+	return I_CRYPTOS_ERR;
+      }
+      if(read) {
+	memmove(fs->buffer, &fs->buffer[read], fs->buffer_size - read);
+	fs->buffer_used -= read;
+	memset(&fs->buffer[fs->buffer_used], 0, fs->buffer_size - fs->buffer_used);
+	progress = 1;
+      }
+    } while(read && fs->buffer_used);
+
+    /* And pass the next crypto packet, if available, to the cryptographic 
+       layer. cb holds at most one packet at a time. */
+    group = fs->group;
+    if(fec_next_packet(fs, &cb->buffer[cb->buffer_used], 
+		       cb->buffer_size - cb->buffer_used, &d_len, &lost) 
+       == I_FEC_ERR) {
+      return I_CRYPTOS_ERR;
+    }
+
+    /* Skip the ids of the packets given up */
+    if(lost) {
+      cc->packet += lost;
+      progress = 1;
+    }
+
+    if(d_len) {
+      cb->buffer_used += d_len;
+      if(cryptos_inverse(cc, cb) == I_CRYPTOS_ERR) {
+	return I_CRYPTOS_ERR;
+      }
+      progress = 1;
+    }
+
+    if(group != fs->group) {
+      progress = 1;
+    }
+
+    if(!progress) {
+      break;
+    }
+
+  }
+
   return I_CRYPTOS_OK;
 
 }
@@ -324,14 +616,15 @@ int steganos_forward(steganos_state_t *ss, vorbis_config_t *vc, int *floor,
      metainfo bits for a sole single info bit! */
   if(ss->synchro_method == RES_HEADER || ss->synchro_method == FORCED_RES_HEADER) {
     if(ss->min_fc_capacity <= (SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE)) {
+      ss->frame_stats.capacity = (int) ss->max_fc_capacity;
       return I_STEGANOS_FRAME_SKIP;
     }
   }
 
   /* Once here, we know there still are bits to send */
   d_len = buffer_len;
-  if(d_len > MAX_SUBLIMINAL_SIZE) {
-    d_len = MAX_SUBLIMINAL_SIZE;
+  if(d_len > MAX_SUBLIMINAL_BYTES) {
+    d_len = MAX_SUBLIMINAL_BYTES;
   }
     
   /* Allocate a (unsigned char *) for, at maximum, MAX_SUBLIMINAL_SIZE bits */
@@ -388,9 +681,8 @@ int steganos_inverse(steganos_state_t *ss, vorbis_config_t *vc, int *posts,
 
   iss_cfg_t iss_cfg;
   int read, i, aux, bit, pcmend, posts_len, hack, carry_prev, read_w_carry;
-  byte *data, buff;
-  static byte carry=0;
-  static int carry_len=0;
+  byte *data, buff, carry;
+  int carry_len;
 
 
   /* Input parameters control */
@@ -405,6 +697,8 @@ int steganos_inverse(steganos_state_t *ss, vorbis_config_t *vc, int *posts,
   pcmend = vc->pcmend;
   posts_len = vc->posts_len;
   hack = 0;
+  carry = ss->carry;
+  carry_len = ss->carry_len;
 
   if(ss->synchro_method == ISS) {
     
@@ -517,6 +811,9 @@ int steganos_inverse(steganos_state_t *ss, vorbis_config_t *vc, int *posts,
       }
 
     }
+
+    ss->carry = carry;
+    ss->carry_len = carry_len;
     
 #ifdef STEGANOS_DEBUG
     {
@@ -18,6 +18,7 @@
 //#include "codec_internal.h"
 #include "steganos_types.h"
 #include "cryptos_types.h"
+#include "fec_types.h"
 #include "global_types.h"
 
 /* Functions */
@@ -28,7 +29,7 @@
  * @brief Produces a new cryptographic packet when necessary.
  *
  * When this function is called, and the cryptographic layer buffer is at risk
- * of underflow (i.e., if it has less than MAX_SUBLIMINAL_SIZE bits stores),
+ * of underflow (i.e., if it has less than cb->frame_bytes bytes stored),
  * produces a new crypto packet, storing it in the cryptographic layer buffer.
  * The data to include is read from the file descriptor stored in the 
  * cryptographic layer buffer.
@@ -70,6 +71,82 @@ int cryptos_forward(cryptos_config_t *cc, cryptos_protocol_buffer_t *cb,
  */
 int cryptos_inverse(cryptos_config_t *cc, cryptos_protocol_buffer_t *clb);
 
+/** 
+ * @fn int cryptos_inverse_resync(steganos_state_t *ss, cryptos_config_t *cc,
+ *                                cryptos_protocol_buffer_t *cb)
+ * @brief Works as cryptos_inverse, but while <i>cc->resync</i> is active it 
+ *  also looks for the alignment of the received bits.
+ *
+ * After a seek, the first bit received is anywhere in a byte of the sender,
+ * and the steganographic layer has packed the bits from there. Every bit
+ * alignment and byte offset of the received bits (the buffer and the carry
+ * of <i>ss</i>) is tried until a packet passes the integrity check. Then the
+ * buffer and the carry are realigned, so the next steganos_inverse calls 
+ * continue in the sender's alignment, and the recovered data is written at 
+ * its payload offset (see cryptos_config_set_seekable). Not suitable for the
+ * FEC layer buffer.
+ *
+ * @param[in] ss Steganographic layer state.
+ * @param[in] cc Cryptographic layer configuration structure.
+ * @param[in] cb Cryptographic layer buffer.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error, in sync or still searching).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int cryptos_inverse_resync(steganos_state_t *ss, cryptos_config_t *cc, 
+			   cryptos_protocol_buffer_t *cb);
+
+/** 
+ * @fn int fec_forward(fec_state_t *fs, cryptos_config_t *cc, 
+ *                     cryptos_protocol_buffer_t *cb, uint64_t data_size)
+ * @brief Produces a new crypto packet when necessary, protected by the FEC
+ *  layer.
+ *
+ * Works as cryptos_forward, but the produced crypto packet is wrapped in a FEC
+ * frame, and every fs->k packets (and after the last one of the 
+ * transmission) the fs->m parity frames of the group are appended too. 
+ * <i>cb</i> must have room for fs->m+1 FEC frames over cb->frame_bytes.
+ *
+ * @param[in] fs FEC layer state.
+ * @param[in] cc Cryptographic layer configuration structure.
+ * @param[in] cb Cryptographic layer buffer.
+ * @param[in] data_size See cryptos_forward.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_forward(fec_state_t *fs, cryptos_config_t *cc, 
+		cryptos_protocol_buffer_t *cb, uint64_t data_size);
+
+/** 
+ * @fn int fec_inverse(fec_state_t *fs, cryptos_config_t *cc, 
+ *                     cryptos_protocol_buffer_t *cb)
+ * @brief Parses the FEC frames stored in fs->buffer and passes the crypto
+ *  packets, in order, to cryptos_inverse.
+ *
+ * Missing crypto packets are rebuilt from the parity frames when possible.
+ * For those that can't be rebuilt, the expected packet id of <i>cc</i> is
+ * advanced, so the following ones are still accepted.
+ *
+ * @param[in] fs FEC layer state.
+ * @param[in] cc Cryptographic layer configuration structure.
+ * @param[in] cb Cryptographic layer buffer.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ */
+int fec_inverse(fec_state_t *fs, cryptos_config_t *cc, 
+		cryptos_protocol_buffer_t *cb);
+
 /** 
  * @fn int steganos_vorbis_config_init(vorbis_config_t *vc, int rate, int pcmend,
  *                                     int mult, int *postlist, 
@@ -23,6 +23,7 @@
 #include <fenv.h>
 #include <gcrypt.h>
 #include "steganos_channel.h"
+#include "steganos_stats.h"
 #include "numbers.h"
 #include "miscellaneous.h"
 #include "vorbis/codec.h"
@@ -130,7 +131,8 @@ static int _itu468_var_tol(const float frequency, const float base, float *toler
 /**
  * @fn static int _get_subliminal_data(steganos_state_t *ss, byte *data, 
  *                       const int d_len, int *floor, float *residue, 
- *                       const int res_len, byte *sub_data, int *size)
+ *                       const int res_len, byte *sub_data, int *size,
+ *                       int *hdr_size)
  * @brief Obtains the next 'size' bits of subliminal data (if available) using
  *  the method specified in ss->hide_method.
  *
@@ -165,6 +167,8 @@ static int _itu468_var_tol(const float frequency, const float base, float *toler
  * @param[in, out] size The maximum amount of subliminal bits to hide as input 
  *  (i.e., the allocated memory for sub_data) and the final data retrieved at 
  *  the output, also in bits, including header, data, and tail (if any) 
+ * @param[out] hdr_size The number of header bits (synchronization header plus
+ *  size field, escaped or not) included in <i>sub_data</i>.
  * @return The corresponding error code for integer returning functions, i.e., 
  *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
  *  with errno updated.
@@ -175,16 +179,16 @@ static int _itu468_var_tol(const float frequency, const float base, float *toler
  */
 static int _get_subliminal_data(steganos_state_t *ss, byte *data, const int d_len, 
 				int *floor, float *residue, const int res_len,
-				byte *sub_data, int *size) {
+				byte *sub_data, int *size, int *hdr_size) {
 
   int usage_bits, free_bits, header_bits, data_bits, tail_bits, meta_data_bits;
   int tmp_size, i, size_field, aux, meta_data_bytes, header_bytes;
-  int data_bytes, tail_bytes;
+  int data_bytes, tail_bytes, size_bits, size_offset;
   byte *meta_data;
 
 
   /* Input parameters control */
-  if(!ss || d_len < 0 ||
+  if(!ss || d_len < 0 || !hdr_size ||
      !floor || !residue || res_len <= 0 || !sub_data || *size <= 0) {
     errno = EINVAL;
     message_log("_get_subliminal_data", strerror(errno));
@@ -221,6 +225,24 @@ static int _get_subliminal_data(steganos_state_t *ss, byte *data, const int d_le
     } else {
       data_bits = free_bits;
     }
+
+    /* With FRAME_V2, sizes that don't fit in the short size field are 
+       announced with SIZE_FIELD_ESCAPE followed by the extended size field.
+       If the extended field leaves less room than the short one, we just
+       send SIZE_FIELD_SHORT_MAX bits. */
+    if(ss->frame_version >= FRAME_V2 && data_bits > SIZE_FIELD_SHORT_MAX) {
+      if(free_bits - SIZE_FIELD_EXT_BITS > SIZE_FIELD_SHORT_MAX) {
+	header_bits += SIZE_FIELD_EXT_BITS;
+	free_bits -= SIZE_FIELD_EXT_BITS;
+	if(d_len <= free_bits) {
+	  data_bits = d_len;
+	} else {
+	  data_bits = free_bits;
+	}
+      } else {
+	data_bits = SIZE_FIELD_SHORT_MAX;
+      }
+    }
  
   } else {
     data_bits = 0;
@@ -271,12 +293,20 @@ static int _get_subliminal_data(steganos_state_t *ss, byte *data, const int d_le
       amount of subliminal data this channel will shelter. The final data hidden
       might be lesser, though. Such cases must not be contemplated as errors. */
   size_field = data_bits + tail_bits;
-  for(i=0; i<SIZE_FIELD_BITS; i++) {
-    aux = ceilf((float)SIZE_FIELD_BITS/(float)BITS_PER_BYTE)-(i/BITS_PER_BYTE)-1;
-    if(ss->synchro_method == RES_HEADER || 
-       ss->synchro_method == FORCED_RES_HEADER) {
-      aux += SYNCHRO_HEADER_BYTES_RES;
-    }
+  size_offset = 0;
+  if(ss->synchro_method == RES_HEADER || 
+     ss->synchro_method == FORCED_RES_HEADER) {
+    size_offset += SYNCHRO_HEADER_BYTES_RES;
+  }
+  size_bits = SIZE_FIELD_BITS;
+  if(header_bits - size_offset*BITS_PER_BYTE > SIZE_FIELD_BITS) {
+    meta_data[size_offset] = SIZE_FIELD_ESCAPE;
+    size_offset += SIZE_FIELD_BITS/BITS_PER_BYTE;
+    size_bits = SIZE_FIELD_EXT_BITS;
+  }
+  for(i=0; i<size_bits; i++) {
+    aux = ceilf((float)size_bits/(float)BITS_PER_BYTE)-(i/BITS_PER_BYTE)-1;
+    aux += size_offset;
     if((size_field >> i) % 2) {
       meta_data[aux] |=
 	(1 << (i % BITS_PER_BYTE));
@@ -330,6 +360,7 @@ static int _get_subliminal_data(steganos_state_t *ss, byte *data, const int d_le
   }
 
   *size = tmp_size;
+  *hdr_size = header_bits;
   memcpy(sub_data, meta_data, sizeof(byte)*meta_data_bytes);
   free(meta_data);
 
@@ -650,6 +681,583 @@ static int _residue_variation(const float residue, const float frequency,
   return I_STEGANOS_OK;
 }
 
+/**
+ * @fn static int _stc_columns(steganos_key_t *key, const int w, int *columns)
+ * @brief Derives the columns of the syndrome-trellis codes submatrix from the
+ *  hiding key.
+ *
+ * The parity-check matrix is built placing the STC_HEIGHT x w submatrix along
+ * its main diagonal, shifting it one row down every w columns. Each column has
+ * its first and last bits set, so that every syndrome can be reached.
+ *
+ * @param[in] key The hiding key.
+ * @param[in] w The width of the submatrix, at most STC_MAX_WIDTH.
+ * @param[out] columns Will store the w columns of the submatrix, being the
+ *  least significant bit the upper row.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _stc_columns(steganos_key_t *key, const int w, int *columns) {
+
+  uint32_t seed;
+  int i;
+
+
+  /* Input parameters control */
+  if(!key || !key->key || w <= 0 || w > STC_MAX_WIDTH || !columns) {
+    errno = EINVAL;
+    message_log("_stc_columns", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  seed = 0;
+  for(i=0; i<key->length/BITS_PER_BYTE; i++) {
+    seed = seed*31 + key->key[i];
+  }
+
+  for(i=0; i<w; i++) {
+    seed = seed*1103515245u + 12345u;
+    columns[i] = (seed >> 16) & ((1 << STC_HEIGHT) - 1);
+    columns[i] |= 1 | (1 << (STC_HEIGHT - 1));
+  }
+
+  return I_STEGANOS_OK;
+}
+
+/**
+ * @fn static int _stc_carriers(steganos_state_t *ss, const float *residue, 
+ *                              const int res_len, const int start, 
+ *                              int *carriers, int *n)
+ * @brief Gets the residual values whose LSBs carry the syndrome-trellis coded 
+ *  data.
+ *
+ * Those are the residual values with absolute value of 2 or more, taken in the
+ * ss->res_lineup order from the <i>start</i> position. The modifications made
+ * by _hide_data_stc never take a residual value below 2, so the receiver gets
+ * the very same carriers.
+ *
+ * @param[in] ss Internal state structure.
+ * @param[in] residue The current frame and channel residue vector.
+ * @param[in] res_len The number of residual values in residue.
+ * @param[in] start First position of ss->res_lineup to consider.
+ * @param[out] carriers Will store the positions of the carriers in 
+ *  <i>residue</i>. Must have room for <i>res_len</i> elements.
+ * @param[out] n Will store the number of carriers.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _stc_carriers(steganos_state_t *ss, const float *residue, 
+			 const int res_len, const int start, 
+			 int *carriers, int *n) {
+
+  int i, pos;
+
+
+  /* Input parameters control */
+  if(!ss || !residue || res_len <= 0 || start < 0 || !carriers || !n) {
+    errno = EINVAL;
+    message_log("_stc_carriers", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  *n = 0;
+  for(i=start; i<res_len; i++) {
+    pos = ss->res_lineup[i];
+    if(fabsf(rintf(residue[pos])) >= 2.f) {
+      carriers[(*n)++] = pos;
+    }
+  }
+
+  return I_STEGANOS_OK;
+}
+
+/**
+ * @fn static int _stc_embed(const byte *cover, const float *cost, 
+ *                           const byte *message, const int m, const int w,
+ *                           const int *columns, byte *stego, float *distortion)
+ * @brief Finds the stego bits with the given syndrome closest to the cover
+ *  bits (Viterbi algorithm over the syndrome trellis).
+ *
+ * The trellis has 2^STC_HEIGHT states, each one being the partial syndrome of
+ * the STC_HEIGHT rows of the parity-check matrix the current column reaches.
+ * Every w columns the upper row is complete, so only the states matching the
+ * corresponding message bit survive and the window moves one row down. At the
+ * end of the matrix, the columns are truncated to its m rows.
+ *
+ * @param[in] cover The m*w cover bits, one per byte.
+ * @param[in] cost The cost of flipping each cover bit.
+ * @param[in] message The m message bits, one per byte.
+ * @param[in] m The number of message bits.
+ * @param[in] w The width of the submatrix.
+ * @param[in] columns The w columns of the submatrix.
+ * @param[out] stego Will store the m*w stego bits, one per byte.
+ * @param[out] distortion Will store the total cost of the modifications.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _stc_embed(const byte *cover, const float *cost, 
+		      const byte *message, const int m, const int w,
+		      const int *columns, byte *stego, float *distortion) {
+
+  uint32_t *path;
+  float *weights, *wght, *nwght, *swap, w0, w1, c0, c1;
+  int states, words, i, j, k, indx, col, mask, state;
+
+
+  /* Input parameters control */
+  if(!cover || !cost || !message || m <= 0 || w <= 0 || 
+     !columns || !stego || !distortion) {
+    errno = EINVAL;
+    message_log("_stc_embed", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  states = 1 << STC_HEIGHT;
+  words = (states + 31) / 32;
+
+  /* One bit per state and column: 1 if the best path to the state marks 
+     the column as used (stego bit = 1) */
+  if(!(path = (uint32_t *) calloc(m*w*words, sizeof(uint32_t)))) {
+    message_log("_stc_embed", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(weights = (float *) malloc(sizeof(float)*2*states))) {
+    message_log("_stc_embed", strerror(errno));
+    free(path);
+    return I_STEGANOS_ERR;
+  }
+  wght = weights;
+  nwght = &weights[states];
+
+  for(k=0; k<states; k++) wght[k] = INFINITY;
+  wght[0] = 0.f;
+
+  /* Forward pass */
+  indx = 0;
+  for(i=0; i<m; i++) {
+
+    mask = states - 1;
+    if(m - i < STC_HEIGHT) mask = (1 << (m - i)) - 1;
+
+    for(j=0; j<w; j++, indx++) {
+
+      col = columns[j] & mask;
+      c0 = cover[indx] ? cost[indx] : 0.f;
+      c1 = cover[indx] ? 0.f : cost[indx];
+
+      for(k=0; k<states; k++) {
+	w0 = wght[k] + c0;
+	w1 = wght[k ^ col] + c1;
+	if(w1 < w0) {
+	  nwght[k] = w1;
+	  path[indx*words + (k >> 5)] |= (1u << (k & 31));
+	} else {
+	  nwght[k] = w0;
+	}
+      }
+
+      swap = wght; wght = nwght; nwght = swap;
+
+    }
+
+    /* The upper row is complete: keep the states matching the message bit */
+    for(k=0; k<states/2; k++) nwght[k] = wght[2*k + message[i]];
+    for(k=states/2; k<states; k++) nwght[k] = INFINITY;
+    swap = wght; wght = nwght; nwght = swap;
+
+  }
+
+  *distortion = wght[0];
+
+  /* Backward pass */
+  state = 0;
+  for(i=m-1; i>=0; i--) {
+
+    mask = states - 1;
+    if(m - i < STC_HEIGHT) mask = (1 << (m - i)) - 1;
+
+    state = (state << 1) | message[i];
+    for(j=w-1; j>=0; j--) {
+      indx--;
+      stego[indx] = (path[indx*words + (state >> 5)] >> (state & 31)) & 1;
+      if(stego[indx]) state ^= (columns[j] & mask);
+    }
+
+  }
+
+  free(weights);
+  free(path);
+
+  return I_STEGANOS_OK;
+}
+
+/**
+ * @fn static int _stc_extract(const byte *stego, const int m, const int w,
+ *                             const int *columns, byte *message)
+ * @brief Multiplies the parity-check matrix by the stego bits.
+ *
+ * @param[in] stego The m*w stego bits, one per byte.
+ * @param[in] m The number of message bits.
+ * @param[in] w The width of the submatrix.
+ * @param[in] columns The w columns of the submatrix.
+ * @param[out] message Will store the m message bits, one per byte.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _stc_extract(const byte *stego, const int m, const int w,
+			const int *columns, byte *message) {
+
+  int i, j, indx, syndrome, mask;
+
+
+  /* Input parameters control */
+  if(!stego || m <= 0 || w <= 0 || !columns || !message) {
+    errno = EINVAL;
+    message_log("_stc_extract", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  syndrome = 0;
+  indx = 0;
+  for(i=0; i<m; i++) {
+
+    mask = (1 << STC_HEIGHT) - 1;
+    if(m - i < STC_HEIGHT) mask = (1 << (m - i)) - 1;
+
+    for(j=0; j<w; j++, indx++) {
+      if(stego[indx]) syndrome ^= (columns[j] & mask);
+    }
+
+    message[i] = syndrome & 1;
+    syndrome >>= 1;
+
+  }
+
+  return I_STEGANOS_OK;
+}
+
+/**
+ * @fn static int _hide_data_stc(steganos_state_t *ss, byte *data, 
+ *                               const int d_len, int *floor, 
+ *                               const float *residue, float *sub_residue,
+ *                               const int res_len, const float p,
+ *                               const int max_size, int *written, 
+ *                               int *hdr_size, float *capacity)
+ * @brief Hides data in the residue with the SYNDROME_TRELLIS hiding method.
+ *
+ * The headers (synchronization header, if any, and size field) are written as
+ * with the other hiding methods. The data is then embedded in the LSBs of the
+ * following carriers (see _stc_carriers) with a rate of one bit every w
+ * carriers. Each modification changes a residual value in one unit, and costs
+ * the inverse of the variation tolerated in that sense by ss->variation_limit.
+ * If no embedding within the tolerated variations exists, the payload is
+ * reduced until it does.
+ *
+ * @param[in] ss Internal state structure.
+ * @param[in] data The remaining data to hide.
+ * @param[in] d_len The length of the data parameter, in bits.
+ * @param[in] floor The current frame and channel floor vector.
+ * @param[in] residue The current frame and channel residue vector.
+ * @param[out] sub_residue Will store the subliminal residue.
+ * @param[in] res_len The number of residual values in residue.
+ * @param[in] p The aggressiveness to use for the current frame, in [0,10].
+ * @param[in] max_size Maximum number of data bits the frame format can 
+ *  announce.
+ * @param[out] written Will store the number of bits hidden, including headers,
+ *  or 0 if not even the headers fit.
+ * @param[out] hdr_size Will store the number of header bits.
+ * @param[out] capacity Will store the subliminal capacity of the frame.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _hide_data_stc(steganos_state_t *ss, byte *data, const int d_len,
+			  int *floor, const float *residue, float *sub_residue,
+			  const int res_len, const float p, const int max_size,
+			  int *written, int *hdr_size, float *capacity) {
+
+  byte *sub_data, *cover, *stego, *message, bits[sizeof(float)];
+  float *cost, distortion, upper, lower, room;
+  int *carriers, *delta, columns[STC_MAX_WIDTH];
+  int i, m, n, w, start, size, read, aux, header_max, value, rc;
+
+
+  /* Input parameters control */
+  if(!ss || d_len < 0 || !floor || !residue || !sub_residue ||
+     res_len <= 0 || !written || !hdr_size || !capacity) {
+    errno = EINVAL;
+    message_log("_hide_data_stc", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  *written = 0;
+  *hdr_size = 0;
+  *capacity = 0.f;
+
+  header_max = SIZE_FIELD_BITS + SIZE_FIELD_EXT_BITS;
+  if(ss->synchro_method == RES_HEADER || 
+     ss->synchro_method == FORCED_RES_HEADER) {
+    header_max += SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE;
+  }
+
+  sub_data = NULL; cover = NULL; cost = NULL; carriers = NULL; delta = NULL;
+  if(!(sub_data = (byte *) malloc(sizeof(byte)*
+				  ((header_max+max_size)/BITS_PER_BYTE+1))) ||
+     !(cover = (byte *) malloc(sizeof(byte)*3*res_len)) ||
+     !(cost = (float *) malloc(sizeof(float)*res_len)) ||
+     !(carriers = (int *) malloc(sizeof(int)*res_len)) ||
+     !(delta = (int *) malloc(sizeof(int)*res_len))) {
+    message_log("_hide_data_stc", strerror(errno));
+    free(sub_data); free(cover); free(cost); free(carriers); free(delta);
+    return I_STEGANOS_ERR;
+  }
+  stego = &cover[res_len];
+  message = &cover[2*res_len];
+
+  rc = I_STEGANOS_ERR;
+
+  /* First estimation of the payload, the headers will take some carriers */
+  if(_stc_carriers(ss, residue, res_len, 0, carriers, &n) == I_STEGANOS_ERR) {
+    goto stc_end;
+  }
+
+  m = (int) ((p*(float)(n/STC_MIN_WIDTH))/10.f);
+  if(m > d_len) m = d_len;
+  if(m > max_size) m = max_size;
+  if(ss->desync) m = 0;
+
+  while(1) {
+
+    memcpy(sub_residue, residue, res_len*sizeof(*residue));
+    memset(sub_data, 0, (header_max+max_size)/BITS_PER_BYTE+1);
+
+    /* Get the headers announcing m bits, and write them directly */
+    size = header_max + m;
+    if(_get_subliminal_data(ss, data, m, floor, sub_residue, res_len,
+			    sub_data, &size, hdr_size) == I_STEGANOS_ERR) {
+      goto stc_end;
+    }
+
+    if(_write_subliminal_data(ss, sub_data, *hdr_size, sub_residue, 
+			      res_len, &aux) == I_STEGANOS_ERR) {
+      goto stc_end;
+    }
+
+    /* Not even room for the headers */
+    if(aux < *hdr_size) {
+      *written = 0;
+      break;
+    }
+
+    /* Skip the residual values sheltering the headers, as the receiver will */
+    start = 0; read = 0;
+    while(read < *hdr_size && start < res_len) {
+      if(_read_subliminal_residue(sub_residue[ss->res_lineup[start]], 
+				  bits, &aux) == I_STEGANOS_ERR) {
+	goto stc_end;
+      }
+      read += aux;
+      start++;
+    }
+
+    if(_stc_carriers(ss, sub_residue, res_len, start, 
+		     carriers, &n) == I_STEGANOS_ERR) {
+      goto stc_end;
+    }
+
+    if(!m) {
+      *written = *hdr_size;
+      break;
+    }
+
+    if(m*STC_MIN_WIDTH > n) {
+      m = n/STC_MIN_WIDTH;
+      continue;
+    }
+
+    w = n/m;
+    if(w > STC_MAX_WIDTH) w = STC_MAX_WIDTH;
+
+    if(_stc_columns(ss->hiding_key, w, columns) == I_STEGANOS_ERR) {
+      goto stc_end;
+    }
+
+    /* Cover bits and cost of flipping them. A residual value of 2 can only
+       grow, so that it remains a carrier. */
+    for(i=0; i<m*w; i++) {
+
+      value = (int) rintf(sub_residue[carriers[i]]);
+      cover[i] = abs(value) % 2;
+
+      lower = ss->variation_limit[carriers[i]][0];
+      upper = ss->variation_limit[carriers[i]][1];
+      if(lower > upper) {
+	room = lower; lower = upper; upper = room;
+      }
+
+      if(abs(value) == 2) {
+	delta[i] = value > 0 ? 1 : -1;
+	room = value > 0 ? upper : -lower;
+      } else if(upper >= -lower) {
+	delta[i] = 1;
+	room = upper;
+      } else {
+	delta[i] = -1;
+	room = -lower;
+      }
+
+      cost[i] = room >= 1.f ? 1.f/room : STC_WET_COST;
+
+    }
+
+    for(i=0; i<m; i++) {
+      message[i] = (data[i/BITS_PER_BYTE] >> 
+		    ((BITS_PER_BYTE-1) - (i % BITS_PER_BYTE))) % 2;
+    }
+
+    if(_stc_embed(cover, cost, message, m, w, columns, 
+		  stego, &distortion) == I_STEGANOS_ERR) {
+      goto stc_end;
+    }
+
+    /* Some modification exceeds the tolerated variation, try a lower rate */
+    if(distortion >= STC_WET_COST) {
+      m = (3*m)/4;
+      continue;
+    }
+
+    for(i=0; i<m*w; i++) {
+      if(stego[i] != cover[i]) {
+	sub_residue[carriers[i]] = rintf(sub_residue[carriers[i]]) + delta[i];
+      }
+    }
+
+    *written = *hdr_size + m;
+    break;
+
+  }
+
+  *capacity = (float) (n/STC_MIN_WIDTH + *hdr_size);
+  rc = I_STEGANOS_OK;
+
+ stc_end:
+  free(sub_data); free(cover); free(cost); free(carriers); free(delta);
+  return rc;
+}
+
+/**
+ * @fn static int _unhide_data_stc(steganos_state_t *ss, const float *residue,
+ *                                 const int res_len, const int start,
+ *                                 const int sub_size, byte *bitstream, 
+ *                                 int *read)
+ * @brief Recovers the data hidden with the SYNDROME_TRELLIS hiding method.
+ *
+ * @param[in] ss Internal state structure.
+ * @param[in] residue The current frame and channel residue vector.
+ * @param[in] res_len The number of residual values in residue.
+ * @param[in] start First position of ss->res_lineup after the headers.
+ * @param[in] sub_size The number of hidden bits, as read in the size field.
+ * @param[out] bitstream Will store the recovered bits.
+ * @param[out] read Will store the number of bits recovered, i.e., sub_size or 0
+ *  if there are not enough carriers.
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+static int _unhide_data_stc(steganos_state_t *ss, const float *residue,
+			    const int res_len, const int start, 
+			    const int sub_size, byte *bitstream, int *read) {
+
+  byte *stego, *message;
+  int *carriers, columns[STC_MAX_WIDTH];
+  int i, n, w;
+
+
+  /* Input parameters control */
+  if(!ss || !residue || res_len <= 0 || start < 0 || sub_size < 0 ||
+     !bitstream || !read) {
+    errno = EINVAL;
+    message_log("_unhide_data_stc", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  *read = 0;
+  if(!sub_size) {
+    return I_STEGANOS_OK;
+  }
+
+  if(!(carriers = (int *) malloc(sizeof(int)*res_len))) {
+    message_log("_unhide_data_stc", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(_stc_carriers(ss, residue, res_len, start, 
+		   carriers, &n) == I_STEGANOS_ERR) {
+    free(carriers);
+    return I_STEGANOS_ERR;
+  }
+
+  /* The sender never uses a higher rate */
+  if(sub_size*STC_MIN_WIDTH > n) {
+    free(carriers);
+    return I_STEGANOS_OK;
+  }
+
+  w = n/sub_size;
+  if(w > STC_MAX_WIDTH) w = STC_MAX_WIDTH;
+
+  if(_stc_columns(ss->hiding_key, w, columns) == I_STEGANOS_ERR) {
+    free(carriers);
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(stego = (byte *) malloc(sizeof(byte)*(sub_size*w+sub_size)))) {
+    message_log("_unhide_data_stc", strerror(errno));
+    free(carriers);
+    return I_STEGANOS_ERR;
+  }
+  message = &stego[sub_size*w];
+
+  for(i=0; i<sub_size*w; i++) {
+    stego[i] = ((int) fabsf(rintf(residue[carriers[i]]))) % 2;
+  }
+
+  if(_stc_extract(stego, sub_size, w, columns, message) == I_STEGANOS_ERR) {
+    free(stego);
+    free(carriers);
+    return I_STEGANOS_ERR;
+  }
+
+  /* As always, most significant bits first */
+  for(i=0; i<sub_size; i++) {
+    bitstream[i/BITS_PER_BYTE] |= 
+      (message[i] << ((BITS_PER_BYTE-1) - (i % BITS_PER_BYTE)));
+  }
+
+  *read = sub_size;
+  free(stego);
+  free(carriers);
+
+  return I_STEGANOS_OK;
+}
+
 int steganos_state_init(steganos_state_t *ss, int da, int hide_method, 
 			int sync_method, char *key, int keylen) {
   
@@ -666,7 +1274,7 @@ int steganos_state_init(steganos_state_t *ss, int da, int hide_method,
     return I_STEGANOS_ERR;
   }
 
-  if(hide_method < 0 || hide_method > 1) {
+  if(hide_method < 0 || hide_method > 2) {
     errno = EINVAL;
     message_log("steganos_state_init", "Wrong hiding method");
     return I_STEGANOS_ERR;
@@ -711,7 +1319,8 @@ int steganos_state_init(steganos_state_t *ss, int da, int hide_method,
      hide_method from the file 'steganos_config.xml' */
   ss->hide_method = hide_method;
 
-  /* ss->hide will be set in agreement with hide_mode_et */
+  /* ss->hide will be set in agreement with hide_mode_et. SYNDROME_TRELLIS
+     writes the headers directly, and codes the data in hide_data. */
   if(ss->hide_method == PARITY_BITS) 
     ss->hide = parity_bits_method;
   else 
@@ -722,6 +1331,13 @@ int steganos_state_init(steganos_state_t *ss, int da, int hide_method,
   ss->da = da;
   ss->ra = ss->da;
 
+  /* Produce plain size fields unless told otherwise (see 
+     steganos_state_set_frame_version): receivers older than FRAME_V2 read
+     the escape as a size. The decoder understands both versions. */
+  ss->frame_version = FRAME_V1;
+
+  steganos_stats_init(ss);
+
   memset(ss->variation_limit, 0, sizeof(float)*(2*VORBIS_MAX_BLOCK));
    
   ss->max_fc_capacity = 0.f;
@@ -746,6 +1362,8 @@ int steganos_state_init(steganos_state_t *ss, int da, int hide_method,
   ss->status = I_STEGANOS_OK;
   ss->sent = 0;
   ss->read = 0;
+  ss->carry = 0;
+  ss->carry_len = 0;
   ss->aligned = 0;
   ss->total_sub_capacity = 0;
   ss->metadata_sent = 0;
@@ -755,6 +1373,21 @@ int steganos_state_init(steganos_state_t *ss, int da, int hide_method,
    
 }
 
+int steganos_state_set_frame_version(steganos_state_t *ss, int version) {
+
+  /* Input parameters control */
+  if(!ss || (version != FRAME_V1 && version != FRAME_V2)) {
+    errno = EINVAL;
+    message_log("steganos_state_set_frame_version", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  ss->frame_version = version;
+
+  return I_STEGANOS_OK;
+
+}
+
 int steganos_state_reset_iter(steganos_state_t *ss) {
 
   if(!ss) {
@@ -763,6 +1396,9 @@ int steganos_state_reset_iter(steganos_state_t *ss) {
     return I_STEGANOS_ERR;
   }
 
+  /* The current frame and channel is done, commit its telemetry record */
+  steganos_stats_commit(ss);
+
   ss->max_fc_capacity = 0.f;
   ss->min_fc_capacity = 0.f;
   ss->status = I_STEGANOS_OK;
@@ -1092,9 +1728,9 @@ int set_subliminal_capacity_limit(steganos_state_t *ss, float *residue,
 int hide_data(steganos_state_t *ss, byte *data, const int d_len, 
 	      int *floor, float *residue, const int res_len, int *size) {
 
-  float usage, *sub_residue, p;
+  float usage, *sub_residue, p, capacity;
   long int prng_iters;
-  int iusage, write, written, fail;
+  int iusage, write, written, fail, max_size, hdr_size;
   byte *sub_data;
 
 
@@ -1140,10 +1776,17 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
 
   /* TODO!! ss->ra must range from 0 to 10 */
 
-  /* Range control, usage shouldn't be greater than MAX_CAPACITY in any case */
+  /* Range control, usage shouldn't be greater than the maximum size the
+     selected frame format can announce in any case */
+  if(ss->frame_version >= FRAME_V2) {
+    max_size = MAX_SUBLIMINAL_SIZE;
+  } else {
+    max_size = MAX_SUBLIMINAL_SIZE_V1;
+  }
+
   iusage = 0;
-  if(usage > MAX_SUBLIMINAL_SIZE) {
-    iusage = MAX_SUBLIMINAL_SIZE;
+  if(usage > max_size) {
+    iusage = max_size;
   } else if(usage < 0) {
     iusage = 0;
   } else { 
@@ -1151,11 +1794,12 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
   }
 
   /* If we are using ISS as synchronization method, the maximum amount of
-     subliminal bits we can send is MAX_SUBLIMINAL_SIZE-1 given that the
+     subliminal bits we can send is MAX_SUBLIMINAL_SIZE_V1-1 given that the
      RES_HEADER is 0xFF, because if we send a 0xFF as size field, we will
      not be able to distinguish between a FORCED_RES_HEADER synchronization
-     or an actual frame with ISS and 0xFF subliminal bits */
-  if(iusage == MAX_SUBLIMINAL_SIZE)
+     or an actual frame with ISS and 0xFF subliminal bits. FRAME_V2 never
+     sends 0xFF as size field (SIZE_FIELD_ESCAPE is used instead). */
+  if(iusage == MAX_SUBLIMINAL_SIZE_V1 && ss->frame_version < FRAME_V2)
     if(ss->synchro_method == ISS || FORCED_RES_HEADER) iusage--;
 
   /* The subliminal data will have at most iusage bits of length */
@@ -1183,8 +1827,29 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
      less as ss->da decreases) */
   write = iusage;
   written = 0;
+  hdr_size = 0;
   fail = write - written;
   prng_iters = ss->prng->iters;
+  capacity = ss->max_fc_capacity;
+  ss->frame_stats.retries = 0;
+
+  /* Syndrome-trellis codes choose by themselves the residual values to modify */
+  if(ss->hide_method == SYNDROME_TRELLIS) {
+    if(ss->frame_version < FRAME_V2 && 
+       (ss->synchro_method == ISS || ss->synchro_method == FORCED_RES_HEADER)) {
+      max_size--;
+    }
+    if(_hide_data_stc(ss, data, d_len, floor, residue, sub_residue, res_len,
+		      p, max_size, &written, &hdr_size, 
+		      &capacity) == I_STEGANOS_ERR) {
+      free(sub_residue);
+      free(sub_data);
+      sub_data = NULL;
+      return I_STEGANOS_ERR;
+    }
+    write = written;
+    fail = 0;
+  }
 
   while(fail) {
 
@@ -1194,7 +1859,7 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
 
     /* Retrieve 'iusage' bits of subliminal message prepared to be hided */
     if(_get_subliminal_data(ss, data, d_len, floor, residue, res_len,
-			    sub_data, &write) == I_STEGANOS_ERR) {
+			    sub_data, &write, &hdr_size) == I_STEGANOS_ERR) {
       free(sub_residue);
       free(sub_data);
       sub_data = NULL;
@@ -1222,6 +1887,7 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
     fail = write - written;
     if(fail) {
 
+      ss->frame_stats.retries++;
       if(prng_reset_byte(ss->prng, ss->hiding_key->key, ss->hiding_key->length,
 			 prng_iters) == I_ERR) {
 	free(sub_residue);
@@ -1244,7 +1910,11 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
     memset(siter, 0, 50*sizeof(char));
     memset(sdata, 0, 400*sizeof(char));
     sprintf(siter, "%d) sending %d bits", ss->iters, write);
-    for(i=0; i<ceilf((float)write/(float)BITS_PER_BYTE); i++) {
+    /* SYNDROME_TRELLIS does not use sub_data. FRAME_V2 frames carry up
+       to 8192 bytes, so the dump stops at what fits in sdata */
+    for(i=0; ss->hide_method != SYNDROME_TRELLIS &&
+	  i<ceilf((float)write/(float)BITS_PER_BYTE) &&
+	  i<sizeof(sdata)/2-1; i++) {
       sprintf(&sdata[2*i], "%X", sub_data[i]&0xF0);
       sprintf(&sdata[2*i+1], "%X", sub_data[i]&0x0F);
       
@@ -1262,18 +1932,15 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
   /*   } */
   
   *size = 0;
-  if((ss->synchro_method == ISS && written >= SIZE_FIELD_BITS) ||
-     (ss->synchro_method == RES_HEADER && 
-      written >= (SIZE_FIELD_BITS+(SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE)))) {
+  if((ss->synchro_method == ISS || ss->synchro_method == RES_HEADER) &&
+     hdr_size && written >= hdr_size) {
 
     *size = written;
     ss->metadata_sent += *size;
     
-    /* We have to discard the header bits from the total amount of data hided */
-    *size -= SIZE_FIELD_BITS;
-    if(ss->synchro_method == RES_HEADER || ss->synchro_method == FORCED_RES_HEADER) {
-      *size -= (SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE);
-    }
+    /* We have to discard the header bits (synchronization header and size
+       field, extended or not) from the total amount of data hided */
+    *size -= hdr_size;
 
     /* Everything has gone OK, copy the result */
     memcpy(residue, sub_residue, res_len*sizeof(*residue));
@@ -1283,8 +1950,13 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
 
   free(sub_residue);
 
+  ss->frame_stats.sync_method = ss->synchro_method;
+  ss->frame_stats.capacity = (int) capacity;
+  ss->frame_stats.bits = *size;
+  ss->frame_stats.hdr_bits = *size ? hdr_size : 0;
+
   /* Update the real aggressiveness til this moment */
-  ss->total_sub_capacity += ss->max_fc_capacity;   
+  ss->total_sub_capacity += capacity;   
   ss->ra = 10.f*((float)ss->metadata_sent/(float)ss->total_sub_capacity); 
 
   free(sub_data);
@@ -1299,8 +1971,7 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
 
   byte *bitstream, *floatbyte;
   int i, j, tmp_read, aux, sub_size, same, wr_byte, wr_bit, bit;
-  int repeat;
-  char sdata[1000]; // TODO!! borrar
+  int repeat, field_bits;
 
   /* Input parameters control */ // TODO!! todo controlado?
   if(!ss || !floor || !residue || 
@@ -1311,15 +1982,15 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
     return I_STEGANOS_ERR;
   }
 
+  /* Each residue may give up to sizeof(float) bytes more than requested */
   if(!(bitstream = (byte *) 
-       malloc(sizeof(byte)*
-	      ceilf((float)MAX_SUBLIMINAL_SIZE/(float)BITS_PER_BYTE)))) {
+       malloc(sizeof(byte)*(MAX_SUBLIMINAL_BYTES+sizeof(float))))) {
     message_log("unhide_data", strerror(errno));
     *read = 0;
     return I_STEGANOS_ERR;
   }
   
-  memset(bitstream, 0, ceilf((float)MAX_SUBLIMINAL_SIZE/(float)BITS_PER_BYTE));
+  memset(bitstream, 0, MAX_SUBLIMINAL_BYTES+sizeof(float));
 
   /* Auxiliar buffer */
   if(!(floatbyte = (byte *) malloc(sizeof(byte)*sizeof(float)))) {
@@ -1330,7 +2001,7 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
   }
 
   tmp_read = 0;
-  memset(sdata, 0, 1000*sizeof(char)); // TODO!! Borrar
+  ss->frame_stats.sync_method = ss->synchro_method;
 
   /* If we are using the RES_HEADER synchronization method, we will first
      check for the first SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE bits, if they are
@@ -1375,7 +2046,6 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
 
     /* Apply the un-hiding method.
        Note: For now, the two existing methods are selfinvertibles. */
-    memcpy(sdata, bitstream, SYNCHRO_HEADER_BYTES_RES); // TODO!!! borrar
     aux = SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE;
     if(ss->hide(bitstream, SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE, floor, 
 		residue, res_len, ss->hiding_key, bitstream, &aux, 
@@ -1404,23 +2074,25 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
       }
     }
     if(!same) {
-      *read = 0; /* No match, nothing to read, nothing read */
-      free(bitstream);
-      free(floatbyte);
+#ifdef STEGANOS_DEBUG
       {
-	char siter[20], ssdata[2000];
+	char siter[20], ssdata[2*SYNCHRO_HEADER_BYTES_RES+20];
 	int kk;
 	memset(siter, 0, 20);
-	memset(ssdata, 0, 2000);
+	memset(ssdata, 0, 2*SYNCHRO_HEADER_BYTES_RES+20);
 	sprintf(siter, "%d) ", ss->iters);
 	for(kk=0; kk<SYNCHRO_HEADER_BYTES_RES; kk++) {
-	  sprintf(&ssdata[2*kk], "%X", sdata[kk]&0xF0);
-	  sprintf(&ssdata[2*kk+1], "%X", sdata[kk]&0x0F);
+	  sprintf(&ssdata[2*kk], "%X", bitstream[kk]&0xF0);
+	  sprintf(&ssdata[2*kk+1], "%X", bitstream[kk]&0x0F);
 	}
-	sprintf(&ssdata[2*kk+1], "Ignoring frame");
+	sprintf(&ssdata[2*kk], " Ignoring frame");
 	message_log(siter, ssdata);
       }
-
+#endif
+      ss->frame_stats.reason = I_STEGANOS_SYNC_FAIL;
+      *read = 0; /* No match, nothing to read, nothing read */
+      free(bitstream);
+      free(floatbyte);
       return I_STEGANOS_OK;
     }
 
@@ -1447,11 +2119,14 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
   }
 
   /* Once here, whichever the hiding method is, we have to read SIZE_FIELD_BITS
-     bits to know how many subliminal bits are hided in the current residue. */
+     bits to know how many subliminal bits are hided in the current residue. 
+     If they contain SIZE_FIELD_ESCAPE, the actual size is stored in the next
+     SIZE_FIELD_EXT_BITS bits (FRAME_V2). */
+  field_bits = SIZE_FIELD_BITS;
   repeat = 1;
   while(repeat) {
 
-    while(tmp_read < SIZE_FIELD_BITS) {
+    while(tmp_read < field_bits) {
 
       /* Not enough capacity in the frame */
       if(i == res_len) {
@@ -1483,16 +2158,10 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
       i++;
     }
 
-    // TODO!! borrar
-    if(ss->synchro_method != ISS)
-      memcpy(&sdata[SYNCHRO_HEADER_BYTES_RES], bitstream, 1);
-    else 
-      memcpy(sdata, bitstream, 1);
-
     /* Apply the un-hiding method.
        Note: For now, the two existing methods are selfinvertibles. */
-    aux = SIZE_FIELD_BITS;
-    if(ss->hide(bitstream, SIZE_FIELD_BITS, floor, residue, res_len,
+    aux = field_bits;
+    if(ss->hide(bitstream, field_bits, floor, residue, res_len,
 		ss->hiding_key, bitstream, &aux, ss->prng) == I_STEGANOS_ERR) {
       free(bitstream);
       free(floatbyte);
@@ -1500,7 +2169,7 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
       return I_STEGANOS_ERR;
     }
  
-    if(aux != SIZE_FIELD_BITS) {
+    if(aux != field_bits) {
       message_log("unhide_data", "Wrong output size after unhide");
       free(bitstream);
       free(floatbyte);
@@ -1510,34 +2179,37 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
 
     /* Set the number of bits to read */
     sub_size = 0;
-    aux = ceil((float)SIZE_FIELD_BITS/(float)BITS_PER_BYTE);
+    aux = ceil((float)field_bits/(float)BITS_PER_BYTE);
     for(j=0; j<aux; j++) {
       /* As always, using big endian ordering */
       sub_size += (((int)bitstream[j]) << ((aux - j - 1) * BITS_PER_BYTE));
     }
 
     // TODO!! this fails in case of non byte multiple headers!!
-    if(tmp_read > SIZE_FIELD_BITS) {
+    if(tmp_read > field_bits) {
     
-      aux = ceilf((float)tmp_read/(float)BITS_PER_BYTE) -SIZE_FIELD_BITS/BITS_PER_BYTE;  
+      aux = ceilf((float)tmp_read/(float)BITS_PER_BYTE) -field_bits/BITS_PER_BYTE;  
       for(j=0; j<aux; j++) {
-	bitstream[j] = bitstream[j+SIZE_FIELD_BITS/BITS_PER_BYTE];
+	bitstream[j] = bitstream[j+field_bits/BITS_PER_BYTE];
       }
       for(j=aux; j<ceilf((float)tmp_read/(float)BITS_PER_BYTE); j++) {
 	bitstream[j] = 0;
       }
     
     } else {
-      memset(bitstream, 0, (SIZE_FIELD_BITS/BITS_PER_BYTE)*sizeof(byte));
+      memset(bitstream, 0, (field_bits/BITS_PER_BYTE)*sizeof(byte));
     }   
 
-    tmp_read -= SIZE_FIELD_BITS;
+    tmp_read -= field_bits;
 
     /* Might happen that we receive a size of 0xFF using ISS. This is not possible as
        this is reserved to FORCE_RES_HEADER synchronization, so, if that happens, we
        have to discard it and read the next SIZE_FIELD_BITS, those will be the real
-       subliminal size. */
-    if(sub_size == 0xFF) {
+       subliminal size. A SIZE_FIELD_ESCAPE means the extended size field follows. */
+    if(field_bits == SIZE_FIELD_BITS && sub_size == 0xFF) {
+      repeat = 1;
+    } else if(field_bits == SIZE_FIELD_BITS && sub_size == SIZE_FIELD_ESCAPE) {
+      field_bits = SIZE_FIELD_EXT_BITS;
       repeat = 1;
     } else {
       repeat = 0;
@@ -1545,6 +2217,29 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
 
   }
   
+  /* With SYNDROME_TRELLIS, the data is the syndrome of the following LSBs */
+  if(ss->hide_method == SYNDROME_TRELLIS) {
+
+    free(floatbyte);
+    memset(bitstream, 0, MAX_SUBLIMINAL_BYTES+sizeof(float));
+    if(_unhide_data_stc(ss, residue, res_len, i, sub_size, 
+			bitstream, read) == I_STEGANOS_ERR) {
+      free(bitstream);
+      *read = 0;
+      return I_STEGANOS_ERR;
+    }
+
+    ss->frame_stats.bits = *read;
+    if(*read == 0) {
+      free(bitstream);
+      return I_STEGANOS_OK;
+    }
+
+    *data = bitstream;
+    return I_STEGANOS_OK;
+
+  }
+
   /* Read proper data */
   while(i<res_len && tmp_read < sub_size) {
   
@@ -1577,13 +2272,6 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
     bitstream[sub_size/BITS_PER_BYTE] >>= (BITS_PER_BYTE - (sub_size % BITS_PER_BYTE));
   }
 
-  // TODO!! Borrar!!
-  if(ss->synchro_method == ISS)
-    memcpy(&sdata[1], bitstream, (int) ceilf((float)sub_size/(float)BITS_PER_BYTE));
-  else
-    memcpy(&sdata[SYNCHRO_HEADER_BYTES_RES+1], bitstream,
-	   (int) ceilf((float)sub_size/(float)BITS_PER_BYTE));
-
   /* Apply the un-hiding method.
      Note: For now, the two existing methods are selfinvertibles. */
   aux = sub_size;  
@@ -1632,6 +2320,7 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
     *read = sub_size;
   }
 
+  ss->frame_stats.bits = *read;
   if(*read == 0) {
     free(bitstream);
     return I_STEGANOS_OK;
@@ -1647,12 +2336,13 @@ int parity_bits_method(byte *plain_mess, int p_m_len,
 		       steganos_key_t *key, byte *sub_mess, 
 		       int *s_m_len, prng_t *prng) {
 
-  int p_m_r, s_m_wr, s_m_bytes, parity, run_length;
-  int readbit, readbyte, readelem, floor_bits, rnd, i;
-  byte *tmp;
+  int rnd[PARITY_BLOCK_BYTES*BITS_PER_BYTE*BITS_PARITY];
+  int s_m_bytes, p_m_bytes, floor_bits, int_bits, block, draws, byte_i;
+  int i, j, k, l;
+  unsigned int mask;
 
 
-  /* Input parameters control */ // TODO!! todo controlado?
+  /* Input parameters control */
   if(!plain_mess || p_m_len <= 0 || !floor || res_len <= 0 || 
      !sub_mess || !key || !s_m_len || *s_m_len <= 0 ||
      !prng) {
@@ -1661,72 +2351,61 @@ int parity_bits_method(byte *plain_mess, int p_m_len,
     return I_STEGANOS_ERR;
   }
 
-  s_m_bytes = ceilf((float)(*s_m_len)/(float)BITS_PER_BYTE);
-  if(!(tmp = (byte *) malloc(sizeof(byte)*s_m_bytes))) {
+  /* sub_mess is owned by the caller, it must be big enough */
+  if(*s_m_len < p_m_len) {
+    errno = ERANGE;
     message_log("parity_bits_method", strerror(errno));
     return I_STEGANOS_ERR;
   }
-  memset(tmp, 0, s_m_bytes);
 
-  p_m_r = 0;
-  s_m_wr = 0;
-  run_length = 0;
-  floor_bits = res_len*BITS_PER_BYTE*sizeof(*floor);
+  s_m_bytes = ceilf((float)(*s_m_len)/(float)BITS_PER_BYTE);
+  p_m_bytes = ceilf((float)p_m_len/(float)BITS_PER_BYTE);
+  int_bits = BITS_PER_BYTE*sizeof(*floor);
+  floor_bits = res_len*int_bits;
 
-  while(p_m_r < p_m_len) {
-    
-    /* Get the next plain_mess bit */
-    readbyte = p_m_r / BITS_PER_BYTE;
-    readbit = p_m_r % BITS_PER_BYTE;
-    parity = (plain_mess[readbyte] >> readbit) % 2;
-
-    /* The next sub_mess bit will be the result of XORing the next
-       PARITY_BITS random bits with the current plain_mess bit */
-    for(i=0; i<BITS_PARITY; i++) {
-
-      /* Get a new pseudo random number */
-      if(prng_get_random_int(prng, floor_bits, &rnd) == I_STEGANOS_ERR) {
-	free(tmp);
-	return I_STEGANOS_ERR;
-      }
+  /* Each sub_mess bit is the result of XORing the next BITS_PARITY random 
+     floor bits with the corresponding plain_mess bit. The random floor bits
+     are drawn in blocks of PARITY_BLOCK_BYTES bytes, and sub_mess and 
+     plain_mess may point to the same direction. */
+  for(byte_i=0; byte_i<p_m_bytes; byte_i+=PARITY_BLOCK_BYTES) {
 
-      readbyte = rnd / BITS_PER_BYTE;
-      readelem = readbyte / sizeof(*floor);
-      readbit = (rnd % BITS_PER_BYTE)+((readbyte % sizeof(*floor))*BITS_PER_BYTE);      
-      parity ^= ((floor[readelem] >> readbit) % 2);
+    block = p_m_bytes - byte_i;
+    if(block > PARITY_BLOCK_BYTES) block = PARITY_BLOCK_BYTES;
 
+    draws = block*BITS_PER_BYTE;
+    if(byte_i + block == p_m_bytes) {
+      draws = p_m_len - byte_i*BITS_PER_BYTE;
     }
 
-    /* Write the obtained parity in the corresponding sub_mess bit */
-    readbyte = s_m_wr / BITS_PER_BYTE;
-    readbit = s_m_wr % BITS_PER_BYTE;
-    
-    /* Memory overflow control */
-    if(readbyte >= s_m_bytes) {
-      if(!(tmp = (byte *) realloc((byte *) tmp, sizeof(byte)*(s_m_bytes+1)))) {
-	free(tmp);
-	return I_STEGANOS_ERR;
-      }
-      s_m_bytes++;
+    if(prng_get_random_ints(prng, floor_bits, rnd, 
+			    draws*BITS_PARITY) == I_ERR) {
+      return I_STEGANOS_ERR;
     }
 
-    tmp[readbyte] |= (parity << readbit);
-    p_m_r++;
-    s_m_wr++;
+    /* Floor bit r is bit (r % int_bits) of floor[r / int_bits] */
+    k = 0;
+    for(i=0; i<block; i++) {
+      mask = 0;
+      for(j=0; j<BITS_PER_BYTE && k<draws*BITS_PARITY; j++) {
+	for(l=0; l<BITS_PARITY; l++, k++) {
+	  mask ^= ((((unsigned int) floor[rnd[k] / int_bits]) >> 
+		    (rnd[k] % int_bits)) & 1) << j;
+	}
+      }
+      sub_mess[byte_i+i] = plain_mess[byte_i+i] ^ mask;
+    }
 
   }
 
-  /* Prepare the return */
-  if((int) ceilf((float)(*s_m_len)/(float)BITS_PER_BYTE) < s_m_bytes) {
-    if(!(sub_mess = (byte *) realloc((byte *) sub_mess, sizeof(byte)*s_m_bytes))) {
-      free(tmp);
-      return I_STEGANOS_ERR;
-    }
+  /* Bits beyond p_m_len are cleared */
+  if(p_m_len % BITS_PER_BYTE) {
+    sub_mess[p_m_bytes-1] &= (1 << (p_m_len % BITS_PER_BYTE)) - 1;
+  }
+  if(s_m_bytes > p_m_bytes) {
+    memset(&sub_mess[p_m_bytes], 0, s_m_bytes-p_m_bytes);
   }
 
-  memcpy(sub_mess, tmp, s_m_bytes);
-  *s_m_len = s_m_wr;  
-  free(tmp);
+  *s_m_len = p_m_len;  
 
   return I_STEGANOS_OK;
 }
@@ -2456,6 +3135,48 @@ int calculate_residue_lineup(steganos_state_t *ss, const int res_len) {
   
 }
 
+int peek_subliminal_bits(const float *residue, const int *lineup,
+			 const int res_len, const int bits, byte *data,
+			 int *read) {
+
+  byte floatbyte[sizeof(float)];
+  int i, j, aux, bit, tmp_read;
+
+  /* Input parameters control */
+  if(!residue || !lineup || res_len <= 0 || bits <= 0 || !data || !read) {
+    errno = EINVAL;
+    message_log("peek_subliminal_bits", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(data, 0, bits/BITS_PER_BYTE+sizeof(float)+1);
+
+  /* Same bit ordering than unhide_data */
+  tmp_read = 0;
+  for(i=0; i<res_len && tmp_read<bits; i++) {
+
+    memset(floatbyte, 0, sizeof(float));
+    if(_read_subliminal_residue(residue[lineup[i]], floatbyte, &aux) == 
+       I_STEGANOS_ERR) {
+      *read = 0;
+      return I_STEGANOS_ERR;
+    }
+
+    for(j=aux-1; j>=0; j--) {
+      bit = (floatbyte[j/BITS_PER_BYTE] >> (j % BITS_PER_BYTE)) % 2;
+      data[tmp_read/BITS_PER_BYTE] |= 
+	(bit << ((BITS_PER_BYTE-1) - (tmp_read % BITS_PER_BYTE)));
+      tmp_read++;
+    }
+
+  }
+
+  *read = tmp_read;
+
+  return I_STEGANOS_OK;
+
+}
+
 /* channel.c ends here */
 
 #endif
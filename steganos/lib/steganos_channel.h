@@ -67,11 +67,55 @@
  */
 #define RES_HEADER_BITS SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+SIZE_FIELD_BITS
 
+/**
+ * @def SIZE_FIELD_ESCAPE
+ * @brief Value of the SIZE_FIELD_BITS size field announcing that the real size
+ *  follows in an extended field of SIZE_FIELD_EXT_BITS bits (FRAME_V2 only).
+ *  0xFF remains reserved for FORCED_RES_HEADER synchronization.
+ */
+#define SIZE_FIELD_ESCAPE 0xFE
+
+/**
+ * @def SIZE_FIELD_SHORT_MAX
+ * @brief Maximum number of subliminal bits that can be announced directly in
+ *  the SIZE_FIELD_BITS size field, i.e., without using the escape.
+ */
+#define SIZE_FIELD_SHORT_MAX (SIZE_FIELD_ESCAPE - 1)
+
+/**
+ * @def SIZE_FIELD_EXT_BITS
+ * @brief Length of the extended size field that follows a SIZE_FIELD_ESCAPE.
+ */
+#define SIZE_FIELD_EXT_BITS 16
+
+/**
+ * @def MAX_SUBLIMINAL_SIZE_V1
+ * @brief Maximum number of subliminal bits that could be hidden in a residue
+ *  with the FRAME_V1 format (plain SIZE_FIELD_BITS size field).
+ */
+#define MAX_SUBLIMINAL_SIZE_V1 ((1 << SIZE_FIELD_BITS) - 1)
+
 /**
  * @def MAX_SUBLIMINAL_SIZE
  * @brief Maximum number of subliminal bits that could be hidden in a residue.
  */
-#define MAX_SUBLIMINAL_SIZE ((1 << SIZE_FIELD_BITS) - 1)
+#define MAX_SUBLIMINAL_SIZE ((1 << SIZE_FIELD_EXT_BITS) - 1)
+
+/**
+ * @def MAX_SUBLIMINAL_BYTES
+ * @brief MAX_SUBLIMINAL_SIZE, in bytes. Used to dimension the buffers that
+ *  exchange data between the cryptographic and the steganographic layers.
+ */
+#define MAX_SUBLIMINAL_BYTES ((MAX_SUBLIMINAL_SIZE + BITS_PER_BYTE - 1) / BITS_PER_BYTE)
+
+/**
+ * @def MAX_FRAME_BYTES
+ * @brief Bytes of the cryptographic layer buffer the emitter keeps ready for
+ *  stego-frames of the given version (see cryptos_protocol_buffer_t). 
+ *  FRAME_V1 keeps the MAX_SUBLIMINAL_SIZE_V1 bytes it has always used.
+ */
+#define MAX_FRAME_BYTES(version) \
+  ((version) >= FRAME_V2 ? MAX_SUBLIMINAL_BYTES : MAX_SUBLIMINAL_SIZE_V1)
 
 /**
  * @def BITS_PARITY
@@ -79,6 +123,40 @@
  */
 #define BITS_PARITY 2
 
+/**
+ * @def PARITY_BLOCK_BYTES
+ * @brief Number of message bytes processed per bulk PRNG draw in the parity
+ *  bit method
+ */
+#define PARITY_BLOCK_BYTES 64
+
+/**
+ * @def STC_HEIGHT
+ * @brief Constraint height of the syndrome-trellis codes. The trellis has
+ *  2^STC_HEIGHT states per stage.
+ */
+#define STC_HEIGHT 7
+
+/**
+ * @def STC_MIN_WIDTH
+ * @brief Minimum width of the syndrome-trellis codes submatrix, i.e., the 
+ *  highest payload is one subliminal bit every STC_MIN_WIDTH residual values.
+ */
+#define STC_MIN_WIDTH 2
+
+/**
+ * @def STC_MAX_WIDTH
+ * @brief Maximum width of the syndrome-trellis codes submatrix.
+ */
+#define STC_MAX_WIDTH 32
+
+/**
+ * @def STC_WET_COST
+ * @brief Cost assigned to the modifications exceeding the maximum variation
+ *  tolerated by a residual value.
+ */
+#define STC_WET_COST 1e6f
+
 /**
  * @def ITU_R_BS_468_SIZE
  * @brief Size of the global static array ITU_R_BS_468
@@ -242,6 +320,25 @@ static const float FLOOR1[256]={
 int steganos_state_init(steganos_state_t *ss, int da, int hide_method, 
 			int sync_method, char *key, int keylen);
 
+/** 
+ * @fn int steganos_state_set_frame_version(steganos_state_t *ss, int version)
+ * @brief Sets the stego-frame format produced when encoding. 
+ *  steganos_state_init sets FRAME_V1, which every receiver reads; FRAME_V2
+ *  lifts the per frame size limit, but needs receivers that know it.
+ *
+ * @param[in] ss Pointer to the steganographic protocol state variable.
+ * @param[in] version FRAME_V1 or FRAME_V2.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ *
+ * @see frame_version_et 
+ */
+int steganos_state_set_frame_version(steganos_state_t *ss, int version);
+
 /** 
  * @fn int steganos_state_reset_iter(steganos_state_t *ss)
  * @brief Resets the members of the steganos state structure that change
@@ -356,6 +453,12 @@ int set_subliminal_capacity_limit(steganos_state_t *ss, float *residue,
  * vector, giving the final subliminal-residue vector. Note that this function
  * shouldn't be called if ss->aggressiveness*ss->max_fc_capacity is not big
  * enough to store the meta-information required (plus some subliminal info).
+ *
+ * @note With the SYNDROME_TRELLIS hiding method, only the headers are written
+ *  as described above. The data is then embedded as the syndrome of the LSBs
+ *  of the following residual values (those with absolute value of 2 or more),
+ *  choosing the modifications with a Viterbi search over the syndrome trellis
+ *  that minimizes the cost derived from ss->variation_limit. 
  * 
  * @param[in, out] ss Internal state structure. The function updates the 
  *  ss->protocol_send_state field, which must be SYNCHRONIZED at the input and
@@ -392,6 +495,9 @@ int hide_data(steganos_state_t *ss, byte *data, const int d_len,
  * if we have to recover any data. At the end of a successful execution, 
  * <i>data</i> will point to the recovered data and <i>read</i> store the number
  * of bits read. If no data has been recovered, <i>read</i> will be 0.
+ * With the SYNDROME_TRELLIS hiding method, the data is obtained multiplying
+ * the parity-check matrix by the LSBs of the residual values that follow the
+ * headers.
  *
  * @note This function uses the PRNG function <i>get_random_int</i>, therefore,
  *  the PRNG must have been seeded previously with the same key used for hiding
@@ -438,9 +544,11 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
  * Limits of Steganosgraphy" by Anderson and Petitcolas. The function keeps the
  * (*hide_method) typedef format.
  *
- * @note This function uses the PRNG function <i>get_random_int</i>, therefore,
+ * @note This function uses the PRNG function <i>get_random_ints</i>, therefore,
  *  the PRNG must have been seeded previously with the same key used for hiding
- *  in order to get the correct data from the residue/floor vectors.
+ *  in order to get the correct data from the residue/floor vectors. The floor
+ *  bits are drawn in blocks of PARITY_BLOCK_BYTES message bytes, consuming the
+ *  same PRN sequence as one draw per parity bit would.
  *
  * @param[in] plain_mess Plain message to hide.
  * @param[in] p_m_len Length of plain message in bits.
@@ -449,17 +557,18 @@ int unhide_data(steganos_state_t *ss, int *floor, float *residue,
  * @param[in] res_len Number of elements in <i>floor</i> and <i>res</i> vectors.
  * @param[in] key Key to use.
  * @param[in, out] sub_mess String in which the subliminal message will be stored. 
- *  It has to be allocated previously to calling the function.
+ *  It has to be allocated previously to calling the function. May be the same
+ *  as <i>plain_mess</i>.
  * @param[in, out] s_m_len At the input, will store the allocated size (in bits)
- *  of <i>sub_mess</i>. At the output, the length of the resulting sub_message, 
- *  in bits (it may  be different than p_m_len as it may include 
- *  de-synchronization bits), or discard them.
+ *  of <i>sub_mess</i>, which must be at least <i>p_m_len</i>. At the output, 
+ *  the length of the resulting sub_message, in bits.
  * @param[in] prng PRNG in use.
  * @return The corresponding error code for integer returning functions, i.e., 
  *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured
  *  with errno updated.
  * @retval I_STEGANOS_OK with errno = 0 (No error).
  * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ERANGE (<i>sub_mess</i> too small).
  * @see hide_method
  */
 int parity_bits_method(byte *plain_mess, int p_m_len,
@@ -717,6 +826,37 @@ int steganos_key_init(byte *byte_key, const int key_len, steganos_key_t *key);
  */
 int calculate_residue_lineup(steganos_state_t *ss, const int res_len);
 
+/** 
+ * @fn int peek_subliminal_bits(const float *residue, const int *lineup,
+ *                              const int res_len, const int bits, byte *data,
+ *                              int *read)
+ * @brief Reads the raw subliminal bits of the first residues in <i>lineup</i>
+ *  order, until at least <i>bits</i> bits are gathered.
+ *
+ * The bits are stored as unhide_data does, most significant bit first, and
+ *  without applying the hiding method. Used to check the headers of a frame
+ *  without recovering its data.
+ *
+ * @param[in] residue The residue vector.
+ * @param[in] lineup The residue ordering.
+ * @param[in] res_len Number of elements in <i>residue</i> and <i>lineup</i>.
+ * @param[in] bits Number of bits wanted.
+ * @param[out] data Will store the bits read. Must have room for
+ *  <i>bits</i>/BITS_PER_BYTE+sizeof(float)+1 bytes.
+ * @param[out] read The number of bits read. Less than <i>bits</i> if the
+ *  frame has not enough capacity.
+ * 
+ * @return The corresponding error code for integer returning functions, i.e., 
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error occured 
+ *  with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ERANGE (wrong residual value read)
+ */
+int peek_subliminal_bits(const float *residue, const int *lineup,
+			 const int res_len, const int bits, byte *data,
+			 int *read);
+
 #endif /* CHANNEL_H */
 
 /* channel.h ends here */
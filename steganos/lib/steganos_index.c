@@ -0,0 +1,281 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_index.c
+ * @brief: Embedding index sidecar. The sender records where each
+ *  crypto-packet starts in the Vorbis stream and which payload bytes it
+ *  carries, so the receiver can seek straight to a byte range.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 18:42:03 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 18:42:03 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "steganos_index.h"
+#include "miscellaneous.h"
+
+/* Longest index line */
+#define _INDEX_LINE 256
+
+static int _index_grow(steganos_index_t *index) {
+
+  steganos_index_entry_t *entries;
+  int size;
+
+  if(index->n_entries < index->size) return I_STEGANOS_OK;
+
+  size = index->size ? 2*index->size : 16;
+  if(!(entries = (steganos_index_entry_t *)
+       realloc(index->entries, sizeof(steganos_index_entry_t)*size))) {
+    message_log("_index_grow", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  index->entries = entries;
+  index->size = size;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_index_open(steganos_index_t *index, const char *path) {
+
+  /* Input parameters control */
+  if(!index || !path) {
+    errno = EINVAL;
+    message_log("steganos_index_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(index, 0, sizeof(steganos_index_t));
+
+  if(!(index->fp = fopen(path, "w"))) {
+    message_log("steganos_index_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  fprintf(index->fp, "%s\n# packet granule bit offset length\n",
+	  STEGANOS_INDEX_MAGIC);
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_index_add(steganos_index_t *index, uint64_t packet, uint64_t bit,
+		       uint64_t offset, uint64_t length) {
+
+  steganos_index_entry_t *e;
+
+  /* Input parameters control */
+  if(!index || !index->fp) {
+    errno = EINVAL;
+    message_log("steganos_index_add", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(_index_grow(index) == I_STEGANOS_ERR) {
+    return I_STEGANOS_ERR;
+  }
+
+  e = &index->entries[index->n_entries++];
+  e->packet = packet;
+  e->granule = -1;
+  e->bit = bit;
+  e->offset = offset;
+  e->length = length;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_index_place(steganos_index_t *index, uint64_t sent,
+			 int64_t granule) {
+
+  steganos_index_entry_t *e;
+  int placed;
+
+  /* Input parameters control */
+  if(!index || !index->fp) {
+    errno = EINVAL;
+    message_log("steganos_index_place", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  /* The entries are waiting in stream order */
+  for(placed=0; placed<index->n_entries; placed++) {
+    e = &index->entries[placed];
+    if(e->bit >= sent) break;
+    e->granule = granule;
+    fprintf(index->fp, "%" PRIu64 " %" PRId64 " %" PRIu64 " %" PRIu64
+	    " %" PRIu64 "\n", e->packet, e->granule, e->bit, e->offset,
+	    e->length);
+  }
+
+  if(!placed) return I_STEGANOS_OK;
+
+  index->n_entries -= placed;
+  memmove(index->entries, &index->entries[placed],
+	  sizeof(steganos_index_entry_t)*index->n_entries);
+
+  /* A reader may want the index before the encoding is over */
+  if(fflush(index->fp)) {
+    message_log("steganos_index_place", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_index_load(steganos_index_t *index, const char *path) {
+
+  FILE *fp;
+  steganos_index_entry_t *e, *prev;
+  char line[_INDEX_LINE];
+  size_t len;
+
+  /* Input parameters control */
+  if(!index || !path) {
+    errno = EINVAL;
+    message_log("steganos_index_load", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(index, 0, sizeof(steganos_index_t));
+
+  if(!(fp = fopen(path, "r"))) {
+    message_log("steganos_index_load", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!fgets(line, _INDEX_LINE, fp) ||
+     strncmp(line, STEGANOS_INDEX_MAGIC, strlen(STEGANOS_INDEX_MAGIC))) {
+    errno = EILSEQ;
+    message_log("steganos_index_load", "Not an index file");
+    fclose(fp);
+    return I_STEGANOS_ERR;
+  }
+
+  while(fgets(line, _INDEX_LINE, fp)) {
+
+    len = strlen(line);
+    while(len && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = 0;
+    if(!len || line[0] == '#') continue;
+
+    if(_index_grow(index) == I_STEGANOS_ERR) {
+      fclose(fp);
+      steganos_index_free(index);
+      return I_STEGANOS_ERR;
+    }
+
+    e = &index->entries[index->n_entries];
+    if(sscanf(line, "%" SCNu64 " %" SCNd64 " %" SCNu64 " %" SCNu64
+	      " %" SCNu64, &e->packet, &e->granule, &e->bit, &e->offset,
+	      &e->length) != 5 || e->granule < 0) {
+      errno = EILSEQ;
+      message_log("steganos_index_load", "Malformed index line");
+      fclose(fp);
+      steganos_index_free(index);
+      return I_STEGANOS_ERR;
+    }
+
+    /* The payload is carried in order, and with no gaps */
+    prev = index->n_entries ? &index->entries[index->n_entries-1] : NULL;
+    if((!prev && e->offset) ||
+       (prev && (e->offset != prev->offset + prev->length ||
+		 e->granule < prev->granule || e->bit <= prev->bit))) {
+      errno = EILSEQ;
+      message_log("steganos_index_load", "Index entries out of order");
+      fclose(fp);
+      steganos_index_free(index);
+      return I_STEGANOS_ERR;
+    }
+
+    index->n_entries++;
+
+  }
+
+  fclose(fp);
+
+  if(!index->n_entries) {
+    errno = EILSEQ;
+    message_log("steganos_index_load", "Empty index");
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+/* Entry carrying the payload byte <i>offset</i>, which must be in range */
+static int _index_find(steganos_index_t *index, uint64_t offset) {
+
+  int lo, hi, mid;
+
+  lo = 0; hi = index->n_entries-1;
+  while(lo < hi) {
+    mid = (lo+hi+1)/2;
+    if(index->entries[mid].offset <= offset) lo = mid;
+    else hi = mid-1;
+  }
+
+  return lo;
+
+}
+
+int steganos_index_lookup(steganos_index_t *index, uint64_t offset,
+			  uint64_t length, int *first, int *last) {
+
+  steganos_index_entry_t *end;
+
+  /* Input parameters control */
+  if(!index || !index->n_entries || !first || !last) {
+    errno = EINVAL;
+    message_log("steganos_index_lookup", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  end = &index->entries[index->n_entries-1];
+  if(offset >= end->offset + end->length) {
+    errno = EINVAL;
+    message_log("steganos_index_lookup", "Offset past the end of the payload");
+    return I_STEGANOS_ERR;
+  }
+
+  if(!length) length = 1;
+
+  *first = _index_find(index, offset);
+  if(length > end->offset + end->length - offset) {
+    *last = index->n_entries-1;
+  } else {
+    *last = _index_find(index, offset+length-1);
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_index_free(steganos_index_t *index) {
+
+  if(!index) {
+    return I_STEGANOS_OK;
+  }
+
+  if(index->fp) fclose(index->fp);
+  if(index->entries) free(index->entries);
+  memset(index, 0, sizeof(steganos_index_t));
+
+  return I_STEGANOS_OK;
+
+}
+
+/* steganos_index.c ends here */
+#endif
@@ -0,0 +1,144 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_index.h
+ * @brief: Headers for the embedding index sidecar.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 18:40:12 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 18:40:12 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef STEGANOS_INDEX_H
+#define STEGANOS_INDEX_H
+
+#include <stdio.h>
+#include "steganos_types.h"
+
+/**
+ * @fn int steganos_index_open(steganos_index_t *index, const char *path)
+ * @brief Creates the index file <i>path</i> and initializes <i>index</i> to
+ *  write into it (sender).
+ *
+ * The file is text: the STEGANOS_INDEX_MAGIC line, a comment with the column
+ * names, and one line per crypto-packet with its packet id, granule, first
+ * stream bit, payload offset and length, in this order.
+ *
+ * @param index The index to initialize.
+ * @param path The index file.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_index_open(steganos_index_t *index, const char *path);
+
+/**
+ * @fn int steganos_index_add(steganos_index_t *index, uint64_t packet,
+ *                            uint64_t bit, uint64_t offset, uint64_t length)
+ * @brief Adds a crypto-packet just produced, still waiting to be hidden
+ *  (sender).
+ *
+ * @param index The index.
+ * @param packet The crypto-packet ID.
+ * @param bit Position of the first bit of the crypto-packet in the
+ *  subliminal stream.
+ * @param offset Offset of the carried data in the compressed payload.
+ * @param length Bytes of data carried.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ENOMEM (out of memory).
+ */
+int steganos_index_add(steganos_index_t *index, uint64_t packet, uint64_t bit,
+		       uint64_t offset, uint64_t length);
+
+/**
+ * @fn int steganos_index_place(steganos_index_t *index, uint64_t sent,
+ *                              int64_t granule)
+ * @brief Writes the entries whose first bit is already hidden, i.e., below
+ *  <i>sent</i>, with <i>granule</i> as their granule (sender).
+ *
+ * Must be called after every hiding with the granule position of the Vorbis
+ * packet being encoded, so the granule written is the one of the packet
+ * hiding the first bit.
+ *
+ * @param index The index.
+ * @param sent Bits of the subliminal stream hidden so far.
+ * @param granule Granule position of the current Vorbis packet.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_index_place(steganos_index_t *index, uint64_t sent,
+			 int64_t granule);
+
+/**
+ * @fn int steganos_index_load(steganos_index_t *index, const char *path)
+ * @brief Loads the index file <i>path</i> (receiver).
+ *
+ * @param index The index to initialize.
+ * @param path The index file, as written by the sender.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = EILSEQ (malformed index: bad magic,
+ *  unparseable line, or offsets not contiguous).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_index_load(steganos_index_t *index, const char *path);
+
+/**
+ * @fn int steganos_index_lookup(steganos_index_t *index, uint64_t offset,
+ *                               uint64_t length, int *first, int *last)
+ * @brief Finds the entries carrying the payload bytes [<i>offset</i>,
+ *  <i>offset</i>+<i>length</i>) by bisection.
+ *
+ * @param index The loaded index.
+ * @param offset First byte of the range, in the compressed payload.
+ * @param length Bytes in the range (0 is taken as 1).
+ * @param first Will store the entry carrying the first byte.
+ * @param last Will store the entry carrying the last byte. When the range
+ *  goes past the end of the payload, the last entry.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument, or
+ *  <i>offset</i> past the end of the payload).
+ */
+int steganos_index_lookup(steganos_index_t *index, uint64_t offset,
+			  uint64_t length, int *first, int *last);
+
+/**
+ * @fn int steganos_index_free(steganos_index_t *index)
+ * @brief Frees the entries and, at the sender, closes the index file. The
+ *  entries still waiting for their granule are lost.
+ *
+ * @param index The index.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ */
+int steganos_index_free(steganos_index_t *index);
+
+#endif /* STEGANOS_INDEX_H */
+
+/* steganos_index.h ends here */
@@ -0,0 +1,324 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_live.c
+ * @brief: Live payload queue. The payload of a live emission is pushed as it
+ *  arrives instead of being read from a file compressed up front, and the
+ *  crypto-packets are cut so that no byte waits longer than requested.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 20:14:31 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 20:14:31 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "zlib.h"
+
+#include "steganos_live.h"
+#include "steganos_stats.h"
+#include "steganos_channel.h"
+#include "cryptos_channel.h"
+#include "miscellaneous.h"
+
+/* Minimum free space given to deflate at each call */
+#define _LIVE_CHUNK 4096
+
+/* Compresses <i>len</i> bytes (possibly none) into the queue, with the
+   given zlib flush mode, and marks the new bytes with the current time. */
+static int _live_deflate(steganos_live_t *live, const byte *data, size_t len,
+			 int mode) {
+
+  z_stream *zs;
+  byte *grown;
+  size_t size;
+  int ret;
+
+  zs = (z_stream *) live->zs;
+  zs->next_in = (Bytef *) data;
+  zs->avail_in = len;
+
+  do {
+
+    if(live->size - live->used < _LIVE_CHUNK) {
+      size = live->size ? 2*live->size : 4*_LIVE_CHUNK;
+      if(!(grown = (byte *) realloc(live->data, sizeof(byte)*size))) {
+	message_log("_live_deflate", strerror(errno));
+	return I_STEGANOS_ERR;
+      }
+      live->data = grown;
+      live->size = size;
+    }
+
+    zs->next_out = live->data + live->used;
+    zs->avail_out = live->size - live->used;
+    ret = deflate(zs, mode);
+    if(ret == Z_STREAM_ERROR) {
+      errno = EINVAL;
+      message_log("_live_deflate", "Zlib error while compressing");
+      return I_STEGANOS_ERR;
+    }
+    live->used = live->size - zs->avail_out;
+
+  } while(zs->avail_in || !zs->avail_out ||
+	  (mode == Z_FINISH && ret != Z_STREAM_END));
+
+  if(!live->n_marks ||
+     live->marks[live->n_marks-1].end < live->offset + live->used) {
+
+    /* Out of marks: merge the two oldest, keeping the oldest time */
+    if(live->n_marks == STEGANOS_LIVE_MARKS) {
+      live->marks[1].t = live->marks[0].t;
+      memmove(live->marks, &live->marks[1],
+	      sizeof(steganos_live_mark_t)*(--live->n_marks));
+    }
+
+    live->marks[live->n_marks].end = live->offset + live->used;
+    live->marks[live->n_marks].t = steganos_stats_clock();
+    live->n_marks++;
+
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_live_init(steganos_live_t *live, uint32_t max_latency, int level) {
+
+  z_stream *zs;
+
+  /* Input parameters control */
+  if(!live) {
+    errno = EINVAL;
+    message_log("steganos_live_init", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(live, 0, sizeof(steganos_live_t));
+
+  if(!(zs = (z_stream *) malloc(sizeof(z_stream)))) {
+    message_log("steganos_live_init", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(zs, 0, sizeof(z_stream));
+  if(deflateInit(zs, level) != Z_OK) {
+    errno = EINVAL;
+    message_log("steganos_live_init", "Zlib error while initializing");
+    free(zs);
+    return I_STEGANOS_ERR;
+  }
+
+  live->zs = zs;
+  live->max_latency = max_latency;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_push_payload(steganos_live_t *live, const byte *data, size_t len,
+			  int flush) {
+
+  /* Input parameters control */
+  if(!live || !live->zs || live->closed || (!data && len)) {
+    errno = EINVAL;
+    message_log("steganos_push_payload", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(_live_deflate(live, data, len, Z_SYNC_FLUSH) == I_STEGANOS_ERR) {
+    return I_STEGANOS_ERR;
+  }
+
+  live->pushed += len;
+  if(flush && live->used) live->flush = 1;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_live_close(steganos_live_t *live) {
+
+  /* Input parameters control */
+  if(!live || !live->zs) {
+    errno = EINVAL;
+    message_log("steganos_live_close", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(live->closed) {
+    return I_STEGANOS_OK;
+  }
+
+  if(_live_deflate(live, NULL, 0, Z_FINISH) == I_STEGANOS_ERR) {
+    return I_STEGANOS_ERR;
+  }
+
+  live->closed = 1;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_live_forward(steganos_live_t *live, cryptos_config_t *cc,
+			  cryptos_protocol_buffer_t *cb, uint64_t bit) {
+
+  steganos_live_packet_t *p;
+  byte *packet;
+  uint64_t size_limit, take, packet_size, written, id;
+  int due, last;
+
+  /* Input parameters control */
+  if(!live || !cc || !cb) {
+    errno = EINVAL;
+    message_log("steganos_live_forward", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  /* As in cryptos_forward, nothing to do while the buffer covers a whole
+     stego-frame */
+  if(cb->buffer_used >= cb->frame_bytes || !live->used) {
+    return I_CRYPTOS_OK;
+  }
+
+  if(cryptos_config_data_size(cc, &size_limit) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  take = live->used < size_limit ? live->used : size_limit;
+  due = take == size_limit || live->flush || live->closed ||
+    (live->max_latency &&
+     steganos_stats_clock() - live->marks[0].t >= live->max_latency);
+  if(!due) {
+    return I_CRYPTOS_OK;
+  }
+
+  /* The packet carrying the last byte of a closed payload ends the
+     emission */
+  last = live->closed && take == live->used;
+  if(last) cc->packet = 0;
+  id = cc->packet;
+
+  if(cryptos_packet_len(cc, take, &packet_size) == I_CRYPTOS_ERR) {
+    return I_CRYPTOS_ERR;
+  }
+
+  if(cb->buffer_used + packet_size > cb->buffer_size) {
+    errno = ENOBUFS;
+    message_log("steganos_live_forward", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  if(!(packet = (byte *) malloc(sizeof(byte)*packet_size))) {
+    message_log("steganos_live_forward", strerror(errno));
+    return I_CRYPTOS_ERR;
+  }
+
+  memset(packet, 0, sizeof(byte)*packet_size);
+  written = 0;
+  if(produce_packet(cc, live->data, take, packet, packet_size,
+		    &written) == I_CRYPTOS_ERR) {
+    free(packet);
+    return I_CRYPTOS_ERR;
+  }
+
+  if(written != take) {
+    message_log("steganos_live_forward", "Unknown error");
+    free(packet);
+    return I_CRYPTOS_ERR;
+  }
+
+  memcpy(&cb->buffer[cb->buffer_used], packet, packet_size);
+  free(packet);
+  cb->buffer_used += packet_size;
+  cb->offset += written;
+
+  /* Track the packet until its last bit is hidden. The oldest is forgotten
+     if too many are being hidden. */
+  if(live->n_pending == STEGANOS_LIVE_PENDING) {
+    memmove(live->pending, &live->pending[1],
+	    sizeof(steganos_live_packet_t)*(--live->n_pending));
+  }
+  p = &live->pending[live->n_pending++];
+  p->packet = id;
+  p->end = bit + packet_size*BITS_PER_BYTE;
+  p->bytes = written;
+  p->t = live->marks[0].t;
+
+  /* Consume the bytes and the marks they cover */
+  live->used -= written;
+  memmove(live->data, &live->data[written], live->used);
+  live->offset += written;
+  while(live->n_marks && live->marks[0].end <= live->offset) {
+    memmove(live->marks, &live->marks[1],
+	    sizeof(steganos_live_mark_t)*(--live->n_marks));
+  }
+  if(!live->used) live->flush = 0;
+
+  return I_CRYPTOS_OK;
+
+}
+
+int steganos_live_hidden(steganos_live_t *live, uint64_t sent, FILE *fp) {
+
+  steganos_live_packet_t *p;
+  uint32_t latency;
+  int done;
+
+  /* Input parameters control */
+  if(!live) {
+    errno = EINVAL;
+    message_log("steganos_live_hidden", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  for(done=0; done<live->n_pending; done++) {
+
+    p = &live->pending[done];
+    if(p->end > sent) break;
+
+    latency = steganos_stats_clock() - p->t;
+    live->packets++;
+    live->latency_sum += latency;
+    if(latency > live->latency_max) live->latency_max = latency;
+
+    if(fp) {
+      fprintf(fp, "{\"live_packet\":%lu,\"bytes\":%lu,\"latency_us\":%u}\n",
+	      (unsigned long) p->packet, (unsigned long) p->bytes, latency);
+    }
+
+  }
+
+  if(done) {
+    live->n_pending -= done;
+    memmove(live->pending, &live->pending[done],
+	    sizeof(steganos_live_packet_t)*live->n_pending);
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_live_free(steganos_live_t *live) {
+
+  if(!live) {
+    return I_STEGANOS_OK;
+  }
+
+  if(live->zs) {
+    deflateEnd((z_stream *) live->zs);
+    free(live->zs);
+  }
+  if(live->data) free(live->data);
+  memset(live, 0, sizeof(steganos_live_t));
+
+  return I_STEGANOS_OK;
+
+}
+
+/* steganos_live.c ends here */
+#endif
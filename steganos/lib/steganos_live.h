@@ -0,0 +1,146 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_live.h
+ * @brief: Headers for the live payload queue.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 20:12:55 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 20:12:55 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef STEGANOS_LIVE_H
+#define STEGANOS_LIVE_H
+
+#include <stdio.h>
+#include "steganos_types.h"
+#include "cryptos_types.h"
+
+/**
+ * @fn int steganos_live_init(steganos_live_t *live, uint32_t max_latency,
+ *                           int level)
+ * @brief Initializes an empty live payload queue.
+ *
+ * @param live The queue to initialize.
+ * @param max_latency Maximum time, in microseconds, a payload byte may wait
+ *  for a crypto-packet before a short one is cut. 0 to wait for full packets
+ *  (or a flush).
+ * @param level zlib compression level.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ENOMEM (out of memory).
+ */
+int steganos_live_init(steganos_live_t *live, uint32_t max_latency, int level);
+
+/**
+ * @fn int steganos_push_payload(steganos_live_t *live, const byte *data,
+ *                              size_t len, int flush)
+ * @brief Appends <i>len</i> payload bytes to the queue.
+ *
+ * The bytes are compressed and sync flushed at once, so they can be sent in
+ * the next crypto-packet. The receiver gets a regular zlib stream.
+ *
+ * @param live The queue.
+ * @param data The payload bytes.
+ * @param len Number of bytes in <i>data</i> (0 is valid, e.g. to flush).
+ * @param flush When set, the bytes queued so far go in a crypto-packet as
+ *  soon as possible, even if a short one.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument, or queue
+ *  already closed).
+ * @retval I_STEGANOS_ERR with errno = ENOMEM (out of memory).
+ */
+int steganos_push_payload(steganos_live_t *live, const byte *data, size_t len,
+			  int flush);
+
+/**
+ * @fn int steganos_live_close(steganos_live_t *live)
+ * @brief Ends the payload. The compressed stream is finished, and the
+ *  crypto-packet carrying its last byte will be the last one (ID 0).
+ *
+ * @param live The queue.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ENOMEM (out of memory).
+ */
+int steganos_live_close(steganos_live_t *live);
+
+/**
+ * @fn int steganos_live_forward(steganos_live_t *live, cryptos_config_t *cc,
+ *                              cryptos_protocol_buffer_t *cb, uint64_t bit)
+ * @brief Live counterpart of cryptos_forward: cuts the next crypto-packet
+ *  from the queue into <i>cb</i>, if one is due.
+ *
+ * A packet is due when <i>cb</i> does not hold a whole stego-frame and
+ * either a full packet is queued, a flush was requested, the payload is
+ * closed, or the oldest queued byte waits for longer than the maximum
+ * latency. <i>cb</i>->offset counts the compressed bytes sent.
+ *
+ * @param live The queue.
+ * @param cc The crypto config.
+ * @param cb The protocol buffer.
+ * @param bit Position in the subliminal stream of the end of <i>cb</i>'s
+ *  bytes, i.e., where the new packet would start.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_CRYPTOS_OK if no error was present and I_CRYPTOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_CRYPTOS_OK with errno = 0 (No error).
+ * @retval I_CRYPTOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_CRYPTOS_ERR with errno != 0 && errno != EINVAL (see
+ *  cryptos_forward).
+ */
+int steganos_live_forward(steganos_live_t *live, cryptos_config_t *cc,
+			  cryptos_protocol_buffer_t *cb, uint64_t bit);
+
+/**
+ * @fn int steganos_live_hidden(steganos_live_t *live, uint64_t sent, FILE *fp)
+ * @brief Accounts the packets completely hidden, i.e., ending at or before
+ *  the stream bit <i>sent</i>, and reports their latency.
+ *
+ * The latency of a packet runs from the push of its first payload byte to
+ * the hiding of its last bit. A JSON line is written to <i>fp</i> per
+ * packet, if given:
+ * {"live_packet":id,"bytes":n,"latency_us":t}
+ *
+ * @param live The queue.
+ * @param sent Bits of the subliminal stream hidden so far.
+ * @param fp Report file, may be NULL.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_live_hidden(steganos_live_t *live, uint64_t sent, FILE *fp);
+
+/**
+ * @fn int steganos_live_free(steganos_live_t *live)
+ * @brief Frees the queue.
+ *
+ * @param live The queue.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ */
+int steganos_live_free(steganos_live_t *live);
+
+#endif /* STEGANOS_LIVE_H */
+
+/* steganos_live.h ends here */
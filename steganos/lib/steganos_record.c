@@ -0,0 +1,427 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_record.c
+ * @brief: Frame recordings of the steganographic layer. The encoder and the
+ *  decoder append the input of the steganographic kernels to a sidecar file
+ *  (--srecord), so that they can be replayed outside the codec. Recordings
+ *  are little endian whatever the host.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 18:40:12 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 18:40:12 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "steganos_record.h"
+#include "miscellaneous.h"
+
+/* Size of the recording header: magic, version and byte order mark */
+#define _RECORD_HDR_SIZE 12
+
+/* Values converted at a time when writing on big endian hosts */
+#define _RECORD_CHUNK 256
+
+/* Returns 1 on little endian hosts */
+static int _host_le() {
+
+  uint32_t one = 1;
+
+  return *(byte *) &one;
+
+}
+
+/* Swaps the byte order of n 32 bits values, in place */
+static void _swap32(void *v, size_t n) {
+
+  byte *p = (byte *) v, t;
+  size_t i;
+
+  for(i=0; i<n; i++, p+=4) {
+    t = p[0]; p[0] = p[3]; p[3] = t;
+    t = p[1]; p[1] = p[2]; p[2] = t;
+  }
+
+}
+
+/* Writes n 32 bits values (integers or floats) in little endian order.
+   Returns the number of values written. */
+static size_t _write_le32(const void *v, size_t n, FILE *fp) {
+
+  uint32_t buf[_RECORD_CHUNK];
+  const byte *p = (const byte *) v;
+  size_t w, c;
+
+  if(_host_le()) return fwrite(v, 4, n, fp);
+
+  for(w=0; w<n; w+=c) {
+    c = n-w < _RECORD_CHUNK ? n-w : _RECORD_CHUNK;
+    memcpy(buf, &p[4*w], 4*c);
+    _swap32(buf, c);
+    if(fwrite(buf, 4, c, fp) != c) return w;
+  }
+
+  return n;
+
+}
+
+/* Reads n 32 bits values in little endian order. Returns the number of values
+   read. */
+static size_t _read_le32(void *v, size_t n, FILE *fp) {
+
+  size_t r;
+
+  r = fread(v, 4, n, fp);
+  if(!_host_le()) _swap32(v, r);
+
+  return r;
+
+}
+
+/* Checks a recording header. Returns 0 if valid, or the errno value */
+static int _check_header(const byte *hdr) {
+
+  uint32_t v[2];
+
+  if(memcmp(hdr, STEGANOS_RECORD_MAGIC, 4)) return EILSEQ;
+
+  memcpy(v, &hdr[4], sizeof(v));
+  if(!_host_le()) _swap32(v, 2);
+  if(v[1] != STEGANOS_RECORD_BOM) return EILSEQ;
+  if(v[0] != STEGANOS_RECORD_VERSION) return ENOTSUP;
+
+  return 0;
+
+}
+
+int steganos_record_open(const char *path, FILE **fp) {
+
+  uint32_t v[2];
+
+  /* Input parameters control */
+  if(!path || !fp) {
+    errno = EINVAL;
+    message_log("steganos_record_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(*fp = fopen(path, "wb"))) {
+    message_log("steganos_record_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  v[0] = STEGANOS_RECORD_VERSION;
+  v[1] = STEGANOS_RECORD_BOM;
+  if(fwrite(STEGANOS_RECORD_MAGIC, 1, 4, *fp) != 4 ||
+     _write_le32(v, 2, *fp) != 2) {
+    message_log("steganos_record_open", strerror(errno));
+    fclose(*fp);
+    *fp = NULL;
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_record_frame(FILE *fp, vorbis_config_t *vc, int *posts,
+			  int *floor, float *residue) {
+
+  int32_t hdr[4];
+  int len;
+  size_t w;
+
+  /* Input parameters control */
+  if(!fp || !vc || !vc->postlist || !vc->forward_index || vc->posts_len <= 0 ||
+     vc->pcmend <= 0 || !posts || !floor || !residue) {
+    errno = EINVAL;
+    message_log("steganos_record_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  hdr[0] = vc->rate; hdr[1] = vc->pcmend; hdr[2] = vc->mult;
+  hdr[3] = vc->posts_len;
+  len = vc->pcmend/2;
+
+  w = fwrite(STEGANOS_FRAME_MAGIC, 1, 4, fp);
+  w += _write_le32(hdr, 4, fp);
+  w += _write_le32(vc->postlist, vc->posts_len, fp);
+  w += _write_le32(vc->forward_index, vc->posts_len, fp);
+  w += _write_le32(posts, vc->posts_len, fp);
+  w += _write_le32(floor, len, fp);
+  w += _write_le32(residue, len, fp);
+
+  if(w != (size_t) (8 + 3*vc->posts_len + 2*len)) {
+    message_log("steganos_record_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_load_open(const char *path, FILE **fp) {
+
+  byte hdr[_RECORD_HDR_SIZE];
+  int err;
+
+  /* Input parameters control */
+  if(!path || !fp) {
+    errno = EINVAL;
+    message_log("steganos_load_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(*fp = fopen(path, "rb"))) {
+    message_log("steganos_load_open", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(fread(hdr, 1, _RECORD_HDR_SIZE, *fp) != _RECORD_HDR_SIZE) err = EILSEQ;
+  else err = _check_header(hdr);
+
+  if(err) {
+    errno = err;
+    message_log("steganos_load_open", strerror(errno));
+    fclose(*fp);
+    *fp = NULL;
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_load_frame(FILE *fp, steganos_frame_t *frame) {
+
+  char magic[4];
+  int32_t hdr[4];
+  int len;
+
+  /* Input parameters control */
+  if(!fp || !frame) {
+    errno = EINVAL;
+    message_log("steganos_load_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(frame, 0, sizeof(steganos_frame_t));
+
+  if(fread(magic, 1, 4, fp) != 4) {
+    errno = ENODATA;
+    return I_STEGANOS_ERR;
+  }
+
+  if(memcmp(magic, STEGANOS_FRAME_MAGIC, 4) ||
+     _read_le32(hdr, 4, fp) != 4 ||
+     hdr[1] <= 0 || hdr[1] > VORBIS_MAX_BLOCK*2 || hdr[3] <= 0 ||
+     hdr[3] > VORBIS_MAX_BLOCK) {
+    errno = EILSEQ;
+    message_log("steganos_load_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  frame->vc.rate = hdr[0]; frame->vc.pcmend = hdr[1]; frame->vc.mult = hdr[2];
+  frame->vc.posts_len = hdr[3];
+  len = hdr[1]/2;
+
+  if(!(frame->vc.postlist = (int *) malloc(sizeof(int)*hdr[3])) ||
+     !(frame->vc.forward_index = (int *) malloc(sizeof(int)*hdr[3])) ||
+     !(frame->posts = (int *) malloc(sizeof(int)*hdr[3])) ||
+     !(frame->floor = (int *) malloc(sizeof(int)*len)) ||
+     !(frame->residue = (float *) malloc(sizeof(float)*len))) {
+    message_log("steganos_load_frame", strerror(errno));
+    steganos_free_frame(frame);
+    return I_STEGANOS_ERR;
+  }
+
+  if(_read_le32(frame->vc.postlist, hdr[3], fp) != (size_t) hdr[3] ||
+     _read_le32(frame->vc.forward_index, hdr[3], fp) != (size_t) hdr[3] ||
+     _read_le32(frame->posts, hdr[3], fp) != (size_t) hdr[3] ||
+     _read_le32(frame->floor, len, fp) != (size_t) len ||
+     _read_le32(frame->residue, len, fp) != (size_t) len) {
+    errno = EILSEQ;
+    message_log("steganos_load_frame", strerror(errno));
+    steganos_free_frame(frame);
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_free_frame(steganos_frame_t *frame) {
+
+  /* Input parameters control */
+  if(!frame) {
+    errno = EINVAL;
+    message_log("steganos_free_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  free(frame->vc.postlist);
+  free(frame->vc.forward_index);
+  free(frame->posts);
+  free(frame->floor);
+  free(frame->residue);
+  memset(frame, 0, sizeof(steganos_frame_t));
+
+  return I_STEGANOS_OK;
+
+}
+
+/* Walks the records of a mapped recording, after its header. Counts them,
+   and fills frames if not NULL, swapping the values to the host byte order.
+   Returns -1 if a record is malformed. */
+static int _walk_frames(byte *map, size_t size, steganos_frame_t *frames) {
+
+  int32_t hdr[4];
+  size_t off, need;
+  int n, len;
+
+  n = 0;
+  off = _RECORD_HDR_SIZE;
+  while(off < size) {
+
+    if(size - off < 4 + sizeof(hdr) ||
+       memcmp(&map[off], STEGANOS_FRAME_MAGIC, 4)) {
+      return -1;
+    }
+    memcpy(hdr, &map[off+4], sizeof(hdr));
+    if(!_host_le()) _swap32(hdr, 4);
+
+    if(hdr[1] <= 0 || hdr[1] > VORBIS_MAX_BLOCK*2 || hdr[3] <= 0 ||
+       hdr[3] > VORBIS_MAX_BLOCK) {
+      return -1;
+    }
+
+    len = hdr[1]/2;
+    need = 4 + sizeof(hdr) + sizeof(int32_t)*(3*hdr[3] + 2*len);
+    if(size - off < need) {
+      return -1;
+    }
+
+    if(frames) {
+      steganos_frame_t *f = &frames[n];
+      int32_t *v = (int32_t *) &map[off + 4 + sizeof(hdr)];
+
+      if(!_host_le()) _swap32(v, 3*hdr[3] + 2*len);
+
+      f->vc.rate = hdr[0]; f->vc.pcmend = hdr[1]; f->vc.mult = hdr[2];
+      f->vc.posts_len = hdr[3];
+      f->vc.postlist = (int *) v; v += hdr[3];
+      f->vc.forward_index = (int *) v; v += hdr[3];
+      f->posts = (int *) v; v += hdr[3];
+      f->floor = (int *) v; v += len;
+      f->residue = (float *) v;
+    }
+
+    off += need;
+    n++;
+
+  }
+
+  return n;
+}
+
+int steganos_map_frames(const char *path, steganos_frames_t *frames) {
+
+  struct stat st;
+  int fd, n, err;
+
+  /* Input parameters control */
+  if(!path || !frames) {
+    errno = EINVAL;
+    message_log("steganos_map_frames", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(frames, 0, sizeof(steganos_frames_t));
+
+  if((fd = open(path, O_RDONLY)) < 0) {
+    message_log("steganos_map_frames", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(fstat(fd, &st)) {
+    message_log("steganos_map_frames", strerror(errno));
+    close(fd);
+    return I_STEGANOS_ERR;
+  }
+
+  if(st.st_size <= _RECORD_HDR_SIZE) {
+    errno = EILSEQ;
+    message_log("steganos_map_frames", strerror(errno));
+    close(fd);
+    return I_STEGANOS_ERR;
+  }
+
+  /* Private and writable: steganos_inverse gets the vectors as non const,
+     and big endian hosts swap them in place */
+  frames->size = st.st_size;
+  frames->map = mmap(NULL, frames->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		     fd, 0);
+  close(fd);
+  if(frames->map == MAP_FAILED) {
+    message_log("steganos_map_frames", strerror(errno));
+    memset(frames, 0, sizeof(steganos_frames_t));
+    return I_STEGANOS_ERR;
+  }
+
+  /* The frames are read once, in order */
+  madvise(frames->map, frames->size, MADV_SEQUENTIAL);
+
+  if((err = _check_header((byte *) frames->map))) {
+    errno = err;
+    message_log("steganos_map_frames", strerror(errno));
+    steganos_unmap_frames(frames);
+    return I_STEGANOS_ERR;
+  }
+
+  if((n = _walk_frames((byte *) frames->map, frames->size, NULL)) < 0) {
+    errno = EILSEQ;
+    message_log("steganos_map_frames", strerror(errno));
+    steganos_unmap_frames(frames);
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(frames->frames = (steganos_frame_t *)
+       malloc(sizeof(steganos_frame_t)*n))) {
+    message_log("steganos_map_frames", strerror(errno));
+    steganos_unmap_frames(frames);
+    return I_STEGANOS_ERR;
+  }
+
+  frames->n_frames = _walk_frames((byte *) frames->map, frames->size,
+				  frames->frames);
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_unmap_frames(steganos_frames_t *frames) {
+
+  if(!frames) {
+    return I_STEGANOS_OK;
+  }
+
+  if(frames->frames) free(frames->frames);
+  if(frames->map) munmap(frames->map, frames->size);
+  memset(frames, 0, sizeof(steganos_frames_t));
+
+  return I_STEGANOS_OK;
+
+}
+
+/* steganos_record.c ends here */
+#endif
@@ -0,0 +1,159 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_record.h
+ * @brief: Headers for the frame recordings of the steganographic layer.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 18:40:12 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 18:40:12 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef STEGANOS_RECORD_H
+#define STEGANOS_RECORD_H
+
+#include <stdio.h>
+#include "steganos_types.h"
+
+/**
+ * @fn int steganos_record_open(const char *path, FILE **fp)
+ * @brief Creates a recording, and writes its header.
+ *
+ * The header is STEGANOS_RECORD_MAGIC followed by STEGANOS_RECORD_VERSION
+ * and STEGANOS_RECORD_BOM, as 32 bits little endian integers. Every record
+ * appended afterwards by steganos_record_frame is little endian too, so
+ * recordings can be replayed on any host.
+ *
+ * @param path The recording.
+ * @param fp Will store the output stream, to be closed with fclose.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_record_open(const char *path, FILE **fp);
+
+/**
+ * @fn int steganos_record_frame(FILE *fp, vorbis_config_t *vc, int *posts,
+ *                               int *floor, float *residue)
+ * @brief Appends a frame and channel to a recording opened with
+ *  steganos_record_open, to replay the steganographic kernels on real data
+ *  outside the codec.
+ *
+ * The record is STEGANOS_FRAME_MAGIC followed by the rate, pcmend, mult and
+ *  posts_len fields of <i>vc</i> as 32 bits integers, and the postlist,
+ *  forward_index, posts, floor and residue vectors. Integers are written in
+ *  little endian order, and the residue as little endian IEEE 754 single
+ *  precision values.
+ *
+ * @param fp The output stream.
+ * @param vc The Vorbis configuration of the frame.
+ * @param posts The floor posts (vc->posts_len).
+ * @param floor The floor vector (vc->pcmend/2).
+ * @param residue The residue vector (vc->pcmend/2).
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_record_frame(FILE *fp, vorbis_config_t *vc, int *posts,
+			  int *floor, float *residue);
+
+/**
+ * @fn int steganos_load_open(const char *path, FILE **fp)
+ * @brief Opens a recording to read its frames with steganos_load_frame.
+ *
+ * @param path The recording.
+ * @param fp Will store the input stream, to be closed with fclose.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = EILSEQ (not a recording).
+ * @retval I_STEGANOS_ERR with errno = ENOTSUP (unknown recording version).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_load_open(const char *path, FILE **fp);
+
+/**
+ * @fn int steganos_load_frame(FILE *fp, steganos_frame_t *frame)
+ * @brief Reads the next frame of a recording opened with steganos_load_open.
+ *
+ * The vectors of <i>frame</i> are allocated here, and must be released with
+ * steganos_free_frame.
+ *
+ * @param fp The input stream.
+ * @param frame Will store the frame.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = ENODATA (no more frames).
+ * @retval I_STEGANOS_ERR with errno = EILSEQ (malformed record).
+ */
+int steganos_load_frame(FILE *fp, steganos_frame_t *frame);
+
+/**
+ * @fn int steganos_free_frame(steganos_frame_t *frame)
+ * @brief Frees the vectors of a frame read with steganos_load_frame.
+ *
+ * @param frame The frame.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_free_frame(steganos_frame_t *frame);
+
+/**
+ * @fn int steganos_map_frames(const char *path, steganos_frames_t *frames)
+ * @brief Maps a whole recording written by steganos_record_frame, by the
+ *  encoder or by the decoder (--srecord).
+ *
+ * Nothing is copied: the vectors of the frames point into the mapping, which
+ * is private, so the frames can be handed to functions modifying them. On big
+ * endian hosts the values are swapped in place, in the private mapping.
+ *
+ * @param path The recording.
+ * @param frames Will store the mapping and the frames.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno = EILSEQ (malformed record).
+ * @retval I_STEGANOS_ERR with errno = ENOTSUP (unknown recording version).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_map_frames(const char *path, steganos_frames_t *frames);
+
+/**
+ * @fn int steganos_unmap_frames(steganos_frames_t *frames)
+ * @brief Releases a recording mapped with steganos_map_frames.
+ *
+ * @param frames The mapped recording.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ */
+int steganos_unmap_frames(steganos_frames_t *frames);
+
+#endif /* STEGANOS_RECORD_H */
+
+/* steganos_record.h ends here */
@@ -0,0 +1,513 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_scan.c
+ * @brief: Multi-key steganalysis scan. Each decoded frame is checked against
+ *  many candidate keys, stopping at the headers: no data is ever unhidden.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 15:04:12 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 15:04:12 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <gcrypt.h>
+
+#include "steganos_scan.h"
+#include "steganos_channel.h"
+#include "miscellaneous.h"
+
+#if STEGANOS_SCAN_DRAWS < (SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+SIZE_FIELD_BITS)*BITS_PARITY
+#error "STEGANOS_SCAN_DRAWS too small for the headers"
+#endif
+
+/* Size of the frame key digest (MD5), see steganos_prepare_packet_keys */
+#define _SCAN_DIGEST 16
+
+/* Longest candidate key line */
+#define _SCAN_LINE 1024
+
+/* Same seed as prng_set_seed_byte gets from a 128 bits frame key */
+static unsigned int _scan_seed(const byte *key) {
+
+  unsigned int seed;
+  int i;
+
+  seed = 0;
+  for(i=0; i<(int)sizeof(int); i++) {
+    seed += (((unsigned int) key[i]) << (BITS_PER_BYTE*i));
+  }
+
+  return seed;
+}
+
+/* Parity mask of a header byte, as parity_bits_method computes it */
+static byte _scan_parity_mask(const int *draws, const int *floor) {
+
+  unsigned int mask;
+  int j, l, k, int_bits;
+
+  int_bits = BITS_PER_BYTE*sizeof(*floor);
+  mask = 0;
+  for(j=0, k=0; j<BITS_PER_BYTE; j++) {
+    for(l=0; l<BITS_PARITY; l++, k++) {
+      mask ^= ((((unsigned int) floor[draws[k] / int_bits]) >>
+		(draws[k] % int_bits)) & 1) << j;
+    }
+  }
+
+  return (byte) mask;
+}
+
+/* Whether a size field fits what unhide_data would accept with <i>capacity</i>
+   bits left in the frame. 0xFF only follows a synchronization header. */
+static int _scan_plausible_size(int size, int capacity, int after_header) {
+
+  if(size == 0xFF) {
+    return after_header && capacity >= 2*SIZE_FIELD_BITS;
+  }
+  if(size == SIZE_FIELD_ESCAPE) {
+    return capacity >= SIZE_FIELD_BITS+SIZE_FIELD_EXT_BITS;
+  }
+
+  return size > 0 && SIZE_FIELD_BITS + size <= capacity;
+}
+
+/* Fills a cache entry, replaying the PRNG sequences of steganos_inverse */
+static int _scan_fill(steganos_scan_t *scan, steganos_scan_cache_t *e,
+		      unsigned int seed, int res_len, int posts_len) {
+
+  int *occupied, i, aux, rnd;
+
+  e->valid = 0;
+  if(e->lineup) { free(e->lineup); e->lineup = NULL; }
+  if(e->u) { free(e->u); e->u = NULL; }
+
+  /* ISS watermark, as in iss_cfg_init */
+  if(scan->synchro_method == ISS) {
+
+    if(!(e->u = (float *) malloc(sizeof(float)*posts_len))) {
+      message_log("_scan_fill", strerror(errno));
+      return I_STEGANOS_ERR;
+    }
+
+    if(prng_set_seed_uint(scan->prng, seed) == I_ERR) {
+      return I_STEGANOS_ERR;
+    }
+
+    e->u_norm = 0.f;
+    for(i=0; i<posts_len; i++) {
+      if(prng_get_random_int(scan->prng, 2, &rnd) == I_ERR) {
+	return I_STEGANOS_ERR;
+      }
+      e->u[i] = rnd ? scan->sigma : -scan->sigma;
+      e->u_norm += scan->sigma*scan->sigma;
+    }
+
+  }
+
+  /* Residue lineup, and the parity draws following it */
+  if(!(e->lineup = (int *) malloc(sizeof(int)*res_len))) {
+    message_log("_scan_fill", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(occupied = (int *) calloc(res_len, sizeof(int)))) {
+    message_log("_scan_fill", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(prng_set_seed_uint(scan->prng, seed) == I_ERR) {
+    free(occupied);
+    return I_STEGANOS_ERR;
+  }
+
+  i = 0;
+  while(i<res_len) {
+    if(prng_get_random_int(scan->prng, res_len, &aux) == I_ERR) {
+      free(occupied);
+      return I_STEGANOS_ERR;
+    }
+    if(!occupied[aux]) {
+      e->lineup[i] = aux;
+      occupied[aux] = 1;
+      i++;
+    }
+  }
+  free(occupied);
+
+  memset(e->draws, 0, sizeof(int)*STEGANOS_SCAN_DRAWS);
+  if(scan->hide_method == PARITY_BITS) {
+    if(prng_get_random_ints(scan->prng, res_len*BITS_PER_BYTE*sizeof(int),
+			    e->draws, STEGANOS_SCAN_DRAWS) == I_ERR) {
+      return I_STEGANOS_ERR;
+    }
+  }
+
+  e->seed = seed;
+  e->res_len = res_len;
+  e->posts_len = posts_len;
+  e->valid = 1;
+
+  return I_STEGANOS_OK;
+}
+
+/* Ranking for steganos_scan_ranking, most likely first */
+static int _scan_cmp(const void *a, const void *b) {
+
+  const steganos_scan_candidate_t *ca, *cb;
+
+  ca = *(const steganos_scan_candidate_t **) a;
+  cb = *(const steganos_scan_candidate_t **) b;
+
+  if(ca->hits != cb->hits) return ca->hits < cb->hits ? 1 : -1;
+  if(ca->headers+ca->marks != cb->headers+cb->marks)
+    return ca->headers+ca->marks < cb->headers+cb->marks ? 1 : -1;
+  return 0;
+}
+
+int steganos_scan_init(steganos_scan_t *scan, const char *keys_file,
+		       int hide_method, int synchro_method, float sigma) {
+
+  FILE *fp;
+  gcry_error_t gce;
+  gcry_cipher_hd_t chd;
+  steganos_scan_candidate_t *c;
+  char line[_SCAN_LINE];
+  int len, alloc;
+
+  /* Input parameters control */
+  if(!scan || !keys_file || (synchro_method == ISS && sigma <= 0)) {
+    errno = EINVAL;
+    message_log("steganos_scan_init", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(scan, 0, sizeof(steganos_scan_t));
+  scan->hide_method = hide_method;
+  scan->synchro_method = synchro_method;
+  scan->sigma = sigma;
+
+  if(!(scan->prng = (prng_t *) malloc(sizeof(prng_t)))) {
+    message_log("steganos_scan_init", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(prng_init(scan->prng) == I_ERR) {
+    free(scan->prng); scan->prng = NULL;
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(fp = fopen(keys_file, "r"))) {
+    message_log("steganos_scan_init", strerror(errno));
+    steganos_scan_free(scan);
+    return I_STEGANOS_ERR;
+  }
+
+  alloc = 0;
+  while(fgets(line, _SCAN_LINE, fp)) {
+
+    len = strlen(line);
+    while(len && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = 0;
+    if(!len || line[0] == '#') continue;
+
+    /* steganos_state_init rejects shorter master keys */
+    if(len*BITS_PER_BYTE < 128) {
+      message_log("steganos_scan_init", "Candidate key too short, skipped");
+      continue;
+    }
+
+    if(scan->n_candidates == alloc) {
+      alloc = alloc ? 2*alloc : 16;
+      if(!(c = (steganos_scan_candidate_t *)
+	   realloc(scan->candidates, sizeof(steganos_scan_candidate_t)*alloc))) {
+	message_log("steganos_scan_init", strerror(errno));
+	fclose(fp);
+	steganos_scan_free(scan);
+	return I_STEGANOS_ERR;
+      }
+      scan->candidates = c;
+    }
+
+    c = &scan->candidates[scan->n_candidates];
+    memset(c, 0, sizeof(steganos_scan_candidate_t));
+
+    /* The frame keys are ARCFOUR(master_key)(md5(forward_index)), so the
+       keystream is all we need from the master key */
+    gce = gcry_cipher_open(&chd, GCRY_CIPHER_ARCFOUR, GCRY_CIPHER_MODE_STREAM,
+			   GCRY_CIPHER_SECURE);
+    if(gce != GPG_ERR_NO_ERROR) {
+      message_log("steganos_scan_init", gcry_strerror(gce));
+      fclose(fp);
+      steganos_scan_free(scan);
+      return I_STEGANOS_ERR;
+    }
+
+    gce = gcry_cipher_setkey(chd, line, len);
+    if(gce == GPG_ERR_NO_ERROR) {
+      gce = gcry_cipher_encrypt(chd, c->stream, _SCAN_DIGEST, NULL, 0);
+    }
+    gcry_cipher_close(chd);
+
+    /* Keys the cipher rejects can't have been used to hide anything */
+    if(gce != GPG_ERR_NO_ERROR) {
+      message_log("steganos_scan_init", gcry_strerror(gce));
+      continue;
+    }
+
+    if(!(c->key = strdup(line))) {
+      message_log("steganos_scan_init", strerror(errno));
+      fclose(fp);
+      steganos_scan_free(scan);
+      return I_STEGANOS_ERR;
+    }
+
+    scan->n_candidates++;
+
+  }
+
+  fclose(fp);
+
+  if(!scan->n_candidates) {
+    errno = EINVAL;
+    message_log("steganos_scan_init", "No valid candidate keys");
+    steganos_scan_free(scan);
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_scan_frame(steganos_scan_t *scan, vorbis_config_t *vc,
+			int *posts, int *floor, float *residue) {
+
+  steganos_scan_candidate_t *c;
+  steganos_scan_cache_t *e;
+  byte digest[_SCAN_DIGEST], key[_SCAN_DIGEST], *buffer;
+  byte data[(SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+SIZE_FIELD_BITS)/BITS_PER_BYTE
+	    +sizeof(float)+1];
+  unsigned int seed, buffer_len, forward_len;
+  float posts_mean, r, fvalue;
+  int res_len, posts_len, capacity, bit, read, same, i, j, k;
+
+  /* Input parameters control */
+  if(!scan || !scan->candidates || !vc || !vc->forward_index ||
+     vc->posts_len <= 0 || vc->pcmend <= 0 ||
+     vc->pcmend/2 > VORBIS_MAX_BLOCK || !posts || !floor || !residue) {
+    errno = EINVAL;
+    message_log("steganos_scan_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  res_len = vc->pcmend/2;
+  posts_len = vc->posts_len;
+
+  /* md5(forward_index), shared by all the candidates */
+  forward_len = posts_len*sizeof(*vc->forward_index);
+  buffer_len = forward_len < _SCAN_DIGEST ? _SCAN_DIGEST : forward_len;
+  if(!(buffer = (byte *) calloc(buffer_len, sizeof(byte)))) {
+    message_log("steganos_scan_frame", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+  memcpy(buffer, vc->forward_index, forward_len);
+  gcry_md_hash_buffer(GCRY_MD_MD5, digest, buffer, buffer_len);
+  free(buffer);
+
+  /* Subliminal bits the frame could shelter, whatever the lineup */
+  capacity = 0;
+  for(i=0; i<res_len; i++) {
+    if(residue[i] >= -1 && residue[i] <= 1) continue;
+    fvalue = fabs(residue[i]);
+    capacity += (int) floorf(logf(fvalue)/logf(2.f));
+  }
+
+  /* Posts mean, as in synchro_iss */
+  posts_mean = 0.f;
+  if(scan->synchro_method == ISS) {
+    for(i=0; i<posts_len; i++) {
+      posts_mean += posts[i]&0x7fff;
+    }
+    posts_mean /= (float) posts_len;
+  }
+
+  for(k=0; k<scan->n_candidates; k++) {
+
+    c = &scan->candidates[k];
+
+    for(i=0; i<_SCAN_DIGEST; i++) key[i] = digest[i] ^ c->stream[i];
+    seed = _scan_seed(key);
+
+    e = NULL;
+    for(i=0; i<STEGANOS_SCAN_CACHE; i++) {
+      if(c->cache[i].valid && c->cache[i].seed == seed &&
+	 c->cache[i].res_len == res_len && c->cache[i].posts_len == posts_len) {
+	e = &c->cache[i];
+	break;
+      }
+    }
+
+    if(!e) {
+      e = &c->cache[c->next];
+      c->next = (c->next+1) % STEGANOS_SCAN_CACHE;
+      if(_scan_fill(scan, e, seed, res_len, posts_len) == I_STEGANOS_ERR) {
+	return I_STEGANOS_ERR;
+      }
+      c->lineups++;
+    }
+
+    /* ISS mark: sign of the projection of the posts over the watermark */
+    bit = 0;
+    if(scan->synchro_method == ISS) {
+      r = 0.f;
+      for(i=0; i<posts_len; i++) {
+	r += ((posts[i]&0x7fff)-posts_mean)*e->u[i];
+      }
+      r /= e->u_norm;
+      bit = r < 0 ? 0 : (r > 0 ? 1 : INDETERMINATE_MARK);
+    }
+
+    /* Without an ISS mark, only a synchronization header (RES_HEADER or
+       FORCED_RES_HEADER) may tell there is data */
+    if(scan->synchro_method == RES_HEADER || !bit) {
+
+      if(peek_subliminal_bits(residue, e->lineup, res_len,
+			      SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+
+			      SIZE_FIELD_BITS, data, &read) == I_STEGANOS_ERR) {
+	return I_STEGANOS_ERR;
+      }
+
+      if(read < SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE) continue;
+
+      same = 1;
+      for(j=0; j<SYNCHRO_HEADER_BYTES_RES && same; j++) {
+	if(scan->hide_method == PARITY_BITS) {
+	  data[j] ^= _scan_parity_mask(&e->draws[j*BITS_PER_BYTE*BITS_PARITY],
+				       floor);
+	}
+	if(data[j] != SYNCHRO_HEADER[j]) same = 0;
+      }
+
+      /* Early exit: no header, nothing to read with this key */
+      if(!same) continue;
+
+      c->headers++;
+      if(read < SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE+SIZE_FIELD_BITS) continue;
+
+      if(scan->hide_method == PARITY_BITS) {
+	data[j] ^= _scan_parity_mask(&e->draws[j*BITS_PER_BYTE*BITS_PARITY],
+				     floor);
+      }
+      if(_scan_plausible_size(data[j], capacity -
+			      SYNCHRO_HEADER_BYTES_RES*BITS_PER_BYTE, 1)) {
+	c->hits++;
+      }
+
+    } else {
+
+      c->marks++;
+
+      if(peek_subliminal_bits(residue, e->lineup, res_len, SIZE_FIELD_BITS,
+			      data, &read) == I_STEGANOS_ERR) {
+	return I_STEGANOS_ERR;
+      }
+
+      if(read < SIZE_FIELD_BITS) continue;
+
+      if(scan->hide_method == PARITY_BITS) {
+	data[0] ^= _scan_parity_mask(e->draws, floor);
+      }
+      if(_scan_plausible_size(data[0], capacity, 0)) {
+	c->hits++;
+      }
+
+    }
+
+  }
+
+  scan->frames++;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_scan_ranking(steganos_scan_t *scan,
+			  steganos_scan_result_t *results, int n, int *ranked) {
+
+  steganos_scan_candidate_t **rank;
+  int i;
+
+  /* Input parameters control */
+  if(!scan || !results || n < 0 || !ranked) {
+    errno = EINVAL;
+    message_log("steganos_scan_ranking", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!(rank = (steganos_scan_candidate_t **)
+       malloc(sizeof(steganos_scan_candidate_t *)*(scan->n_candidates+1)))) {
+    message_log("steganos_scan_ranking", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  for(i=0; i<scan->n_candidates; i++) rank[i] = &scan->candidates[i];
+  qsort(rank, scan->n_candidates, sizeof(*rank), _scan_cmp);
+
+  if(n > scan->n_candidates) n = scan->n_candidates;
+
+  for(i=0; i<n; i++) {
+    results[i].key = rank[i]->key;
+    results[i].hits = rank[i]->hits;
+    results[i].headers = rank[i]->headers;
+    results[i].marks = rank[i]->marks;
+    results[i].lineups = rank[i]->lineups;
+    results[i].score = scan->frames ? (double) rank[i]->hits/scan->frames : 0.;
+  }
+  *ranked = n;
+
+  free(rank);
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_scan_free(steganos_scan_t *scan) {
+
+  int i, j;
+
+  if(!scan) {
+    return I_STEGANOS_OK;
+  }
+
+  for(i=0; i<scan->n_candidates; i++) {
+    if(scan->candidates[i].key) free(scan->candidates[i].key);
+    for(j=0; j<STEGANOS_SCAN_CACHE; j++) {
+      if(scan->candidates[i].cache[j].lineup)
+	free(scan->candidates[i].cache[j].lineup);
+      if(scan->candidates[i].cache[j].u)
+	free(scan->candidates[i].cache[j].u);
+    }
+  }
+
+  if(scan->candidates) free(scan->candidates);
+  scan->candidates = NULL;
+  scan->n_candidates = 0;
+
+  if(scan->prng) {
+    prng_free(scan->prng);
+    free(scan->prng);
+    scan->prng = NULL;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+/* steganos_scan.c ends here */
+#endif
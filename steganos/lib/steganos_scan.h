@@ -0,0 +1,115 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_scan.h
+ * @brief: Headers for the multi-key steganalysis scan.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 15:02:37 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 15:02:37 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef STEGANOS_SCAN_H
+#define STEGANOS_SCAN_H
+
+#include "steganos_types.h"
+
+/**
+ * @fn int steganos_scan_init(steganos_scan_t *scan, const char *keys_file,
+ *                            int hide_method, int synchro_method, float sigma)
+ * @brief Initializes a scan with the candidate keys in <i>keys_file</i>.
+ *
+ * The file has one candidate master key per line. Empty lines and lines
+ * starting with '#' are ignored. The ARCFOUR keystream of every candidate is
+ * computed here, so deriving a frame key afterwards is just a XOR with the
+ * digest of the frame's forward_index.
+ *
+ * @param scan The scan to initialize.
+ * @param keys_file The candidate keys file.
+ * @param hide_method The hiding method assumed (hide_method_et).
+ * @param synchro_method The synchronization method assumed
+ *  (synchro_method_et).
+ * @param sigma The ISS sigma, ignored with RES_HEADER.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument, or no valid
+ *  candidate in the file).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (I/O error).
+ */
+int steganos_scan_init(steganos_scan_t *scan, const char *keys_file,
+		       int hide_method, int synchro_method, float sigma);
+
+/**
+ * @fn int steganos_scan_frame(steganos_scan_t *scan, vorbis_config_t *vc,
+ *                             int *posts, int *floor, float *residue)
+ * @brief Evaluates every candidate key against a decoded frame and channel.
+ *
+ * Mirrors what steganos_inverse would do with each key up to the headers: the
+ * ISS mark, the synchronization header and the size field. A candidate is
+ * abandoned as soon as its synchronization header mismatches, and nothing is
+ * ever unhidden. The lineup and the parity draws depend only on the frame key
+ * and the block sizes, so they are computed once per candidate and cached.
+ *
+ * @param scan The scan.
+ * @param vc The Vorbis configuration of the frame.
+ * @param posts The received floor posts (vc->posts_len).
+ * @param floor The floor vector (vc->pcmend/2).
+ * @param residue The residue vector (vc->pcmend/2).
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_scan_frame(steganos_scan_t *scan, vorbis_config_t *vc,
+			int *posts, int *floor, float *residue);
+
+/**
+ * @fn int steganos_scan_ranking(steganos_scan_t *scan,
+ *                               steganos_scan_result_t *results, int n,
+ *                               int *ranked)
+ * @brief Fills <i>results</i> with the <i>n</i> most likely candidates, most
+ *  likely first.
+ *
+ * Candidates are ranked by the frames they would read (hits), then by the
+ * synchronization evidence (headers and ISS marks). The keys in
+ * <i>results</i> point into the scan, and are valid until steganos_scan_free.
+ *
+ * @param scan The scan.
+ * @param results Array of at least <i>n</i> results.
+ * @param n Maximum number of candidates to rank.
+ * @param ranked Receives the number of results filled, i.e., the lowest of
+ *  <i>n</i> and the number of candidates.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ * @retval I_STEGANOS_ERR with errno != 0 && errno != EINVAL (memory error).
+ */
+int steganos_scan_ranking(steganos_scan_t *scan,
+			  steganos_scan_result_t *results, int n, int *ranked);
+
+/**
+ * @fn int steganos_scan_free(steganos_scan_t *scan)
+ * @brief Frees the memory allocated by steganos_scan_init and the cached
+ *  lineups.
+ *
+ * @param scan The scan.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ */
+int steganos_scan_free(steganos_scan_t *scan);
+
+#endif /* STEGANOS_SCAN_H */
+
+/* steganos_scan.h ends here */
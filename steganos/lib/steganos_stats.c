@@ -0,0 +1,248 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_stats.c
+ * @brief: Per-frame telemetry of the steganographic layer. Records are kept
+ *  in a fixed size ring buffer inside the steganographic state, with a sole
+ *  writer (the codec) and readers synchronized by a sequence lock.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 13:24:40 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 13:24:40 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include "steganos_stats.h"
+#include "miscellaneous.h"
+
+/* Atomic accesses to the sequence counter and the head. The stores release
+   the writes before them, and the loads acquire the reads after them */
+#if defined(__GNUC__)
+#define _STATS_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define _STATS_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define _STATS_FENCE_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define _STATS_FENCE_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define _STATS_LOAD(p) (*(volatile __typeof__(*(p)) *) (p))
+#define _STATS_STORE(p, v) (*(volatile __typeof__(*(p)) *) (p) = (v))
+#define _STATS_FENCE_RELEASE()
+#define _STATS_FENCE_ACQUIRE()
+#endif
+
+static const char *_status_names[] = { "idle", "hidden", "desync", "ignored" };
+
+int steganos_stats_init(steganos_state_t *ss) {
+
+  /* Input parameters control */
+  if(!ss) {
+    errno = EINVAL;
+    message_log("steganos_stats_init", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(&ss->frame_stats, 0, sizeof(steganos_frame_stats_t));
+  memset(ss->stats_ring, 0, sizeof(steganos_frame_stats_t)*STEGANOS_STATS_RING);
+  memset(&ss->stats_totals, 0, sizeof(steganos_stats_totals_t));
+  ss->stats_open = 0;
+  ss->stats_seq = 0;
+  ss->stats_head = 0;
+  ss->stats_dumped = 0;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_stats_begin(steganos_state_t *ss, int channel) {
+
+  /* Input parameters control */
+  if(!ss) {
+    errno = EINVAL;
+    message_log("steganos_stats_begin", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(&ss->frame_stats, 0, sizeof(steganos_frame_stats_t));
+  ss->frame_stats.frame = ss->iters;
+  ss->frame_stats.channel = channel;
+  ss->frame_stats.sync_method = ss->synchro_method;
+  ss->frame_stats.status = FRAME_STATUS_IDLE;
+  ss->frame_stats.reason = I_STEGANOS_OK;
+  ss->stats_open = 1;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_stats_commit(steganos_state_t *ss) {
+
+  steganos_frame_stats_t *fs;
+  steganos_stats_totals_t *t;
+  uint64_t head;
+  unsigned int seq;
+
+  /* Input parameters control */
+  if(!ss) {
+    errno = EINVAL;
+    message_log("steganos_stats_commit", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  if(!ss->stats_open) return I_STEGANOS_OK;
+
+  fs = &ss->frame_stats;
+  t = &ss->stats_totals;
+  seq = ss->stats_seq;
+  head = _STATS_LOAD(&ss->stats_head);
+
+  /* Odd sequence: a write is in progress. The fence keeps the writes below
+     from being seen before it */
+  _STATS_STORE(&ss->stats_seq, seq+1);
+  _STATS_FENCE_RELEASE();
+
+  t->frames++;
+  if(fs->status == FRAME_STATUS_HIDDEN) t->hidden++;
+  else if(fs->status == FRAME_STATUS_DESYNC) t->desync++;
+  else if(fs->status == FRAME_STATUS_IGNORED) t->ignored++;
+  if(fs->status == FRAME_STATUS_DESYNC && fs->reason == I_STEGANOS_FRAME_SKIP)
+    t->skipped++;
+  t->attempts += fs->attempts;
+  t->retries += fs->retries;
+  t->capacity += fs->capacity;
+  t->bits += fs->bits;
+  t->hdr_bits += fs->hdr_bits;
+  t->t_crypto += fs->t_crypto;
+  t->t_sync += fs->t_sync;
+  t->t_hide += fs->t_hide;
+
+  memcpy(&ss->stats_ring[head & (STEGANOS_STATS_RING-1)], fs,
+	 sizeof(steganos_frame_stats_t));
+  _STATS_STORE(&ss->stats_head, head+1);
+
+  /* Even sequence: the record and the counters are published */
+  _STATS_STORE(&ss->stats_seq, seq+2);
+  ss->stats_open = 0;
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_get_stats(steganos_state_t *ss, steganos_stats_t *stats) {
+
+  uint64_t head, first, i;
+  unsigned int seq;
+
+  /* Input parameters control */
+  if(!ss || !stats) {
+    errno = EINVAL;
+    message_log("steganos_get_stats", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  /* Copy while no write is in progress (even sequence), and again if the
+     sequence has changed meanwhile */
+  do {
+
+    seq = _STATS_LOAD(&ss->stats_seq);
+    if(seq & 1) continue;
+
+    head = _STATS_LOAD(&ss->stats_head);
+    memcpy(&stats->totals, &ss->stats_totals, sizeof(steganos_stats_totals_t));
+    first = head > STEGANOS_STATS_RING ? head - STEGANOS_STATS_RING : 0;
+    for(i=first; i<head; i++) {
+      memcpy(&stats->records[i-first],
+	     &ss->stats_ring[i & (STEGANOS_STATS_RING-1)],
+	     sizeof(steganos_frame_stats_t));
+    }
+    stats->n_records = (int) (head - first);
+
+    /* The copy must be done before the sequence is checked again */
+    _STATS_FENCE_ACQUIRE();
+
+  } while((seq & 1) || _STATS_LOAD(&ss->stats_seq) != seq);
+
+  return I_STEGANOS_OK;
+
+}
+
+int steganos_stats_dump(steganos_state_t *ss, FILE *fp, int final) {
+
+  steganos_frame_stats_t *fs;
+  steganos_stats_totals_t *t;
+  uint64_t head, i;
+
+  /* Input parameters control */
+  if(!ss || !fp) {
+    errno = EINVAL;
+    message_log("steganos_stats_dump", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  head = _STATS_LOAD(&ss->stats_head);
+  if(!final && head - ss->stats_dumped < STEGANOS_STATS_RING/2)
+    return I_STEGANOS_OK;
+
+  /* Records not dumped in time have been overwritten */
+  if(head - ss->stats_dumped > STEGANOS_STATS_RING) {
+    fprintf(fp, "{\"dropped\":%lu}\n",
+	    (unsigned long) (head - ss->stats_dumped - STEGANOS_STATS_RING));
+    ss->stats_dumped = head - STEGANOS_STATS_RING;
+  }
+
+  for(i=ss->stats_dumped; i<head; i++) {
+    fs = &ss->stats_ring[i & (STEGANOS_STATS_RING-1)];
+    fprintf(fp, "{\"frame\":%d,\"channel\":%d,\"sync\":%d,\"posts_mode\":%d,"
+	    "\"attempts\":%d,\"status\":\"%s\",\"reason\":%d,\"retries\":%d,"
+	    "\"capacity\":%d,\"bits\":%d,\"hdr_bits\":%d,\"t_crypto_us\":%u,"
+	    "\"t_sync_us\":%u,\"t_hide_us\":%u}\n",
+	    fs->frame, fs->channel, fs->sync_method, fs->posts_mode,
+	    fs->attempts,
+	    fs->status >= 0 && fs->status <= FRAME_STATUS_IGNORED ?
+	    _status_names[fs->status] : "unknown",
+	    fs->reason, fs->retries, fs->capacity, fs->bits, fs->hdr_bits,
+	    (unsigned) fs->t_crypto, (unsigned) fs->t_sync,
+	    (unsigned) fs->t_hide);
+  }
+  ss->stats_dumped = head;
+
+  if(final) {
+    t = &ss->stats_totals;
+    fprintf(fp, "{\"totals\":{\"frames\":%lu,\"hidden\":%lu,\"desync\":%lu,"
+	    "\"ignored\":%lu,\"skipped\":%lu,\"attempts\":%lu,\"retries\":%lu,"
+	    "\"capacity\":%lu,\"bits\":%lu,\"hdr_bits\":%lu,"
+	    "\"t_crypto_us\":%lu,\"t_sync_us\":%lu,\"t_hide_us\":%lu}}\n",
+	    (unsigned long) t->frames, (unsigned long) t->hidden,
+	    (unsigned long) t->desync, (unsigned long) t->ignored,
+	    (unsigned long) t->skipped, (unsigned long) t->attempts,
+	    (unsigned long) t->retries, (unsigned long) t->capacity,
+	    (unsigned long) t->bits, (unsigned long) t->hdr_bits,
+	    (unsigned long) t->t_crypto, (unsigned long) t->t_sync,
+	    (unsigned long) t->t_hide);
+  }
+
+  if(fflush(fp)) {
+    message_log("steganos_stats_dump", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+uint32_t steganos_stats_clock() {
+
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (uint32_t) ((uint64_t) tv.tv_sec*1000000 + tv.tv_usec);
+
+}
+
+/* steganos_stats.c ends here */
+#endif
@@ -0,0 +1,123 @@
+/*                               -*- Mode: C -*-
+ * @file: steganos_stats.h
+ * @brief: Headers for the per-frame telemetry of the steganographic layer.
+ * @author: Jesus
+ * Maintainer:
+ * @date: dom oct 18 13:21:05 2026 (+0200)
+ * @version:
+ * Last-Updated: dom oct 18 13:21:05 2026 (+0200)
+ *           By: Jesus
+ *     Update #: 1
+ * URL:
+ */
+#ifndef STEGANOS_STATS_H
+#define STEGANOS_STATS_H
+
+#include <stdio.h>
+#include "steganos_types.h"
+
+/**
+ * @fn int steganos_stats_init(steganos_state_t *ss)
+ * @brief Empties the telemetry ring buffer and counters of the given state.
+ *
+ * @param ss The steganographic state.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_stats_init(steganos_state_t *ss);
+
+/**
+ * @fn int steganos_stats_begin(steganos_state_t *ss, int channel)
+ * @brief Starts the record of the current frame (ss->iters) and the given
+ *  channel.
+ *
+ * The fields of ss->frame_stats are filled along the protocol, and the record
+ * is committed to the ring buffer by steganos_state_reset_iter.
+ *
+ * @param ss The steganographic state.
+ * @param channel The channel, -1 if unknown.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_stats_begin(steganos_state_t *ss, int channel);
+
+/**
+ * @fn int steganos_stats_commit(steganos_state_t *ss)
+ * @brief Commits the current record, if started, to the ring buffer and
+ *  updates the aggregated counters.
+ *
+ * There must be a sole writer (the codec thread). The writes are enclosed
+ * by the stats_seq sequence lock: odd before them, even after, so
+ * steganos_get_stats may run concurrently and never blocks the codec.
+ *
+ * @param ss The steganographic state.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_stats_commit(steganos_state_t *ss);
+
+/**
+ * @fn int steganos_get_stats(steganos_state_t *ss, steganos_stats_t *stats)
+ * @brief Takes a snapshot of the telemetry: the aggregated counters and the
+ *  last (at most STEGANOS_STATS_RING) records, oldest first.
+ *
+ * May be called from another thread while the codec runs. The copy is
+ * retried while a commit is in progress or if one has happened meanwhile, so
+ * the counters and the records always belong to the same commit.
+ *
+ * @param ss The steganographic state.
+ * @param stats Will store the snapshot.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_get_stats(steganos_state_t *ss, steganos_stats_t *stats);
+
+/**
+ * @fn int steganos_stats_dump(steganos_state_t *ss, FILE *fp, int final)
+ * @brief Writes the records not dumped yet to <i>fp</i>, one JSON object per
+ *  line.
+ *
+ * To keep file I/O out of the per-frame path, nothing is written until half
+ * of the ring buffer is pending, unless <i>final</i> is set. With
+ * <i>final</i>, a last line with the aggregated counters is appended.
+ *
+ * @param ss The steganographic state.
+ * @param fp The output stream.
+ * @param final Boolean. Flush everything and write the totals.
+ *
+ * @return The corresponding error code for integer returning functions, i.e.,
+ *  I_STEGANOS_OK if no error was present and I_STEGANOS_ERR if an error
+ *  occured with errno updated.
+ * @retval I_STEGANOS_OK with errno = 0 (No error).
+ * @retval I_STEGANOS_ERR with errno = EINVAL (invalid argument).
+ */
+int steganos_stats_dump(steganos_state_t *ss, FILE *fp, int final);
+
+/**
+ * @fn uint32_t steganos_stats_clock()
+ * @brief Returns a timestamp in microseconds, for the stage timings. Only
+ *  differences between timestamps are meaningful.
+ *
+ * @return The timestamp.
+ */
+uint32_t steganos_stats_clock();
+
+#endif /* STEGANOS_STATS_H */
+
+/* steganos_stats.h ends here */
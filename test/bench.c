@@ -0,0 +1,592 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: end-to-end throughput benchmark of the steganographic layer
+
+ Encodes synthetic covers hiding a random payload and decodes them
+ back, for every combination of the requested parameters, and prints
+ one JSON object per run:
+
+   encode/decode frames per second, payload bits per second (per
+   wall second and per audio second), capacity utilisation and peak
+   RSS of the encoder and the decoder.
+
+ Each stage runs in its own process: the stego layer keeps per
+ process state, and the peak RSS is measured per stage.
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <vorbis/codec.h>
+#include <vorbis/vorbisenc.h>
+
+#include "util.h"
+
+#ifdef STEGO
+#include "steganos_types.h"
+#include "steganos_stats.h"
+
+#define PAYLOAD_FILE    "stegobench_payload.bin"
+#define RECOVERED_FILE  "stegobench_recovered.bin"
+#define STREAM_FILE     "stegobench.ogg"
+#define STATS_FILE      "stegobench_stats.jsonl"
+#define BENCH_KEY       "stegobench reproducible key"
+
+#define MAX_LIST        16
+#define READ_CHUNK      4096
+
+enum { SIG_SINE = 0, SIG_NOISE = 1, SIG_TRANSIENTS = 2 } ;
+static const char *signal_names [] = { "sine", "noise", "transients" } ;
+
+typedef struct {
+  int srate ;
+  int channels ;
+  int signal ;
+  int da ;
+  int hide_method ;
+  int sync_method ;
+  float seconds ;
+  float quality ;
+  char *record ;            /* Frames recording for stegokern, or NULL */
+  char *drecord ;           /* Decoded frames for stegoreplay, or NULL */
+} bench_cfg ;
+
+typedef struct {
+  int ok ;
+  long frames ;             /* Vorbis blocks encoded or decoded */
+  double elapsed ;          /* Wall seconds spent in the codec loop */
+  unsigned long bits ;      /* Payload bits hidden or read */
+  unsigned long hdr_bits ;
+  unsigned long capacity ;
+  long maxrss_kb ;
+} stage_result ;
+
+typedef int (*stage_fn) (const bench_cfg *cfg, stage_result *res) ;
+
+static double
+now (void)
+{
+  struct timeval tv ;
+
+  gettimeofday (&tv, NULL) ;
+  return tv.tv_sec + tv.tv_usec / 1e6 ;
+}
+
+/* Telemetry totals: from the live state, or from the last line of the
+ * JSON-lines dump if the state was freed at the end of the transmission. */
+static void
+stage_totals (vorbis_block *vb, stage_result *res)
+{
+  static steganos_stats_t stats ;
+  char line [1024] ;
+  FILE *file ;
+  unsigned long v [10] ;
+
+  if (vb->ss) {
+    if (steganos_get_stats (vb->ss, &stats) == I_STEGANOS_OK) {
+      res->bits = stats.totals.bits ;
+      res->hdr_bits = stats.totals.hdr_bits ;
+      res->capacity = stats.totals.capacity ;
+    }
+    return ;
+  }
+
+  if ((file = fopen (STATS_FILE, "r")) == NULL)
+    return ;
+
+  while (fgets (line, sizeof (line), file)) {
+    if (sscanf (line, "{\"totals\":{\"frames\":%lu,\"hidden\":%lu,"
+                "\"desync\":%lu,\"ignored\":%lu,\"skipped\":%lu,"
+                "\"attempts\":%lu,\"retries\":%lu,\"capacity\":%lu,"
+                "\"bits\":%lu,\"hdr_bits\":%lu", &v [0], &v [1], &v [2],
+                &v [3], &v [4], &v [5], &v [6], &v [7], &v [8], &v [9]) == 10) {
+      res->capacity = v [7] ;
+      res->bits = v [8] ;
+      res->hdr_bits = v [9] ;
+    }
+  }
+  fclose (file) ;
+}
+
+static void
+stego_setup (vorbis_block *vb, const bench_cfg *cfg, char *sfile)
+{
+  vb->sfile = sfile ;
+  vb->skey = BENCH_KEY ;
+  vb->da = cfg->da ;
+  vb->delayfr = 0 ;
+  vb->hide_method = cfg->hide_method ;
+  vb->sync_method = cfg->sync_method ;
+  vb->sigma = 1.f ;
+  vb->scpkt = 1 ;
+  vb->sfv = 1 ;
+  vb->scfmt = 1 ;
+  vb->sstats = STATS_FILE ;
+  vb->quiet = 1 ;
+}
+
+static void
+gen_cover (float *data, int len, const bench_cfg *cfg, int channel)
+{
+  unsigned int seed = 1234 + channel ;
+
+  switch (cfg->signal) {
+  case SIG_SINE:
+    gen_sine (data, len, cfg->srate, 220.f * (channel + 1), 0.5f) ;
+    break ;
+  case SIG_NOISE:
+    gen_noise (data, len, 0.5f, &seed) ;
+    break ;
+  default:
+    gen_transients (data, len, cfg->srate, 0.8f, &seed) ;
+    break ;
+  }
+}
+
+static void
+write_pages (ogg_stream_state *os, FILE *file, int flush)
+{
+  ogg_page og ;
+
+  while (flush ? ogg_stream_flush (os, &og) : ogg_stream_pageout (os, &og)) {
+    fwrite (og.header, 1, og.header_len, file) ;
+    fwrite (og.body, 1, og.body_len, file) ;
+  }
+}
+
+static int
+encode_stage (const bench_cfg *cfg, stage_result *res)
+{
+  ogg_stream_state os ;
+  ogg_packet       op, header, header_comm, header_code ;
+  vorbis_info      vi ;
+  vorbis_comment   vc ;
+  vorbis_dsp_state vd ;
+  vorbis_block     vb ;
+  FILE *file ;
+  float **buffer, *cover ;
+  long len, done, chunk ;
+  int c ;
+  double start ;
+
+  if ((file = fopen (STREAM_FILE, "wb")) == NULL)
+    return 1 ;
+
+  vorbis_info_init (&vi) ;
+  if (vorbis_encode_init_vbr (&vi, cfg->channels, cfg->srate, cfg->quality)) {
+    fclose (file) ;
+    return 1 ;
+  }
+
+  len = (long) (cfg->seconds * cfg->srate) ;
+  if ((cover = malloc (sizeof (float) * len * cfg->channels)) == NULL) {
+    fclose (file) ;
+    return 1 ;
+  }
+  for (c = 0 ; c < cfg->channels ; c++)
+    gen_cover (&cover [c * len], len, cfg, c) ;
+
+  vorbis_comment_init (&vc) ;
+  vorbis_comment_add_tag (&vc, "ENCODER", "test/bench.c") ;
+  vorbis_analysis_init (&vd, &vi) ;
+  memset (&vb, 0, sizeof (vb)) ;
+  vorbis_block_init (&vd, &vb) ;
+  stego_setup (&vb, cfg, PAYLOAD_FILE) ;
+  vb.srecord = cfg->record ;
+  ogg_stream_init (&os, 12345678) ;
+
+  vorbis_analysis_headerout (&vd, &vc, &header, &header_comm, &header_code) ;
+  ogg_stream_packetin (&os, &header) ;
+  ogg_stream_packetin (&os, &header_comm) ;
+  ogg_stream_packetin (&os, &header_code) ;
+  write_pages (&os, file, 1) ;
+
+  start = now () ;
+  done = 0 ;
+  while (1) {
+    chunk = len - done < READ_CHUNK ? len - done : READ_CHUNK ;
+    if (chunk > 0) {
+      buffer = vorbis_analysis_buffer (&vd, chunk) ;
+      for (c = 0 ; c < cfg->channels ; c++)
+        memcpy (buffer [c], &cover [c * len + done], sizeof (float) * chunk) ;
+      done += chunk ;
+    }
+    vorbis_analysis_wrote (&vd, chunk) ;
+
+    while (vorbis_analysis_blockout (&vd, &vb) == 1) {
+      vorbis_analysis (&vb, NULL) ;
+      vorbis_bitrate_addblock (&vb) ;
+      res->frames++ ;
+      while (vorbis_bitrate_flushpacket (&vd, &op)) {
+        ogg_stream_packetin (&os, &op) ;
+        write_pages (&os, file, 0) ;
+      }
+    }
+
+    if (chunk <= 0)
+      break ;
+  }
+  res->elapsed = now () - start ;
+  write_pages (&os, file, 1) ;
+
+  stage_totals (&vb, res) ;
+  res->ok = 1 ;
+
+  ogg_stream_clear (&os) ;
+  vorbis_block_clear (&vb) ;
+  vorbis_dsp_clear (&vd) ;
+  vorbis_comment_clear (&vc) ;
+  vorbis_info_clear (&vi) ;
+  free (cover) ;
+  fclose (file) ;
+
+  return 0 ;
+}
+
+static int
+decode_stage (const bench_cfg *cfg, stage_result *res)
+{
+  ogg_sync_state   oy ;
+  ogg_stream_state os ;
+  ogg_page         og ;
+  ogg_packet       op ;
+  vorbis_info      vi ;
+  vorbis_comment   vc ;
+  vorbis_dsp_state vd ;
+  vorbis_block     vb ;
+  FILE *file ;
+  char *buffer ;
+  float **pcm ;
+  int bytes, headers, samples, started ;
+  double start ;
+
+  if ((file = fopen (STREAM_FILE, "rb")) == NULL)
+    return 1 ;
+
+  ogg_sync_init (&oy) ;
+  vorbis_info_init (&vi) ;
+  vorbis_comment_init (&vc) ;
+  headers = 0 ;
+  started = 0 ;
+  start = now () ;
+
+  do {
+    buffer = ogg_sync_buffer (&oy, READ_CHUNK) ;
+    bytes = fread (buffer, 1, READ_CHUNK, file) ;
+    ogg_sync_wrote (&oy, bytes) ;
+
+    while (ogg_sync_pageout (&oy, &og) == 1) {
+      if (!started) {
+        ogg_stream_init (&os, ogg_page_serialno (&og)) ;
+        started = 1 ;
+      }
+      ogg_stream_pagein (&os, &og) ;
+
+      while (ogg_stream_packetout (&os, &op) == 1) {
+        if (headers < 3) {
+          if (vorbis_synthesis_headerin (&vi, &vc, &op) < 0)
+            goto done ;
+          if (++headers == 3) {
+            vorbis_synthesis_init (&vd, &vi) ;
+            memset (&vb, 0, sizeof (vb)) ;
+            vorbis_block_init (&vd, &vb) ;
+            stego_setup (&vb, cfg, RECOVERED_FILE) ;
+            vb.srecord = cfg->drecord ;
+            start = now () ;
+          }
+          continue ;
+        }
+        if (vorbis_synthesis (&vb, &op) == 0)
+          vorbis_synthesis_blockin (&vd, &vb) ;
+        res->frames++ ;
+        while ((samples = vorbis_synthesis_pcmout (&vd, &pcm)) > 0)
+          vorbis_synthesis_read (&vd, samples) ;
+      }
+    }
+  } while (bytes > 0) ;
+
+  if (headers == 3) {
+    res->elapsed = now () - start ;
+    stage_totals (&vb, res) ;
+    res->ok = 1 ;
+    vorbis_block_clear (&vb) ;
+    vorbis_dsp_clear (&vd) ;
+  }
+
+ done:
+  if (started)
+    ogg_stream_clear (&os) ;
+  vorbis_comment_clear (&vc) ;
+  vorbis_info_clear (&vi) ;
+  ogg_sync_clear (&oy) ;
+  fclose (file) ;
+
+  return res->ok ? 0 : 1 ;
+}
+
+/* Runs a stage in a child process, which sends its results back through a
+ * pipe. The child's peak RSS is obtained from wait4. */
+static int
+run_stage (stage_fn fn, const bench_cfg *cfg, stage_result *res)
+{
+  struct rusage ru ;
+  int fds [2], status ;
+  pid_t pid ;
+
+  memset (res, 0, sizeof (*res)) ;
+  remove (STATS_FILE) ;
+
+  if (pipe (fds))
+    return 1 ;
+
+  fflush (stdout) ;
+  if ((pid = fork ()) < 0) {
+    close (fds [0]) ;
+    close (fds [1]) ;
+    return 1 ;
+  }
+
+  if (pid == 0) {
+    close (fds [0]) ;
+    fn (cfg, res) ;
+    if (write (fds [1], res, sizeof (*res)) != sizeof (*res))
+      _exit (1) ;
+    _exit (0) ;
+  }
+
+  close (fds [1]) ;
+  if (read (fds [0], res, sizeof (*res)) != sizeof (*res))
+    res->ok = 0 ;
+  close (fds [0]) ;
+
+  if (wait4 (pid, &status, 0, &ru) < 0 || !WIFEXITED (status))
+    res->ok = 0 ;
+  res->maxrss_kb = ru.ru_maxrss ;
+
+  return res->ok ? 0 : 1 ;
+}
+
+/* 1 if the recovered file matches the payload, 0 if not, -1 if the
+ * transmission did not end within the cover. */
+static int
+check_recovered (void)
+{
+  FILE *a, *b ;
+  int ca, cb, same ;
+
+  if ((b = fopen (RECOVERED_FILE, "rb")) == NULL)
+    return -1 ;
+  if ((a = fopen (PAYLOAD_FILE, "rb")) == NULL) {
+    fclose (b) ;
+    return 0 ;
+  }
+
+  same = 1 ;
+  do {
+    ca = fgetc (a) ;
+    cb = fgetc (b) ;
+    if (ca != cb)
+      same = 0 ;
+  } while (same && ca != EOF) ;
+
+  fclose (a) ;
+  fclose (b) ;
+  return same ;
+}
+
+static int
+write_payload (long bytes, unsigned int seed)
+{
+  FILE *file ;
+  long k ;
+
+  if ((file = fopen (PAYLOAD_FILE, "wb")) == NULL) {
+    printf ("Error : fopen failed : %s\n", strerror (errno)) ;
+    return 1 ;
+  }
+  for (k = 0 ; k < bytes ; k++) {
+    seed = seed * 1103515245u + 12345u ;
+    fputc ((seed >> 16) & 0xFF, file) ;
+  }
+  fclose (file) ;
+  return 0 ;
+}
+
+static void
+run_one (const bench_cfg *cfg)
+{
+  stage_result enc, dec ;
+  int recovered ;
+
+  remove (RECOVERED_FILE) ;
+
+  printf ("{\"rate\":%d,\"channels\":%d,\"signal\":\"%s\",\"seconds\":%.2f,"
+          "\"da\":%d,\"hide_method\":%d,\"sync_method\":%d,",
+          cfg->srate, cfg->channels, signal_names [cfg->signal], cfg->seconds,
+          cfg->da, cfg->hide_method, cfg->sync_method) ;
+
+  if (run_stage (encode_stage, cfg, &enc) || enc.elapsed <= 0) {
+    printf ("\"error\":\"encode\"}\n") ;
+    return ;
+  }
+  if (run_stage (decode_stage, cfg, &dec) || dec.elapsed <= 0) {
+    printf ("\"error\":\"decode\"}\n") ;
+    return ;
+  }
+  recovered = check_recovered () ;
+
+  printf ("\"enc_fps\":%.1f,\"dec_fps\":%.1f,\"enc_payload_bps\":%.1f,"
+          "\"dec_payload_bps\":%.1f,\"embed_rate_bps\":%.1f,"
+          "\"utilisation\":%.4f,\"bits\":%lu,\"dec_bits\":%lu,"
+          "\"capacity\":%lu,\"enc_peak_rss_kb\":%ld,\"dec_peak_rss_kb\":%ld,"
+          "\"recovered\":%d}\n",
+          enc.frames / enc.elapsed, dec.frames / dec.elapsed,
+          enc.bits / enc.elapsed, dec.bits / dec.elapsed,
+          enc.bits / cfg->seconds,
+          enc.capacity ? (double) (enc.bits + enc.hdr_bits) / enc.capacity : 0.,
+          enc.bits, dec.bits, enc.capacity, enc.maxrss_kb, dec.maxrss_kb,
+          recovered) ;
+}
+
+/* Parses a comma separated list of integers in [min,max], or of names of
+ * names[min..max] if names is not NULL. */
+static int
+parse_list (const char *arg, int *list, int min, int max, const char **names)
+{
+  char *copy, *tok ;
+  int n = 0, k ;
+
+  copy = strdup (arg) ;
+  for (tok = strtok (copy, ",") ; tok && n < MAX_LIST ; tok = strtok (NULL, ",")) {
+    list [n] = names ? min - 1 : atoi (tok) ;
+    for (k = min ; names && k <= max ; k++)
+      if (!strcmp (tok, names [k]))
+        list [n] = k ;
+    if (list [n] < min || list [n] > max) {
+      printf ("Error : value \"%s\" not recognised\n", tok) ;
+      free (copy) ;
+      return -1 ;
+    }
+    n++ ;
+  }
+  free (copy) ;
+  return n ;
+}
+
+static void
+usage (void)
+{
+  printf ("Usage: stegobench [options]\n"
+          "  -r rates      Sample rates, comma separated (8000-96000) [44100]\n"
+          "  -c channels   Channel counts (1-6) [2]\n"
+          "  -s signals    sine, noise, transients [noise]\n"
+          "  -a da         Desired aggressiveness (1-10) [1,...,10]\n"
+          "  -m methods    Hiding methods (0-2) [0,1,2]\n"
+          "  -y methods    Synchronization methods (0-1) [0,1]\n"
+          "  -t seconds    Length of the covers [5]\n"
+          "  -p bytes      Payload size [65536]\n"
+          "  -q quality    VBR quality [0.4]\n"
+          "  -R file       Record the encoded frames for stegokern (the last\n"
+          "                run's frames are kept)\n"
+          "  -D file       Record the decoded frames for stegoreplay (the last\n"
+          "                run's frames are kept)\n") ;
+}
+
+int
+main (int argc, char **argv)
+{
+  int rates [MAX_LIST] = { 44100 }, nrates = 1 ;
+  int chans [MAX_LIST] = { 2 }, nchans = 1 ;
+  int sigs [MAX_LIST] = { SIG_NOISE }, nsigs = 1 ;
+  int das [MAX_LIST] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }, ndas = 10 ;
+  int hides [MAX_LIST] = { 0, 1, 2 }, nhides = 3 ;
+  int syncs [MAX_LIST] = { 0, 1 }, nsyncs = 2 ;
+  long payload = 65536 ;
+  int r, c, s, a, m, y, opt ;
+  bench_cfg cfg ;
+
+  memset (&cfg, 0, sizeof (cfg)) ;
+  cfg.seconds = 5.f ;
+  cfg.quality = 0.4f ;
+
+  while ((opt = getopt (argc, argv, "r:c:s:a:m:y:t:p:q:R:D:h")) != -1) {
+    switch (opt) {
+    case 'r': nrates = parse_list (optarg, rates, 8000, 96000, NULL) ; break ;
+    case 'c': nchans = parse_list (optarg, chans, 1, 6, NULL) ; break ;
+    case 's': nsigs = parse_list (optarg, sigs, SIG_SINE, SIG_TRANSIENTS,
+                                    signal_names) ; break ;
+    case 'a': ndas = parse_list (optarg, das, 1, 10, NULL) ; break ;
+    case 'm': nhides = parse_list (optarg, hides, 0, 2, NULL) ; break ;
+    case 'y': nsyncs = parse_list (optarg, syncs, 0, 1, NULL) ; break ;
+    case 't': cfg.seconds = atof (optarg) ; break ;
+    case 'p': payload = atol (optarg) ; break ;
+    case 'q': cfg.quality = atof (optarg) ; break ;
+    case 'R': cfg.record = optarg ; break ;
+    case 'D': cfg.drecord = optarg ; break ;
+    default: usage () ; return opt == 'h' ? 0 : 1 ;
+    }
+  }
+
+  if (nrates < 1 || nchans < 1 || nsigs < 1 || ndas < 1 || nhides < 1 ||
+      nsyncs < 1 || cfg.seconds <= 0 || payload <= 0) {
+    usage () ;
+    return 1 ;
+  }
+
+  if (write_payload (payload, 1))
+    return 1 ;
+
+  for (r = 0 ; r < nrates ; r++)
+    for (c = 0 ; c < nchans ; c++)
+      for (s = 0 ; s < nsigs ; s++)
+        for (a = 0 ; a < ndas ; a++)
+          for (m = 0 ; m < nhides ; m++)
+            for (y = 0 ; y < nsyncs ; y++) {
+              cfg.srate = rates [r] ;
+              cfg.channels = chans [c] ;
+              cfg.signal = sigs [s] ;
+              cfg.da = das [a] ;
+              cfg.hide_method = hides [m] ;
+              cfg.sync_method = syncs [y] ;
+              run_one (&cfg) ;
+            }
+
+  remove (PAYLOAD_FILE) ;
+  remove (RECOVERED_FILE) ;
+  remove (STREAM_FILE) ;
+  remove (STATS_FILE) ;
+  remove ("." PAYLOAD_FILE ".z") ;
+  remove ("." RECOVERED_FILE ".z") ;
+
+  return 0 ;
+}
+
+#else /* #ifndef STEGO */
+
+int
+main (void)
+{
+  printf ("stegobench: the library was built without STEGO\n") ;
+  return 1 ;
+}
+
+#endif /* #ifdef STEGO */
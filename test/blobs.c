@@ -0,0 +1,197 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: bitrate managed packet blobs test
+
+ In bitrate managed mode, the mapping leaves the packet blobs pending
+ and only encodes those the bitrate manager looks at. Encodes the same
+ cover twice, once that way and once encoding every pending blob, in
+ order, before the manager runs, as the encoder used to. Both streams
+ must be byte-identical.
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vorbis/codec.h"
+#include "vorbis/vorbisenc.h"
+
+#include "codec_internal.h"
+#include "registry.h"
+
+#include "util.h"
+
+#define BLOBS_RATE      44100
+#define BLOBS_SECONDS   2
+#define BLOBS_CHUNK     1024
+
+typedef struct {
+  const char *name ;
+  int channels ;
+  long max_bitrate, nominal_bitrate, min_bitrate ;
+} blobs_cfg ;
+
+typedef struct {
+  unsigned char *data ;
+  long len, size ;
+} stream ;
+
+static int
+append (stream *s, const ogg_packet *op)
+{
+  unsigned char *data ;
+
+  if (s->len + op->bytes + (long) sizeof (long) > s->size) {
+    s->size = 2 * (s->size + op->bytes + sizeof (long)) ;
+    if ((data = realloc (s->data, s->size)) == NULL)
+      return 1 ;
+    s->data = data ;
+  }
+
+  /* The packet boundaries count too */
+  memcpy (s->data + s->len, &op->bytes, sizeof (long)) ;
+  memcpy (s->data + s->len + sizeof (long), op->packet, op->bytes) ;
+  s->len += op->bytes + sizeof (long) ;
+  return 0 ;
+}
+
+/* Encodes the audio packets of the cover; with eager, every blob the mapping
+   left pending is encoded before the bitrate manager runs. forced receives
+   the number of blobs that had been left pending. */
+static int
+encode (const blobs_cfg *cfg, float **cover, long len, int eager,
+        stream *out, long *forced)
+{
+  vorbis_info vi ;
+  vorbis_dsp_state vd ;
+  vorbis_block vb ;
+  vorbis_block_internal *vbi ;
+  ogg_packet op ;
+  float **buffer ;
+  long done, n ;
+  int ch, k, rc = 0 ;
+
+  *forced = 0 ;
+  vorbis_info_init (&vi) ;
+  if (vorbis_encode_init (&vi, cfg->channels, BLOBS_RATE, cfg->max_bitrate,
+                          cfg->nominal_bitrate, cfg->min_bitrate)) {
+    vorbis_info_clear (&vi) ;
+    return 1 ;
+  }
+  vorbis_analysis_init (&vd, &vi) ;
+  vorbis_block_init (&vd, &vb) ;
+
+  for (done = 0 ; ; done += n) {
+    n = len - done < BLOBS_CHUNK ? len - done : BLOBS_CHUNK ;
+    if (n) {
+      buffer = vorbis_analysis_buffer (&vd, n) ;
+      for (ch = 0 ; ch < cfg->channels ; ch++)
+        memcpy (buffer [ch], cover [ch] + done, n * sizeof (float)) ;
+    }
+    vorbis_analysis_wrote (&vd, n) ;
+
+    while (vorbis_analysis_blockout (&vd, &vb) == 1) {
+      vorbis_analysis (&vb, NULL) ;
+
+      vbi = vb.internal ;
+      for (k = 0 ; k < PACKETBLOBS ; k++)
+        if (vbi->blobpending & (1 << k)) {
+          (*forced)++ ;
+          if (eager)
+            _mapping_P [0]->blob (&vb, k) ;
+        }
+
+      vorbis_bitrate_addblock (&vb) ;
+      while (vorbis_bitrate_flushpacket (&vd, &op))
+        rc |= append (out, &op) ;
+    }
+
+    if (!n)
+      break ;
+  }
+
+  vorbis_block_clear (&vb) ;
+  vorbis_dsp_clear (&vd) ;
+  vorbis_info_clear (&vi) ;
+  return rc ;
+}
+
+static int
+blobs_test (const blobs_cfg *cfg, float **cover, long len)
+{
+  stream lazy, eager ;
+  long pending, forced ;
+  int rc = 1 ;
+
+  printf ("    %-22s : ", cfg->name) ;
+  fflush (stdout) ;
+  memset (&lazy, 0, sizeof (lazy)) ;
+  memset (&eager, 0, sizeof (eager)) ;
+
+  if (encode (cfg, cover, len, 0, &lazy, &pending) ||
+      encode (cfg, cover, len, 1, &eager, &forced)) {
+    puts ("cannot encode") ;
+    goto out ;
+  }
+
+  if (lazy.len != eager.len || memcmp (lazy.data, eager.data, lazy.len))
+    puts ("streams differ") ;
+  else {
+    /* With STEGO the mapping encodes every blob itself */
+    printf ("%ld bytes, %ld blobs left pending, ok\n", lazy.len, pending) ;
+    rc = 0 ;
+  }
+
+ out:
+  free (lazy.data) ;
+  free (eager.data) ;
+  return rc ;
+}
+
+int
+main (void)
+{
+  static const blobs_cfg cfgs [] = {
+    { "mono, average",      1, -1,     48000,  -1 },
+    { "stereo, average",    2, -1,     96000,  -1 },
+    { "stereo, min/max",    2, 112000, 96000,  64000 },
+    { "stereo, hard",       2, 64000,  64000,  64000 },
+    { "5.1, average",       6, -1,     192000, -1 }
+  } ;
+  float *cover [6] ;
+  long len = BLOBS_RATE * BLOBS_SECONDS ;
+  unsigned int seed = 1 ;
+  unsigned k ;
+  int ch, rc = 0 ;
+
+  for (ch = 0 ; ch < 6 ; ch++) {
+    if ((cover [ch] = malloc (len * sizeof (float))) == NULL) {
+      puts ("Error : malloc failed") ;
+      return 1 ;
+    }
+    if (ch & 1)
+      gen_noise (cover [ch], len, 0.5, &seed) ;
+    else
+      gen_transients (cover [ch], len, BLOBS_RATE, 0.8, &seed) ;
+  }
+
+  puts ("Managed bitrate blobs :") ;
+  for (k = 0 ; k < ARRAY_LEN (cfgs) ; k++)
+    rc |= blobs_test (&cfgs [k], cover, len) ;
+
+  for (ch = 0 ; ch < 6 ; ch++)
+    free (cover [ch]) ;
+
+  return rc ;
+}
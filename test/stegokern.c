@@ -0,0 +1,613 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: micro-benchmark of the steganos kernels
+
+ Runs the per frame kernels of the steganographic layer in isolation
+ on frames recorded by the encoder (--srecord, or stegobench -R), or
+ on synthetic frames, and prints one JSON object per kernel with the
+ cycles per residue bin and per subliminal bit, for the live kernel
+ and for its frozen reference copy (stegoref.c).
+
+ Every output of the live kernels is compared with the reference
+ one, the block PRNG draws with the reference draws one at a time,
+ and the crypto-packets produced are checked against golden CRCs. Any difference is reported and makes the exit status 1: the
+ kernels' output is the format of the streams already out there.
+
+ The static kernels are reached by including steganos_channel.c, so
+ this program is linked against the steganos sources, not against
+ libvorbis.
+
+ ********************************************************************/
+
+#ifdef STEGO
+#include "steganos_channel.c"
+
+#include <unistd.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "cryptos_channel.h"
+#include "steganos_record.h"
+#include "stegoref.h"
+
+#define KERN_KEY        "stegokern reproducible key"
+#define KERN_IV         "fedcba9876543210"
+#define KERN_PKT_KEY    "0123456789abcdef"
+#define KERN_PACKETS    32
+
+/* CRC32 of the KERN_PACKETS crypto-packets produced by packets_check,
+ * for the CRYPTOS_FORMAT_V1 and CRYPTOS_FORMAT_V2 formats. */
+#define KERN_CRC_V1     0x4a85f8c3UL
+#define KERN_CRC_V2     0x2f8e12c0UL
+
+enum {
+  K_CAPACITY = 0, K_LINEUP, K_WRITE, K_READ, K_PARITY, K_PRNG, K_FLOOR,
+  K_SYNCHRO, K_PRODUCE, K_PARSE, K_COUNT
+} ;
+
+static const char *kernel_names [K_COUNT] = {
+  "set_subliminal_capacity_limit", "calculate_residue_lineup",
+  "_write_subliminal_data", "_read_subliminal_residue",
+  "parity_bits_method", "prng_get_random_ints", "iss_simulate_floor",
+  "synchro_iss", "produce_packet", "parse_packet"
+} ;
+
+typedef struct {
+  uint64_t live ;           /* Best time of the live kernel, summed */
+  uint64_t ref ;            /* Best time of the reference kernel, summed */
+  unsigned long bins ;      /* Residue (or floor) bins processed */
+  unsigned long bits ;      /* Subliminal (or payload) bits processed */
+  long frames ;
+  long mismatches ;
+} kern_stat ;
+
+static kern_stat stats [K_COUNT] ;
+static int reps = 16 ;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLOCK_UNIT "cycles"
+static uint64_t
+kern_clock (void)
+{    unsigned int lo, hi ;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi)) ;
+    return ((uint64_t) hi << 32) | lo ;
+}
+#else
+#define CLOCK_UNIT "ns"
+static uint64_t
+kern_clock (void)
+{    struct timespec ts ;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec ;
+}
+#endif
+
+/* Runs stmt, keeping in best the shortest time seen. */
+#define TIMED(best, stmt) do {                    \
+    uint64_t t0_ = kern_clock () ;                \
+    stmt ;                                        \
+    t0_ = kern_clock () - t0_ ;                   \
+    if (t0_ < (best)) (best) = t0_ ;              \
+  } while (0)
+
+static unsigned int
+lcg (unsigned int *seed)
+{    *seed = *seed * 1103515245u + 12345u ;
+    return (*seed >> 16) & 0x7fff ;
+}
+
+static void
+mismatch (int kernel, long frame, const char *what)
+{    fprintf (stderr, "stegokern: %s: frame %ld: %s differs from the "
+                "reference\n", kernel_names [kernel], frame, what) ;
+    stats [kernel].mismatches++ ;
+}
+
+static void
+account (int kernel, uint64_t live, uint64_t ref, long bins, long bits)
+{    stats [kernel].live += live ;
+    stats [kernel].ref += ref ;
+    stats [kernel].bins += bins ;
+    stats [kernel].bits += bits ;
+    stats [kernel].frames++ ;
+}
+
+/* A synthetic frame: a floor1 like posts vector (postlist starting with
+ * 0 and pcmend/2, as floor1 does) and a Laplacian like quantized residue. */
+static int
+synth_frame (steganos_frame_t *fr, int rate, int pcmend, int posts_len,
+                unsigned int seed)
+{    int i, j, len, t, y ;
+
+    len = pcmend / 2 ;
+    memset (fr, 0, sizeof (*fr)) ;
+    fr->vc.rate = rate ;
+    fr->vc.pcmend = pcmend ;
+    fr->vc.mult = 2 ;
+    fr->vc.posts_len = posts_len ;
+
+    fr->vc.postlist = malloc (sizeof (int) * posts_len) ;
+    fr->vc.forward_index = malloc (sizeof (int) * posts_len) ;
+    fr->posts = malloc (sizeof (int) * posts_len) ;
+    fr->floor = malloc (sizeof (int) * len) ;
+    fr->residue = malloc (sizeof (float) * len) ;
+    if (!fr->vc.postlist || !fr->vc.forward_index || !fr->posts ||
+            !fr->floor || !fr->residue)
+        return -1 ;
+
+    fr->vc.postlist [0] = 0 ;
+    fr->vc.postlist [1] = len ;
+    for (i = 2 ; i < posts_len ; i++) {
+        do {
+            t = 1 + lcg (&seed) % (len - 1) ;
+            for (j = 1 ; j < i && fr->vc.postlist [j] != t ; j++) ;
+        } while (j < i) ;
+        fr->vc.postlist [i] = t ;
+    }
+
+    /* forward_index sorts the posts by position */
+    for (i = 0 ; i < posts_len ; i++)
+        fr->vc.forward_index [i] = i ;
+    for (i = 1 ; i < posts_len ; i++)
+        for (j = i ; j > 0 && fr->vc.postlist [fr->vc.forward_index [j - 1]]
+                > fr->vc.postlist [fr->vc.forward_index [j]] ; j--) {
+            t = fr->vc.forward_index [j] ;
+            fr->vc.forward_index [j] = fr->vc.forward_index [j - 1] ;
+            fr->vc.forward_index [j - 1] = t ;
+        }
+
+    y = 60 ;
+    for (i = 0 ; i < posts_len ; i++) {
+        y += (int) (lcg (&seed) % 21) - 10 ;
+        if (y < 10) y = 10 ;
+        if (y > 110) y = 110 ;
+        fr->posts [fr->vc.forward_index [i]] = y ;
+    }
+
+    if (ref_iss_simulate_floor (&fr->vc, fr->posts, fr->floor) != I_STEGANOS_OK)
+        return -1 ;
+
+    for (i = 0 ; i < len ; i++) {
+        /* Magnitudes fall with frequency, like the real residues */
+        t = (int) (-logf ((lcg (&seed) + 1) / 32769.f) * (24.f * (len - i) / len)) ;
+        fr->residue [i] = (float) ((lcg (&seed) & 1) ? t : -t) ;
+    }
+
+    return 0 ;
+}
+
+static int
+kern_state (steganos_state_t *ss)
+{    memset (ss, 0, sizeof (*ss)) ;
+    return steganos_state_init (ss, 3, PARITY_BITS, ISS, KERN_KEY,
+                strlen (KERN_KEY) * BITS_PER_BYTE) ;
+}
+
+static int
+run_frame (steganos_frame_t *fr, long frame, steganos_state_t *sl,
+                steganos_state_t *sr)
+{    static float work_l [VORBIS_MAX_BLOCK], work_r [VORBIS_MAX_BLOCK] ;
+    static int floor_l [VORBIS_MAX_BLOCK], floor_r [VORBIS_MAX_BLOCK] ;
+    static int rnd_l [VORBIS_MAX_BLOCK], rnd_r [VORBIS_MAX_BLOCK] ;
+    static byte data [VORBIS_MAX_BLOCK * 4], sub_l [VORBIS_MAX_BLOCK * 4],
+                sub_r [VORBIS_MAX_BLOCK * 4] ;
+    int *posts_l, *posts_r ;
+    byte rd_l [sizeof (float)], rd_r [sizeof (float)] ;
+    uint64_t bl, br ;
+    iss_cfg_t cfg ;
+    unsigned int seed ;
+    int len, i, r, rc_l, rc_r, d_len, w_l, w_r, rd_bits, n_l, n_r, bit_l,
+                bit_r, s_l, s_r, floor_bits ;
+
+    len = fr->vc.pcmend / 2 ;
+    if (len > VORBIS_MAX_BLOCK) return -1 ;
+
+    steganos_free_packet_keys (sl) ;
+    steganos_free_packet_keys (sr) ;
+    if (steganos_prepare_packet_keys (&fr->vc, sl) != I_STEGANOS_OK ||
+            steganos_prepare_packet_keys (&fr->vc, sr) != I_STEGANOS_OK)
+        return -1 ;
+
+    /* Capacity */
+    bl = br = UINT64_MAX ;
+    rc_l = rc_r = I_STEGANOS_OK ;
+    for (r = 0 ; r < reps ; r++) {
+        memset (sl->res_max_capacity, 0, sizeof (int) * len) ;
+        memset (sl->res_min_capacity, 0, sizeof (int) * len) ;
+        TIMED (bl, rc_l = set_subliminal_capacity_limit (sl, fr->residue,
+                fr->vc.rate, len)) ;
+        memset (sr->res_max_capacity, 0, sizeof (int) * len) ;
+        memset (sr->res_min_capacity, 0, sizeof (int) * len) ;
+        TIMED (br, rc_r = ref_set_subliminal_capacity_limit (sr, fr->residue,
+                fr->vc.rate, len)) ;
+    }
+    if (rc_l != rc_r)
+        mismatch (K_CAPACITY, frame, "return code") ;
+    if (memcmp (sl->variation_limit, sr->variation_limit,
+                sizeof (float) * 2 * len))
+        mismatch (K_CAPACITY, frame, "variation_limit") ;
+    if (memcmp (sl->res_max_capacity, sr->res_max_capacity, sizeof (int) * len) ||
+            memcmp (sl->res_min_capacity, sr->res_min_capacity,
+                sizeof (int) * len))
+        mismatch (K_CAPACITY, frame, "res_{max,min}_capacity") ;
+    if (sl->max_fc_capacity != sr->max_fc_capacity ||
+            sl->min_fc_capacity != sr->min_fc_capacity)
+        mismatch (K_CAPACITY, frame, "{max,min}_fc_capacity") ;
+    account (K_CAPACITY, bl, br, len, (long) sl->max_fc_capacity) ;
+
+    /* Residue lineup */
+    bl = br = UINT64_MAX ;
+    for (r = 0 ; r < reps ; r++) {
+        prng_set_seed_byte (sl->prng, sl->hiding_key->key,
+                sl->hiding_key->length) ;
+        TIMED (bl, rc_l = calculate_residue_lineup (sl, len)) ;
+        prng_set_seed_byte (sr->prng, sr->hiding_key->key,
+                sr->hiding_key->length) ;
+        TIMED (br, rc_r = ref_calculate_residue_lineup (sr, len)) ;
+    }
+    if (rc_l != rc_r)
+        mismatch (K_LINEUP, frame, "return code") ;
+    if (memcmp (sl->res_lineup, sr->res_lineup, sizeof (int) * len))
+        mismatch (K_LINEUP, frame, "res_lineup") ;
+    account (K_LINEUP, bl, br, len, 0) ;
+
+    /* Writing: as many payload bits as the estimated capacity */
+    seed = (unsigned int) frame ;
+    for (i = 0 ; i < (int) sizeof (data) ; i++)
+        data [i] = (byte) lcg (&seed) ;
+    d_len = (int) sl->max_fc_capacity ;
+    if (d_len > (int) sizeof (data) * BITS_PER_BYTE)
+        d_len = sizeof (data) * BITS_PER_BYTE ;
+
+    w_l = w_r = 0 ;
+    if (d_len > 0) {
+        bl = br = UINT64_MAX ;
+        for (r = 0 ; r < reps ; r++) {
+            memcpy (work_l, fr->residue, sizeof (float) * len) ;
+            TIMED (bl, rc_l = _write_subliminal_data (sl, data, d_len, work_l,
+                    len, &w_l)) ;
+            memcpy (work_r, fr->residue, sizeof (float) * len) ;
+            TIMED (br, rc_r = ref_write_subliminal_data (sr, data, d_len,
+                    work_r, len, &w_r)) ;
+        }
+        if (rc_l != rc_r || w_l != w_r)
+            mismatch (K_WRITE, frame, "written bits") ;
+        if (memcmp (work_l, work_r, sizeof (float) * len))
+            mismatch (K_WRITE, frame, "residue") ;
+        account (K_WRITE, bl, br, len, w_l) ;
+    } else {
+        memcpy (work_l, fr->residue, sizeof (float) * len) ;
+    }
+
+    /* Reading, in the lineup order, from the stego residue */
+    bl = br = UINT64_MAX ;
+    rd_bits = 0 ;
+    for (r = 0 ; r < reps ; r++) {
+        uint64_t t0 ;
+
+        t0 = kern_clock () ;
+        for (i = 0, rd_bits = 0 ; i < len ; i++) {
+            _read_subliminal_residue (work_l [sl->res_lineup [i]], rd_l, &n_l) ;
+            rd_bits += n_l ;
+        }
+        t0 = kern_clock () - t0 ;
+        if (t0 < bl) bl = t0 ;
+
+        t0 = kern_clock () ;
+        for (i = 0 ; i < len ; i++)
+            ref_read_subliminal_residue (work_l [sr->res_lineup [i]], rd_r, &n_r) ;
+        t0 = kern_clock () - t0 ;
+        if (t0 < br) br = t0 ;
+    }
+    for (i = 0 ; i < len ; i++) {
+        memset (rd_l, 0, sizeof (rd_l)) ;
+        memset (rd_r, 0, sizeof (rd_r)) ;
+        rc_l = _read_subliminal_residue (work_l [sl->res_lineup [i]], rd_l, &n_l) ;
+        rc_r = ref_read_subliminal_residue (work_l [sr->res_lineup [i]], rd_r,
+                &n_r) ;
+        if (rc_l != rc_r || n_l != n_r || memcmp (rd_l, rd_r, sizeof (rd_l))) {
+            mismatch (K_READ, frame, "read bits") ;
+            break ;
+        }
+    }
+    account (K_READ, bl, br, len, rd_bits) ;
+
+    /* Parity bits over the written payload */
+    if (w_l > 0) {
+        bl = br = UINT64_MAX ;
+        for (r = 0 ; r < reps ; r++) {
+            s_l = s_r = sizeof (sub_l) * BITS_PER_BYTE ;
+            prng_set_seed_byte (sl->prng, sl->hiding_key->key,
+                    sl->hiding_key->length) ;
+            TIMED (bl, rc_l = parity_bits_method (data, w_l, fr->floor, work_l,
+                    len, sl->hiding_key, sub_l, &s_l, sl->prng)) ;
+            prng_set_seed_byte (sr->prng, sr->hiding_key->key,
+                    sr->hiding_key->length) ;
+            TIMED (br, rc_r = ref_parity_bits_method (data, w_l, fr->floor,
+                    work_l, len, sr->hiding_key, sub_r, &s_r, sr->prng)) ;
+        }
+        if (rc_l != rc_r || s_l != s_r ||
+                memcmp (sub_l, sub_r, (w_l + BITS_PER_BYTE - 1) / BITS_PER_BYTE))
+            mismatch (K_PARITY, frame, "subliminal message") ;
+        account (K_PARITY, bl, br, len, w_l) ;
+    }
+
+    /* The block draws of parity_bits_method against one reference draw
+     * at a time, over the floor bits of the frame */
+    floor_bits = len * BITS_PER_BYTE * sizeof (int) ;
+    bl = br = UINT64_MAX ;
+    for (r = 0 ; r < reps ; r++) {
+        prng_set_seed_byte (sl->prng, sl->hiding_key->key,
+                sl->hiding_key->length) ;
+        TIMED (bl, rc_l = prng_get_random_ints (sl->prng, floor_bits, rnd_l,
+                len)) ;
+        prng_set_seed_byte (sr->prng, sr->hiding_key->key,
+                sr->hiding_key->length) ;
+        rc_r = I_OK ;
+        TIMED (br, for (i = 0 ; i < len && rc_r == I_OK ; i++)
+                rc_r = ref_prng_get_random_int (sr->prng, floor_bits,
+                &rnd_r [i])) ;
+    }
+    if (rc_l != rc_r || sl->prng->iters != sr->prng->iters ||
+            memcmp (rnd_l, rnd_r, sizeof (int) * len))
+        mismatch (K_PRNG, frame, "draws") ;
+    account (K_PRNG, bl, br, len, len) ;
+
+    /* Floor rendering */
+    bl = br = UINT64_MAX ;
+    for (r = 0 ; r < reps ; r++) {
+        TIMED (bl, rc_l = iss_simulate_floor (&fr->vc, fr->posts, floor_l)) ;
+        TIMED (br, rc_r = ref_iss_simulate_floor (&fr->vc, fr->posts, floor_r)) ;
+    }
+    if (rc_l != rc_r || memcmp (floor_l, floor_r, sizeof (int) * len))
+        mismatch (K_FLOOR, frame, "floor") ;
+    account (K_FLOOR, bl, br, len, 0) ;
+
+    /* ISS marking ('1', as the encoder tries first) and detection */
+    memset (&cfg, 0, sizeof (cfg)) ;
+    posts_l = malloc (sizeof (int) * fr->vc.posts_len) ;
+    posts_r = malloc (sizeof (int) * fr->vc.posts_len) ;
+    if (!posts_l || !posts_r ||
+            iss_cfg_init (sl, fr->posts, fr->vc.posts_len, 1.f, &cfg)
+            != I_STEGANOS_OK) {
+        free (posts_l) ;
+        free (posts_r) ;
+        return -1 ;
+    }
+    bl = br = UINT64_MAX ;
+    bit_l = bit_r = 1 ;
+    for (r = 0 ; r < reps ; r++) {
+        memcpy (posts_l, fr->posts, sizeof (int) * fr->vc.posts_len) ;
+        bit_l = 1 ;
+        TIMED (bl, rc_l = synchro_iss (&fr->vc, sl->synchro_key, posts_l,
+                fr->residue, &cfg, 0, &bit_l, sl->prng)) ;
+        memcpy (posts_r, fr->posts, sizeof (int) * fr->vc.posts_len) ;
+        bit_r = 1 ;
+        TIMED (br, rc_r = ref_synchro_iss (&fr->vc, sr->synchro_key, posts_r,
+                fr->residue, &cfg, 0, &bit_r, sr->prng)) ;
+    }
+    if (rc_l != rc_r || bit_l != bit_r ||
+            memcmp (posts_l, posts_r, sizeof (int) * fr->vc.posts_len))
+        mismatch (K_SYNCHRO, frame, "marked posts") ;
+    rc_l = synchro_iss (&fr->vc, sl->synchro_key, posts_l, fr->residue, &cfg,
+                1, &bit_l, sl->prng) ;
+    rc_r = ref_synchro_iss (&fr->vc, sr->synchro_key, posts_l, fr->residue,
+                &cfg, 1, &bit_r, sr->prng) ;
+    if (rc_l != rc_r || bit_l != bit_r)
+        mismatch (K_SYNCHRO, frame, "detected bit") ;
+    account (K_SYNCHRO, bl, br, len, 1) ;
+
+    free (cfg.u) ;
+    free (posts_l) ;
+    free (posts_r) ;
+
+    return 0 ;
+}
+
+/* Produces KERN_PACKETS crypto-packets of every format with a fixed
+ * configuration, checks them against the golden CRCs and parses them
+ * back. The cryptographic layer has no reference copy: the CRCs freeze
+ * its output instead. */
+static int
+packets_check (void)
+{    static const unsigned long golden [2] = { KERN_CRC_V1, KERN_CRC_V2 } ;
+    cryptos_config_t tx, rx ;
+    byte data [1024], back [1024], packet [2048] ;
+    uint64_t w, p_len, d_len, r_data, bl, br ;
+    unsigned long crc ;
+    unsigned int seed ;
+    int format, n, i, len, ca, md ;
+
+    if (cryptos_cipher_algo_code (NULL, &ca) != I_CRYPTOS_OK ||
+            cryptos_md_algo_code (NULL, &md) != I_CRYPTOS_OK)
+        return -1 ;
+
+    for (format = CRYPTOS_FORMAT_V1 ; format <= CRYPTOS_FORMAT_V2 ; format++) {
+
+        if (cryptos_config_init (&tx, ca, (byte *) KERN_PKT_KEY,
+                strlen (KERN_PKT_KEY), md, 0, (byte *) KERN_IV,
+                strlen (KERN_IV), 5, 1, 256) != I_CRYPTOS_OK ||
+                cryptos_config_set_format (&tx, format, 0) != I_CRYPTOS_OK ||
+                cryptos_config_init (&rx, ca, (byte *) KERN_PKT_KEY,
+                strlen (KERN_PKT_KEY), md, 0, (byte *) KERN_IV,
+                strlen (KERN_IV), 5, 1, 256) != I_CRYPTOS_OK ||
+                cryptos_config_set_format (&rx, format, 0) != I_CRYPTOS_OK)
+            return -1 ;
+
+        crc = crc32 (0, Z_NULL, 0) ;
+        seed = 7 ;
+        for (n = 0 ; n < KERN_PACKETS ; n++) {
+            len = 1 + n * 29 % 1000 ;
+            for (i = 0 ; i < len ; i++)
+                data [i] = (byte) (lcg (&seed) >> 4) ;
+            if (len > (int) tx.max_data)
+                len = tx.max_data ;
+
+            cryptos_packet_len (&tx, len, &p_len) ;
+            memset (packet, 0, sizeof (packet)) ;
+            bl = kern_clock () ;
+            if (produce_packet (&tx, data, len, packet, sizeof (packet), &w)
+                    != I_CRYPTOS_OK)
+                return -1 ;
+            bl = kern_clock () - bl ;
+            crc = crc32 (crc, packet, p_len) ;
+
+            /* The receiver expects the ID of the packet just produced */
+            rx.packet = tx.packet - 1 ;
+            d_len = sizeof (back) ;
+            br = kern_clock () ;
+            if (parse_packet (&rx, packet, p_len, back, &d_len, &r_data)
+                    != I_CRYPTOS_OK || r_data != p_len || d_len != w ||
+                    memcmp (back, data, w))
+                mismatch (K_PARSE, n, "recovered data") ;
+            br = kern_clock () - br ;
+
+            /* No reference copy: the ref time is left at 0 */
+            account (K_PRODUCE, bl, 0, 0, w * BITS_PER_BYTE) ;
+            account (K_PARSE, br, 0, 0, w * BITS_PER_BYTE) ;
+        }
+
+        if (crc != golden [format - CRYPTOS_FORMAT_V1]) {
+            fprintf (stderr, "stegokern: format %d packets CRC %08lx, "
+                    "expected %08lx\n", format, crc,
+                    golden [format - CRYPTOS_FORMAT_V1]) ;
+            mismatch (K_PRODUCE, -1, "packets") ;
+        }
+
+        cryptos_config_free (&tx) ;
+        cryptos_config_free (&rx) ;
+    }
+
+    return 0 ;
+}
+
+static void
+print_stats (const char *source)
+{    kern_stat *k ;
+    int i ;
+
+    for (i = 0 ; i < K_COUNT ; i++) {
+        k = &stats [i] ;
+        if (!k->frames) continue ;
+        printf ("{\"kernel\":\"%s\",\"source\":\"%s\",\"unit\":\"%s\","
+                "\"frames\":%ld,\"bins\":%lu,\"bits\":%lu,"
+                "\"per_bin\":%.2f,\"per_bit\":%.2f,"
+                "\"ref_per_bin\":%.2f,\"ref_per_bit\":%.2f,"
+                "\"mismatches\":%ld}\n",
+                kernel_names [i], source, CLOCK_UNIT, k->frames, k->bins,
+                k->bits,
+                k->bins ? (double) k->live / k->bins : 0.,
+                k->bits ? (double) k->live / k->bits : 0.,
+                k->bins ? (double) k->ref / k->bins : 0.,
+                k->bits ? (double) k->ref / k->bits : 0.,
+                k->mismatches) ;
+    }
+}
+
+static void
+usage (void)
+{    puts ("\nUsage: stegokern [options]\n\n"
+        "    -f <file>   Frames recorded with --srecord (default: synthetic)\n"
+        "    -n <num>    Number of synthetic frames (default 64)\n"
+        "    -r <num>    Repetitions per kernel and frame, best kept "
+        "(default 16)\n") ;
+}
+
+int
+main (int argc, char **argv)
+{    steganos_state_t sl, sr ;
+    steganos_frame_t fr ;
+    FILE *file = NULL ;
+    char *record = NULL ;
+    long frame, nframes = 64, errors = 0 ;
+    int opt, i, rc ;
+
+    while ((opt = getopt (argc, argv, "f:n:r:h")) != -1) {
+        switch (opt) {
+        case 'f': record = optarg ; break ;
+        case 'n': nframes = atol (optarg) ; break ;
+        case 'r': reps = atoi (optarg) ; break ;
+        default: usage () ; return opt == 'h' ? 0 : 1 ;
+        }
+    }
+    if (reps < 1 || nframes < 1) {
+        usage () ;
+        return 1 ;
+    }
+
+    if (record && steganos_load_open (record, &file) != I_STEGANOS_OK) {
+        fprintf (stderr, "stegokern: %s: %s\n", record, strerror (errno)) ;
+        return 1 ;
+    }
+
+    if (kern_state (&sl) != I_STEGANOS_OK || kern_state (&sr) != I_STEGANOS_OK) {
+        fprintf (stderr, "stegokern: unable to initialize the states\n") ;
+        return 1 ;
+    }
+
+    for (frame = 0 ; ; frame++) {
+        if (file) {
+            if (steganos_load_frame (file, &fr) != I_STEGANOS_OK) {
+                if (errno != ENODATA) errors++ ;
+                break ;
+            }
+        } else {
+            if (frame == nframes) break ;
+            /* Long and short blocks, 44.1 kHz */
+            rc = synth_frame (&fr, 44100, frame % 4 ? 2048 : 256,
+                    frame % 4 ? 33 : 9, (unsigned int) frame + 1) ;
+            if (rc) {
+                steganos_free_frame (&fr) ;
+                errors++ ;
+                break ;
+            }
+        }
+
+        if (run_frame (&fr, frame, &sl, &sr)) {
+            fprintf (stderr, "stegokern: frame %ld could not be run\n", frame) ;
+            errors++ ;
+        }
+        steganos_free_frame (&fr) ;
+    }
+
+    if (file) fclose (file) ;
+
+    if (packets_check ()) {
+        fprintf (stderr, "stegokern: crypto-packets could not be run\n") ;
+        errors++ ;
+    }
+
+    print_stats (record ? record : "synthetic") ;
+
+    steganos_state_free (&sl) ;
+    steganos_state_free (&sr) ;
+
+    for (i = 0 ; i < K_COUNT ; i++)
+        errors += stats [i].mismatches ;
+
+    return errors ? 1 : 0 ;
+}
+
+#else
+
+#include <stdio.h>
+
+int
+main (void)
+{    fprintf (stderr, "stegokern: built without STEGO, nothing to check\n") ;
+    return 0 ;
+}
+
+#endif
@@ -0,0 +1,987 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: frozen reference copies of the steganos kernels
+
+ Verbatim copies of the kernels in steganos/lib/steganos_channel.c,
+ as of the stegokern harness introduction, renamed with a ref_
+ prefix. stegokern checks the live kernels against them bit by bit:
+ the output of these functions defines the format of the streams
+ already produced, so they must never be modified, only the live
+ ones. ref_parity_bits_method is the original version, one draw per
+ floor bit. The draw of steganos/lib/numbers.c is copied as well
+ (ref_prng_get_random_int), so changes to the live PRNG helpers are
+ checked too.
+
+ ********************************************************************/
+
+#ifdef STEGO
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <fenv.h>
+
+#include "steganos_channel.h"
+#include "numbers.h"
+#include "miscellaneous.h"
+#include "stegoref.h"
+
+int ref_prng_get_random_int(prng_t *prng, const int modulo, int *r) {
+
+  int rnd;
+  long int lrnd;
+
+  /* Input parameters control */
+  if(!prng || modulo <= 0 || !r) {
+    errno = EINVAL;
+    message_log("ref_prng_get_random_int", strerror(errno));
+    return I_ERR;
+  }
+
+  lrnd = random();
+  if(lrnd > INT_MAX) rnd = INT_MAX;
+  else rnd = lrnd;
+
+  *r = (int) (((float)modulo*rnd)/(RAND_MAX+1.0));
+  prng->iters++;
+  return I_OK;
+}
+
+static int ref_itu468_var_tol(const float frequency, const float base, float *tolerance) {
+
+  float multiplier, x1, y1, x2, y2;
+  int i;
+
+  /* Input parameters control */
+  if(frequency < 0 || !tolerance) {
+    errno = EINVAL;
+    message_log("_itu468_var_tolerance", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  /** The allowed multiplier is obtained by lineal interpolation, using the
+     greatest point lesser than 'frequency' as left extreme and the least point 
+     greater than 'frequency' as right extreme of the line. These points are
+     obtained from the ITU-R BS. 468-4 document, stored in the global variable
+     ITU_R_BS_468. */
+
+  multiplier = -1.f;
+  x1 = x2 = y1 = y2 = 0;
+
+  /* Special cases: frequency < ITU_R_BS_468[0][0] and 
+     frequency > ITU_R_BS_468[ITU_R_BS_468_SIZE-1][0] */
+  if(frequency < ITU_R_BS_468[0][0]) {
+    multiplier = ITU_R_BS_468[0][1];
+  } else if (frequency > ITU_R_BS_468[ITU_R_BS_468_SIZE-1][0]) {
+    multiplier = ITU_R_BS_468[ITU_R_BS_468_SIZE-1][1];
+  } else {
+
+    /* Locating left and right extremes */
+    for(i=0; i<ITU_R_BS_468_SIZE; i++) {
+      if(ITU_R_BS_468[i][0] > frequency) {
+	x1 = ITU_R_BS_468[i-1][0];
+	y1 = ITU_R_BS_468[i-1][1];
+	x2 = ITU_R_BS_468[i][0];
+	y2 = ITU_R_BS_468[i][1];
+	break;
+      } else if(ITU_R_BS_468[i][0] == frequency) {
+	multiplier = ITU_R_BS_468[i][1];
+	break;
+      }
+    }
+    
+    if(multiplier < 0) {
+      if(linear_interpolation_y(x1, y1, x2, y2, frequency, &multiplier) == I_STEGANOS_ERR) {
+	return I_STEGANOS_ERR;
+      }
+    }
+   
+  }
+
+  /* Shouldn't happen TODO! check */
+  if(multiplier < 0) {
+    message_log("_itu468_var_tolerance", "Wrong tolerance calculation");
+    return I_STEGANOS_ERR;
+  }
+
+  /* Now use the obtained multiplier to calculate the maximum negative and
+     positive variations. See the project documentation for a complete 
+     demonstration of the formulae used here. */
+  /* TODO! referencia a la documentación? */
+  if(base > 0) {
+    /* Maximum negative variation */
+    tolerance[0] = base*(-multiplier);
+    /* Maximum positive variation */
+    tolerance[1] = base*multiplier;
+  } else {
+    /* Maximum negative variation */
+    tolerance[0] = base*multiplier;
+    /* Maximum positive variation */
+    tolerance[1] = base*(-multiplier);
+  }
+
+  return I_STEGANOS_OK;
+
+}
+
+static int ref_residue_variation(const float residue, const float frequency, 
+				  float *variation_limit) {
+
+
+  /* Input parameters control */
+  if(frequency < 0 || !variation_limit) {
+    errno = EINVAL;
+    message_log("ref_residue_variation", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  /** The model used for obtaining the maximum tolerances is ITU-R BS. 468-4 */
+  if(ref_itu468_var_tol(frequency, residue, variation_limit) == I_STEGANOS_ERR) {
+    return I_STEGANOS_ERR;
+  }
+
+  return I_STEGANOS_OK;
+}
+
+int ref_set_subliminal_capacity_limit(steganos_state_t *ss, float *residue, 
+				      const long rate, const int res_len) {
+
+  float max_fc_capacity, min_fc_capacity, esrv, osrv, nbits;
+  int i, aux;
+
+
+  /* Input parameters control */
+  if(!ss || !residue || res_len <= 0) {
+    errno = EINVAL;
+    message_log("ref_set_subliminal_capacity_limit", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  max_fc_capacity = 0.f;
+  min_fc_capacity = 0.f;
+
+  /* Reset the limits */
+  for(i=0; i<res_len; i++) {
+    if(ref_residue_variation(residue[i], i*((float)rate/(2.f*res_len)),
+			  ss->variation_limit[i]) == I_STEGANOS_ERR) {
+      return I_STEGANOS_ERR;
+    }
+    
+    /* Update maximum capacity */
+    if((residue[i] < 0 && ss->variation_limit[i][0] < 0) ||
+       (residue[i] > 0 && ss->variation_limit[i][0] > 0)) {
+      esrv = ss->variation_limit[i][0];
+      osrv = ss->variation_limit[i][1];
+    } else {
+      osrv = ss->variation_limit[i][0];
+      esrv = ss->variation_limit[i][1];
+    }
+
+    /** <i> ss->res_max_capacity (MCRVC) </i> and <i>ss->res_min_capacity</i>
+	(mCRVC) calculation example:
+	<ul>
+	<li>Current Residual Value (CRV) = 17</li>
+	<li>Residue Limit Variations (RLV) = [-7.6, 15.89]</li>
+	<li>Equally Signed Residue Variation (ESRV) = 15.89</li>
+	<li>Opposite Signed Residue Variation (OSRV) = -7.6</li>
+    	<li>Maximum Current Residual Value Capacity (MCRVC) = 
+	ceil(log2(fabs(CRV+ESRV)))-1 = ceil(log2(32.89)) - 1 = 5 bits</li>
+    	<li>minimum Current Residual Value Capacity (mCRVC) = 
+	ceil(log2(CRV+OSRV))-1 = ceil(log2(9.4)) - 1 = 3 bits</li>
+	</ul>
+	<i>Note: if CRV+ESRV is an integer number, the results in MCRVC and
+	mCRVC are the obtained previously + 1.</i><br>
+
+	Taking the ESRV and OSRV to obtain the MCRVC and mCRVC, respectively, 
+	is due to the fact that when the variation made to the original residue
+	is made in the same sense (positive or negative) than the residue, we 
+	will have at least the same quantity of bits to modify (and probably 
+	more), while having less bits to modify if we were to modify the original
+	value in the opposite sense.
+
+     */   
+
+    /* Obtain maximum subliminal capacity for the current residue:
+       Alternative binary logarithm implementation (more efficient than logf) */
+    aux = (int) rintf(fabs(residue[i]+esrv));
+    nbits = 0;
+    while(aux > 1) {
+      nbits++;
+      aux >>= 1;
+    }
+
+    /* Range control, shouldn't happen */
+    if(nbits > BITS_PER_BYTE*sizeof(int)) {
+      nbits = BITS_PER_BYTE*sizeof(int);
+    }
+
+    /* If the previous gives a positive (and >= 1) number of bits to modify 
+       means we can hide info in the current residual value */
+    if(nbits >= 1) {
+      
+      /* Update current residual capacity and maximum frame and channel capacity */
+      ss->res_max_capacity[i] = nbits; /* This means the nbits least significant bits
+					  of the residual value i are prone to shelter
+					  subliminal bits*/
+      max_fc_capacity += nbits;
+
+    }
+
+    /* Obtain minimum subliminal capacity for the current residue
+       Alternative binary logarithm implementation (more efficient than logf) */
+    aux = (int) rintf(fabs(residue[i]+osrv));
+    nbits = 0;
+    while(aux > 1) {
+      nbits++;
+      aux >>= 1;
+    }
+
+    /* Range control, shouldn't happen */
+    if(nbits > BITS_PER_BYTE*sizeof(int)) {
+      nbits = BITS_PER_BYTE*sizeof(int);
+    }
+
+    /* If the previous gives a positive (and >= 1) number of bits to modify 
+       means we can hide info in the current residual value */
+    if(nbits >= 1) {
+
+      /* Update current residual capacity and maximum frame and channel capacity */
+      ss->res_min_capacity[i] = nbits; /* This means the nbits least significant bits
+					  of the residual value i are prone to shelter
+					  subliminal bits*/
+      min_fc_capacity += nbits;
+
+    }
+
+/*     if(!i) */
+/*       fprintf(stderr, "%d: res: %.3f, max_c: %.3f, min_c: %.3f; max_var: %.3f, min_var : %.3f\n", */
+/* 	      ss->iters, residue[i], ss->res_max_capacity[i], ss->res_min_capacity[i], esrv, osrv); */
+    
+    if(ss->res_min_capacity[i] > ss->res_max_capacity[i]) {
+      nbits = ss->res_min_capacity[i];
+      ss->res_min_capacity[i] = ss->res_max_capacity[i];
+      ss->res_max_capacity[i] = nbits;
+    }
+
+
+  }
+
+  /* Update the remaining internal state structure variables */
+  ss->max_fc_capacity = max_fc_capacity;
+  ss->min_fc_capacity = min_fc_capacity;
+
+  return I_STEGANOS_OK;
+}
+
+int ref_write_subliminal_data(steganos_state_t *ss, byte *data, const int d_len,
+			      float *residue, const int res_len, int *written) {
+  
+  int i, j, pos, max_bits, min_bits, curr_value, sub_value, tmp_written;
+  int upper, lower, nearest, diff, bit, neg, rd_byte, rd_bit;
+
+ 
+  /* Input parameters control */ // TODO!! todo controlado?
+  if(!ss || !data || d_len < 0 || 
+     !residue || res_len <= 0 || !written) {
+    errno = EINVAL;
+    message_log("ref_write_subliminal_data", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  tmp_written = 0;
+  for(i=0; i<res_len; i++) {
+    
+    pos = ss->res_lineup[i];
+    if(residue[pos] < 0) {
+      neg = 1;
+    } else {
+      neg = 0;
+    }
+
+    /* Gets the maximum and minimum bit capacity "estimations" */
+    max_bits = ss->res_max_capacity[pos];
+    min_bits = ss->res_min_capacity[pos];
+    
+    /* Gets the "estimated" and recommended range, as we will have to manage
+       integers, we take the ceil and floor for the upper and lower limits */
+    if((residue[pos] < 0 && ss->variation_limit[pos][0] < 0) ||
+       (residue[pos] > 0 && ss->variation_limit[pos][0] > 0)) {
+/*     if(signbit(residue[pos]) == signbit(ss->variation_limit[pos][0])) { */
+      upper = ceil(residue[pos]+ss->variation_limit[pos][0]);
+      lower = floor(residue[pos]+ss->variation_limit[pos][1]);
+    } else {
+      lower = ceil(residue[pos]+ss->variation_limit[pos][0]); 
+      upper = floor(residue[pos]+ss->variation_limit[pos][1]);
+    }
+
+    /* The more number of bits we can hide, the better */
+    sub_value = 0;
+
+    /* Get the next 'max_bits' subliminal bits... but if there isn't room enough
+       for max_bits, we reduce it. */
+    if((max_bits + tmp_written) > d_len) {
+      max_bits = d_len - tmp_written;
+      if(max_bits < min_bits) {
+	min_bits = max_bits;
+      }
+    }
+
+    for(j=0; j<max_bits; j++) {
+      rd_byte = (tmp_written+j)/BITS_PER_BYTE;
+      rd_bit = (BITS_PER_BYTE-1) - ((tmp_written+j) % BITS_PER_BYTE);
+      bit = (data[rd_byte] >> rd_bit) % 2;
+      sub_value |= (bit << (max_bits - j - 1));
+    }
+
+    /* This inner loop will get the greatest number of subliminal bits that fit
+       in the current residue, so it'll start with max_bits and will try every
+       option until min_bits. The first of the values that fits in the range, 
+       will be hided. If no value fits, the value which minimizes the differnece
+       with the range (using the lower and upper limits as references) will be 
+       stored, to be used in the case a "relaxation protocol" is desired to be 
+       used. */
+    diff = INT_MAX; nearest = INT_MAX;
+    for(j=max_bits; j>=min_bits && j>0; j--) {        
+      curr_value = sub_value + (1 << j);
+
+      if(curr_value >= abs(lower) && curr_value <= abs(upper)) { /* Fits!! */
+	residue[pos] = curr_value;
+	tmp_written += j;
+	break;
+      } else {
+	
+	if(diff > abs(curr_value-lower) || diff > abs(curr_value-upper)) {
+	  nearest = curr_value;
+	  if(abs(curr_value-lower) < abs(curr_value-upper)) {
+	    diff = abs(curr_value-lower);
+	  } else {
+	    diff = abs(curr_value-upper);
+	  }
+	}
+
+      }
+      
+      /* Discard the least significant subliminal bit */
+      sub_value >>= 1;
+      
+    }
+
+    /* If none of the possible values fit the recommended range, we choose the
+       option that minimizes the commited error, which will be stored in the 
+       'nearest' variable. */
+    if(j < min_bits || (j == 0 && diff != INT_MAX )) {
+      if(nearest == INT_MAX) {
+	message_log("ref_write_subliminal_data", "Unknown error");
+	return I_STEGANOS_ERR;
+      }
+      residue[pos] = nearest;
+      while(abs(nearest) > 1) { /* Efficient integer binary logarithm */
+	tmp_written++;
+	nearest = (nearest >> 1);
+      }
+    }
+
+    if(neg) {
+      residue[pos] *= -1;
+    }
+
+    /* @todo Adjust the last residue if it's not completely filled! */
+    if(tmp_written >= d_len) {
+      break;
+    }
+   
+  }
+
+  *written = tmp_written;
+
+  return I_STEGANOS_OK;
+}
+
+int ref_read_subliminal_residue(const float residue, byte *data, int *read) {
+
+  float fvalue;
+  int i, ivalue, msab, tmp_read, bit;
+  byte *tmp;
+
+
+  /* Input parameters control */
+  if(!data || !read) {
+    errno = EINVAL;
+    message_log("ref_read_subliminal_residue", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  /* If the received abs(residue) is 0 or 1, there is nothing to read */
+  if(residue >= -1 && residue <= 1) {
+    *read = 0;
+    return I_STEGANOS_OK;
+  }
+  
+  fvalue = fabs(residue);
+
+  /* We don't want to fill data with crap until we know everything has gone OK */
+  if(!(tmp = (byte *) malloc(sizeof(byte)*sizeof(float)))) {
+    message_log("ref_read_subliminal_residue", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(tmp, 0, sizeof(float));
+
+  /* Get the bits at the left of the Most Significant Active bit */
+  msab = (int) floor(logf(fvalue)/logf(2.f));
+  fvalue -= (1 << msab); /* Discard the MSbit */
+
+  /* Range check */
+  if(fvalue < INT_MIN || fvalue > INT_MAX) {
+    errno = ERANGE;
+    message_log("ref_read_subliminal_residue", strerror(errno));
+    return I_STEGANOS_ERR;
+  } else {
+    ivalue = (int) fvalue;
+  }
+
+  /* The remaining bits (of the integer representation) are all subliminal and we
+     must read them from the most to the least significant bit */
+  tmp_read = 0;
+  for(i=msab-1; i>=0; i--) {
+    /* Gets the subliminal bit */
+    bit = ((1 << i) & ivalue) >> i;
+    /* Writes it in it's corresponding location of tmp */
+    tmp[i/BITS_PER_BYTE] |= (bit << (i % BITS_PER_BYTE));
+    tmp_read++;
+  }
+
+  *read = tmp_read;
+  memcpy(data, tmp, ceil((float) tmp_read / (float) BITS_PER_BYTE));
+  free(tmp);
+
+  return I_STEGANOS_OK;
+}
+
+int ref_parity_bits_method(byte *plain_mess, int p_m_len,
+			   int *floor, float *res, int res_len, 
+			   steganos_key_t *key, byte *sub_mess, 
+			   int *s_m_len, prng_t *prng) {
+
+  int p_m_r, s_m_wr, s_m_bytes, parity, run_length;
+  int readbit, readbyte, readelem, floor_bits, rnd, i;
+  byte *tmp;
+
+
+  /* Input parameters control */ // TODO!! todo controlado?
+  if(!plain_mess || p_m_len <= 0 || !floor || res_len <= 0 || 
+     !sub_mess || !key || !s_m_len || *s_m_len <= 0 ||
+     !prng) {
+    errno = EINVAL;
+    message_log("ref_parity_bits_method", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  s_m_bytes = ceilf((float)(*s_m_len)/(float)BITS_PER_BYTE);
+  if(!(tmp = (byte *) malloc(sizeof(byte)*s_m_bytes))) {
+    message_log("ref_parity_bits_method", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+  memset(tmp, 0, s_m_bytes);
+
+  p_m_r = 0;
+  s_m_wr = 0;
+  run_length = 0;
+  floor_bits = res_len*BITS_PER_BYTE*sizeof(*floor);
+
+  while(p_m_r < p_m_len) {
+    
+    /* Get the next plain_mess bit */
+    readbyte = p_m_r / BITS_PER_BYTE;
+    readbit = p_m_r % BITS_PER_BYTE;
+    parity = (plain_mess[readbyte] >> readbit) % 2;
+
+    /* The next sub_mess bit will be the result of XORing the next
+       PARITY_BITS random bits with the current plain_mess bit */
+    for(i=0; i<BITS_PARITY; i++) {
+
+      /* Get a new pseudo random number */
+      if(ref_prng_get_random_int(prng, floor_bits, &rnd) == I_STEGANOS_ERR) {
+	free(tmp);
+	return I_STEGANOS_ERR;
+      }
+
+      readbyte = rnd / BITS_PER_BYTE;
+      readelem = readbyte / sizeof(*floor);
+      readbit = (rnd % BITS_PER_BYTE)+((readbyte % sizeof(*floor))*BITS_PER_BYTE);      
+      parity ^= ((floor[readelem] >> readbit) % 2);
+
+    }
+
+    /* Write the obtained parity in the corresponding sub_mess bit */
+    readbyte = s_m_wr / BITS_PER_BYTE;
+    readbit = s_m_wr % BITS_PER_BYTE;
+    
+    /* Memory overflow control */
+    if(readbyte >= s_m_bytes) {
+      if(!(tmp = (byte *) realloc((byte *) tmp, sizeof(byte)*(s_m_bytes+1)))) {
+	free(tmp);
+	return I_STEGANOS_ERR;
+      }
+      s_m_bytes++;
+    }
+
+    tmp[readbyte] |= (parity << readbit);
+    p_m_r++;
+    s_m_wr++;
+
+  }
+
+  /* Prepare the return */
+  if((int) ceilf((float)(*s_m_len)/(float)BITS_PER_BYTE) < s_m_bytes) {
+    if(!(sub_mess = (byte *) realloc((byte *) sub_mess, sizeof(byte)*s_m_bytes))) {
+      free(tmp);
+      return I_STEGANOS_ERR;
+    }
+  }
+
+  memcpy(sub_mess, tmp, s_m_bytes);
+  *s_m_len = s_m_wr;  
+  free(tmp);
+
+  return I_STEGANOS_OK;
+}
+
+static void ref_render_line0(int x0,int x1,int y0,int y1,int *d){
+  int dy=y1-y0;
+  int adx=x1-x0;
+  int ady=abs(dy);
+  int base=dy/adx;
+  int sy=(dy<0?base-1:base+1);
+  int x=x0;
+  int y=y0;
+  int err=0;
+
+  ady-=abs(base*adx);
+
+  d[x]=y;
+  while(++x<x1){
+    err=err+ady;
+    if(err>=adx){
+      err-=adx;
+      y+=sy;
+    }else{
+      y+=base;
+    }
+    d[x]=y;
+  }
+}
+
+int ref_iss_simulate_floor(vorbis_config_t *vc, int *posts, int *floor) {
+
+  int hx, lx, ly, hy, current, j, pcmend, posts_len, *forward_index;
+  int *postlist, mult;
+
+
+  /* Input parameters control */
+  if(!posts || !floor) {
+    errno = EINVAL;
+    message_log("ref_iss_simulate_floor", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  pcmend = vc->pcmend;
+  mult = vc->mult;
+  postlist = vc->postlist;
+  posts_len = vc->posts_len;
+  forward_index = vc->forward_index;
+
+  /* NOTE!! This code is the same (just some variable renaming) that the one
+     at the end of 'floor1_encode' function in lib/floor1.c libvorbis file */
+
+  /* generate quantized floor equivalent to what we'd unpack in decode */
+  /* render the lines */
+  hx=0;
+  lx=0;
+  ly=posts[0]*mult;
+  for(j=1;j<posts_len;j++){
+    current=forward_index[j];
+    hy=posts[current]&0x7fff;
+    if(hy==posts[current]){
+	  
+      hy*=mult;
+      hx=postlist[current];
+
+      ref_render_line0(lx,hx,ly,hy,floor);
+      lx=hx;
+      ly=hy;
+    }
+  }
+
+  for(j=hx;j<pcmend/2;j++) floor[j]=ly; /* be certain */
+  return I_STEGANOS_OK;
+
+}
+
+int ref_synchro_iss(vorbis_config_t *vc, steganos_key_t *key, int *posts, 
+		    float *residue, void *cfg, int decoding, int *bit, prng_t *prng) {
+
+  iss_cfg_t *icfg;
+  float r, var[2], posts_mean;
+  int *work, i, j, b, *floor_ref, *floor_new, rc, rate, pcmend, mult;
+  int lx, hx, ly, hy, current, previous, remake, old, variation;
+  int *forward_index, *postlist, posts_len;
+
+
+  /* Input parameters control */
+  if(!vc || !posts || !cfg || !bit ||
+     (!decoding && *bit != 0 && *bit != 1)) { // TODO!! todo controlado?
+    errno = EINVAL;
+    message_log("ref_synchro_iss", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  rate = vc->rate;
+  pcmend = vc->pcmend;
+  mult = vc->mult;
+  postlist = vc->postlist;
+  forward_index = vc->forward_index;
+  posts_len = vc->posts_len;
+  icfg = (iss_cfg_t *) cfg;
+
+  /* First of all, we have to calculate the original floor as would be calculated
+     by the receiver may no subliminal data be hidden. This floor will be used as
+     reference when estimating the dB variations introduced by the watermark. */
+  if(!(floor_ref = (int *) malloc(sizeof(int)*pcmend/2))) {
+    message_log("ref_synchro_iss", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+  
+  if(ref_iss_simulate_floor(vc, posts, floor_ref) == I_STEGANOS_ERR) {
+    return I_STEGANOS_ERR;
+  }
+
+  /* Copy the posts to the working vector, to prevent modifying the original
+     when encoding in case an error occurs. */
+  if(!(work = (int *) malloc(sizeof(int)*posts_len))) {
+    message_log("ref_synchro_iss", strerror(errno));
+    free(floor_ref);
+    return I_STEGANOS_ERR;
+  }
+
+  /* Copy the posts vector to work, unsetting the "floor1_step2_flags", 
+     calculate the projection of the floor over the watermark */
+  posts_mean = 0.f;
+  for(i=0; i<posts_len;i++) {
+    work[i] = posts[i]&0x7fff;
+    posts_mean += work[i];
+  }
+  posts_mean /= (float) posts_len;
+
+  r = 0.f;
+  for(i=0; i<posts_len;i++) {
+    r += (work[i]-posts_mean)*icfg->u[i]; /* We want the statistic to be
+					     centered in 0. */
+  }
+
+  /* Actually, here u_norm is the norm*N (N here is floor_len) as we use it to
+     get the statistic r, which contains 1/N both in the numerator and
+     denominator in it's formula and is therefore cancelled out in the result */
+  r /= icfg->u_norm;
+
+  /* Here, if we are decoding, we just return the sign of r as the received bit,
+     being 0 if r < 0 and 1 if r > 0. But the posts vector, although follows a 
+     Gausssian probability distribution (see Vorbis floor1 comments), does not
+     have a mean centered in 0, so we have to shift it. */
+  if(decoding) {
+    free(floor_ref);
+    free(work);
+    if(r < 0) {
+      *bit = 0;
+      return I_STEGANOS_OK;
+    } else if(r > 0 ) {
+      *bit = 1;
+      return I_STEGANOS_OK;
+    } else if(r == 0) {
+      message_log("ref_synchro_iss",
+		  "Not enough evidence to determine the presence of a watermark");
+      *bit = INDETERMINATE_MARK;
+#ifdef STEGANOS_DEBUG 
+      message_log("ref_synchro_iss", 
+		  "Not enough statistical evidence to determine watermark presence");
+#endif
+      return I_STEGANOS_SYNC_FAIL;
+    }
+  }
+
+  /* If we are here, it's because we are encoding, r stores the projection of
+     the floor over the watermark (the inner product) and *bit the bit we want
+     to hide. */
+  if(*bit) {
+    b = 1;
+  } else {
+    b = -1;
+  }
+ 
+  /* Floor synchronized "as it comes" */
+  if(b*r > icfg->alpha/icfg->lambda) { /* See formula (31) from
+					  Malvar's and Florencio's */
+    for(i=0; i<posts_len; i++) {
+      posts[i] = work[i];
+    }
+    free(floor_ref);
+    free(work);
+    return I_STEGANOS_OK;
+  }
+
+  /* Otherwise, we have to mark it */
+  /**
+     The Give Up concept explained in section V.B in Malvar's and Florencio's
+     is simulated here in the following way:
+	
+     1) For each element in the posts vector, we get the variation to
+     introduce if we were using a simple linear ISS.
+     2) We calculate the floor that will be obtained by the decoder.
+     3) We calculate the dB variance induced this way, taking as reference the
+     the floor_ref vector.
+     4) If it is acceptable given the ITU-R BS. 468-4 tolerances, we give it
+     as valid. If not, we reduce the modifications until it an acceptable
+     point.
+     5) Once Obtained the final posts vector, we calculate again the floor as
+     will be obtained by the decoder, and if we get the hided bit, means
+     we have succeed in hiding it with an allowable distortion (Note that
+     this approach assumes no noise will be introduced during 
+     transmission).
+  */
+
+  if(!(floor_new = (int *) malloc(sizeof(int)*pcmend/2))) {
+    message_log("ref_synchro_iss", strerror(errno));
+    free(floor_ref);
+    free(work);
+    return I_STEGANOS_ERR;
+  }
+
+  /* Introduce the watermark using linear ISS (formula 13 in Malvar's
+     and Flornecio's) */
+  for(i=0; i<posts_len; i++) {
+    variation = (int) rint((icfg->alpha*b - icfg->lambda*r)*icfg->u[i]);
+    if((work[i] + variation >= 0) && (work[i] + variation <= 255)) {
+      work[i] += variation;
+    }
+  }
+
+  /* generate quantized floor equivalent to what we'd unpack in decode */
+  /* render the lines */
+  hx=0;
+  lx=0;
+  ly=(work[0])*mult;
+ 
+  for(i=1;i<posts_len;i++){
+
+    /* Reset the "working" floor vector */
+    memset(floor_new, 0, sizeof(int)*pcmend/2);
+
+    previous=forward_index[i-1];
+    current=forward_index[i];
+    hy=work[current];
+    if(hy==work[current]){
+      hy*=mult;
+      hx=postlist[current];
+  
+      ref_render_line0(lx,hx,ly,hy,floor_new);
+
+      /* Check if the variations introduced are allowable according to the ITU-R
+         BS. 468-4 document specifications. */
+      remake = 0;
+
+      /* lx and hx are the lower and higher ends of the current interpolated
+	 floor segment */
+      for(j=lx; j<hx; j++) {
+
+	/* var will store the maximum negative and positive variations the j-th
+	   element in the floor could withstand accordingly to ITU-R BS. 468-4.
+	   Note that despite most of the floor values aren't being actually
+	   sent, we still have to control the distortion introduced in them. */
+	var[0] = var[1] = 0.f;
+	if(ref_itu468_var_tol(j*((float)rate/((float)pcmend)),
+			   FLOOR1[floor_ref[j]],
+			   var) == I_STEGANOS_ERR) {
+	  free(work);
+	  free(floor_ref);
+	  free(floor_new);
+	  return I_STEGANOS_ERR;
+	}
+	
+	if((FLOOR1[floor_new[j]] < (FLOOR1[floor_ref[j]] + var[0])) ||
+	   (FLOOR1[floor_new[j]] > (FLOOR1[floor_ref[j]] + var[1]))) {
+	  
+	  /* We reduce the variations to the maximum allowed */
+	  /* Lower end */
+	  rc = ref_itu468_var_tol(lx*((float)rate/((float)pcmend)),
+			       FLOOR1[floor_ref[lx]],
+			       var);
+	  
+	  /* We reduce the watermark, but it have to preserve the direction */
+	  old = work[previous];
+	  if(work[previous] > (posts[previous]&0x7fff)) {
+	    while(FLOOR1[work[previous]] > (FLOOR1[(posts[previous]&0x7fff)]+var[1]) &&
+		  work[previous] > (posts[previous]&0x7fff)) {
+	      work[previous]--;
+	    }
+	  } else {
+	    while(FLOOR1[work[previous]] < (FLOOR1[(posts[previous]&0x7fff)]+var[0]) &&
+		  work[previous] < (posts[previous]&0x7fff)) {
+	      work[previous]++;
+	    }
+	  }
+	  
+	  if(old != work[previous]) remake++;
+	  
+	  /* Higher end */
+	  if(i==posts_len-1) {
+	    rc += ref_itu468_var_tol(hx*((float)rate/((float)pcmend)),
+				  FLOOR1[posts[1]&0x7fff],
+				  var);
+	  } else {
+	    rc += ref_itu468_var_tol(hx*((float)rate/((float)pcmend)),
+				  FLOOR1[floor_ref[hx]],
+				  var);
+	  }
+	  
+	  /* We reduce the watermark, but it have to preserve the direction */
+	  old = work[current];
+	  if(work[current] > (posts[current]&0x7fff)) {
+	    while(FLOOR1[work[current]] > (FLOOR1[(posts[current]&0x7fff)]+var[1]) &&
+		  work[current] > (posts[current]&0x7fff)) {
+	      work[current]--;
+	    }
+	  } else {
+	    while(FLOOR1[work[current]] < (FLOOR1[(posts[current]&0x7fff)]+var[0]) &&
+		  work[current] < (posts[current]&0x7fff)) {
+	      work[current]++;
+	    }
+	  }
+
+	  if(old != work[current]) remake++;
+
+	  if(rc) {
+	    free(work);
+	    free(floor_ref);
+	    free(floor_new);
+	    return I_STEGANOS_ERR;
+	  }
+
+	  /* Since we have modified the working "posts" vector, we have to repeat
+	     the distortion control, to see if it is allowable with the reduction
+	     made. */
+	  if(remake) {
+	    break;
+	  }
+	}
+	
+      }
+
+      /* If there has been changes, we repeat the last iteration with the new
+	 posts */
+      if(remake) {
+	remake = 0;
+	i--; /* This will neutralize the "continue" */
+	continue;
+      }
+
+      lx=hx;
+      ly=hy;
+      
+    }
+
+  }
+  
+  /* At this point either we have failed synchronizing, or we have a candidate,
+     but we still have to see if it is "strong" enough. */
+  free(floor_ref);
+  
+  /* Simulate the receiver's side */
+  posts_mean = 0.f;
+  for(i=0; i<posts_len;i++) {
+    posts_mean += work[i];
+  }
+  posts_mean /= (float) posts_len;
+
+  r = 0.f;
+  for(i=0; i<posts_len; i++) {
+    r += (work[i]-posts_mean)*icfg->u[i];
+  }
+  r /= icfg->u_norm; /* This is the statistic obtained by the receiver */
+
+  /* If the decoder will correctly interpret the watermark, we've succeed */
+  if((r<0 && b == -1) || (r>0 && b == 1)) {
+
+    /* The working vector will be the new (watermarked) floor */
+    memcpy(posts, work, posts_len*sizeof(*posts));
+    free(work);
+    free(floor_new);
+    return I_STEGANOS_OK;
+    
+  }
+
+  free(work);
+  free(floor_new);
+
+  /* The posts vector is not prone to be watermarked, i.e., its too strong in the
+     opposite direction. */
+#ifdef STEGANOS_DEBUG
+  {
+    char message[200];
+    memset(message, 0, 200*sizeof(char));
+    sprintf(message, "Unable to %d mark", *bit);
+    message_log("ref_synchro_iss", message);
+  }
+#endif
+  *bit = !(*bit);
+  return I_STEGANOS_SYNC_FAIL;
+
+}
+
+int ref_calculate_residue_lineup(steganos_state_t *ss, const int res_len) {
+
+  int aux, i;
+
+  if(!ss || !ss->prng || res_len <= 0) {
+    errno = EINVAL;
+    message_log("align_residue", strerror(errno));
+    return I_STEGANOS_ERR;
+  }
+
+  memset(ss->res_lineup, 0, VORBIS_MAX_BLOCK*sizeof(int));
+  memset(ss->res_occupied, 0, VORBIS_MAX_BLOCK*sizeof(int));
+
+  /* Calculate residue lineup */
+  i=0;    
+  while(i<res_len) {
+      
+    if(ref_prng_get_random_int(ss->prng, res_len, &aux) == I_STEGANOS_ERR){
+      return I_STEGANOS_ERR;
+    }
+      
+    /* Check if this residual value has been already chosen */
+    if(!ss->res_occupied[aux]) {
+      ss->res_lineup[i] = aux;
+      ss->res_occupied[aux] = 1;
+      i++;
+    }
+    
+  }
+  ss->aligned = 1;
+
+  return I_STEGANOS_OK;
+  
+}
+
+#endif
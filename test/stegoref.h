@@ -0,0 +1,42 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: frozen reference copies of the steganos kernels
+
+ ********************************************************************/
+
+/* Same contracts as the kernels of the same name, without the ref_
+ * prefix, in steganos/lib/steganos_channel.c (steganos/lib/numbers.c
+ * for ref_prng_get_random_int). */
+
+int ref_set_subliminal_capacity_limit (steganos_state_t *ss, float *residue,
+                        const long rate, const int res_len) ;
+
+int ref_write_subliminal_data (steganos_state_t *ss, byte *data,
+                        const int d_len, float *residue, const int res_len,
+                        int *written) ;
+
+int ref_read_subliminal_residue (const float residue, byte *data, int *read) ;
+
+int ref_prng_get_random_int (prng_t *prng, const int modulo, int *r) ;
+
+int ref_parity_bits_method (byte *plain_mess, int p_m_len, int *floor,
+                        float *res, int res_len, steganos_key_t *key,
+                        byte *sub_mess, int *s_m_len, prng_t *prng) ;
+
+int ref_iss_simulate_floor (vorbis_config_t *vc, int *posts, int *floor) ;
+
+int ref_synchro_iss (vorbis_config_t *vc, steganos_key_t *key, int *posts,
+                        float *residue, void *cfg, int decoding, int *bit,
+                        prng_t *prng) ;
+
+int ref_calculate_residue_lineup (steganos_state_t *ss, const int res_len) ;
@@ -0,0 +1,335 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: replays the extraction from a decoded frames sidecar
+
+ The decoder writes the posts, floor and residue it hands to the
+ steganographic layer to a sidecar with --srecord (stegobench -D).
+ This program maps the sidecar and runs the receiver on it, as
+ floor1_inverse2 does, with the settings given in the command line:
+ no Ogg parsing, no codebook decode, no inverse MDCT. Repeated
+ extraction attempts with different settings then cost a pass over
+ the mapped vectors each.
+
+ Prints one JSON object with the frames replayed, the payload bits
+ recovered and the time spent. The exit status is 0 only if the end
+ of the transmission was reached.
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef STEGO
+#include <zlib.h>
+
+#include "global_types.h"
+#include "steganos_types.h"
+#include "cryptos_types.h"
+#include "fec_types.h"
+#include "protocols.h"
+#include "steganos_channel.h"
+#include "cryptos_channel.h"
+#include "fec_channel.h"
+#include "steganos_stats.h"
+#include "steganos_record.h"
+#include "miscellaneous.h"
+
+#define RECOVERED_FILE  "stegoreplay_recovered.bin"
+
+typedef struct {
+  char *frames ;            /* Sidecar written with --srecord */
+  char *output ;            /* Recovered payload */
+  char *key ;
+  char *cipher ;
+  char *digest ;
+  int hmac ;
+  uint64_t emission ;
+  uint64_t packet ;
+  int format ;
+  int fec_k ;
+  int fec_m ;
+  int hide_method ;
+  int sync_method ;
+  float sigma ;
+} replay_cfg ;
+
+typedef struct {
+  steganos_state_t ss ;
+  cryptos_config_t cc ;
+  cryptos_protocol_buffer_t cb ;
+  fec_state_t fs ;
+  int fec ;
+  char tmp_name [1024] ;
+} receiver ;
+
+static double
+now (void)
+{
+  struct timeval tv ;
+
+  gettimeofday (&tv, NULL) ;
+  return tv.tv_sec + tv.tv_usec / 1e6 ;
+}
+
+/* Same set up as floor1_inverse2 on its first frame */
+static int
+receiver_init (receiver *rx, const replay_cfg *cfg)
+{
+  uint64_t max_packet ;
+  int sca, scmda, fd ;
+
+  memset (rx, 0, sizeof (*rx)) ;
+
+  if (steganos_state_init (&rx->ss, 4, cfg->hide_method, cfg->sync_method,
+                           cfg->key, strlen (cfg->key) * BITS_PER_BYTE)
+      == I_STEGANOS_ERR)
+    return 1 ;
+
+  sca = 0 ;
+  scmda = 0 ;
+  cryptos_cipher_algo_code (cfg->cipher, &sca) ;
+  cryptos_md_algo_code (cfg->digest, &scmda) ;
+
+  if (cryptos_config_init (&rx->cc, sca, (byte *) cfg->key, strlen (cfg->key),
+                           scmda, cfg->hmac, NULL, 0, cfg->emission,
+                           cfg->packet, 0) == I_CRYPTOS_ERR ||
+      cryptos_config_set_format (&rx->cc, cfg->format, 0) == I_CRYPTOS_ERR)
+    return 1 ;
+
+  if (cfg->fec_k) {
+    cryptos_packet_len (&rx->cc, rx->cc.max_data, &max_packet) ;
+    max_packet += CRYPTOS_VARINT_MAX_LEN ;
+    if (fec_state_init (&rx->fs, cfg->fec_k, cfg->fec_m, max_packet,
+                        2 * FEC_FRAME_LEN (max_packet + 2) + MAX_SUBLIMINAL_BYTES)
+        == I_FEC_ERR)
+      return 1 ;
+    rx->fec = 1 ;
+  }
+
+  snprintf (rx->tmp_name, sizeof (rx->tmp_name), "%s.z", cfg->output) ;
+  if ((fd = open (rx->tmp_name, O_WRONLY | O_CREAT | O_TRUNC,
+                  S_IRWXU | S_IRGRP | S_IROTH)) < 0) {
+    printf ("Error : open failed : %s\n", strerror (errno)) ;
+    return 1 ;
+  }
+
+  if (cryptos_buffer_init (&rx->cb, fd, rx->cc.default_data_size * 2 +
+                           MAX_SUBLIMINAL_BYTES) == I_CRYPTOS_ERR) {
+    close (fd) ;
+    return 1 ;
+  }
+
+  return 0 ;
+}
+
+/* One frame and channel, as in floor1_inverse2. Returns 1 at the end of the
+ * transmission, -1 on error. */
+static int
+receiver_frame (receiver *rx, const replay_cfg *cfg, steganos_frame_t *f)
+{
+  byte *sbuffer ;
+  size_t sbuffer_size, *sbuffer_used ;
+  int read, rc ;
+
+  if (steganos_prepare_packet_keys (&f->vc, &rx->ss) == I_STEGANOS_ERR)
+    return -1 ;
+
+  rx->ss.iters++ ;
+
+  if (rx->fec) {
+    sbuffer = rx->fs.buffer ;
+    sbuffer_size = rx->fs.buffer_size ;
+    sbuffer_used = &rx->fs.buffer_used ;
+  } else {
+    sbuffer = rx->cb.buffer ;
+    sbuffer_size = rx->cb.buffer_size ;
+    sbuffer_used = &rx->cb.buffer_used ;
+  }
+
+  if (sbuffer_size - *sbuffer_used < MAX_SUBLIMINAL_BYTES) {
+    memset (sbuffer, 0, sbuffer_size) ;
+    *sbuffer_used = 0 ;
+  }
+
+  read = 0 ;
+  if (steganos_inverse (&rx->ss, &f->vc, f->posts, f->floor, f->residue,
+                        cfg->sigma, &sbuffer [*sbuffer_used],
+                        sbuffer_size - *sbuffer_used, &read) == I_STEGANOS_ERR)
+    return -1 ;
+
+  rc = I_CRYPTOS_OK ;
+  if (read) {
+    *sbuffer_used += read ;
+    if (rx->fec)
+      rc = fec_inverse (&rx->fs, &rx->cc, &rx->cb) ;
+    else
+      rc = cryptos_inverse (&rx->cc, &rx->cb) ;
+  }
+
+  steganos_state_reset_iter (&rx->ss) ;
+
+  if (rc == I_CRYPTOS_ERR)
+    return -1 ;
+
+  return rx->cc.packet ? 0 : 1 ;
+}
+
+/* Inflates the received stream into the output file */
+static int
+receiver_finish (receiver *rx, const replay_cfg *cfg)
+{
+  FILE *fz, *fnz ;
+  int rc = 1 ;
+
+  close (rx->cb.fd) ;
+  if ((fz = fopen (rx->tmp_name, "rb")) == NULL)
+    return 1 ;
+  if ((fnz = fopen (cfg->output, "wb")) != NULL) {
+    rc = zlib_inf (fz, fnz) != Z_OK ;
+    fclose (fnz) ;
+  }
+  fclose (fz) ;
+  unlink (rx->tmp_name) ;
+
+  return rc ;
+}
+
+static void
+receiver_free (receiver *rx)
+{
+  if (rx->fec)
+    fec_state_free (&rx->fs) ;
+  cryptos_buffer_free (&rx->cb) ;
+  cryptos_config_free (&rx->cc) ;
+  steganos_state_free (&rx->ss) ;
+}
+
+static void
+usage (void)
+{
+  printf ("Usage: stegoreplay -f frames -k key [options]\n"
+          "  -f file       Decoded frames sidecar (--srecord, stegobench -D)\n"
+          "  -k key        Key\n"
+          "  -o file       Recovered payload [" RECOVERED_FILE "]\n"
+          "  -m method     Hiding method (0-2) [1]\n"
+          "  -y method     Synchronization method (0-1) [1]\n"
+          "  -g sigma      ISS sigma [1]\n"
+          "  -c cipher     Cipher algorithm [default]\n"
+          "  -d digest     Digest algorithm [default]\n"
+          "  -H            Use HMAC\n"
+          "  -e id         Emission ID [0]\n"
+          "  -p id         First packet ID [1]\n"
+          "  -F format     Crypto-packets format (1-2) [1]\n"
+          "  -x k,m        FEC group size and parity packets [none]\n") ;
+}
+
+int
+main (int argc, char **argv)
+{
+  static receiver rx ;     /* The steganographic state is large */
+  steganos_frames_t frames ;
+  replay_cfg cfg ;
+  double start, mapped, done ;
+  int i, rc, opt, used ;
+
+  memset (&cfg, 0, sizeof (cfg)) ;
+  cfg.output = RECOVERED_FILE ;
+  cfg.hide_method = PARITY_BITS ;
+  cfg.sync_method = ISS ;
+  cfg.sigma = 1.f ;
+  cfg.packet = 1 ;
+  cfg.format = CRYPTOS_FORMAT_V1 ;
+
+  while ((opt = getopt (argc, argv, "f:k:o:m:y:g:c:d:He:p:F:x:h")) != -1) {
+    switch (opt) {
+    case 'f': cfg.frames = optarg ; break ;
+    case 'k': cfg.key = optarg ; break ;
+    case 'o': cfg.output = optarg ; break ;
+    case 'm': cfg.hide_method = atoi (optarg) ; break ;
+    case 'y': cfg.sync_method = atoi (optarg) ; break ;
+    case 'g': cfg.sigma = atof (optarg) ; break ;
+    case 'c': cfg.cipher = optarg ; break ;
+    case 'd': cfg.digest = optarg ; break ;
+    case 'H': cfg.hmac = 1 ; break ;
+    case 'e': cfg.emission = strtoull (optarg, NULL, 10) ; break ;
+    case 'p': cfg.packet = strtoull (optarg, NULL, 10) ; break ;
+    case 'F': cfg.format = atoi (optarg) ; break ;
+    case 'x':
+      if (sscanf (optarg, "%d,%d", &cfg.fec_k, &cfg.fec_m) != 2 ||
+          cfg.fec_k < 1 || cfg.fec_m < 1) {
+        usage () ;
+        return 1 ;
+      }
+      break ;
+    default: usage () ; return opt == 'h' ? 0 : 1 ;
+    }
+  }
+
+  if (!cfg.frames || !cfg.key || cfg.hide_method < 0 || cfg.hide_method > 2 ||
+      cfg.sync_method < 0 || cfg.sync_method > 1 || cfg.sigma <= 0 ||
+      (cfg.format != CRYPTOS_FORMAT_V1 && cfg.format != CRYPTOS_FORMAT_V2)) {
+    usage () ;
+    return 1 ;
+  }
+
+  start = now () ;
+  if (steganos_map_frames (cfg.frames, &frames) == I_STEGANOS_ERR) {
+    printf ("Error : cannot map \"%s\" : %s\n", cfg.frames, strerror (errno)) ;
+    return 1 ;
+  }
+  mapped = now () ;
+
+  if (receiver_init (&rx, &cfg)) {
+    printf ("Error : cannot set the receiver up\n") ;
+    steganos_unmap_frames (&frames) ;
+    return 1 ;
+  }
+
+  rc = 0 ;
+  for (i = 0, used = 0 ; i < frames.n_frames && !rc ; i++, used++)
+    rc = receiver_frame (&rx, &cfg, &frames.frames [i]) ;
+  done = now () ;
+
+  printf ("{\"frames\":%d,\"replayed\":%d,\"bits\":%ld,\"eot\":%d,"
+          "\"map_seconds\":%.4f,\"seconds\":%.4f,\"fps\":%.1f}\n",
+          frames.n_frames, used, rx.ss.read, rc == 1, mapped - start,
+          done - mapped, done > mapped ? used / (done - mapped) : 0.) ;
+
+  if (rc == 1 && receiver_finish (&rx, &cfg)) {
+    printf ("Error : cannot write \"%s\"\n", cfg.output) ;
+    rc = -1 ;
+  }
+
+  receiver_free (&rx) ;
+  steganos_unmap_frames (&frames) ;
+
+  return rc == 1 ? 0 : 1 ;
+}
+
+#else /* #ifndef STEGO */
+
+int
+main (void)
+{
+  printf ("stegoreplay: the library was built without STEGO\n") ;
+  return 1 ;
+}
+
+#endif /* #ifdef STEGO */
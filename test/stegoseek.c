@@ -0,0 +1,289 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: seekable extraction test
+
+ Produces an emission of crypto-packets, and hands the receiver the
+ bits from the middle of a packet on, not byte aligned, the way the
+ steganographic layer does after a seek. The receiver must find the
+ next packet and write the data of every packet from there at its
+ payload offset. Runs for each packet format, with and without HMAC;
+ CRYPTOS_FORMAT_V1 without HMAC can't be checked mid-stream and must
+ be refused.
+
+ ov_stego_extract_range must refuse the same settings, the defaults,
+ before it decodes anything.
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef STEGO
+#include "global_types.h"
+#include "steganos_types.h"
+#include "cryptos_types.h"
+#include "protocols.h"
+#include "cryptos_channel.h"
+
+#include "vorbis/codec.h"
+#include "vorbis/vorbisfile.h"
+
+#include "util.h"
+#include "write_read.h"
+
+#define SEEK_KEY        "stegoseek reproducible key"
+#define SEEK_DATA_SIZE  48
+#define SEEK_PACKETS    8
+#define SEEK_CHUNK      13      /* bits handed per call, as a frame would */
+#define SEEK_BUFFER     4096
+#define RANGE_FILE      "stegoseek_range.ogg"
+#define RANGE_LEN       2048
+
+static int
+config_init (cryptos_config_t *cc, int format, int hmac)
+{
+  int sca, scmda ;
+
+  cryptos_cipher_algo_code (NULL, &sca) ;
+  cryptos_md_algo_code (NULL, &scmda) ;
+
+  if (cryptos_config_init (cc, sca, (byte *) SEEK_KEY, strlen (SEEK_KEY),
+                           scmda, hmac, NULL, 0, 0, 1, SEEK_DATA_SIZE)
+      == I_CRYPTOS_ERR)
+    return 1 ;
+
+  return cryptos_config_set_format (cc, format, 0) == I_CRYPTOS_ERR ;
+}
+
+/* Appends a received bit, as steganos_inverse does */
+static void
+receive_bit (steganos_state_t *ss, cryptos_protocol_buffer_t *cb, int bit)
+{
+  ss->carry |= (byte) (bit << (BITS_PER_BYTE - 1 - ss->carry_len)) ;
+  if (++ss->carry_len == BITS_PER_BYTE) {
+    cb->buffer [cb->buffer_used++] = ss->carry ;
+    ss->carry = 0 ;
+    ss->carry_len = 0 ;
+  }
+}
+
+static int
+seek_test (int format, int hmac)
+{
+  static steganos_state_t ss ;
+  cryptos_config_t tx, rx ;
+  cryptos_protocol_buffer_t cb ;
+  byte data [SEEK_PACKETS * SEEK_DATA_SIZE], out [SEEK_DATA_SIZE] ;
+  byte *stream = NULL ;
+  uint64_t start [SEEK_PACKETS + 1], p_len, written, bit, skip ;
+  size_t used ;
+  char tmp_name [] = "stegoseek_XXXXXX" ;
+  int i, k, first, fd, rc = 1 ;
+
+  printf ("    format %d, %-7s : ", format, hmac ? "HMAC" : "no HMAC") ;
+  fflush (stdout) ;
+  memset (&cb, 0, sizeof (cb)) ;
+
+  if (config_init (&tx, format, hmac) || config_init (&rx, format, hmac)) {
+    printf ("cannot set the crypto config up\n") ;
+    return 1 ;
+  }
+
+  if (cryptos_config_set_seekable (&rx, SEEK_DATA_SIZE) == I_CRYPTOS_ERR) {
+    if (format == CRYPTOS_FORMAT_V1 && !hmac && errno == ENOTSUP) {
+      puts ("refused, ok") ;
+      rc = 0 ;
+    } else
+      printf ("seekable extraction refused : %s\n", strerror (errno)) ;
+    cryptos_config_free (&tx) ;
+    cryptos_config_free (&rx) ;
+    return rc ;
+  }
+  if (format == CRYPTOS_FORMAT_V1 && !hmac) {
+    puts ("seekable extraction accepted, but can't work") ;
+    goto out ;
+  }
+
+  for (i = 0 ; i < (int) sizeof (data) ; i++)
+    data [i] = (byte) (i * 7 + 3) ;
+
+  /* The emission */
+  stream = calloc (SEEK_BUFFER, 1) ;
+  cb.buffer = calloc (SEEK_BUFFER, 1) ;
+  cb.buffer_size = SEEK_BUFFER ;
+  if (!stream || !cb.buffer)
+    goto out ;
+
+  start [0] = 0 ;
+  for (i = 0 ; i < SEEK_PACKETS ; i++) {
+    if (cryptos_packet_len (&tx, SEEK_DATA_SIZE, &p_len) == I_CRYPTOS_ERR ||
+        start [i] + p_len > SEEK_BUFFER ||
+        produce_packet (&tx, &data [i * SEEK_DATA_SIZE], SEEK_DATA_SIZE,
+                        &stream [start [i]], p_len, &written) == I_CRYPTOS_ERR ||
+        written != SEEK_DATA_SIZE) {
+      printf ("cannot produce packet %d\n", i) ;
+      goto out ;
+    }
+    start [i + 1] = start [i] + p_len ;
+  }
+
+  if ((fd = mkstemp (tmp_name)) == -1) {
+    printf ("cannot create a temporary file : %s\n", strerror (errno)) ;
+    goto out ;
+  }
+  cb.fd = fd ;
+
+  /* The receiver starts 3 bits into the fifth byte of the second packet, so
+     the third one is the first it can read */
+  first = 2 ;
+  skip = (start [1] + 4) * BITS_PER_BYTE + 3 ;
+  memset (&ss, 0, sizeof (ss)) ;
+  for (bit = skip ; bit < start [SEEK_PACKETS] * BITS_PER_BYTE ; ) {
+    for (k = 0 ; k < SEEK_CHUNK && bit < start [SEEK_PACKETS] * BITS_PER_BYTE ;
+         k++, bit++)
+      receive_bit (&ss, &cb, (stream [bit / BITS_PER_BYTE]
+                              >> (BITS_PER_BYTE - 1 - bit % BITS_PER_BYTE)) & 1) ;
+
+    if (rx.resync) {
+      if (cryptos_inverse_resync (&ss, &rx, &cb) == I_CRYPTOS_ERR) {
+        printf ("resync failed : %s\n", strerror (errno)) ;
+        goto close ;
+      }
+      continue ;
+    }
+
+    /* In sync: every complete packet in the buffer */
+    do {
+      used = cb.buffer_used ;
+      if (cryptos_inverse (&rx, &cb) == I_CRYPTOS_ERR) {
+        printf ("extraction failed : %s\n", strerror (errno)) ;
+        goto close ;
+      }
+    } while (cb.buffer_used && cb.buffer_used < used) ;
+  }
+
+  if (rx.resync) {
+    puts ("never resynchronized") ;
+    goto close ;
+  }
+
+  /* Nothing before the first packet read, and the data of every packet from
+     there at (packet ID - first packet ID) * data size */
+  if (lseek (fd, 0, SEEK_END) != SEEK_PACKETS * SEEK_DATA_SIZE) {
+    puts ("wrong payload size") ;
+    goto close ;
+  }
+  for (i = 0 ; i < SEEK_PACKETS ; i++) {
+    if (pread (fd, out, SEEK_DATA_SIZE, i * SEEK_DATA_SIZE) != SEEK_DATA_SIZE) {
+      printf ("cannot read back packet %d\n", i) ;
+      goto close ;
+    }
+    if (i < first) {
+      for (k = 0 ; k < SEEK_DATA_SIZE ; k++)
+        if (out [k])
+          break ;
+      if (k < SEEK_DATA_SIZE) {
+        printf ("data written for packet %d, before the seek\n", i) ;
+        goto close ;
+      }
+    } else if (memcmp (out, &data [i * SEEK_DATA_SIZE], SEEK_DATA_SIZE)) {
+      printf ("packet %d data mismatch\n", i) ;
+      goto close ;
+    }
+  }
+
+  printf ("packets %d to %d, ok\n", first, SEEK_PACKETS - 1) ;
+  rc = 0 ;
+
+ close:
+  close (fd) ;
+  unlink (tmp_name) ;
+ out:
+  free (stream) ;
+  free (cb.buffer) ;
+  cryptos_config_free (&tx) ;
+  cryptos_config_free (&rx) ;
+  return rc ;
+}
+
+/* A range extraction on a stream with the default stego settings. The
+   index doesn't exist: with the settings accepted, the load must fail */
+static int
+range_test (const char *name, int format, int expected)
+{
+  OggVorbis_File vf ;
+  int ret, rc = 1 ;
+
+  printf ("    %-18s : ", name) ;
+  fflush (stdout) ;
+
+  if (ov_fopen (RANGE_FILE, &vf) < 0) {
+    printf ("cannot open %s\n", RANGE_FILE) ;
+    return 1 ;
+  }
+
+  vf.vb.sfile = "stegoseek_range.bin" ;
+  vf.vb.skey = SEEK_KEY ;
+  vf.vb.hide_method = PARITY_BITS ;
+  vf.vb.sync_method = ISS ;
+  vf.vb.sigma = 1.f ;
+  vf.vb.scfmt = format ;
+
+  ret = ov_stego_extract_range (&vf, "stegoseek_missing.idx", 0, 16) ;
+  if (ret != expected)
+    printf ("returned %d instead of %d\n", ret, expected) ;
+  else if (ov_pcm_tell (&vf) != 0)
+    puts ("decoded before refusing") ;
+  else {
+    puts ("ok") ;
+    rc = 0 ;
+  }
+
+  ov_clear (&vf) ;
+  return rc ;
+}
+
+int
+main (void)
+{
+  static float data [RANGE_LEN] ;
+  int format, hmac, rc = 0 ;
+
+  puts ("Seekable extraction :") ;
+  for (format = CRYPTOS_FORMAT_V1 ; format <= CRYPTOS_FORMAT_V2 ; format++)
+    for (hmac = 0 ; hmac <= 1 ; hmac++)
+      rc |= seek_test (format, hmac) ;
+
+  puts ("Range extraction :") ;
+  gen_windowed_sine (data, RANGE_LEN, 0.95) ;
+  write_vorbis_data_or_die (RANGE_FILE, 44100, data, RANGE_LEN) ;
+  rc |= range_test ("default settings", 0, OV_EIMPL) ;
+  rc |= range_test ("format 2", CRYPTOS_FORMAT_V2, OV_EREAD) ;
+  remove (RANGE_FILE) ;
+
+  return rc ;
+}
+
+#else
+
+int
+main (void)
+{
+  puts ("Seekable extraction : no steganographic layer") ;
+  return 0 ;
+}
+
+#endif
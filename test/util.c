@@ -51,3 +51,43 @@ set_data_in (float * data, unsigned len, float value)
         for (k = 0 ; k < len ; k++)
                 data [k] = value ;
 }
+
+/* Portable LCG, so that the test signals are the same everywhere. */
+static float
+lcg_uniform (unsigned int *seed)
+{       *seed = *seed * 1103515245u + 12345u ;
+        return ((*seed >> 8) & 0xFFFF) / 32768.0f - 1.0f ;
+}
+
+void
+gen_sine (float *data, int len, int srate, float freq, float maximum)
+{       int k ;
+
+        for (k = 0 ; k < len ; k++)
+                data [k] = maximum * sin (2.0 * M_PI * freq * k / srate) ;
+}
+
+void
+gen_noise (float *data, int len, float maximum, unsigned int *seed)
+{       int k ;
+
+        for (k = 0 ; k < len ; k++)
+                data [k] = maximum * lcg_uniform (seed) ;
+}
+
+void
+gen_transients (float *data, int len, int srate, float maximum,
+                        unsigned int *seed)
+{       int k, period ;
+        float env ;
+
+        period = srate / 4 ;
+        if (period < 1)
+                period = 1 ;
+
+        for (k = 0 ; k < len ; k++)
+        {       /* 5 ms exponential decay after each attack */
+                env = exp (-(float) (k % period) / (0.005f * srate)) ;
+                data [k] = (0.01f + 0.99f * env) * maximum * lcg_uniform (seed) ;
+                }
+}
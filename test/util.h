@@ -22,3 +22,15 @@ void gen_windowed_sine (float *data, int len, float maximum) ;
 
 /* Set len values of data array to given value. */
 void set_data_in (float * data, unsigned len, float value) ;
+
+/* Create a sine wave of the given frequency (Hz) at the given sample rate. */
+void gen_sine (float *data, int len, int srate, float freq, float maximum) ;
+
+/* Create uniform white noise. The generator is seeded with *seed and the
+ * state left there, so the output is reproducible across platforms. */
+void gen_noise (float *data, int len, float maximum, unsigned int *seed) ;
+
+/* Create a train of decaying noise bursts (attacks) every srate/4 samples
+ * on a low level noise floor. Stresses the short blocks. */
+void gen_transients (float *data, int len, int srate, float maximum,
+                        unsigned int *seed) ;